@@ -0,0 +1,658 @@
+/*
+ * apex_batch.c
+ * Contains the APEX batched functional engine
+ *
+ * The engine issues the instruction at the lowest PC any running lane is at
+ * to every lane at that PC. Lanes that branched ahead wait for the others,
+ * so lanes that diverged run together again where their paths join. On hosts
+ * with AVX2, arithmetic, logic, moves, compares and branches execute eight
+ * lanes per vector operation, as do loads and stores when the lanes use the
+ * same address, since their words are adjacent in a batch page. DIV and
+ * scattered accesses go lane by lane, as does everything on other hosts.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "apex_batch.h"
+#include "apex_macros.h"
+
+void
+APEX_batch_free(APEX_Batch *batch)
+{
+    if (!batch)
+    {
+        return;
+    }
+    for (int reg = 0; reg < REG_FILE_SIZE; reg++)
+    {
+        free(batch->regs[reg]);
+    }
+    free(batch->zero_flag);
+    free(batch->positive_flag);
+    free(batch->pc);
+    free(batch->stop_pc);
+    free(batch->status);
+    free(batch->executed);
+    for (unsigned int dir = 0; dir < BATCH_DIR_SIZE; dir++)
+    {
+        if (!batch->tables[dir])
+        {
+            continue;
+        }
+        for (unsigned int table = 0; table < BATCH_TABLE_SIZE; table++)
+        {
+            free(batch->tables[dir][table]);
+        }
+        free(batch->tables[dir]);
+    }
+    free(batch);
+}
+
+/*
+ * Creates a batch of instances of a CPU's program, all in the reset state
+ * with empty data memory. CID reads as the instance number. Returns NULL if
+ * out of host memory.
+ */
+APEX_Batch *
+APEX_batch_create(const APEX_CPU *cpu, int instances, unsigned long long limit)
+{
+    APEX_Batch *batch = calloc(1, sizeof(APEX_Batch));
+    int lanes = (instances + BATCH_WIDTH - 1) / BATCH_WIDTH * BATCH_WIDTH;
+    int allocated = TRUE;
+
+    if (!batch)
+    {
+        return NULL;
+    }
+    batch->instances = instances;
+    batch->lanes = lanes;
+    batch->code_memory = cpu->code_memory;
+    batch->code_memory_size = cpu->code_memory_size;
+    batch->memory_size = cpu->config.memory_size;
+    batch->limit = limit;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    batch->vector = __builtin_cpu_supports("avx2");
+#endif
+
+    for (int reg = 0; reg < REG_FILE_SIZE; reg++)
+    {
+        batch->regs[reg] = calloc(lanes, sizeof(int));
+        allocated = allocated && batch->regs[reg];
+    }
+    batch->zero_flag = calloc(lanes, sizeof(int));
+    batch->positive_flag = calloc(lanes, sizeof(int));
+    batch->pc = calloc(lanes, sizeof(int));
+    batch->stop_pc = calloc(lanes, sizeof(int));
+    batch->status = calloc(lanes, sizeof(int));
+    batch->executed = calloc(lanes, sizeof(unsigned long long));
+    if (!allocated || !batch->zero_flag || !batch->positive_flag || !batch->pc
+        || !batch->stop_pc || !batch->status || !batch->executed)
+    {
+        APEX_batch_free(batch);
+        return NULL;
+    }
+    for (int lane = 0; lane < lanes; lane++)
+    {
+        batch->pc[lane] = lane < instances ? 4000 : BATCH_STOPPED;
+        batch->stop_pc[lane] = 4000;
+        batch->status[lane] = FUNC_OK;
+    }
+    return batch;
+}
+
+/*
+ * Returns the batch page holding an address, NULL if it was never written
+ * unless allocate is set.
+ */
+static int *
+batch_page(APEX_Batch *batch, unsigned int address, int allocate)
+{
+    unsigned int page = address >> BATCH_PAGE_BITS;
+    int ***table = &batch->tables[page >> BATCH_TABLE_BITS];
+    int **slot;
+
+    if (!*table)
+    {
+        if (!allocate)
+        {
+            return NULL;
+        }
+        *table = calloc(BATCH_TABLE_SIZE, sizeof(int *));
+        if (!*table)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for batch page table\n");
+            exit(1);
+        }
+    }
+    slot = &(*table)[page & (BATCH_TABLE_SIZE - 1)];
+    if (!*slot && allocate)
+    {
+        *slot = calloc((size_t)BATCH_PAGE_WORDS * batch->lanes, sizeof(int));
+        if (!*slot)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for batch data page\n");
+            exit(1);
+        }
+    }
+    return *slot;
+}
+
+static size_t
+word_index(const APEX_Batch *batch, unsigned int address, int lane)
+{
+    return (size_t)(address & (BATCH_PAGE_WORDS - 1)) * batch->lanes + lane;
+}
+
+/*
+ * Reads a word of one instance's data memory.
+ */
+int
+APEX_batch_read(const APEX_Batch *batch, int lane, unsigned int address)
+{
+    const int *page = batch_page((APEX_Batch *)batch, address, FALSE);
+
+    return page ? page[word_index(batch, address, lane)] : 0;
+}
+
+static void
+batch_write(APEX_Batch *batch, int lane, unsigned int address, int value)
+{
+    int *page = batch_page(batch, address, value != 0);
+
+    if (page)
+    {
+        page[word_index(batch, address, lane)] = value;
+    }
+}
+
+/*
+ * Copies the words written in a memory, which must have no dense region,
+ * into one instance's data memory.
+ */
+void
+APEX_batch_load(APEX_Batch *batch, int lane, const APEX_Memory *mem)
+{
+    for (unsigned int dir = 0; dir < MEM_DIR_SIZE; dir++)
+    {
+        if (!mem->tables[dir])
+        {
+            continue;
+        }
+        for (unsigned int table = 0; table < MEM_TABLE_SIZE; table++)
+        {
+            const int *page = mem->tables[dir][table];
+            unsigned int address = (dir << (MEM_TABLE_BITS + MEM_PAGE_BITS))
+                                   | (table << MEM_PAGE_BITS);
+
+            for (unsigned int cnt = 0; page && cnt < MEM_PAGE_WORDS; cnt++)
+            {
+                if (page[cnt])
+                {
+                    batch_write(batch, lane, address + cnt, page[cnt]);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Returns a data memory holding a range of one instance's data memory, for
+ * the functions of the memory module. Returns NULL if out of host memory.
+ */
+APEX_Memory *
+APEX_batch_memory(const APEX_Batch *batch, int lane, unsigned int base,
+                  unsigned long long words)
+{
+    APEX_Memory *mem = APEX_memory_create(batch->memory_size);
+
+    for (unsigned long long cnt = 0; mem && cnt < words; cnt++)
+    {
+        int value = APEX_batch_read(batch, lane, (unsigned int)(base + cnt));
+
+        if (value)
+        {
+            APEX_memory_write(mem, (unsigned int)(base + cnt), value);
+        }
+    }
+    return mem;
+}
+
+static void
+stop_lane(APEX_Batch *batch, int lane, int status)
+{
+    batch->stop_pc[lane] = batch->pc[lane];
+    batch->status[lane] = status;
+    batch->pc[lane] = BATCH_STOPPED;
+}
+
+static void
+set_flags(APEX_Batch *batch, int lane, int result)
+{
+    batch->zero_flag[lane] = result == 0;
+    batch->positive_flag[lane] = result > 0;
+}
+
+/* Executes an instruction on one lane, as APEX_func_step does */
+static void
+execute_lane(APEX_Batch *batch, const APEX_Instruction *insn, int lane)
+{
+    int pc = batch->pc[lane];
+    int next_pc = pc + 4;
+    int rs1 = batch->regs[insn->rs1][lane];
+    int rs2 = batch->regs[insn->rs2][lane];
+    int *rd = &batch->regs[insn->rd][lane];
+    unsigned int address;
+
+    switch (insn->opcode)
+    {
+        case OPCODE_ADD:
+            set_flags(batch, lane, *rd = rs1 + rs2);
+            break;
+        case OPCODE_SUB:
+            set_flags(batch, lane, *rd = rs1 - rs2);
+            break;
+        case OPCODE_MUL:
+            set_flags(batch, lane, *rd = rs1 * rs2);
+            break;
+        case OPCODE_DIV:
+            set_flags(batch, lane, *rd = APEX_isa_divide(rs1, rs2));
+            break;
+        case OPCODE_ADDL:
+            set_flags(batch, lane, *rd = rs1 + insn->imm);
+            break;
+        case OPCODE_SUBL:
+            set_flags(batch, lane, *rd = rs1 - insn->imm);
+            break;
+        case OPCODE_AND:
+            *rd = rs1 & rs2;
+            break;
+        case OPCODE_OR:
+            *rd = rs1 | rs2;
+            break;
+        case OPCODE_XOR:
+            *rd = rs1 ^ rs2;
+            break;
+        case OPCODE_MOVC:
+            *rd = insn->imm;
+            break;
+        case OPCODE_CID:
+            *rd = lane;
+            break;
+        case OPCODE_CMP:
+            batch->zero_flag[lane] = rs1 == rs2;
+            batch->positive_flag[lane] = rs1 > rs2;
+            break;
+
+        case OPCODE_LOAD:
+        case OPCODE_LDI:
+            address = (unsigned int)(rs1 + insn->imm);
+            if (address >= batch->memory_size)
+            {
+                stop_lane(batch, lane, FUNC_MEMORY_FAULT);
+                return;
+            }
+            *rd = APEX_batch_read(batch, lane, address);
+            if (insn->opcode == OPCODE_LDI)
+            {
+                batch->regs[insn->rs1][lane] = rs1 + 4;
+            }
+            break;
+        case OPCODE_STORE:
+        case OPCODE_STI:
+            address = (unsigned int)(rs2 + insn->imm);
+            if (address >= batch->memory_size)
+            {
+                stop_lane(batch, lane, FUNC_MEMORY_FAULT);
+                return;
+            }
+            batch_write(batch, lane, address, rs1);
+            if (insn->opcode == OPCODE_STI)
+            {
+                batch->regs[insn->rs2][lane] = rs2 + 4;
+            }
+            break;
+
+        case OPCODE_BZ:
+            next_pc = batch->zero_flag[lane] ? pc + insn->imm : next_pc;
+            break;
+        case OPCODE_BNZ:
+            next_pc = !batch->zero_flag[lane] ? pc + insn->imm : next_pc;
+            break;
+        case OPCODE_BP:
+            next_pc = batch->positive_flag[lane] ? pc + insn->imm : next_pc;
+            break;
+        case OPCODE_BNP:
+            next_pc = !batch->positive_flag[lane] ? pc + insn->imm : next_pc;
+            break;
+        case OPCODE_JUMP:
+            next_pc = rs1 + insn->imm;
+            break;
+
+        case OPCODE_HALT:
+            batch->executed[lane]++;
+            stop_lane(batch, lane, FUNC_HALT);
+            return;
+
+        default:
+            break;
+    }
+    batch->pc[lane] = next_pc;
+    batch->executed[lane]++;
+}
+
+static int
+lowest_pc(const APEX_Batch *batch)
+{
+    int low = BATCH_STOPPED;
+
+    for (int lane = 0; lane < batch->lanes; lane++)
+    {
+        low = batch->pc[lane] < low ? batch->pc[lane] : low;
+    }
+    return low;
+}
+
+/*
+ * Issues an instruction to the lanes at a PC one lane at a time. Returns the
+ * lowest PC afterwards.
+ */
+static int
+issue_scalar(APEX_Batch *batch, const APEX_Instruction *insn, int pc)
+{
+    for (int lane = 0; lane < batch->lanes; lane++)
+    {
+        if (batch->pc[lane] == pc)
+        {
+            execute_lane(batch, insn, lane);
+        }
+    }
+    return lowest_pc(batch);
+}
+
+#if defined(__x86_64__)
+#define LOAD_LANES(from) _mm256_loadu_si256((const __m256i *)(from))
+#define STORE_LANES(to, value) _mm256_storeu_si256((__m256i *)(to), value)
+
+/* Stores the lanes of value selected by mask, keeping the others */
+__attribute__((target("avx2")))
+static void
+store_masked(int *to, __m256i value, __m256i mask)
+{
+    STORE_LANES(to, _mm256_blendv_epi8(LOAD_LANES(to), value, mask));
+}
+
+__attribute__((target("avx2")))
+static void
+store_flags(APEX_Batch *batch, int lane, __m256i zero, __m256i positive, __m256i mask)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+
+    store_masked(&batch->zero_flag[lane], _mm256_and_si256(zero, one), mask);
+    store_masked(&batch->positive_flag[lane], _mm256_and_si256(positive, one), mask);
+}
+
+__attribute__((target("avx2")))
+static void
+count_executed(APEX_Batch *batch, int lane, __m256i mask)
+{
+    /* Selected lanes are -1, subtracting them widened to 64 bits adds one */
+    __m256i low = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(mask));
+    __m256i high = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(mask, 1));
+
+    STORE_LANES(&batch->executed[lane],
+                _mm256_sub_epi64(LOAD_LANES(&batch->executed[lane]), low));
+    STORE_LANES(&batch->executed[lane + 4],
+                _mm256_sub_epi64(LOAD_LANES(&batch->executed[lane + 4]), high));
+}
+
+/*
+ * Loads or stores for the lanes selected by mask when they all use the same
+ * address, which is in range. Returns FALSE to leave it to execute_lane.
+ */
+__attribute__((target("avx2")))
+static int
+access_lanes(APEX_Batch *batch, const APEX_Instruction *insn, int lane,
+             __m256i base, __m256i mask)
+{
+    int is_load = insn->opcode == OPCODE_LOAD || insn->opcode == OPCODE_LDI;
+    __m256i address = _mm256_add_epi32(base, _mm256_set1_epi32(insn->imm));
+    int first = __builtin_ctz(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+    int addresses[BATCH_WIDTH];
+    int *page;
+    int *word;
+
+    STORE_LANES(addresses, address);
+    if (!_mm256_testc_si256(_mm256_cmpeq_epi32(address, _mm256_set1_epi32(addresses[first])),
+                            mask)
+        || (unsigned int)addresses[first] >= batch->memory_size)
+    {
+        return FALSE;
+    }
+    page = batch_page(batch, (unsigned int)addresses[first], !is_load);
+    word = page ? &page[word_index(batch, (unsigned int)addresses[first], lane)] : NULL;
+
+    if (is_load)
+    {
+        store_masked(&batch->regs[insn->rd][lane],
+                     word ? LOAD_LANES(word) : _mm256_setzero_si256(), mask);
+        if (insn->opcode == OPCODE_LDI)
+        {
+            store_masked(&batch->regs[insn->rs1][lane],
+                         _mm256_add_epi32(base, _mm256_set1_epi32(4)), mask);
+        }
+    }
+    else
+    {
+        store_masked(word, LOAD_LANES(&batch->regs[insn->rs1][lane]), mask);
+        if (insn->opcode == OPCODE_STI)
+        {
+            store_masked(&batch->regs[insn->rs2][lane],
+                         _mm256_add_epi32(base, _mm256_set1_epi32(4)), mask);
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Issues an instruction to the lanes at a PC, BATCH_WIDTH lanes at a time.
+ * Returns the lowest PC afterwards.
+ */
+__attribute__((target("avx2")))
+static int
+issue_vector(APEX_Batch *batch, const APEX_Instruction *insn, int pc)
+{
+    const __m256i at = _mm256_set1_epi32(pc);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i low = _mm256_set1_epi32(BATCH_STOPPED);
+    int lows[BATCH_WIDTH];
+    int lowest = BATCH_STOPPED;
+
+    for (int lane = 0; lane < batch->lanes; lane += BATCH_WIDTH)
+    {
+        __m256i pcs = LOAD_LANES(&batch->pc[lane]);
+        __m256i mask = _mm256_cmpeq_epi32(pcs, at);
+        __m256i rs1, rs2, result, taken;
+        __m256i next = _mm256_add_epi32(pcs, _mm256_set1_epi32(4));
+
+        if (_mm256_testz_si256(mask, mask))
+        {
+            low = _mm256_min_epi32(low, pcs);
+            continue;
+        }
+        rs1 = LOAD_LANES(&batch->regs[insn->rs1][lane]);
+        rs2 = LOAD_LANES(&batch->regs[insn->rs2][lane]);
+
+        switch (insn->opcode)
+        {
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_MUL:
+            case OPCODE_ADDL:
+            case OPCODE_SUBL:
+                switch (insn->opcode)
+                {
+                    case OPCODE_ADD:
+                        result = _mm256_add_epi32(rs1, rs2);
+                        break;
+                    case OPCODE_SUB:
+                        result = _mm256_sub_epi32(rs1, rs2);
+                        break;
+                    case OPCODE_MUL:
+                        result = _mm256_mullo_epi32(rs1, rs2);
+                        break;
+                    case OPCODE_ADDL:
+                        result = _mm256_add_epi32(rs1, _mm256_set1_epi32(insn->imm));
+                        break;
+                    default:
+                        result = _mm256_sub_epi32(rs1, _mm256_set1_epi32(insn->imm));
+                        break;
+                }
+                store_masked(&batch->regs[insn->rd][lane], result, mask);
+                store_flags(batch, lane, _mm256_cmpeq_epi32(result, zero),
+                            _mm256_cmpgt_epi32(result, zero), mask);
+                break;
+            case OPCODE_AND:
+                store_masked(&batch->regs[insn->rd][lane], _mm256_and_si256(rs1, rs2), mask);
+                break;
+            case OPCODE_OR:
+                store_masked(&batch->regs[insn->rd][lane], _mm256_or_si256(rs1, rs2), mask);
+                break;
+            case OPCODE_XOR:
+                store_masked(&batch->regs[insn->rd][lane], _mm256_xor_si256(rs1, rs2), mask);
+                break;
+            case OPCODE_MOVC:
+                store_masked(&batch->regs[insn->rd][lane], _mm256_set1_epi32(insn->imm), mask);
+                break;
+            case OPCODE_CID:
+                store_masked(&batch->regs[insn->rd][lane],
+                             _mm256_add_epi32(_mm256_set1_epi32(lane),
+                                              _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)),
+                             mask);
+                break;
+            case OPCODE_CMP:
+                store_flags(batch, lane, _mm256_cmpeq_epi32(rs1, rs2),
+                            _mm256_cmpgt_epi32(rs1, rs2), mask);
+                break;
+
+            case OPCODE_LOAD:
+            case OPCODE_LDI:
+            case OPCODE_STORE:
+            case OPCODE_STI:
+                if (access_lanes(batch, insn, lane,
+                                 insn->opcode == OPCODE_LOAD || insn->opcode == OPCODE_LDI
+                                 ? rs1 : rs2, mask))
+                {
+                    break;
+                }
+                /* Fall through, the lanes use different addresses */
+            default:
+                for (int cnt = 0; cnt < BATCH_WIDTH; cnt++)
+                {
+                    if (batch->pc[lane + cnt] == pc)
+                    {
+                        execute_lane(batch, insn, lane + cnt);
+                    }
+                }
+                low = _mm256_min_epi32(low, LOAD_LANES(&batch->pc[lane]));
+                continue;
+
+            case OPCODE_BZ:
+            case OPCODE_BNZ:
+            case OPCODE_BP:
+            case OPCODE_BNP:
+                taken = LOAD_LANES(insn->opcode == OPCODE_BZ || insn->opcode == OPCODE_BNZ
+                                   ? &batch->zero_flag[lane] : &batch->positive_flag[lane]);
+                taken = _mm256_cmpeq_epi32(taken, insn->opcode == OPCODE_BZ
+                                                  || insn->opcode == OPCODE_BP ? one : zero);
+                next = _mm256_blendv_epi8(next, _mm256_set1_epi32(pc + insn->imm), taken);
+                break;
+            case OPCODE_JUMP:
+                next = _mm256_add_epi32(rs1, _mm256_set1_epi32(insn->imm));
+                break;
+        }
+        pcs = _mm256_blendv_epi8(pcs, next, mask);
+        STORE_LANES(&batch->pc[lane], pcs);
+        count_executed(batch, lane, mask);
+        low = _mm256_min_epi32(low, pcs);
+    }
+
+    STORE_LANES(lows, low);
+    for (int cnt = 0; cnt < BATCH_WIDTH; cnt++)
+    {
+        lowest = lows[cnt] < lowest ? lows[cnt] : lowest;
+    }
+    return lowest;
+}
+#endif
+
+/*
+ * Stops the lanes at a PC that executed the instruction limit. Returns TRUE
+ * if any did.
+ */
+static int
+stop_at_limit(APEX_Batch *batch, int pc)
+{
+    int stopped = FALSE;
+
+    for (int lane = 0; lane < batch->lanes; lane++)
+    {
+        if (batch->pc[lane] == pc && batch->executed[lane] >= batch->limit)
+        {
+            stop_lane(batch, lane, FUNC_OK);
+            stopped = TRUE;
+        }
+    }
+    return stopped;
+}
+
+/*
+ * Runs every instance until it halts, faults or executes the instruction
+ * limit.
+ */
+void
+APEX_batch_run(APEX_Batch *batch)
+{
+    unsigned long long issued = 0;
+    int pc = lowest_pc(batch);
+
+    while (pc != BATCH_STOPPED)
+    {
+        int index = (pc - 4000) / 4;
+
+        if (pc < 4000 || (pc - 4000) % 4 || index >= batch->code_memory_size)
+        {
+            for (int lane = 0; lane < batch->lanes; lane++)
+            {
+                if (batch->pc[lane] == pc)
+                {
+                    stop_lane(batch, lane, FUNC_PC_FAULT);
+                }
+            }
+            pc = lowest_pc(batch);
+            continue;
+        }
+
+        /* No lane can have executed more instructions than were issued */
+        if (batch->limit && issued >= batch->limit && stop_at_limit(batch, pc))
+        {
+            pc = lowest_pc(batch);
+            continue;
+        }
+
+#if defined(__x86_64__)
+        if (batch->vector)
+        {
+            pc = issue_vector(batch, &batch->code_memory[index], pc);
+            issued++;
+            continue;
+        }
+#endif
+        pc = issue_scalar(batch, &batch->code_memory[index], pc);
+        issued++;
+    }
+}
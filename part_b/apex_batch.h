@@ -0,0 +1,59 @@
+/*
+ * apex_batch.h
+ * Contains the APEX batched functional engine declarations
+ *
+ * The batch runs one program as many independent instances, each with its
+ * own registers, flags, PC and data memory, laid out lane by lane so that
+ * one instruction executes on BATCH_WIDTH instances with one vector
+ * operation. Instances that branch apart are masked out and wait until the
+ * others reach their PC again.
+ */
+#ifndef _APEX_BATCH_H_
+#define _APEX_BATCH_H_
+#include "apex_func.h"
+
+#define BATCH_WIDTH 8              /* 32-bit lanes of an AVX2 vector */
+#define MAX_INSTANCES 65536
+
+/* Batch data memory, a page holds BATCH_PAGE_WORDS words of every lane */
+#define BATCH_PAGE_BITS 8
+#define BATCH_TABLE_BITS 12
+#define BATCH_DIR_BITS (32 - BATCH_TABLE_BITS - BATCH_PAGE_BITS)
+#define BATCH_PAGE_WORDS (1u << BATCH_PAGE_BITS)
+#define BATCH_TABLE_SIZE (1u << BATCH_TABLE_BITS)
+#define BATCH_DIR_SIZE (1u << BATCH_DIR_BITS)
+
+/* PC of a lane that stopped, or pads the batch to whole vectors */
+#define BATCH_STOPPED 0x7fffffff
+
+typedef struct APEX_Batch
+{
+    int instances;
+    int lanes;                     /* Instances rounded up to BATCH_WIDTH */
+    const APEX_Instruction *code_memory;
+    int code_memory_size;
+    unsigned long long memory_size;
+    unsigned long long limit;      /* Instructions per instance, 0 for none */
+    int vector;                    /* Host runs the AVX2 engine */
+
+    /* Architectural state, [lane] */
+    int *regs[REG_FILE_SIZE];
+    int *zero_flag;
+    int *positive_flag;
+    int *pc;                       /* BATCH_STOPPED once the lane stopped */
+    int *stop_pc;                  /* Where it stopped */
+    int *status;                   /* FUNC_* outcome, FUNC_OK at the limit */
+    unsigned long long *executed;
+
+    /* Words [offset * lanes + lane] of each page, allocated on first write */
+    int **tables[BATCH_DIR_SIZE];
+} APEX_Batch;
+
+APEX_Batch *APEX_batch_create(const APEX_CPU *cpu, int instances, unsigned long long limit);
+void APEX_batch_free(APEX_Batch *batch);
+void APEX_batch_load(APEX_Batch *batch, int lane, const APEX_Memory *mem);
+int APEX_batch_read(const APEX_Batch *batch, int lane, unsigned int address);
+APEX_Memory *APEX_batch_memory(const APEX_Batch *batch, int lane, unsigned int base,
+                               unsigned long long words);
+void APEX_batch_run(APEX_Batch *batch);
+#endif
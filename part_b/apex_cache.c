@@ -0,0 +1,427 @@
+/*
+ * apex_cache.c
+ * Contains APEX private L1 data caches kept coherent over a snooping bus
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apex_cache.h"
+#include "apex_macros.h"
+
+/*
+ * Creates the bus and one empty L1 per core. The number of sets and the line
+ * size must be powers of two.
+ */
+APEX_Bus *
+APEX_bus_create(const APEX_Cache_Config *config, int num_caches)
+{
+    APEX_Bus *bus = calloc(1, sizeof(APEX_Bus));
+
+    if (!bus)
+    {
+        return NULL;
+    }
+    bus->config = *config;
+    bus->num_caches = num_caches;
+    while ((1 << bus->line_shift) < config->line_words)
+    {
+        bus->line_shift++;
+    }
+
+    bus->caches = calloc(num_caches, sizeof(APEX_Cache));
+    if (!bus->caches)
+    {
+        APEX_bus_free(bus);
+        return NULL;
+    }
+    for (int i = 0; i < num_caches; i++)
+    {
+        bus->caches[i].lines = calloc(config->sets * config->ways, sizeof(APEX_Cache_Line));
+        if (!bus->caches[i].lines)
+        {
+            APEX_bus_free(bus);
+            return NULL;
+        }
+    }
+    return bus;
+}
+
+void
+APEX_bus_free(APEX_Bus *bus)
+{
+    if (!bus)
+    {
+        return;
+    }
+    for (int i = 0; bus->caches && i < bus->num_caches; i++)
+    {
+        free(bus->caches[i].lines);
+        free(bus->caches[i].pending);
+    }
+    free(bus->caches);
+    free(bus);
+}
+
+/*
+ * Copies the cache contents, statistics and bus state of a bus into another
+ * one of the same configuration, as used for the snapshots of the debugger.
+ * Only lockstep runs are snapshotted, so no requests are ever deferred.
+ */
+void
+APEX_bus_copy(APEX_Bus *bus, const APEX_Bus *from)
+{
+    APEX_Cache *caches = bus->caches;
+
+    for (int i = 0; i < bus->num_caches; i++)
+    {
+        APEX_Cache_Line *lines = caches[i].lines;
+
+        memcpy(lines, from->caches[i].lines,
+               bus->config.sets * bus->config.ways * sizeof(APEX_Cache_Line));
+        caches[i].use_clock = from->caches[i].use_clock;
+        caches[i].stats = from->caches[i].stats;
+    }
+    *bus = *from;
+    bus->caches = caches;
+}
+
+/*
+ * Clears the statistics and the bus occupancy while keeping the cache
+ * contents, so that a detailed run starting from caches warmed by the
+ * functional model only counts its own accesses.
+ */
+void
+APEX_bus_reset_stats(APEX_Bus *bus)
+{
+    for (int i = 0; i < bus->num_caches; i++)
+    {
+        memset(&bus->caches[i].stats, 0, sizeof(APEX_Cache_Stats));
+    }
+    bus->busy_until = 0;
+    bus->bus_reads = 0;
+    bus->bus_read_exclusive = 0;
+    bus->bus_upgrades = 0;
+    bus->transfers = 0;
+    bus->busy_cycles = 0;
+    bus->wait_cycles = 0;
+}
+
+/*
+ * Returns the valid line holding a memory line in a cache, or NULL.
+ */
+static APEX_Cache_Line *
+find_line(const APEX_Bus *bus, int core, unsigned int line_address)
+{
+    APEX_Cache_Line *set = bus->caches[core].lines
+                           + (line_address & (bus->config.sets - 1)) * bus->config.ways;
+
+    for (int way = 0; way < bus->config.ways; way++)
+    {
+        if (set[way].state != LINE_INVALID && set[way].tag == line_address)
+        {
+            return &set[way];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Picks the line to refill in a set: an invalid one if there is any,
+ * otherwise the least recently used.
+ */
+static APEX_Cache_Line *
+choose_victim(const APEX_Bus *bus, int core, unsigned int line_address)
+{
+    APEX_Cache_Line *set = bus->caches[core].lines
+                           + (line_address & (bus->config.sets - 1)) * bus->config.ways;
+    APEX_Cache_Line *victim = &set[0];
+
+    for (int way = 0; way < bus->config.ways; way++)
+    {
+        if (set[way].state == LINE_INVALID)
+        {
+            return &set[way];
+        }
+        if (set[way].last_use < victim->last_use)
+        {
+            victim = &set[way];
+        }
+    }
+    return victim;
+}
+
+/*
+ * Every other cache snoops a bus request for a line. A modified copy is
+ * supplied to the requester (and written back); an exclusive request
+ * invalidates all copies, a shared one demotes them to shared. Returns TRUE
+ * if another cache supplied the line, sets *shared if a copy remains.
+ */
+static int
+snoop(APEX_Bus *bus, int requester, unsigned int line_address, int exclusive, int *shared)
+{
+    int supplied = FALSE;
+
+    *shared = FALSE;
+    for (int core = 0; core < bus->num_caches; core++)
+    {
+        APEX_Cache_Line *line;
+
+        if (core == requester || !(line = find_line(bus, core, line_address)))
+        {
+            continue;
+        }
+        if (line->state == LINE_MODIFIED)
+        {
+            bus->caches[core].stats.supplied++;
+            supplied = TRUE;
+        }
+        if (exclusive)
+        {
+            line->state = LINE_INVALID;
+            bus->caches[core].stats.invalidated++;
+        }
+        else
+        {
+            line->state = LINE_SHARED;
+            *shared = TRUE;
+        }
+    }
+    return supplied;
+}
+
+/*
+ * Occupies the bus for one transaction starting no earlier than now.
+ * Returns the cycles the requester waited for the bus to become free.
+ */
+static long long
+bus_transaction(APEX_Bus *bus, long long now)
+{
+    long long start = now > bus->busy_until ? now : bus->busy_until;
+
+    bus->busy_until = start + bus->config.bus_latency;
+    bus->busy_cycles += bus->config.bus_latency;
+    bus->wait_cycles += start - now;
+    return start - now;
+}
+
+/*
+ * Queues a bus request of a cache in deferred mode.
+ */
+static void
+post_request(APEX_Cache *cache, long long cycle, unsigned int line_address, int type)
+{
+    APEX_Bus_Request *request;
+
+    if (cache->num_pending == cache->pending_capacity)
+    {
+        int capacity = cache->pending_capacity ? 2 * cache->pending_capacity : 64;
+        APEX_Bus_Request *pending = realloc(cache->pending, capacity * sizeof(APEX_Bus_Request));
+
+        if (!pending)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for bus requests\n");
+            exit(1);
+        }
+        cache->pending = pending;
+        cache->pending_capacity = capacity;
+    }
+    request = &cache->pending[cache->num_pending++];
+    request->cycle = cycle;
+    request->line_address = line_address;
+    request->type = type;
+}
+
+/*
+ * Snoops the requests every cache queued since the last barrier, oldest
+ * cycle first and lower core first on a tie, so the outcome only depends on
+ * what each core did and not on how the host threads were scheduled. A read
+ * that finds the line in another cache leaves the requester shared instead
+ * of exclusive. Must be called with all cores stopped.
+ */
+void
+APEX_bus_deliver(APEX_Bus *bus)
+{
+    int next[MAX_CORES] = {0};
+
+    while (TRUE)
+    {
+        const APEX_Bus_Request *request;
+        APEX_Cache_Line *line;
+        int core = -1;
+        int shared;
+
+        for (int i = 0; i < bus->num_caches; i++)
+        {
+            if (next[i] < bus->caches[i].num_pending
+                && (core < 0 || bus->caches[i].pending[next[i]].cycle
+                                < bus->caches[core].pending[next[core]].cycle))
+            {
+                core = i;
+            }
+        }
+        if (core < 0)
+        {
+            break;
+        }
+        request = &bus->caches[core].pending[next[core]++];
+
+        switch (request->type)
+        {
+            case BUS_READ:
+                bus->bus_reads++;
+                break;
+            case BUS_READ_EXCLUSIVE:
+                bus->bus_read_exclusive++;
+                break;
+            default:
+                bus->bus_upgrades++;
+                break;
+        }
+        bus->busy_cycles += bus->config.bus_latency;
+        if (snoop(bus, core, request->line_address, request->type != BUS_READ, &shared)
+            && request->type != BUS_UPGRADE)
+        {
+            bus->transfers++;
+        }
+        line = find_line(bus, core, request->line_address);
+        if (request->type == BUS_READ && shared && line && line->state == LINE_EXCLUSIVE)
+        {
+            line->state = LINE_SHARED;
+        }
+    }
+
+    for (int i = 0; i < bus->num_caches; i++)
+    {
+        bus->caches[i].num_pending = 0;
+    }
+}
+
+/*
+ * Performs a load (is_write FALSE) or store from a core through its L1 at
+ * cycle now and returns how many cycles beyond the normal memory stage the
+ * access takes. Hits are free; an upgrade of a shared line costs one bus
+ * transaction; a miss costs a bus transaction plus the line fill, from
+ * another cache if it held the line modified, otherwise from memory. The bus
+ * carries one transaction at a time, so misses from several cores queue up.
+ *
+ * In deferred mode only the core's own cache is touched, so cores on
+ * different host threads never race: requests are queued for
+ * APEX_bus_deliver, misses are always filled from memory and bus contention
+ * is not modelled.
+ */
+int
+APEX_cache_access(APEX_Bus *bus, int core, unsigned int address, int is_write,
+                  long long now)
+{
+    APEX_Cache *cache = &bus->caches[core];
+    APEX_Cache_Stats *stats = &cache->stats;
+    unsigned int line_address = address >> bus->line_shift;
+    APEX_Cache_Line *line = find_line(bus, core, line_address);
+    long long latency;
+    int supplied;
+    int shared;
+
+    if (line && (!is_write || line->state != LINE_SHARED))
+    {
+        /* Hit; a write to an exclusive line needs no bus transaction (MESI) */
+        if (is_write)
+        {
+            stats->write_hits++;
+            line->state = LINE_MODIFIED;
+        }
+        else
+        {
+            stats->read_hits++;
+        }
+        line->last_use = ++cache->use_clock;
+        return 0;
+    }
+
+    if (line)
+    {
+        /* Write to a shared line, invalidate the other copies */
+        stats->write_hits++;
+        stats->upgrades++;
+        if (bus->deferred)
+        {
+            post_request(cache, now, line_address, BUS_UPGRADE);
+            line->state = LINE_MODIFIED;
+            line->last_use = ++cache->use_clock;
+            return bus->config.bus_latency;
+        }
+        bus->bus_upgrades++;
+        snoop(bus, core, line_address, TRUE, &shared);
+        line->state = LINE_MODIFIED;
+        line->last_use = ++cache->use_clock;
+        return bus_transaction(bus, now) + bus->config.bus_latency;
+    }
+
+    /* Miss, make room first */
+    latency = 0;
+    line = choose_victim(bus, core, line_address);
+    if (line->state == LINE_MODIFIED)
+    {
+        stats->writebacks++;
+        latency += (bus->deferred ? 0 : bus_transaction(bus, now)) + bus->config.bus_latency;
+    }
+
+    if (bus->deferred)
+    {
+        /* The other caches are snooped at the barrier, until then the line
+         * is filled from memory as if no other core held it */
+        if (is_write)
+        {
+            stats->write_misses++;
+        }
+        else
+        {
+            stats->read_misses++;
+        }
+        post_request(cache, now + latency, line_address,
+                     is_write ? BUS_READ_EXCLUSIVE : BUS_READ);
+        line->tag = line_address;
+        line->state = is_write ? LINE_MODIFIED
+                      : bus->config.protocol == COHERENCE_MSI ? LINE_SHARED : LINE_EXCLUSIVE;
+        line->last_use = ++cache->use_clock;
+        return (int)latency + bus->config.memory_latency;
+    }
+
+    if (is_write)
+    {
+        stats->write_misses++;
+        bus->bus_read_exclusive++;
+    }
+    else
+    {
+        stats->read_misses++;
+        bus->bus_reads++;
+    }
+    latency += bus_transaction(bus, now + latency);
+    supplied = snoop(bus, core, line_address, is_write, &shared);
+    if (supplied)
+    {
+        /* Cache to cache transfer: request plus data on the bus */
+        bus->transfers++;
+        latency += 2 * bus->config.bus_latency;
+    }
+    else
+    {
+        latency += bus->config.memory_latency;
+    }
+
+    line->tag = line_address;
+    if (is_write)
+    {
+        line->state = LINE_MODIFIED;
+    }
+    else if (shared || bus->config.protocol == COHERENCE_MSI)
+    {
+        line->state = LINE_SHARED;
+    }
+    else
+    {
+        line->state = LINE_EXCLUSIVE;
+    }
+    line->last_use = ++cache->use_clock;
+    return (int)latency;
+}
@@ -0,0 +1,112 @@
+/*
+ * apex_cache.h
+ * Contains APEX private L1 data cache and coherence bus declarations
+ *
+ * Every core has a private set associative L1 that only tracks tags and
+ * coherence state; the data itself always lives in the shared data memory.
+ * Because a core performs a whole bus transaction atomically in its memory
+ * stage, the coherence protocol (MSI or MESI) decides how long an access
+ * takes and how much bus traffic it causes, never which value it returns.
+ */
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+
+/* Coherence states of a cache line */
+#define LINE_INVALID 0
+#define LINE_SHARED 1
+#define LINE_EXCLUSIVE 2
+#define LINE_MODIFIED 3
+
+/* Coherence protocols */
+#define COHERENCE_MSI 0
+#define COHERENCE_MESI 1
+
+/* Default L1 geometry and latencies (cycles) */
+#define L1_DEFAULT_SETS 64
+#define L1_DEFAULT_WAYS 2
+#define L1_DEFAULT_LINE_WORDS 8
+#define L1_MAX_WAYS 8
+#define MEMORY_LATENCY 20
+#define BUS_LATENCY 4
+
+/* L1 and bus configuration, sets == 0 means no caches are modelled */
+typedef struct APEX_Cache_Config
+{
+    int sets;
+    int ways;
+    int line_words;
+    int protocol;                  /* COHERENCE_MSI or COHERENCE_MESI */
+    int memory_latency;            /* Line fill from memory */
+    int bus_latency;               /* One bus transaction without data */
+} APEX_Cache_Config;
+
+typedef struct APEX_Cache_Line
+{
+    unsigned int tag;
+    int state;
+    unsigned long long last_use;   /* For LRU replacement */
+} APEX_Cache_Line;
+
+/* Per core L1 statistics */
+typedef struct APEX_Cache_Stats
+{
+    long long read_hits;
+    long long read_misses;
+    long long write_hits;
+    long long write_misses;
+    long long upgrades;            /* Writes to a shared line */
+    long long writebacks;          /* Modified victims written to memory */
+    long long invalidated;         /* Lines lost to another core's write */
+    long long supplied;            /* Modified lines handed to another core */
+} APEX_Cache_Stats;
+
+/* Bus requests */
+#define BUS_READ 0
+#define BUS_READ_EXCLUSIVE 1
+#define BUS_UPGRADE 2
+
+/* Bus request of a core that the other caches snoop at the next barrier */
+typedef struct APEX_Bus_Request
+{
+    long long cycle;
+    unsigned int line_address;
+    int type;
+} APEX_Bus_Request;
+
+typedef struct APEX_Cache
+{
+    APEX_Cache_Line *lines;        /* sets * ways lines */
+    unsigned long long use_clock;  /* LRU time stamp source */
+    APEX_Cache_Stats stats;
+    APEX_Bus_Request *pending;     /* Deferred requests, in cycle order */
+    int num_pending;
+    int pending_capacity;
+} APEX_Cache;
+
+/* Shared snooping bus connecting the L1s to data memory */
+typedef struct APEX_Bus
+{
+    APEX_Cache_Config config;
+    int num_caches;
+    APEX_Cache *caches;
+    int line_shift;                /* log2(line_words) */
+    int deferred;                  /* Snoop at quantum barriers, see APEX_bus_deliver */
+    long long busy_until;          /* Cycle the current transaction ends */
+
+    /* Bus statistics */
+    long long bus_reads;           /* BusRd, read miss */
+    long long bus_read_exclusive;  /* BusRdX, write miss */
+    long long bus_upgrades;        /* BusUpgr, write hit on a shared line */
+    long long transfers;           /* Misses served by another cache */
+    long long busy_cycles;
+    long long wait_cycles;         /* Cycles cores waited for the bus */
+} APEX_Bus;
+
+APEX_Bus *APEX_bus_create(const APEX_Cache_Config *config, int num_caches);
+void APEX_bus_free(APEX_Bus *bus);
+void APEX_bus_copy(APEX_Bus *bus, const APEX_Bus *from);
+void APEX_bus_reset_stats(APEX_Bus *bus);
+void APEX_bus_deliver(APEX_Bus *bus);
+int APEX_cache_access(APEX_Bus *bus, int core, unsigned int address, int is_write,
+                      long long now);
+#endif
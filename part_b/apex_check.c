@@ -0,0 +1,194 @@
+/*
+ * apex_check.c
+ * Contains the APEX co-simulation checker
+ *
+ * The checker is a retire stream consumer that steps the functional model
+ * once for every instruction the pipeline retires and compares PC, opcode,
+ * registers written with their values and the memory access. At the first
+ * difference it tells the core to stop and, once the stream is drained,
+ * reports both sides with the instructions retired just before.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apex_check.h"
+#include "apex_func.h"
+#include "apex_trace.h"
+
+/* Retired instructions shown before a divergence */
+#define CHECK_HISTORY 8
+
+typedef struct APEX_Checker
+{
+    APEX_CPU *core;                /* Only its diverged flag is touched */
+    APEX_Func model;
+    APEX_Memory *memory;           /* The model's own copy of data memory */
+    int observed_loads;            /* Take loaded values from the pipeline */
+    unsigned long long checked;
+    APEX_Retired history[CHECK_HISTORY];
+
+    /* First divergence */
+    const char *reason;
+    APEX_Retired actual;
+    APEX_Retired expected;
+    int model_regs[REG_FILE_SIZE];
+} APEX_Checker;
+
+/*
+ * Returns why a retired instruction differs from what the model executed, or
+ * NULL if it matches.
+ */
+static const char *
+compare_effects(const APEX_Checker *checker, const APEX_Retired *insn,
+                const APEX_Retired *expected, int outcome)
+{
+    if (outcome == FUNC_PC_FAULT)
+    {
+        return "the model has no instruction at its PC";
+    }
+    if (outcome == FUNC_MEMORY_FAULT)
+    {
+        return "the model faulted on the memory access";
+    }
+    if (insn->pc != expected->pc)
+    {
+        return "different PC, control flow diverged";
+    }
+    if (insn->opcode != expected->opcode)
+    {
+        return "different instruction";
+    }
+    if (insn->num_dest != expected->num_dest)
+    {
+        return "different registers written";
+    }
+    for (int i = 0; i < insn->num_dest; i++)
+    {
+        /* LDI may write the same register twice, compare the final value */
+        if (insn->dest[i] != expected->dest[i])
+        {
+            return "different registers written";
+        }
+        if (insn->dest_value[i] != checker->model.regs[insn->dest[i]])
+        {
+            return "different register value";
+        }
+    }
+    if (insn->mem_access != expected->mem_access)
+    {
+        return "different memory access";
+    }
+    if (insn->mem_access != RETIRE_NO_ACCESS
+        && (insn->mem_address != expected->mem_address
+            || insn->mem_value != expected->mem_value))
+    {
+        return insn->mem_address != expected->mem_address ? "different memory address"
+                                                          : "different memory data";
+    }
+    return NULL;
+}
+
+static void
+check_consume(const APEX_Retired *insn, void *arg)
+{
+    APEX_Checker *checker = arg;
+    APEX_Retired expected;
+    const int *load_value = NULL;
+    int outcome;
+
+    if (checker->reason)
+    {
+        return;
+    }
+    if (checker->observed_loads && insn->mem_access == RETIRE_LOAD)
+    {
+        load_value = &insn->mem_value;
+    }
+    outcome = APEX_func_step(&checker->model, load_value, &expected);
+
+    checker->reason = compare_effects(checker, insn, &expected, outcome);
+    if (checker->reason)
+    {
+        checker->actual = *insn;
+        checker->expected = expected;
+        checker->expected.cycle = insn->cycle;
+        memcpy(checker->model_regs, checker->model.regs, sizeof(checker->model_regs));
+        atomic_store_explicit(&checker->core->diverged, TRUE, memory_order_relaxed);
+        return;
+    }
+    checker->history[checker->checked % CHECK_HISTORY] = *insn;
+    checker->checked++;
+}
+
+static void
+check_finish(void *arg)
+{
+    APEX_Checker *checker = arg;
+    char text[128];
+
+    if (!checker->reason)
+    {
+        printf("APEX_CHECK: Core %d: %llu instructions match the functional model\n",
+               checker->model.core_id, checker->checked);
+    }
+    else
+    {
+        unsigned long long first = checker->checked > CHECK_HISTORY
+                                   ? checker->checked - CHECK_HISTORY : 0;
+
+        printf("APEX_CHECK: Core %d diverged from the functional model at retired instruction %llu: %s\n",
+               checker->model.core_id, checker->checked, checker->reason);
+        for (unsigned long long i = first; i < checker->checked; i++)
+        {
+            APEX_trace_format(&checker->history[i % CHECK_HISTORY], text, sizeof(text));
+            printf("APEX_CHECK:             %s\n", text);
+        }
+        APEX_trace_format(&checker->actual, text, sizeof(text));
+        printf("APEX_CHECK:   pipeline: %s\n", text);
+        APEX_trace_format(&checker->expected, text, sizeof(text));
+        printf("APEX_CHECK:   model:    %s\n", text);
+        printf("APEX_CHECK:   model registers:");
+        for (int reg = 0; reg < REG_FILE_SIZE; reg++)
+        {
+            printf(" R%d=%d", reg, checker->model_regs[reg]);
+        }
+        printf("\n");
+    }
+
+    APEX_memory_free(checker->memory);
+    free(checker);
+}
+
+/*
+ * Adds a checker for one core to its retire ring. The model starts from the
+ * data memory as loaded. On a multicore machine the other cores' stores are
+ * invisible to it, so it takes loaded values from the pipeline and checks
+ * everything else.
+ */
+int
+APEX_check_subscribe(APEX_CPU *core, APEX_Retire_Ring *ring)
+{
+    APEX_Checker *checker = calloc(1, sizeof(APEX_Checker));
+
+    if (!checker)
+    {
+        return FALSE;
+    }
+    checker->memory = APEX_memory_clone(core->data_memory);
+    if (!checker->memory)
+    {
+        free(checker);
+        return FALSE;
+    }
+    checker->core = core;
+    checker->observed_loads = core->config.num_cores > 1;
+    APEX_func_init(&checker->model, core, checker->memory);
+
+    if (!APEX_retire_subscribe(ring, check_consume, check_finish, checker))
+    {
+        APEX_memory_free(checker->memory);
+        free(checker);
+        return FALSE;
+    }
+    return TRUE;
+}
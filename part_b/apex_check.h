@@ -0,0 +1,10 @@
+/*
+ * apex_check.h
+ * Contains the APEX co-simulation checker declarations
+ */
+#ifndef _APEX_CHECK_H_
+#define _APEX_CHECK_H_
+#include "apex_cpu.h"
+
+int APEX_check_subscribe(APEX_CPU *core, APEX_Retire_Ring *ring);
+#endif
@@ -8,15 +8,50 @@
  * 
  * This file is updated for data forwarding (Part B) logic by Nikita Navkar
  */  
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "apex_cpu.h"
 #include "apex_macros.h"
+#include "apex_batch.h"
+#include "apex_debug.h"
+#include "apex_func.h"
+#include "apex_interval.h"
+#include "apex_jit.h"
+#include "apex_output.h"
+#include "apex_parallel.h"
+#include "apex_replay.h"
+#include "apex_results.h"
+#include "apex_reuse.h"
+#include "apex_simpoint.h"
+#include "apex_snapshot.h"
+#include "apex_trace.h"
 // Initalization
 int command;
 int cycle_count;
-CPU_Stage pipeline_logs[5]; 
+char const *compare_programs[MAX_COMPARE_PROGRAMS];
+int num_compare_programs;
+
+/* Names accepted by --hazard, indexed by policy */
+static const char *hazard_names[NUM_HAZARD_POLICIES] = {
+    "stall", "forward", "perfect"
+};
+
+/* Display names of the pipeline phases */
+static const char *phase_names[NUM_PHASES] = {
+    "FETCH", "DECODE_RF", "EX", "MEMORY", "WRITEBACK"
+};
+
+/* Combinational delay of each phase (ps) before it is split into sub-stages */
+static const int phase_logic_delay[NUM_PHASES] = {
+    FETCH_LOGIC_DELAY, DECODE_LOGIC_DELAY, EXECUTE_LOGIC_DELAY,
+    MEMORY_LOGIC_DELAY, WRITEBACK_LOGIC_DELAY
+};
 /* 
  * To Display Memory Content
  * Note: You can edit this function to print in more detail
@@ -24,1260 +59,3459 @@ CPU_Stage pipeline_logs[5];
 static void 
 show_memory(const APEX_CPU *cpu)
 {
-    printf("\n============================== STATE OF DATA MEMORY ===============================\n\n");
+    APEX_Output *out = cpu->output;
+
+    APEX_output_memory_begin(out);
     for(int cnt = 0; cnt < DATA_MEMORY_SIZE; cnt++) 
     {
-        printf("|           MEM[%04d]           |               Data Value = %d             \n", cnt, cpu->data_memory[cnt]);
+        APEX_output_memory(out, cnt, APEX_memory_read(cpu->data_memory, cnt));
+    }
+
+    /* Beyond the first words only pages that were written are shown */
+    for (unsigned long long page = DATA_MEMORY_SIZE; page < cpu->data_memory->size;
+         page += MEM_PAGE_WORDS)
+    {
+        const int *words = APEX_memory_page(cpu->data_memory, (unsigned int)page);
+
+        for (unsigned int cnt = 0; words && cnt < MEM_PAGE_WORDS; cnt++)
+        {
+            if (words[cnt])
+            {
+                APEX_output_memory(out, page + cnt, words[cnt]);
+            }
+        }
     }
+    APEX_output_memory_end(out);
 }
 
-static int 
-map_commands(char const *arguments[])
+/*
+ * Parses a decimal or 0x prefixed hexadecimal number, returns FALSE if the
+ * text is not entirely a number.
+ */
+static int
+parse_number(const char *text, unsigned long long *value)
 {
-    int ret_val = FALSE;
-    if(arguments[2])
+    char *end;
+
+    *value = strtoull(text, &end, 0);
+    return end != text && *end == '\0';
+}
+
+/*
+ * Parses a "--name=value" pipeline option into the CPU configuration.
+ * Returns FALSE for unknown options or out of range values.
+ */
+static int
+map_pipeline_option(APEX_Config *config, const char *option)
+{
+    unsigned long long number;
+    static const char *depth_options[NUM_PHASES] = {
+        "--fetch-stages=", "--decode-stages=", "--execute-stages=",
+        "--memory-stages=", NULL
+    };
+    int value;
+
+    for (int phase = 0; phase < NUM_PHASES; phase++)
     {
-        if (strcmp(arguments[2], "simulate") == 0)
+        if (depth_options[phase]
+            && strncmp(option, depth_options[phase], strlen(depth_options[phase])) == 0)
         {
-            if(arguments[3])
+            value = atoi(option + strlen(depth_options[phase]));
+            if (value < 1 || value > MAX_PHASE_DEPTH)
             {
-                command = COMMAND_SIMULATE;
-                cycle_count = atoi(arguments[3]);
-                ret_val = TRUE;
+                printf("Pipeline depth must be between 1 and %d - %s\n", MAX_PHASE_DEPTH, option);
+                return FALSE;
             }
+            config->depth[phase] = value;
+            return TRUE;
         }
-        else if (strcmp(arguments[2], "display") == 0)
+    }
+    if (strncmp(option, "--hazard=", strlen("--hazard=")) == 0)
+    {
+        for (int policy = 0; policy < NUM_HAZARD_POLICIES; policy++)
         {
-            if(arguments[3])
+            if (strcmp(option + strlen("--hazard="), hazard_names[policy]) == 0)
             {
-                command = COMMAND_DISPLAY;
-                cycle_count = atoi(arguments[3]);
-                ret_val = TRUE;
+                config->hazard_policy = policy;
+                return TRUE;
             }
         }
-        else if (strcmp(arguments[2], "single_step") == 0)
+        printf("Hazard policy must be stall, forward or perfect - %s\n", option);
+        return FALSE;
+    }
+    if (strncmp(option, "--latch-overhead=", strlen("--latch-overhead=")) == 0)
+    {
+        value = atoi(option + strlen("--latch-overhead="));
+        if (value < 0)
         {
-            command = COMMAND_SINGLE_STEP;
-            ret_val = TRUE;
+            printf("Latch overhead can not be negative - %s\n", option);
+            return FALSE;
         }
-        else if (strcmp(arguments[2], "show_mem") == 0)
+        config->latch_overhead = value;
+        return TRUE;
+    }
+    if (strncmp(option, "--memory-size=", strlen("--memory-size=")) == 0)
+    {
+        if (!parse_number(option + strlen("--memory-size="), &number)
+            || number == 0 || number > MEM_ADDRESS_SPACE)
         {
-            if(arguments[3])
-            {
-                command = COMMAND_SHOW_MEMORY;
-                cycle_count = atoi(arguments[3]);
-                ret_val = TRUE;
-            }
+            printf("Memory size must be between 1 and %llu words - %s\n", MEM_ADDRESS_SPACE, option);
+            return FALSE;
         }
-        else 
+        config->memory_size = number;
+        return TRUE;
+    }
+    if (strncmp(option, "--dense-memory=", strlen("--dense-memory=")) == 0)
+    {
+        char text[64];
+        char *words;
+
+        /* --dense-memory=<base>:<words> */
+        strncpy(text, option + strlen("--dense-memory="), sizeof(text) - 1);
+        text[sizeof(text) - 1] = '\0';
+        words = strchr(text, ':');
+        if (!words)
         {
-            printf("Command not found exiting - %s\n", arguments[1]);
+            printf("Dense memory region must be given as <base>:<words> - %s\n", option);
+            return FALSE;
+        }
+        *words++ = '\0';
+        if (!parse_number(text, &number) || number >= MEM_ADDRESS_SPACE)
+        {
+            printf("Dense memory base out of range - %s\n", option);
+            return FALSE;
+        }
+        config->dense_base = (unsigned int)number;
+        if (!parse_number(words, &number) || number == 0
+            || config->dense_base + number > MEM_ADDRESS_SPACE)
+        {
+            printf("Dense memory size out of range - %s\n", option);
+            return FALSE;
         }
+        config->dense_words = number;
+        return TRUE;
     }
+    if (strncmp(option, "--load-data=", strlen("--load-data=")) == 0)
+    {
+        char text[64];
+        char *path = strchr(option, ':');
 
-    return ret_val;
-}
-
-/* Converts the PC(4000 series) into array index for code memory
- *
- * Note: You are not supposed to edit this function
- */
-static int
-get_code_memory_index_from_pc(const int pc)
-{
-    return (pc - 4000) / 4;
-}
-// Print opcode string, source regiters, destination register and literal value for all input instruction
-static void
-print_instruction(const CPU_Stage *stage)
-{
-    switch (stage->opcode)
+        /* --load-data=<base>:<file> */
+        if (!path || path - option - strlen("--load-data=") >= sizeof(text) || !path[1])
+        {
+            printf("Data image must be given as <base>:<file> - %s\n", option);
+            return FALSE;
+        }
+        if (config->num_images == MAX_DATA_IMAGES)
+        {
+            printf("At most %d data images can be loaded - %s\n", MAX_DATA_IMAGES, option);
+            return FALSE;
+        }
+        memcpy(text, option + strlen("--load-data="), path - option - strlen("--load-data="));
+        text[path - option - strlen("--load-data=")] = '\0';
+        if (!parse_number(text, &number) || number >= MEM_ADDRESS_SPACE)
+        {
+            printf("Data image base out of range - %s\n", option);
+            return FALSE;
+        }
+        config->images[config->num_images].base = (unsigned int)number;
+        config->images[config->num_images].path = path + 1;
+        config->num_images++;
+        return TRUE;
+    }
+    if (strncmp(option, "--dump-memory=", strlen("--dump-memory=")) == 0)
     {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
+        char text[64];
+        char *words;
+        char *path;
+        APEX_Memory_Dump *dump = &config->dumps[config->num_dumps];
+
+        /* --dump-memory=<base>:<words>:<file> */
+        strncpy(text, option + strlen("--dump-memory="), sizeof(text) - 1);
+        text[sizeof(text) - 1] = '\0';
+        words = strchr(text, ':');
+        path = words ? strchr(words + 1, ':') : NULL;
+        if (!path || !path[1])
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->rs2);
-            break;
+            printf("Memory dump must be given as <base>:<words>:<file> - %s\n", option);
+            return FALSE;
         }
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_LDI:
-        case OPCODE_LOAD:
+        if (config->num_dumps == MAX_MEMORY_DUMPS)
         {
-           printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
-            break; 
+            printf("At most %d memory dumps can be written - %s\n", MAX_MEMORY_DUMPS, option);
+            return FALSE;
         }
-         case OPCODE_STORE:
+        *words++ = '\0';
+        *path = '\0';
+        if (!parse_number(text, &number) || number >= MEM_ADDRESS_SPACE)
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-                   stage->imm);
-            break;
+            printf("Memory dump base out of range - %s\n", option);
+            return FALSE;
         }
-        case OPCODE_STI:
+        dump->base = (unsigned int)number;
+        if (!parse_number(words, &number) || number == 0
+            || dump->base + number > MEM_ADDRESS_SPACE)
         {
-           printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-                   stage->imm);
-            break; 
+            printf("Memory dump size out of range - %s\n", option);
+            return FALSE;
         }
-        case OPCODE_MOVC:
-        case OPCODE_JUMP:
+        dump->words = number;
+        /* The file name is kept from the original argument, not the copy */
+        dump->path = option + strlen("--dump-memory=") + (path - text) + 1;
+        config->num_dumps++;
+        return TRUE;
+    }
+    if (strncmp(option, "--dump-diff=", strlen("--dump-diff=")) == 0)
+    {
+        config->diff_path = option + strlen("--dump-diff=");
+        if (!config->diff_path[0])
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
-            break;
+            printf("Memory diff needs a file name or - for stdout - %s\n", option);
+            return FALSE;
         }
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
+        return TRUE;
+    }
+    if (strncmp(option, "--cores=", strlen("--cores=")) == 0)
+    {
+        value = atoi(option + strlen("--cores="));
+        if (value < 1 || value > MAX_CORES)
         {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
-            break;
+            printf("Number of cores must be between 1 and %d - %s\n", MAX_CORES, option);
+            return FALSE;
         }
-        case OPCODE_HALT:
-        case OPCODE_NOP:
+        config->num_cores = value;
+        return TRUE;
+    }
+    if (strncmp(option, "--quantum=", strlen("--quantum=")) == 0)
+    {
+        value = atoi(option + strlen("--quantum="));
+        if (value < 0)
         {
-            printf("%s", stage->opcode_str);
-            break;
+            printf("Quantum can not be negative - %s\n", option);
+            return FALSE;
         }
-        case OPCODE_CMP:
+        config->quantum = value;
+        return TRUE;
+    }
+    if (strncmp(option, "--threads=", strlen("--threads=")) == 0)
+    {
+        value = atoi(option + strlen("--threads="));
+        if (value < 1 || value > MAX_CORES)
         {
-            printf("%s,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2);
-            break;
+            printf("Number of threads must be between 1 and %d - %s\n", MAX_CORES, option);
+            return FALSE;
         }
+        config->threads = value;
+        return TRUE;
     }
-}
-
-/* This function will prints the CPU stage content
- *
- * Note: You can edit this function to print in more detail
- */
-static void
-print_stage_content(const APEX_CPU *cpu)
-{
-    for(int cnt = 0; cnt < 5; cnt++)
+    if (strncmp(option, "--output=", strlen("--output=")) == 0)
     {
-        char *stage_name;
-        switch (cnt)
+        value = APEX_output_format(option + strlen("--output="));
+        if (value < 0)
         {
-        case FETCH_STAGE:
-            stage_name = "FETCH_____STAGE";
-            break;
-
-        case DECODE_STAGE:
-            stage_name = "DECODE_RF_STAGE";
-            break;
-
-        case EXECUTE_STAGE:
-            stage_name = "EX________STAGE";
-            break;
-
-        case MEMORY_STAGE:
-            stage_name = "MEMORY____STAGE";
-            break;
-
-        case WRITE_BACK_STAGE:
-            stage_name = "WRITEBACK_STAGE";
-            break;
-        default:
-            break;
+            printf("Output format must be text, json or csv - %s\n", option);
+            return FALSE;
         }
-        if(pipeline_logs[cnt].has_insn)
+        config->output_format = value;
+        return TRUE;
+    }
+    if (strncmp(option, "--output-file=", strlen("--output-file=")) == 0)
+    {
+        config->output_path = option + strlen("--output-file=");
+        if (!config->output_path[0])
         {
-            int I = (pipeline_logs[cnt].pc - 4000) / 4;
-
-            printf("%d. Instruction at %s ---->        ", cnt+1, stage_name);
-
-            printf("(I%d: %d) ", I, pipeline_logs[cnt].pc);
-
-            print_instruction(&pipeline_logs[cnt]);
-
-            pipeline_logs[cnt].has_insn = 0;
+            printf("Output file needs a file name - %s\n", option);
+            return FALSE;
         }
-        else
+        return TRUE;
+    }
+    if (strncmp(option, "--snapshot-interval=", strlen("--snapshot-interval=")) == 0)
+    {
+        value = atoi(option + strlen("--snapshot-interval="));
+        if (value < 1)
         {
-            printf("%d. Instruction at %s --->         EMPTY", cnt+1, stage_name);
+            printf("Snapshot interval must be at least one cycle - %s\n", option);
+            return FALSE;
         }
-        printf("\n");
+        config->snapshot_interval = value;
+        return TRUE;
     }
-}
-
-/* This function will print the register files
- *
- * Note: You are not supposed to edit this function
- */
-static void
-show_register_files(const APEX_CPU *cpu)
-{
-    printf("\n=============================== STATE OF ARCHITECTURAL REGISTER FILE =============================\n\n");
-    
-    for(int cnt = 0; cnt < REG_FILE_SIZE; cnt++)
+    if (strncmp(option, "--max-snapshots=", strlen("--max-snapshots=")) == 0)
     {
-        if(cpu->state[cnt])
+        value = atoi(option + strlen("--max-snapshots="));
+        if (value < 3)
         {
-            printf("|           REG[%04d]           |           Value = %4d|            Status = INVALID      |\n", cnt, cpu->regs[cnt]);
+            printf("At least three snapshots must be kept - %s\n", option);
+            return FALSE;
         }
-        else
+        config->max_snapshots = value;
+        return TRUE;
+    }
+    if (strncmp(option, "--fast-forward=", strlen("--fast-forward=")) == 0)
+    {
+        if (!parse_number(option + strlen("--fast-forward="), &number))
         {
-            printf("|           REG[%04d]           |           Value = %4d|            Status = VALID        |\n", cnt, cpu->regs[cnt]);
+            printf("Fast-forward needs an instruction count - %s\n", option);
+            return FALSE;
         }
+        config->fast_forward = number;
+        return TRUE;
     }
-}
-
-
-/*
- * Note: You can edit this function to print in more detail
- */ 
- /* This function will the pipeline data for each command
- */
-static void 
-print_pipeline_logs(const APEX_CPU *cpu)
-{
-    switch (command)
+    if (strncmp(option, "--warm=", strlen("--warm=")) == 0)
     {
-        case COMMAND_SIMULATE:
-            {
-                show_register_files(cpu);
-                show_memory(cpu);
-                if(cpu->clock >= cycle_count)
-                {
-                    printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                    exit(1);
-                }
-            }
-            break;
-        case COMMAND_DISPLAY:
-            {
-                if(cpu->clock >= cycle_count)
-                {
-                    show_register_files(cpu);
-                    show_memory(cpu);
-                    printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                    exit(1);
-                }
-                else
-                {
-                    printf("\n............................. CLOCK CYCLE %d ..............................\n\n", cpu->clock+1);
-                    print_stage_content(cpu);
-                }
-            }
-            break;
-    
-        case COMMAND_SINGLE_STEP:
-            {
-                printf("\n.......................... CLOCK CYCLE %d ...........................\n\n", cpu->clock+1);
-                print_stage_content(cpu);
-            }
-            break;
-    
-        default:
-            break;
+        if (strcmp(option + strlen("--warm="), "all") == 0)
+        {
+            config->warm = ULLONG_MAX;
+            return TRUE;
+        }
+        if (!parse_number(option + strlen("--warm="), &number) || !number)
+        {
+            printf("Warming needs an instruction count or all - %s\n", option);
+            return FALSE;
+        }
+        config->warm = number;
+        return TRUE;
     }
-}
-
-/*
- * Fetch Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
- */
-static void
-APEX_fetch(APEX_CPU *cpu)
-{
-    APEX_Instruction *current_ins;
-    if(cpu->halt != cpu->halted)
+    if (strncmp(option, "--jit=", strlen("--jit=")) == 0)
     {
-        if(cpu->halt)
+        if (strcmp(option + strlen("--jit="), "on") == 0)
         {
-            /* Store current PC in fetch latch */
-            cpu->fetch.pc = cpu->pc;
-
-            /* Index into code memory using this pc and copy all instruction fields
-            * into fetch latch  */
-            current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-            strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-            cpu->fetch.opcode = current_ins->opcode;
-            cpu->fetch.rd = current_ins->rd;
-            cpu->fetch.rs1 = current_ins->rs1;
-            cpu->fetch.rs2 = current_ins->rs2;
-            cpu->fetch.imm = current_ins->imm;
-
-            /* Update PC for next instruction */
-            cpu->pc += 4;
-
-            pipeline_logs[FETCH_STAGE] = cpu->fetch;
-            
-            /* Stop fetching new instructions if HALT is fetched */
-            if (cpu->fetch.opcode == OPCODE_HALT)
-            {
-                cpu->halt_instruction_received = TRUE;
-            } 
+            config->jit = TRUE;
+            return TRUE;
         }
-        else
+        if (strcmp(option + strlen("--jit="), "off") == 0)
         {
-            cpu->decode = cpu->fetch;
-            pipeline_logs[FETCH_STAGE] = cpu->fetch;
-            if(cpu->halt_instruction_received)
-            {
-                cpu->halt_instruction_received = FALSE;
-                cpu->fetch.has_insn = FALSE;
-                return;
-            }        
+            config->jit = FALSE;
+            return TRUE;
         }
+        printf("JIT must be on or off - %s\n", option);
+        return FALSE;
     }
-    else if(!cpu->halt)
+    if (strncmp(option, "--batch-limit=", strlen("--batch-limit=")) == 0)
     {
-        if (cpu->fetch.has_insn)
+        if (!parse_number(option + strlen("--batch-limit="), &number))
         {
-            /* This fetches new branch target instruction from next cycle */
-            if (cpu->fetch_from_next_cycle == TRUE)
-            {
-                cpu->fetch_from_next_cycle = FALSE;
-                /* Skip this cycle*/
-                return;
-            }
-
-            /* Store current PC in fetch latch */
-            cpu->fetch.pc = cpu->pc;
-
-            /* Index into code memory using this pc and copy all instruction fields
-             * into fetch latch  */
-            current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-            strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-            cpu->fetch.opcode = current_ins->opcode;
-            cpu->fetch.rd = current_ins->rd;
-            cpu->fetch.rs1 = current_ins->rs1;
-            cpu->fetch.rs2 = current_ins->rs2;
-            cpu->fetch.imm = current_ins->imm;
-
-            /* Update PC for next instruction */
-            cpu->pc += 4;
-
-            /* Copy data from fetch latch to decode latch*/
-            cpu->decode = cpu->fetch;
-
-            /* Copy data from fetch latch to debug fetch latch*/
-            pipeline_logs[FETCH_STAGE] = cpu->fetch;
-
-            /* Stop fetching new instructions if HALT is fetched */
-            if (cpu->fetch.opcode == OPCODE_HALT)
-            {
-                cpu->fetch.has_insn = FALSE;
-            }
-        }   
+            printf("Batch limit needs an instruction count - %s\n", option);
+            return FALSE;
+        }
+        config->batch_limit = number;
+        return TRUE;
     }
-    else
+    if (strncmp(option, "--simpoint-max=", strlen("--simpoint-max=")) == 0)
     {
-        pipeline_logs[FETCH_STAGE] = cpu->fetch;
+        value = atoi(option + strlen("--simpoint-max="));
+        if (value < 1 || value > SIMPOINT_MAX_CLUSTERS)
+        {
+            printf("Simulation points must be between 1 and %d - %s\n", SIMPOINT_MAX_CLUSTERS,
+                   option);
+            return FALSE;
+        }
+        config->simpoint_max = value;
+        return TRUE;
     }
-    cpu->halted = cpu->halt;
-}
-
-
-/*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
- */
-static void
-APEX_decode(APEX_CPU *cpu)
-{
-    if (cpu->decode.has_insn)
-    {
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode.opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {   
-                
-                if (cpu->decode.rs1==cpu->exe_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->execute.dataforwarding_exe_buffer;
-                    cpu->halt=0;   
-                }
-                else if (cpu->decode.rs1==cpu->mem_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->memory.dataforwarding_mem_buffer;
-                    cpu->halt=0;
-                }
-                else if (cpu->state[cpu->decode.rs1])
-                {
-                    cpu->halt=1;
-                }
-                else
-                {
-                   cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                   cpu->halt=0;
-                }
-            if (!(cpu->halt))
-            {
-                 if (cpu->decode.rs2==cpu->exe_dest_reg) 
-                {
-                    cpu->decode.rs2_value = cpu->execute.dataforwarding_exe_buffer;
-                    cpu->halt=0;   
-                }
-                else if (cpu->decode.rs2==cpu->mem_dest_reg)
-                {
-                    cpu->decode.rs2_value = cpu->memory.dataforwarding_mem_buffer;
-                    cpu->halt=0;
-                }
-                else if(cpu->state[cpu->decode.rs2])
-                {
-                    cpu->halt=1;
-                }
-                else
-                {
-                   cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                   cpu->halt=0;
-                }
-            }
-             
-            if (!(cpu->halt))
-            {
-                if ((cpu->decode.rs1==cpu->decode.rd)||(cpu->decode.rs2==cpu->decode.rd))
-                {
-                    cpu->halt=0;
-                }
-                else if (cpu->state[cpu->decode.rd])
-                {
-                    cpu->halt=1;
-                }
-                else
-                {
-                    cpu->state[cpu->decode.rd] = 1;
-                    cpu->halt=0;
-                }
-            }
-            
-                break;
-                    
-              
-            }
-            case OPCODE_CMP:
-            {
-                if (cpu->decode.rs1==cpu->exe_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->execute.dataforwarding_exe_buffer;
-                    cpu->halt=0;   
-                }
-                else if (cpu->decode.rs1==cpu->mem_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->memory.dataforwarding_mem_buffer;
-                    cpu->halt=0;
-                }
-                else if (cpu->state[cpu->decode.rs1])
-                {
-                    cpu->halt=1;
-                }
-                else
-                {
-                   cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                   cpu->halt=0;
-                }
-                if (!(cpu->halt))
-                {
-                    if (cpu->decode.rs2==cpu->exe_dest_reg)
-                    {
-                        cpu->decode.rs2_value = cpu->execute.dataforwarding_exe_buffer;
-                        cpu->halt=0;   
-                    }
-                    else if (cpu->decode.rs2==cpu->mem_dest_reg)
-                    {
-                        cpu->decode.rs2_value = cpu->memory.result_buffer;
-                        cpu->halt=0;
-                    }
-                    else if(cpu->state[cpu->decode.rs2])
-                    {
-                        cpu->halt=1;
-                    }
-                    else
-                    {
-                        cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                        cpu->halt=0;
-                    }
-                }
-                break;
-            }
-            case OPCODE_STI:
-            {   if (cpu->decode.rs1==cpu->exe_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->execute.dataforwarding_exe_buffer;
-                    cpu->halt=0;   
-                }
-                else if (cpu->decode.rs1==cpu->mem_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->memory.dataforwarding_mem_buffer;
-                    cpu->halt=0;
-                }
-                else if (cpu->state[cpu->decode.rs1])
-                {
-                    cpu->halt=1;
-                }
-                else
-                {
-                   cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                   cpu->halt=0;
-                }
-                if (!(cpu->halt))
-                {
-                    if (cpu->decode.rs2==cpu->exe_dest_reg)
-                    {
-                        cpu->decode.rs2_value = cpu->execute.dataforwarding_exe_buffer;
-                        cpu->halt=0;   
-                    }
-                    else if (cpu->decode.rs2==cpu->mem_dest_reg)
-                    {
-                        cpu->decode.rs2_value = cpu->memory.dataforwarding_mem_buffer;
-                        cpu->halt=0;
-                    }
-                    else if(cpu->state[cpu->decode.rs2])
-                    {
-                        cpu->halt=1;
-                    }
-                    else
-                    {
-                        cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                        cpu->halt=0;
-                    }
+    if (strncmp(option, "--simpoint-limit=", strlen("--simpoint-limit=")) == 0)
+    {
+        if (!parse_number(option + strlen("--simpoint-limit="), &number))
+        {
+            printf("Simpoint limit needs an instruction count - %s\n", option);
+            return FALSE;
+        }
+        config->simpoint_limit = number;
+        return TRUE;
+    }
+    if (strncmp(option, "--bbv-file=", strlen("--bbv-file=")) == 0)
+    {
+        config->bbv_path = option + strlen("--bbv-file=");
+        if (!config->bbv_path[0])
+        {
+            printf("Basic block vectors need a file name - %s\n", option);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    if (strncmp(option, "--interval=", strlen("--interval=")) == 0)
+    {
+        value = atoi(option + strlen("--interval="));
+        if (value < 1)
+        {
+            printf("Interval must be at least one cycle - %s\n", option);
+            return FALSE;
+        }
+        config->interval = value;
+        return TRUE;
+    }
+    if (strncmp(option, "--interval-file=", strlen("--interval-file=")) == 0)
+    {
+        config->interval_path = option + strlen("--interval-file=");
+        if (!config->interval_path[0])
+        {
+            printf("Interval file needs a file name - %s\n", option);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    if (strcmp(option, "--reuse") == 0)
+    {
+        config->reuse = TRUE;
+        return TRUE;
+    }
+    if (strncmp(option, "--reuse-window=", strlen("--reuse-window=")) == 0)
+    {
+        value = atoi(option + strlen("--reuse-window="));
+        if (value < 1)
+        {
+            printf("Reuse window must be at least one access - %s\n", option);
+            return FALSE;
+        }
+        config->reuse_window = value;
+        return TRUE;
+    }
+    if (strncmp(option, "--reuse-file=", strlen("--reuse-file=")) == 0)
+    {
+        config->reuse_path = option + strlen("--reuse-file=");
+        if (!config->reuse_path[0])
+        {
+            printf("Reuse file needs a file name - %s\n", option);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    if (strncmp(option, "--record-file=", strlen("--record-file=")) == 0)
+    {
+        config->record_path = option + strlen("--record-file=");
+        if (!config->record_path[0])
+        {
+            printf("Record file needs a file name - %s\n", option);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    if (strncmp(option, "--variant=", strlen("--variant=")) == 0)
+    {
+        if (config->num_variants == MAX_VARIANTS)
+        {
+            printf("At most %d variants can be forked - %s\n", MAX_VARIANTS, option);
+            return FALSE;
+        }
+        config->variants[config->num_variants++] = option + strlen("--variant=");
+        return TRUE;
+    }
+    if (strncmp(option, "--result-cache=", strlen("--result-cache=")) == 0)
+    {
+        config->result_dir = option + strlen("--result-cache=");
+        if (!config->result_dir[0])
+        {
+            printf("Result cache needs a directory - %s\n", option);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    if (strncmp(option, "--trace=", strlen("--trace=")) == 0)
+    {
+        config->trace_path = option + strlen("--trace=");
+        if (!config->trace_path[0])
+        {
+            printf("Trace needs a file name - %s\n", option);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    if (strcmp(option, "--check") == 0)
+    {
+        config->check = TRUE;
+        return TRUE;
+    }
+    if (strcmp(option, "--profile") == 0)
+    {
+        config->profile = TRUE;
+        return TRUE;
+    }
+    if (strncmp(option, "--retire-ring=", strlen("--retire-ring=")) == 0)
+    {
+        value = atoi(option + strlen("--retire-ring="));
+        if (value < 1)
+        {
+            printf("Retire ring needs at least one slot - %s\n", option);
+            return FALSE;
+        }
+        config->retire_slots = value;
+        return TRUE;
+    }
+    if (strncmp(option, "--l1=", strlen("--l1=")) == 0)
+    {
+        int sets, ways, words;
 
-                    cpu->state[cpu->decode.rs2] = 1;
+        /* --l1=<sets>:<ways>:<words per line> */
+        if (sscanf(option + strlen("--l1="), "%d:%d:%d", &sets, &ways, &words) != 3
+            || sets < 1 || (sets & (sets - 1)) || ways < 1 || ways > L1_MAX_WAYS
+            || words < 1 || (words & (words - 1)))
+        {
+            printf("L1 must be given as <sets>:<ways>:<words>, sets and words a power of two, at most %d ways - %s\n",
+                   L1_MAX_WAYS, option);
+            return FALSE;
+        }
+        config->l1.sets = sets;
+        config->l1.ways = ways;
+        config->l1.line_words = words;
+        return TRUE;
+    }
+    if (strncmp(option, "--coherence=", strlen("--coherence=")) == 0)
+    {
+        if (strcmp(option + strlen("--coherence="), "msi") == 0)
+        {
+            config->l1.protocol = COHERENCE_MSI;
+            return TRUE;
+        }
+        if (strcmp(option + strlen("--coherence="), "mesi") == 0)
+        {
+            config->l1.protocol = COHERENCE_MESI;
+            return TRUE;
+        }
+        printf("Coherence protocol must be msi or mesi - %s\n", option);
+        return FALSE;
+    }
+    if (strncmp(option, "--memory-latency=", strlen("--memory-latency=")) == 0
+        || strncmp(option, "--bus-latency=", strlen("--bus-latency=")) == 0)
+    {
+        value = atoi(strchr(option, '=') + 1);
+        if (value < 0)
+        {
+            printf("Latency can not be negative - %s\n", option);
+            return FALSE;
+        }
+        if (option[2] == 'm')
+        {
+            config->l1.memory_latency = value;
+        }
+        else
+        {
+            config->l1.bus_latency = value;
+        }
+        return TRUE;
+    }
 
-                }
+    printf("Option not found exiting - %s\n", option);
+    return FALSE;
+}
 
-                break;
-            }
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_LOAD:
-            {   
-                if (cpu->decode.rs1==cpu->decode.rd)
-                {
-                    cpu->halt=0;
-                }
-                else if (cpu->state[cpu->decode.rd])
-                {
-                    cpu->halt=1;
-                }
-                else
-                {
-                    cpu->state[cpu->decode.rd] = 1;
-                    cpu->halt=0;
-                }
-                if (!(cpu->halt))
-                {
-                    if (cpu->decode.rs1==cpu->exe_dest_reg)
-                    {
-                        cpu->decode.rs1_value = cpu->execute.dataforwarding_exe_buffer;
-                        cpu->halt=0;   
-                    }
-                    else if (cpu->decode.rs1==cpu->mem_dest_reg)
-                    {
-                        cpu->decode.rs1_value = cpu->memory.dataforwarding_mem_buffer;
-                        cpu->halt=0;
-                    }
-                    else if (cpu->state[cpu->decode.rs1])
-                    {
-                        cpu->halt=1;
-                    }
-                    else
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                        cpu->halt=0;
-                    }
-                }
-                break;
-            }
+/*
+ * Applies the options of a fork variant, separated by spaces, to a copy of
+ * the base configuration. Only options of the timing model are accepted,
+ * everything the shared prefix depends on stays as it is.
+ */
+static int
+map_variant(const APEX_Config *base, const char *options, APEX_Config *variant)
+{
+    static const char *timing_options[] = {
+        "--fetch-stages=", "--decode-stages=", "--execute-stages=", "--memory-stages=",
+        "--hazard=", "--latch-overhead=", "--l1=", "--coherence=", "--memory-latency=",
+        "--bus-latency=", "--quantum=", "--threads="
+    };
+    char *copy = strdup(options);
+    char *option;
+    int ok = copy != NULL;
+
+    *variant = *base;
+    for (option = copy ? strtok(copy, " ") : NULL; ok && option; option = strtok(NULL, " "))
+    {
+        size_t i = 0;
 
-            case OPCODE_LDI:
-            {
-                if (cpu->decode.rs1==cpu->exe_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->execute.dataforwarding_exe_buffer;
-                    cpu->halt=0;   
-                }
-                else if (cpu->decode.rs1==cpu->mem_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->memory.dataforwarding_mem_buffer;
-                    cpu->halt=0;
-                }
-                else if (cpu->state[cpu->decode.rs1])
-                {
-                    cpu->halt=1;
-                }
-                else
-                {
-                   cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                   cpu->halt=0;
-                }
+        while (i < sizeof(timing_options) / sizeof(timing_options[0])
+               && strncmp(option, timing_options[i], strlen(timing_options[i])) != 0)
+        {
+            i++;
+        }
+        if (i == sizeof(timing_options) / sizeof(timing_options[0]))
+        {
+            printf("A variant may only change stage depths, hazard policy, latch overhead, L1, coherence, latencies, quantum and threads - %s\n",
+                   option);
+            ok = FALSE;
+        }
+        else
+        {
+            ok = map_pipeline_option(variant, option);
+        }
+    }
+    free(copy);
+    return ok;
+}
 
-                if (!(cpu->halt))
-                {
-                    if(cpu->state[cpu->decode.rd])
-                    {
-                        cpu->halt=1;
-                    }
-                    else
-                    {
-                        cpu->state[cpu->decode.rd] = 1;
-                        cpu->halt=0;
-                    }
-                    cpu->state[cpu->decode.rs1]=1;
-                }
-                break;
+static int 
+map_commands(APEX_CPU *cpu, char const *arguments[])
+{
+    int ret_val = FALSE;
+    char const *positional[5] = {NULL, NULL, NULL, NULL, NULL};
+    int count = 0;
 
+    /* Options may appear anywhere after the input file, positional arguments
+     * after the cycle count are further programs for the compare command */
+    for (int i = 0; arguments[i]; i++)
+    {
+        if (strncmp(arguments[i], "--", 2) == 0)
+        {
+            if (!map_pipeline_option(&cpu->config, arguments[i]))
+            {
+                return FALSE;
             }
-            case OPCODE_STORE:
+        }
+        else if (count < 4)
+        {
+            positional[count++] = arguments[i];
+        }
+        else if (num_compare_programs < MAX_COMPARE_PROGRAMS - 1)
+        {
+            /* Slot 0 is kept for the input file */
+            compare_programs[1 + num_compare_programs++] = arguments[i];
+        }
+    }
+    arguments = positional;
+    compare_programs[0] = arguments[1];
+    num_compare_programs++;
+
+    if(arguments[2])
+    {
+        if (strcmp(arguments[2], "simulate") == 0)
+        {
+            if(arguments[3])
             {
-                if (cpu->decode.rs1==cpu->exe_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->execute.dataforwarding_exe_buffer;
-                    cpu->halt=0;   
-                }
-                else if (cpu->decode.rs1==cpu->mem_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->memory.dataforwarding_mem_buffer;
-                    cpu->halt=0;
-                }
-                else if (cpu->state[cpu->decode.rs1])
-                {
-                    cpu->halt=1;
-                }
-                else
-                {
-                   cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                   cpu->halt=0;
-                }
-                if (!(cpu->halt))
-                {
-                    if (cpu->decode.rs2==cpu->exe_dest_reg)
-                    {
-                        cpu->decode.rs2_value = cpu->execute.result_buffer;
-                        cpu->halt=0;   
-                    }
-                    else if (cpu->decode.rs2==cpu->mem_dest_reg)
-                    {
-                        cpu->decode.rs2_value = cpu->memory.dataforwarding_mem_buffer;
-                        cpu->halt=0;
-                    }
-                    else if(cpu->state[cpu->decode.rs2])
-                    {
-                        cpu->halt=1;
-                    }
-                    else
-                    {
-                        cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                        cpu->halt=0;
-                    }
-                }
-                    break;
+                command = COMMAND_SIMULATE;
+                cycle_count = atoi(arguments[3]);
+                ret_val = TRUE;
             }
-            case OPCODE_MOVC:
+        }
+        else if (strcmp(arguments[2], "display") == 0)
+        {
+            if(arguments[3])
             {
-                /* MOVC doesn't have register operands */
-                
-                if(cpu->state[cpu->decode.rd])
-                {
-                    cpu->halt=1;
-                }
-                else{
-                cpu->state[cpu->decode.rd] = 1;
-                cpu->halt=0;
-                }
-                break;
+                command = COMMAND_DISPLAY;
+                cycle_count = atoi(arguments[3]);
+                ret_val = TRUE;
             }
-            case OPCODE_JUMP:
+        }
+        else if (strcmp(arguments[2], "single_step") == 0)
+        {
+            command = COMMAND_SINGLE_STEP;
+            ret_val = TRUE;
+        }
+        else if (strcmp(arguments[2], "compare") == 0)
+        {
+            if(arguments[3])
             {
-                if (cpu->decode.rs1==cpu->exe_dest_reg)
-                {
-                    cpu->decode.rs1_value = cpu->execute.result_buffer;
-                    cpu->halt=0;   
-                }
-                else if (cpu->decode.rs1==cpu->mem_dest_reg)
+                command = COMMAND_COMPARE;
+                cycle_count = atoi(arguments[3]);
+                ret_val = TRUE;
+            }
+        }
+        else if (strcmp(arguments[2], "debug") == 0)
+        {
+            command = COMMAND_DEBUG;
+            ret_val = TRUE;
+        }
+        else if (strcmp(arguments[2], "batch") == 0)
+        {
+            if(arguments[3])
+            {
+                command = COMMAND_BATCH;
+                cycle_count = atoi(arguments[3]);
+                if (cycle_count < 1 || cycle_count > MAX_INSTANCES)
                 {
-                    cpu->decode.rs2_value = cpu->memory.dataforwarding_mem_buffer;
-                    cpu->halt=0;
+                    printf("A batch runs 1 to %d instances - %s\n", MAX_INSTANCES, arguments[3]);
+                    return FALSE;
                 }
-                else if(cpu->state[cpu->decode.rs1])
+                ret_val = TRUE;
+            }
+        }
+        else if (strcmp(arguments[2], "simpoint") == 0)
+        {
+            if(arguments[3])
+            {
+                command = COMMAND_SIMPOINT;
+                cycle_count = atoi(arguments[3]);
+                if (cycle_count < 1)
                 {
-                    cpu->halt=1;
+                    printf("Simpoint intervals need at least one instruction - %s\n", arguments[3]);
+                    return FALSE;
                 }
-                else
+                ret_val = TRUE;
+            }
+        }
+        else if (strcmp(arguments[2], "fork") == 0)
+        {
+            if(arguments[3])
+            {
+                command = COMMAND_FORK;
+                cycle_count = atoi(arguments[3]);
+                ret_val = TRUE;
+            }
+        }
+        else if (strcmp(arguments[2], "record") == 0)
+        {
+            if(arguments[3])
+            {
+                command = COMMAND_RECORD;
+                cycle_count = atoi(arguments[3]);
+                if (cycle_count < 0)
                 {
-                   cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                   cpu->halt=0;
+                    printf("Record needs an instruction limit, 0 for none - %s\n", arguments[3]);
+                    return FALSE;
                 }
-                break;
+                ret_val = TRUE;
+            }
+        }
+        else if (strcmp(arguments[2], "replay") == 0)
+        {
+            if(arguments[3])
+            {
+                command = COMMAND_REPLAY;
+                cycle_count = atoi(arguments[3]);
+                ret_val = TRUE;
+            }
+        }
+        else if (strcmp(arguments[2], "show_mem") == 0)
+        {
+            if(arguments[3])
+            {
+                command = COMMAND_SHOW_MEMORY;
+                cycle_count = atoi(arguments[3]);
+                ret_val = TRUE;
+            }
+        }
+        else 
+        {
+            printf("Command not found exiting - %s\n", arguments[1]);
+        }
+    }
+
+    return ret_val;
+}
+
+/* Converts the PC(4000 series) into array index for code memory
+ *
+ * Note: You are not supposed to edit this function
+ */
+static int
+get_code_memory_index_from_pc(const int pc)
+{
+    return (pc - 4000) / 4;
+}
+// Format opcode string, source regiters, destination register and literal value for all input instruction
+static void
+format_instruction(const CPU_Stage *stage, char *text, size_t size)
+{
+    APEX_isa_format(stage->opcode, stage->rd, stage->rs1, stage->rs2, stage->imm, text, size);
+}
+
+/* Builds the display name of a pipeline stage, e.g. "EX" for a single
+ * execute stage or "EX_2" for the second of several
+ */
+static void
+get_stage_name(const APEX_CPU *cpu, int stage, char *stage_name)
+{
+    int phase = cpu->phase_of[stage];
+
+    strcpy(stage_name, phase_names[phase]);
+    if (cpu->config.depth[phase] > 1)
+    {
+        sprintf(stage_name + strlen(stage_name), "_%d",
+                stage - cpu->first_of[phase] + 1);
+    }
+}
+
+/* This function will prints the CPU stage content
+ *
+ * Note: You can edit this function to print in more detail
+ */
+static void
+print_stage_content(APEX_Output *out, APEX_CPU *cpu)
+{
+    APEX_Stage_View views[MAX_PIPELINE_STAGES];
+    char stage_names[MAX_PIPELINE_STAGES][32];
+    char insns[MAX_PIPELINE_STAGES][64];
+
+    for(int cnt = 0; cnt < cpu->num_stages; cnt++)
+    {
+        get_stage_name(cpu, cnt, stage_names[cnt]);
+        views[cnt].name = stage_names[cnt];
+        views[cnt].pc = 0;
+        views[cnt].insn = NULL;
+        if(cpu->pipeline_logs[cnt].has_insn)
+        {
+            insns[cnt][0] = '\0';
+            format_instruction(&cpu->pipeline_logs[cnt], insns[cnt], sizeof(insns[cnt]));
+            views[cnt].pc = cpu->pipeline_logs[cnt].pc;
+            views[cnt].insn = insns[cnt];
+
+            cpu->pipeline_logs[cnt].has_insn = 0;
+        }
+    }
+    APEX_output_pipeline(out, cpu->core_id, cpu->clock + 1, views, cpu->num_stages);
+}
+
+/* This function will print the register files
+ *
+ * Note: You are not supposed to edit this function
+ */
+static void
+show_register_files(APEX_Output *out, const APEX_CPU *cpu)
+{
+    APEX_output_registers(out, cpu->core_id, cpu->regs, cpu->state, REG_FILE_SIZE);
+}
+
+
+/*
+ * Prints the stage contents and register files of every core, each headed
+ * by its core number when there is more than one.
+ */
+static void
+print_core_stage_content(APEX_CPU *cpu)
+{
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        print_stage_content(cpu->output, cpu->cores[id]);
+    }
+}
+
+static void
+show_core_register_files(const APEX_CPU *cpu)
+{
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        show_register_files(cpu->output, cpu->cores[id]);
+    }
+}
+
+/*
+ * Prints per core progress and, with L1 caches, the hit rates and the
+ * coherence traffic each core caused on the shared bus.
+ */
+static void
+show_multicore_stats(const APEX_CPU *cpu)
+{
+    const APEX_Bus *bus = cpu->bus;
+    char text[512];
+
+    if (cpu->config.num_cores == 1 && !bus)
+    {
+        return;
+    }
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        const APEX_CPU *core = cpu->cores[id];
+        int cycles = core->halted ? core->halt_cycle : core->clock;
+        double cpi = core->insn_completed ? (double)cycles / core->insn_completed : 0.0;
+        APEX_Stat core_stats[] = {
+            {"cycles", cycles}, {"instructions", core->insn_completed},
+            {"cpi", cpi}, {"memory_stall_cycles", core->memory_stall_cycles}
+        };
+
+        snprintf(text, sizeof(text),
+                 "APEX_CPU: Core %d: cycles = %d, instructions = %d, CPI = %.3f, memory stall cycles = %d\n",
+                 id, cycles, core->insn_completed, cpi, core->memory_stall_cycles);
+        APEX_output_stats(cpu->output, "core", id, text, core_stats, 4);
+        if (bus)
+        {
+            const APEX_Cache_Stats *stats = &bus->caches[id].stats;
+            APEX_Stat l1_stats[] = {
+                {"read_hits", stats->read_hits}, {"read_misses", stats->read_misses},
+                {"write_hits", stats->write_hits}, {"write_misses", stats->write_misses},
+                {"upgrades", stats->upgrades}, {"writebacks", stats->writebacks},
+                {"invalidated", stats->invalidated}, {"supplied", stats->supplied}
+            };
+
+            snprintf(text, sizeof(text),
+                     "APEX_CPU: Core %d L1: read hits = %lld, read misses = %lld, write hits = %lld, write misses = %lld, upgrades = %lld, writebacks = %lld, invalidated = %lld, supplied = %lld\n",
+                     id, stats->read_hits, stats->read_misses, stats->write_hits,
+                     stats->write_misses, stats->upgrades, stats->writebacks,
+                     stats->invalidated, stats->supplied);
+            APEX_output_stats(cpu->output, "l1", id, text, l1_stats, 8);
+        }
+    }
+    if (bus)
+    {
+        const char *protocol = bus->config.protocol == COHERENCE_MSI ? "MSI" : "MESI";
+        APEX_Stat bus_stats[] = {
+            {"protocol", 0, protocol}, {"sets", bus->config.sets},
+            {"ways", bus->config.ways}, {"line_words", bus->config.line_words},
+            {"bus_reads", bus->bus_reads}, {"bus_read_exclusive", bus->bus_read_exclusive},
+            {"bus_upgrades", bus->bus_upgrades}, {"transfers", bus->transfers},
+            {"busy_cycles", bus->busy_cycles}, {"wait_cycles", bus->wait_cycles}
+        };
+
+        snprintf(text, sizeof(text),
+                 "APEX_CPU: Bus (%s, L1 %d sets x %d ways x %d words): BusRd = %lld, BusRdX = %lld, BusUpgr = %lld, cache-to-cache = %lld, busy cycles = %lld, wait cycles = %lld\n",
+                 protocol, bus->config.sets, bus->config.ways, bus->config.line_words,
+                 bus->bus_reads, bus->bus_read_exclusive, bus->bus_upgrades,
+                 bus->transfers, bus->busy_cycles, bus->wait_cycles);
+        APEX_output_stats(cpu->output, "bus", -1, text, bus_stats, 10);
+    }
+}
+
+/*
+ * Reports what --fast-forward executed before the pipeline started.
+ */
+static void
+show_fast_forward_stats(const APEX_CPU *cpu)
+{
+    double mips = cpu->fast_forward_seconds > 0
+                  ? cpu->fast_forwarded / cpu->fast_forward_seconds / 1e6 : 0.0;
+    char text[160];
+    APEX_Stat stats[] = {
+        {"instructions", cpu->fast_forwarded},
+        {"jit_blocks", cpu->jit_blocks},
+        {"host_seconds", cpu->fast_forward_seconds},
+        {"mips", mips}
+    };
+
+    if (!cpu->config.fast_forward)
+    {
+        return;
+    }
+    snprintf(text, sizeof(text),
+             "APEX_CPU: Fast-forwarded %lld instructions, %lld blocks translated, %.3f s (%.1f MIPS)\n",
+             cpu->fast_forwarded, cpu->jit_blocks, cpu->fast_forward_seconds, mips);
+    APEX_output_stats(cpu->output, "fast_forward", -1, text, stats, 4);
+
+    if (cpu->config.warm)
+    {
+        APEX_Stat warm_stats[] = {
+            {"instructions", cpu->warmed},
+            {"host_seconds", cpu->warm_seconds},
+            {"mips", cpu->warm_seconds > 0 ? cpu->warmed / cpu->warm_seconds / 1e6 : 0.0}
+        };
+
+        snprintf(text, sizeof(text),
+                 "APEX_CPU: Warmed the L1s over the last %lld of them, %.3f s (%.1f MIPS)\n",
+                 cpu->warmed, cpu->warm_seconds, warm_stats[2].value);
+        APEX_output_stats(cpu->output, "warming", -1, text, warm_stats, 3);
+    }
+}
+
+/*
+ * This function prints the pipeline organisation and the cycle-time model.
+ * The clock period is set by the slowest sub-stage, so splitting a phase
+ * shortens the cycle but lengthens the branch penalty and the stall window.
+ */
+static void
+show_pipeline_stats(const APEX_CPU *cpu)
+{
+    double cpi = cpu->insn_completed ? (double)cpu->clock / cpu->insn_completed : 0.0;
+    double time = (double)cpu->clock * cpu->cycle_time / 1000.0;
+    char text[1024];
+    int length;
+    APEX_Stat stats[] = {
+        {"hazard_policy", 0, hazard_names[cpu->config.hazard_policy]},
+        {"depth", cpu->num_stages},
+        {"fetch_stages", cpu->config.depth[PHASE_FETCH]},
+        {"decode_stages", cpu->config.depth[PHASE_DECODE]},
+        {"execute_stages", cpu->config.depth[PHASE_EXECUTE]},
+        {"memory_stages", cpu->config.depth[PHASE_MEMORY]},
+        {"writeback_stages", cpu->config.depth[PHASE_WRITEBACK]},
+        {"branch_penalty", cpu->last_of[PHASE_EXECUTE]},
+        {"cycle_time_ps", cpu->cycle_time},
+        {"cpi", cpi},
+        {"execution_time_ns", time},
+        {"stall_cycles", cpu->stall_cycles},
+        {"load_use_stalls", cpu->load_use_stalls},
+        {"branch_flushes", cpu->branch_flushes},
+        {"flushed_insns", cpu->flushed_insns},
+        {"bypass_ex", cpu->bypass_count[PHASE_EXECUTE]},
+        {"bypass_mem", cpu->bypass_count[PHASE_MEMORY]},
+        {"bypass_wb", cpu->bypass_count[PHASE_WRITEBACK]}
+    };
+
+    length = snprintf(text, sizeof(text),
+                      "APEX_CPU: Hazard policy = %s, pipeline depth = %d (F%d D%d E%d M%d W%d), branch penalty = %d cycles\n",
+                      hazard_names[cpu->config.hazard_policy], cpu->num_stages,
+                      cpu->config.depth[PHASE_FETCH], cpu->config.depth[PHASE_DECODE],
+                      cpu->config.depth[PHASE_EXECUTE], cpu->config.depth[PHASE_MEMORY],
+                      cpu->config.depth[PHASE_WRITEBACK], cpu->last_of[PHASE_EXECUTE]);
+    length += snprintf(text + length, sizeof(text) - length,
+                       "APEX_CPU: Cycle time = %d ps (%.1f MHz), CPI = %.3f, execution time = %.3f ns\n",
+                       cpu->cycle_time, 1.0e6 / cpu->cycle_time, cpi, time);
+    length += snprintf(text + length, sizeof(text) - length,
+                       "APEX_CPU: Decode stall cycles = %d (load-use = %d), branch flushes = %d, flushed instructions = %d\n",
+                       cpu->stall_cycles, cpu->load_use_stalls, cpu->branch_flushes,
+                       cpu->flushed_insns);
+    snprintf(text + length, sizeof(text) - length,
+             "APEX_CPU: Bypasses EX = %d, MEM = %d, WB = %d\n",
+             cpu->bypass_count[PHASE_EXECUTE], cpu->bypass_count[PHASE_MEMORY],
+             cpu->bypass_count[PHASE_WRITEBACK]);
+    APEX_output_stats(cpu->output, "pipeline", -1, text, stats,
+                      sizeof(stats) / sizeof(stats[0]));
+    show_multicore_stats(cpu);
+    show_fast_forward_stats(cpu);
+}
+
+/*
+ * Reports how the simulation ended: "complete" when it hit the cycle limit,
+ * "stopped" when the user quit single stepping.
+ */
+static void
+show_end_of_run(const APEX_CPU *cpu, const char *record)
+{
+    char text[128];
+    APEX_Stat stats[] = {
+        {"cycles", cpu->clock}, {"instructions", cpu->insn_completed}
+    };
+
+    snprintf(text, sizeof(text), "APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+             strcmp(record, "complete") == 0 ? "Complete" : "Stopped", cpu->clock,
+             cpu->insn_completed);
+    APEX_output_stats(cpu->output, record, -1, text, stats, 2);
+}
+
+/* Prints the data word given to show_mem */
+static void
+show_memory_word(const APEX_CPU *cpu, int address)
+{
+    char text[128];
+    int value = APEX_memory_read(cpu->data_memory, address);
+    APEX_Stat stats[] = {
+        {"address", address}, {"value", value}
+    };
+
+    snprintf(text, sizeof(text), "|         MEM[%04d]         |       Data Value = %d           \n",
+             address, value);
+    APEX_output_stats(cpu->output, "memory_word", -1, text, stats, 2);
+}
+
+/* Writes one changed word of --dump-diff to its file */
+static void
+diff_to_file(unsigned int address, int initial, int final, void *arg)
+{
+    fprintf(arg, "%08x %08x %08x\n", address, (unsigned int)initial, (unsigned int)final);
+}
+
+/* Hands one changed word of --dump-diff=- to the report output */
+static void
+diff_to_output(unsigned int address, int initial, int final, void *arg)
+{
+    char text[64];
+    APEX_Stat stats[] = {
+        {"address", address}, {"initial", initial}, {"final", final}
+    };
+
+    snprintf(text, sizeof(text), "%08x %08x %08x\n", address, (unsigned int)initial,
+             (unsigned int)final);
+    APEX_output_stats(arg, "memory_change", -1, text, stats, 3);
+}
+
+/*
+ * Reports how many data memory words changed since load. When the diff goes
+ * to the report, the text format heads it with a banner.
+ */
+static void
+show_memory_diff(const APEX_CPU *cpu, long long changed, const char *path)
+{
+    char text[256];
+    APEX_Stat stats[] = {
+        {"changed", (double)changed}, {"path", 0, path}
+    };
+
+    snprintf(text, sizeof(text), "%sAPEX_CPU: %lld data memory words changed since load\n",
+             strcmp(path, "-") == 0
+                 ? "\n============================== DATA MEMORY CHANGES ================================\n\n"
+                 : "",
+             changed);
+    APEX_output_stats(cpu->output, "memory_diff", -1, text, stats, 2);
+}
+
+/*
+ * Writes the memory dumps and the diff against the initial data image
+ * requested on the command line. Called once when the simulation ends.
+ */
+static void
+write_memory_dumps(const APEX_CPU *cpu)
+{
+    for (int i = 0; i < cpu->config.num_dumps; i++)
+    {
+        const APEX_Memory_Dump *dump = &cpu->config.dumps[i];
+
+        if (!APEX_memory_dump(cpu->data_memory, dump->base, dump->words, dump->path))
+        {
+            fprintf(stderr, "APEX_Error: Unable to write memory dump %s\n", dump->path);
+        }
+    }
+    if (cpu->config.diff_path)
+    {
+        const char *path = cpu->config.diff_path;
+        FILE *out;
+        long long changed;
+
+        if (strcmp(path, "-") == 0)
+        {
+            /* The words follow the summary as records of the report */
+            changed = APEX_memory_diff(cpu->initial_memory, cpu->data_memory, NULL, NULL);
+            show_memory_diff(cpu, changed, path);
+            APEX_memory_diff(cpu->initial_memory, cpu->data_memory, diff_to_output,
+                             cpu->output);
+            return;
+        }
+
+        out = fopen(path, "w");
+        if (!out)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write memory diff %s\n", path);
+            return;
+        }
+        changed = APEX_memory_diff(cpu->initial_memory, cpu->data_memory, diff_to_file, out);
+        fclose(out);
+        show_memory_diff(cpu, changed, path);
+    }
+}
+
+/*
+ * Reports the cores that stopped on a memory fault or ran past the end of
+ * code memory instead of retiring a HALT. The cores only record these, so
+ * the report goes through the output layer from here, whichever engine ran.
+ */
+static void
+show_faulted_cores(const APEX_CPU *cpu)
+{
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        const APEX_CPU *core = cpu->cores[id];
+        char text[160];
+
+        if (core->memory_fault)
+        {
+            APEX_Stat stats[] = {
+                {"pc", core->fault_pc}, {"address", core->fault_address},
+                {"memory_words", (double)cpu->data_memory->size}
+            };
+
+            snprintf(text, sizeof(text),
+                     "APEX_CPU: Memory fault at PC %d, address %u is outside data memory of %llu words\n",
+                     core->fault_pc, core->fault_address, cpu->data_memory->size);
+            APEX_output_stats(cpu->output, "fault", id, text, stats, 3);
+        }
+        if (core->ran_off_code)
+        {
+            APEX_Stat stats[] = {
+                {"pc", core->pc}, {"cycles", core->halt_cycle}
+            };
+
+            snprintf(text, sizeof(text),
+                     "APEX_CPU: Core %d ran past the end of code memory at PC %d, ended without HALT\n",
+                     id, core->pc);
+            APEX_output_stats(cpu->output, "no_halt", id, text, stats, 2);
+        }
+    }
+}
+
+/*
+ * Ends a run once its report is printed: reports cores that faulted or ended
+ * without HALT, waits for the retire stream consumers to finish their own reports
+ * and writes the interval statistics and the memory dumps.
+ */
+static void
+finish_run(APEX_CPU *cpu)
+{
+    show_faulted_cores(cpu);
+    APEX_trace_detach(cpu);
+    APEX_reuse_write(cpu);
+    APEX_interval_write(cpu);
+    write_memory_dumps(cpu);
+}
+
+/*
+ * Note: You can edit this function to print in more detail
+ */ 
+ /* This function will the pipeline data for each command
+ */
+static void 
+print_pipeline_logs(APEX_CPU *cpu)
+{
+    switch (command)
+    {
+        case COMMAND_SIMULATE:
+            {
+                show_core_register_files(cpu);
+                show_memory(cpu);
+                if(cpu->clock >= cycle_count)
+                {
+                    show_end_of_run(cpu, "complete");
+                    show_pipeline_stats(cpu);
+                    finish_run(cpu);
+                    exit(1);
+                }
+            }
+            break;
+        case COMMAND_DISPLAY:
+            {
+                if(cpu->clock >= cycle_count)
+                {
+                    show_core_register_files(cpu);
+                    show_memory(cpu);
+                    show_end_of_run(cpu, "complete");
+                    show_pipeline_stats(cpu);
+                    finish_run(cpu);
+                    exit(1);
+                }
+                else
+                {
+                    print_core_stage_content(cpu);
+                }
+            }
+            break;
+    
+        case COMMAND_SINGLE_STEP:
+            {
+                print_core_stage_content(cpu);
+            }
+            break;
+    
+        default:
+            break;
+    }
+}
+
+/*
+ * Lists the architectural registers an instruction writes. LDI and STI also
+ * write back their incremented address register. Returns the count.
+ */
+static int
+get_dest_regs(const CPU_Stage *stage, int dest[2])
+{
+    int count = 0;
+
+    if (APEX_ISA_USES(stage->opcode, OPND_RD))
+    {
+        dest[count++] = stage->rd;
+    }
+    if (apex_isa[stage->opcode].effects & EFFECT_INCREMENT)
+    {
+        dest[count++] = APEX_ISA_BASE(stage->opcode, stage->rs1, stage->rs2);
+    }
+    return count;
+}
+
+/*
+ * Reads a data word as this core sees it. In the quantum engine its own
+ * stores of the current quantum are not in data memory yet.
+ */
+static int
+read_data(const APEX_CPU *cpu, unsigned int address)
+{
+    int value;
+
+    if (cpu->buffer_stores && APEX_store_log_lookup(&cpu->store_log, address, &value))
+    {
+        return value;
+    }
+    return APEX_memory_read(cpu->data_memory, address);
+}
+
+static void
+write_data(APEX_CPU *cpu, unsigned int address, int value)
+{
+    if (cpu->debug)
+    {
+        int old_value = APEX_memory_read(cpu->data_memory, address);
+
+        APEX_memory_write(cpu->data_memory, address, value);
+        APEX_debug_store(cpu->debug, cpu, address, old_value, value);
+    }
+    else if (!cpu->buffer_stores)
+    {
+        APEX_memory_write(cpu->data_memory, address, value);
+    }
+    else if (!APEX_store_log_append(&cpu->store_log, cpu->clock, address, value))
+    {
+        fprintf(stderr, "APEX_Error: Out of memory for buffered stores\n");
+        exit(1);
+    }
+}
+
+/*
+ * An instruction has produced the results of a phase once it has left that
+ * phase's working sub-stage, or is sitting in it with its work done.
+ */
+static int
+phase_completed(const APEX_CPU *cpu, int stage, int phase)
+{
+    return stage > cpu->last_of[phase]
+           || (stage == cpu->last_of[phase] && cpu->stage[stage].done);
+}
+
+/*
+ * Squashes every instruction younger than the given stage, used when a branch
+ * resolves taken. Fetch is re-enabled since a HALT on the wrong path may have
+ * switched it off.
+ */
+static void
+APEX_flush_pipeline(APEX_CPU *cpu, int stage)
+{
+    for (int i = 0; i < stage; i++)
+    {
+        if (cpu->stage[i].has_insn)
+        {
+            if (phase_completed(cpu, i, PHASE_DECODE))
+            {
+                int dest[2];
+                int num_dest = get_dest_regs(&cpu->stage[i], dest);
+
+                for (int j = 0; j < num_dest; j++)
+                {
+                    cpu->state[dest[j]]--;
+                }
+            }
+            cpu->stage[i].has_insn = FALSE;
+            cpu->flushed_insns++;
+        }
+    }
+    cpu->branch_flushes++;
+    cpu->fetch_enabled = TRUE;
+}
+
+/*
+ * Fetches the next instruction of a replayed trace. Behind a taken branch or
+ * jump, until execute resolves it, fetch runs down the wrong path the way it
+ * would in code memory, with NOPs standing in for instructions the trace
+ * does not have. The end of the trace is fetched as a HALT, so a trace
+ * recorded with a limit still drains and stops.
+ */
+static void
+fetch_replayed(APEX_CPU *cpu, CPU_Stage *fetch)
+{
+    APEX_Replay_Insn insn;
+
+    memset(fetch, 0, sizeof(CPU_Stage));
+    fetch->pc = cpu->pc;
+    if (cpu->replay->wrong_path)
+    {
+        fetch->opcode = OPCODE_NOP;
+    }
+    else if (!APEX_replay_next(cpu->replay, &insn))
+    {
+        fetch->opcode = OPCODE_HALT;
+    }
+    else
+    {
+        fetch->pc = insn.pc;
+        fetch->opcode = insn.opcode;
+        fetch->rd = insn.rd;
+        fetch->rs1 = insn.rs1;
+        fetch->rs2 = insn.rs2;
+        fetch->memory_address = (int)insn.address;
+        fetch->redirect = insn.target;
+        cpu->replay->wrong_path = insn.target != 0;
+    }
+    fetch->opcode_str = apex_isa[fetch->opcode].mnemonic;
+    fetch->has_insn = TRUE;
+    fetch->done = TRUE;
+    fetch->entered = cpu->clock;
+    cpu->pc = fetch->pc + 4;
+
+    if (fetch->opcode == OPCODE_HALT)
+    {
+        cpu->fetch_enabled = FALSE;
+    }
+}
+
+/*
+ * Fetch Stage of APEX Pipeline
+ *
+ * Reads the instruction at PC into the first fetch sub-stage. The fetch unit
+ * is held back while that latch is still occupied, which is how a stall in any
+ * later stage reaches the front of the pipeline.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_fetch(APEX_CPU *cpu)
+{
+    APEX_Instruction *current_ins;
+    CPU_Stage *fetch = &cpu->stage[0];
+    int index;
+
+    if (fetch->has_insn || !cpu->fetch_enabled)
+    {
+        return;
+    }
+
+    /* This fetches new branch target instruction from next cycle */
+    if (cpu->fetch_from_next_cycle == TRUE)
+    {
+        cpu->fetch_from_next_cycle = FALSE;
+        /* Skip this cycle*/
+        return;
+    }
+
+    if (cpu->replay)
+    {
+        fetch_replayed(cpu, fetch);
+        return;
+    }
+
+    index = get_code_memory_index_from_pc(cpu->pc);
+    if (index < 0 || index >= cpu->code_memory_size)
+    {
+        /* Ran off the end of code memory without a HALT */
+        cpu->fetch_enabled = FALSE;
+        return;
+    }
+
+    /* Store current PC in fetch latch */
+    memset(fetch, 0, sizeof(CPU_Stage));
+    fetch->pc = cpu->pc;
+
+    /* Index into code memory using this pc and copy all instruction fields
+     * into fetch latch  */
+    current_ins = &cpu->code_memory[index];
+    fetch->opcode_str = current_ins->opcode_str;
+    fetch->opcode = current_ins->opcode;
+    fetch->rd = current_ins->rd;
+    fetch->rs1 = current_ins->rs1;
+    fetch->rs2 = current_ins->rs2;
+    fetch->imm = current_ins->imm;
+    fetch->has_insn = TRUE;
+    fetch->done = TRUE;
+    fetch->entered = cpu->clock;
+
+    /* Update PC for next instruction */
+    cpu->pc += 4;
+
+    /* Stop fetching new instructions if HALT is fetched */
+    if (fetch->opcode == OPCODE_HALT)
+    {
+        cpu->fetch_enabled = FALSE;
+    }
+}
+
+
+/*
+ * Checks whether the instruction in the given stage writes reg. If it does,
+ * reports whether the value has been produced yet and, if so, the value.
+ * ALU results and the LDI/STI address increment are ready after execute,
+ * loaded values only after memory.
+ */
+static int
+lookup_producer(const APEX_CPU *cpu, int stage, int reg, int *value, int *ready)
+{
+    const CPU_Stage *producer = &cpu->stage[stage];
+    const APEX_Isa_Op *op = &apex_isa[producer->opcode];
+
+    /* Writeback stores the address register last, so it wins when rd == rs1 */
+    if ((op->effects & EFFECT_INCREMENT)
+        && APEX_ISA_BASE(producer->opcode, producer->rs1, producer->rs2) == reg)
+    {
+        *value = producer->register_buffer;
+        *ready = phase_completed(cpu, stage, PHASE_EXECUTE);
+        return TRUE;
+    }
+    if (APEX_ISA_USES(producer->opcode, OPND_RD) && producer->rd == reg)
+    {
+        *value = producer->result_buffer;
+        *ready = phase_completed(cpu, stage,
+                                 op->unit == UNIT_LOAD ? PHASE_MEMORY : PHASE_EXECUTE);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Computes the value an in-flight instruction will write to reg before it
+ * has produced it, for the perfect hazard policy. Every older instruction
+ * already holds correct operands, so ALU results follow from the latch; a
+ * load takes the data of the youngest older store to the same address still
+ * in flight, or else the current memory contents.
+ */
+static int
+predict_result(const APEX_CPU *cpu, int stage, int reg)
+{
+    const CPU_Stage *producer = &cpu->stage[stage];
+    const APEX_Isa_Op *op = &apex_isa[producer->opcode];
+    int value = op->eval(producer->rs1_value, producer->rs2_value, producer->imm,
+                         cpu->core_id, cpu->zero_flag, cpu->positive_flag);
+
+    if ((op->effects & EFFECT_INCREMENT)
+        && APEX_ISA_BASE(producer->opcode, producer->rs1, producer->rs2) == reg)
+    {
+        return APEX_ISA_BASE(producer->opcode, producer->rs1_value, producer->rs2_value) + 4;
+    }
+    if (op->unit != UNIT_LOAD)
+    {
+        return value;
+    }
+
+    /* Loaded register, value is the address */
+    for (int i = stage + 1; i < cpu->num_stages; i++)
+    {
+        const CPU_Stage *older = &cpu->stage[i];
+
+        if (older->has_insn && apex_isa[older->opcode].unit == UNIT_STORE
+            && apex_isa[older->opcode].eval(older->rs1_value, older->rs2_value, older->imm,
+                                            cpu->core_id, 0, 0) == value)
+        {
+            return older->rs1_value;
+        }
+    }
+    return read_data(cpu, value);
+}
+
+/*
+ * Sends fetch to a branch or jump target and squashes the younger
+ * instructions.
+ */
+static void
+redirect_fetch(APEX_CPU *cpu, int target)
+{
+    /* Calculate new PC, and send it to fetch unit */
+    cpu->pc = target;
+
+    /* Since we are using reverse callbacks for pipeline stages,
+     * this will prevent the new instruction from being fetched in the current cycle*/
+    cpu->fetch_from_next_cycle = TRUE;
+
+    /* Flush previous stages and restart fetching from new PC */
+    APEX_flush_pipeline(cpu, cpu->last_of[PHASE_EXECUTE]);
+}
+
+static void
+execute_result(APEX_CPU *cpu, CPU_Stage *execute, int value)
+{
+    (void)cpu;
+    execute->result_buffer = value;
+}
+
+static void
+execute_address(APEX_CPU *cpu, CPU_Stage *execute, int value)
+{
+    (void)cpu;
+    execute->memory_address = value;
+}
+
+static void
+execute_branch(APEX_CPU *cpu, CPU_Stage *execute, int value)
+{
+    if (value)
+    {
+        redirect_fetch(cpu, execute->pc + execute->imm);
+    }
+}
+
+static void
+execute_jump(APEX_CPU *cpu, CPU_Stage *execute, int value)
+{
+    (void)execute;
+    redirect_fetch(cpu, value);
+}
+
+/* What execute does with the value of an instruction's semantics, by unit;
+ * NULL when the value is not used */
+static void (*const execute_units[NUM_UNITS])(APEX_CPU *cpu, CPU_Stage *execute, int value) = {
+    [UNIT_ALU] = execute_result,
+    [UNIT_MUL] = execute_result,
+    [UNIT_DIV] = execute_result,
+    [UNIT_LOAD] = execute_address,
+    [UNIT_STORE] = execute_address,
+    [UNIT_BRANCH] = execute_branch,
+    [UNIT_JUMP] = execute_jump,
+    [UNIT_NONE] = NULL
+};
+
+/*
+ * Execute Stage of APEX Pipeline
+ *
+ * Evaluates the instruction's semantics from the ISA table and hands the
+ * value to its unit. An instruction with a latency above one cycle then
+ * stays for the remaining cycles. Returns TRUE once it may leave the stage.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+APEX_execute(APEX_CPU *cpu)
+{
+    CPU_Stage *execute = &cpu->stage[cpu->last_of[PHASE_EXECUTE]];
+    const APEX_Isa_Op *op = &apex_isa[execute->opcode];
+    int value;
+
+    if (execute->ex_wait > 0)
+    {
+        /* Work already done, waiting out the latency */
+        return --execute->ex_wait == 0;
+    }
+
+    if (cpu->replay)
+    {
+        /* The trace holds the outcome and the address, nothing is computed */
+        if (op->unit == UNIT_JUMP || execute->redirect)
+        {
+            redirect_fetch(cpu, execute->redirect);
+            cpu->replay->wrong_path = FALSE;
+        }
+        execute->ex_wait = op->latency - 1;
+        return execute->ex_wait == 0;
+    }
+
+    value = op->eval(execute->rs1_value, execute->rs2_value, execute->imm, cpu->core_id,
+                     cpu->zero_flag, cpu->positive_flag);
+    if (execute_units[op->unit])
+    {
+        execute_units[op->unit](cpu, execute, value);
+    }
+
+    /* Set the zero flag or positive flag based on the result or the comparison */
+    if (op->effects & EFFECT_FLAGS)
+    {
+        cpu->zero_flag = value == 0;
+        cpu->positive_flag = value > 0;
+    }
+    if (op->effects & EFFECT_COMPARE)
+    {
+        cpu->zero_flag = execute->rs1_value == execute->rs2_value;
+        cpu->positive_flag = execute->rs1_value > execute->rs2_value;
+    }
+    if (op->effects & EFFECT_INCREMENT)
+    {
+        execute->register_buffer
+            = APEX_ISA_BASE(execute->opcode, execute->rs1_value, execute->rs2_value) + 4;
+    }
+
+    execute->ex_wait = op->latency - 1;
+    return execute->ex_wait == 0;
+}
+
+/*
+ * Records an access outside the configured data memory and stops the run,
+ * the fault is reported when the run ends.
+ */
+static void
+APEX_memory_fault(APEX_CPU *cpu, const CPU_Stage *memory)
+{
+    cpu->fault_pc = memory->pc;
+    cpu->fault_address = (unsigned int)memory->memory_address;
+    cpu->memory_fault = TRUE;
+}
+
+/*
+ * Memory Stage of APEX Pipeline
+ *
+ * With L1 caches the access goes through the coherence bus when the
+ * instruction first reaches the stage; the data memory itself is updated
+ * right away and the instruction is held for the latency of the access.
+ * Returns TRUE once the instruction may leave the stage.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+APEX_memory(APEX_CPU *cpu)
+{
+    CPU_Stage *memory = &cpu->stage[cpu->last_of[PHASE_MEMORY]];
+    int is_write = FALSE;
+
+    if (memory->mem_wait > 0)
+    {
+        /* Access already done, waiting for the L1 */
+        return --memory->mem_wait == 0;
+    }
+
+    if (apex_isa[memory->opcode].unit != UNIT_LOAD
+        && apex_isa[memory->opcode].unit != UNIT_STORE)
+    {
+        /* No work */
+        return TRUE;
+    }
+    if (!APEX_memory_in_range(cpu->data_memory, memory->memory_address))
+    {
+        APEX_memory_fault(cpu, memory);
+        return TRUE;
+    }
+    if (apex_isa[memory->opcode].unit == UNIT_LOAD)
+    {
+        /* Read from data memory, a replayed trace has no values to read */
+        if (!cpu->replay)
+        {
+            memory->result_buffer = read_data(cpu, memory->memory_address);
+        }
+        cpu->loads++;
+    }
+    else
+    {
+        /* Write to data memory */
+        if (!cpu->replay)
+        {
+            write_data(cpu, memory->memory_address, memory->rs1_value);
+        }
+        cpu->stores++;
+        is_write = TRUE;
+    }
+
+    if (cpu->bus)
+    {
+        memory->mem_wait = APEX_cache_access(cpu->bus, cpu->core_id,
+                                             (unsigned int)memory->memory_address,
+                                             is_write, cpu->clock);
+        cpu->memory_stall_cycles += memory->mem_wait;
+    }
+    return memory->mem_wait == 0;
+}
+
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_writeback(APEX_CPU *cpu)
+{
+    CPU_Stage *writeback = &cpu->stage[cpu->last_of[PHASE_WRITEBACK]];
+
+    /* Write result to register file, the incremented address register last */
+    if (APEX_ISA_USES(writeback->opcode, OPND_RD))
+    {
+        cpu->regs[writeback->rd] = writeback->result_buffer;
+    }
+    if (apex_isa[writeback->opcode].effects & EFFECT_INCREMENT)
+    {
+        cpu->regs[APEX_ISA_BASE(writeback->opcode, writeback->rs1, writeback->rs2)]
+            = writeback->register_buffer;
+    }
+
+    /* Release the scoreboard entries taken in decode */
+    cpu->wb_count = get_dest_regs(writeback, cpu->wb_dest);
+    cpu->wb_cycle = cpu->clock;
+    for (int i = 0; i < cpu->wb_count; i++)
+    {
+        cpu->state[cpu->wb_dest[i]]--;
+    }
+
+    if (cpu->debug)
+    {
+        APEX_debug_retire(cpu->debug, cpu, writeback->pc, cpu->wb_dest, cpu->wb_count);
+    }
+
+    if (cpu->retire)
+    {
+        APEX_trace_publish(cpu, writeback);
+    }
+}
+
+/*
+ * Returns TRUE once fetch has stopped with no HALT in flight and the last
+ * instruction has left the pipeline, i.e. the program ran past the end of
+ * code memory. The core then ends as if HALT had retired.
+ */
+static int
+APEX_ran_off_code(APEX_CPU *cpu)
+{
+    if (cpu->fetch_enabled)
+    {
+        return FALSE;
+    }
+    for (int i = 0; i < cpu->num_stages; i++)
+    {
+        if (cpu->stage[i].has_insn)
+        {
+            return FALSE;
+        }
+    }
+    cpu->ran_off_code = TRUE;
+    return TRUE;
+}
+
+/* Pipeline cycle variants, see apex_cycle.h */
+#define CYCLE_VARIANT stall_quiet_cycles
+#define CYCLE_LOG FALSE
+#define CYCLE_HAZARD HAZARD_STALL
+#define CYCLE_STATS STATS_CYCLES
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT stall_quiet_full
+#define CYCLE_LOG FALSE
+#define CYCLE_HAZARD HAZARD_STALL
+#define CYCLE_STATS STATS_FULL
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT forward_quiet_cycles
+#define CYCLE_LOG FALSE
+#define CYCLE_HAZARD HAZARD_FORWARD
+#define CYCLE_STATS STATS_CYCLES
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT forward_quiet_full
+#define CYCLE_LOG FALSE
+#define CYCLE_HAZARD HAZARD_FORWARD
+#define CYCLE_STATS STATS_FULL
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT perfect_quiet_cycles
+#define CYCLE_LOG FALSE
+#define CYCLE_HAZARD HAZARD_PERFECT
+#define CYCLE_STATS STATS_CYCLES
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT perfect_quiet_full
+#define CYCLE_LOG FALSE
+#define CYCLE_HAZARD HAZARD_PERFECT
+#define CYCLE_STATS STATS_FULL
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT stall_log_cycles
+#define CYCLE_LOG TRUE
+#define CYCLE_HAZARD HAZARD_STALL
+#define CYCLE_STATS STATS_CYCLES
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT stall_log_full
+#define CYCLE_LOG TRUE
+#define CYCLE_HAZARD HAZARD_STALL
+#define CYCLE_STATS STATS_FULL
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT forward_log_cycles
+#define CYCLE_LOG TRUE
+#define CYCLE_HAZARD HAZARD_FORWARD
+#define CYCLE_STATS STATS_CYCLES
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT forward_log_full
+#define CYCLE_LOG TRUE
+#define CYCLE_HAZARD HAZARD_FORWARD
+#define CYCLE_STATS STATS_FULL
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT perfect_log_cycles
+#define CYCLE_LOG TRUE
+#define CYCLE_HAZARD HAZARD_PERFECT
+#define CYCLE_STATS STATS_CYCLES
+#include "apex_cycle.h"
+
+#define CYCLE_VARIANT perfect_log_full
+#define CYCLE_LOG TRUE
+#define CYCLE_HAZARD HAZARD_PERFECT
+#define CYCLE_STATS STATS_FULL
+#include "apex_cycle.h"
+
+/* Indexed by [log stages][hazard policy][statistics level] */
+static int (*const pipeline_cycles[2][NUM_HAZARD_POLICIES][NUM_STATS_LEVELS])(APEX_CPU *cpu) = {
+    {
+        {APEX_pipeline_cycle_stall_quiet_cycles, APEX_pipeline_cycle_stall_quiet_full},
+        {APEX_pipeline_cycle_forward_quiet_cycles, APEX_pipeline_cycle_forward_quiet_full},
+        {APEX_pipeline_cycle_perfect_quiet_cycles, APEX_pipeline_cycle_perfect_quiet_full}
+    },
+    {
+        {APEX_pipeline_cycle_stall_log_cycles, APEX_pipeline_cycle_stall_log_full},
+        {APEX_pipeline_cycle_forward_log_cycles, APEX_pipeline_cycle_forward_log_full},
+        {APEX_pipeline_cycle_perfect_log_cycles, APEX_pipeline_cycle_perfect_log_full}
+    }
+};
+
+/*
+ * Simulates one clock cycle with the variant of the pipeline selected for
+ * the CPU's configuration, after taking the interval sample due at its start.
+ * Returns TRUE when the simulation has to stop.
+ */
+int
+APEX_pipeline_cycle(APEX_CPU *cpu)
+{
+    if (cpu->clock == cpu->next_sample && cpu->interval)
+    {
+        APEX_interval_sample(cpu);
+    }
+    return cpu->cycle(cpu);
+}
+
+/*
+ * Simulates one clock cycle of every core that has not halted yet. The cores
+ * are stepped in a rotating order so that none of them always gets the bus
+ * first. Returns TRUE once all cores have halted or one of them faulted.
+ */
+static int
+APEX_machine_cycle(APEX_CPU *cpu)
+{
+    int running = FALSE;
+
+    for (int i = 0; i < cpu->config.num_cores; i++)
+    {
+        APEX_CPU *core = cpu->cores[(cpu->clock + i) % cpu->config.num_cores];
+
+        if (core->halted)
+        {
+            continue;
+        }
+        if (atomic_load_explicit(&core->diverged, memory_order_relaxed))
+        {
+            return TRUE;
+        }
+        if (!APEX_pipeline_cycle(core))
+        {
+            running = TRUE;
+        }
+        else if (core->memory_fault)
+        {
+            return TRUE;
+        }
+        else
+        {
+            core->halted = TRUE;
+            core->halt_cycle = core->clock;
+        }
+    }
+    return !running;
+}
+
+/*
+ * Moves every core on to the next cycle, all cores share one clock.
+ */
+static void
+APEX_advance_clock(APEX_CPU *cpu)
+{
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        cpu->cores[id]->clock++;
+    }
+}
+
+/*
+ * Lays out the stage latches from the configured depth of every phase and
+ * derives the clock period: each sub-stage gets an equal share of its phase's
+ * logic delay plus one latch overhead, and the slowest one sets the cycle.
+ */
+static int
+APEX_configure_pipeline(APEX_CPU *cpu)
+{
+    int stage = 0;
+
+    cpu->cycle_time = 0;
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+    {
+        int delay = (phase_logic_delay[phase] + cpu->config.depth[phase] - 1)
+                    / cpu->config.depth[phase] + cpu->config.latch_overhead;
+
+        cpu->first_of[phase] = stage;
+        for (int i = 0; i < cpu->config.depth[phase]; i++)
+        {
+            cpu->phase_of[stage++] = phase;
+        }
+        cpu->last_of[phase] = stage - 1;
+
+        if (delay > cpu->cycle_time)
+        {
+            cpu->cycle_time = delay;
+        }
+    }
+    cpu->num_stages = stage;
+    cpu->cycle = pipeline_cycles[cpu->config.log_stages][cpu->config.hazard_policy]
+                                [cpu->config.stats_level];
+    return cpu->num_stages <= MAX_PIPELINE_STAGES;
+}
+
+/*
+ * Adds the other cores of a multicore machine to core 0, together with the
+ * bus connecting their L1 caches. All cores run the same program from the
+ * same PC on the same code and data memory; CID tells them apart.
+ */
+static int
+APEX_cpu_add_cores(APEX_CPU *cpu)
+{
+    cpu->cores[0] = cpu;
+    if (cpu->config.l1.sets)
+    {
+        cpu->bus = APEX_bus_create(&cpu->config.l1, cpu->config.num_cores);
+        if (!cpu->bus)
+        {
+            return FALSE;
+        }
+    }
+
+    for (int id = 1; id < cpu->config.num_cores; id++)
+    {
+        APEX_CPU *core = calloc(1, sizeof(APEX_CPU));
+
+        if (!core)
+        {
+            return FALSE;
+        }
+        cpu->cores[id] = core;
+        core->config = cpu->config;
+        APEX_configure_pipeline(core);
+        core->core_id = id;
+        core->pc = cpu->pc;
+        core->filename = cpu->filename;
+        core->code_memory_size = cpu->code_memory_size;
+        core->code_memory = cpu->code_memory;
+        core->data_memory = cpu->data_memory;
+        core->bus = cpu->bus;
+        core->fetch_enabled = TRUE;
+    }
+    return TRUE;
+}
+
+/*
+ * Runs every core through its first --fast-forward instructions on the
+ * functional model, translated to host code unless --jit=off, so that the
+ * pipeline starts from the architectural state reached. The cores take turns
+ * of FAST_FORWARD_TURN instructions on the shared data memory. A core stops
+ * early at HALT or at an instruction that faults, which the pipeline then
+ * executes and reports as usual. The last --warm instructions of each core run
+ * on the block interpreter instead, which also passes every load and store
+ * through the core's L1, so the pipeline starts with warm caches.
+ */
+static int
+fast_forward(APEX_CPU *cpu)
+{
+    APEX_Func funcs[MAX_CORES];
+    APEX_Jit *jits[MAX_CORES] = {NULL};
+    unsigned long long left[MAX_CORES];
+    int num_cores = cpu->config.num_cores;
+    int running = num_cores;
+    struct timespec start, end;
+
+    if (!cpu->config.fast_forward)
+    {
+        return TRUE;
+    }
+    for (int id = 0; id < num_cores; id++)
+    {
+        APEX_func_init(&funcs[id], cpu->cores[id], cpu->data_memory);
+        jits[id] = APEX_jit_create(&funcs[id], cpu->config.jit);
+        if (!jits[id])
+        {
+            while (id--)
+            {
+                APEX_jit_free(jits[id]);
+            }
+            return FALSE;
+        }
+        left[id] = cpu->config.fast_forward;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (running)
+    {
+        for (int id = 0; id < num_cores; id++)
+        {
+            unsigned long long executed = funcs[id].executed;
+            unsigned long long cold = left[id] > cpu->config.warm ? left[id] - cpu->config.warm : 0;
+            long long turn = left[id] < FAST_FORWARD_TURN ? left[id] : FAST_FORWARD_TURN;
+            int outcome;
+
+            if (!left[id])
+            {
+                continue;
+            }
+            if (cold)
+            {
+                outcome = APEX_jit_run(jits[id], cold < (unsigned long long)turn ? (long long)cold : turn);
+            }
+            else
+            {
+                struct timespec warm_start, warm_end;
+
+                clock_gettime(CLOCK_MONOTONIC, &warm_start);
+                funcs[id].warm = cpu->bus;
+                outcome = APEX_func_run(&funcs[id], turn);
+                clock_gettime(CLOCK_MONOTONIC, &warm_end);
+                cpu->warmed += funcs[id].executed - executed;
+                cpu->warm_seconds += (warm_end.tv_sec - warm_start.tv_sec)
+                                     + (warm_end.tv_nsec - warm_start.tv_nsec) / 1e9;
+            }
+            if (outcome != FUNC_OK)
+            {
+                left[id] = 0;
+            }
+            else
+            {
+                left[id] -= funcs[id].executed - executed;
+            }
+            running -= !left[id];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int id = 0; id < num_cores; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+
+        core->pc = funcs[id].pc;
+        memcpy(core->regs, funcs[id].regs, sizeof(core->regs));
+        core->zero_flag = funcs[id].zero_flag;
+        core->positive_flag = funcs[id].positive_flag;
+        cpu->fast_forwarded += funcs[id].executed;
+        cpu->jit_blocks += jits[id]->blocks;
+        APEX_jit_free(jits[id]);
+        APEX_func_free(&funcs[id]);
+    }
+    cpu->fast_forward_seconds = (end.tv_sec - start.tv_sec)
+                                + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    /* The pipeline counts only its own accesses and finds the bus idle */
+    if (cpu->bus)
+    {
+        APEX_bus_reset_stats(cpu->bus);
+    }
+    return TRUE;
+}
+
+/*
+ * Resets the architectural and pipeline state of a configured CPU and loads
+ * a program into its code memory.
+ */
+static int
+APEX_cpu_load(APEX_CPU *cpu, const char *filename)
+{
+    /* Initialize PC, Registers and all pipeline stages */
+    cpu->pc = 4000;
+    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
+    memset(cpu->state, 0, sizeof(unsigned char) * REG_FILE_SIZE);
+    memset(cpu->stage, 0, MAX_PIPELINE_STAGES * sizeof(CPU_Stage));
+    memset(cpu->pipeline_logs, 0, MAX_PIPELINE_STAGES * sizeof(CPU_Stage));
+
+    if (!APEX_configure_pipeline(cpu))
+    {
+        return FALSE;
+    }
+
+    /* Data memory pages are only allocated when first written */
+    cpu->data_memory = APEX_memory_create(cpu->config.memory_size);
+    if (!cpu->data_memory)
+    {
+        return FALSE;
+    }
+    if (cpu->config.dense_words
+        && !APEX_memory_map_dense(cpu->data_memory, cpu->config.dense_base,
+                                  cpu->config.dense_words))
+    {
+        fprintf(stderr, "APEX_Error: Unable to map dense memory region\n");
+        return FALSE;
+    }
+    /* A batch loads the images into each instance itself */
+    for (int i = 0; command != COMMAND_BATCH && i < cpu->config.num_images; i++)
+    {
+        const APEX_Data_Image *image = &cpu->config.images[i];
+        long long words = APEX_memory_load_image(cpu->data_memory, image->base, image->path);
+
+        if (words < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to load data image %s at %u\n",
+                    image->path, image->base);
+            return FALSE;
+        }
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            fprintf(stderr, "APEX_CPU: Loaded %lld words from %s at %u\n",
+                    words, image->path, image->base);
+        }
+    }
+    if (cpu->config.diff_path)
+    {
+        cpu->initial_memory = APEX_memory_clone(cpu->data_memory);
+        if (!cpu->initial_memory)
+        {
+            return FALSE;
+        }
+    }
+
+    /* Parse input file and create code memory, a replay fetches from the
+     * trace instead and has none */
+    cpu->filename = filename;
+    if (command == COMMAND_REPLAY)
+    {
+        cpu->replay = APEX_replay_open(filename);
+        if (!cpu->replay)
+        {
+            return FALSE;
+        }
+        cpu->pc = cpu->replay->pc;
+    }
+    else
+    {
+        cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
+        if (!cpu->code_memory)
+        {
+            return FALSE;
+        }
+    }
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        fprintf(stderr,
+                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+                cpu->code_memory_size);
+        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
+               "imm");
+
+        for (int i = 0; i < cpu->code_memory_size; ++i)
+        {
+            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
+                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
+                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+        } 
+    }
+
+    /* To start fetch stage */
+    cpu->fetch_enabled = TRUE;
+    if (cpu->config.result_dir)
+    {
+        APEX_results_input(cpu, cpu->input_hash);
+    }
+    return APEX_cpu_add_cores(cpu) && fast_forward(cpu);
+}
+
+/*
+ * This function creates and initializes APEX cpu.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+APEX_CPU *
+APEX_cpu_init(const char *arguments[])
+{
+    APEX_CPU *cpu;
+    if (!arguments[1])
+    {
+        return NULL;
+    }
+    cpu = calloc(1, sizeof(APEX_CPU));
+    if (!cpu)
+    {
+        return NULL;
+    }
+
+    /* Classic five stage pipeline with forwarding unless overridden on the
+     * command line */
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+    {
+        cpu->config.depth[phase] = 1;
+    }
+    cpu->config.latch_overhead = LATCH_OVERHEAD;
+    cpu->config.hazard_policy = HAZARD_FORWARD;
+    cpu->config.memory_size = MEM_ADDRESS_SPACE;
+    cpu->config.num_cores = 1;
+    cpu->config.l1.protocol = COHERENCE_MESI;
+    cpu->config.l1.memory_latency = MEMORY_LATENCY;
+    cpu->config.l1.bus_latency = BUS_LATENCY;
+    cpu->config.retire_slots = RETIRE_RING_SLOTS;
+    cpu->config.snapshot_interval = SNAPSHOT_INTERVAL;
+    cpu->config.max_snapshots = MAX_SNAPSHOTS;
+    cpu->config.jit = TRUE;
+    cpu->config.interval_path = INTERVAL_FILE;
+    cpu->config.reuse_window = REUSE_WINDOW;
+    cpu->config.reuse_path = REUSE_FILE;
+    cpu->config.record_path = RECORD_FILE;
+    cpu->config.simpoint_max = SIMPOINT_DEFAULT_CLUSTERS;
+
+    if (!map_commands(cpu, arguments))
+    {
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    cpu->output = APEX_output_open(cpu->config.output_path, cpu->config.output_format);
+    if (!cpu->output)
+    {
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    cpu->output->num_cores = cpu->config.num_cores;
+    cpu->output->single_step = command == COMMAND_SINGLE_STEP;
+
+    /* Only the commands showing the stages need their contents every cycle,
+     * and compare only reports cycles */
+    cpu->config.log_stages = command == COMMAND_DISPLAY || command == COMMAND_SINGLE_STEP
+                             || command == COMMAND_DEBUG;
+    cpu->config.stats_level = command == COMMAND_COMPARE ? STATS_CYCLES : STATS_FULL;
+
+    /* Several cores always share data memory through coherent L1s */
+    if (cpu->config.num_cores > 1 && !cpu->config.l1.sets)
+    {
+        cpu->config.l1.sets = L1_DEFAULT_SETS;
+        cpu->config.l1.ways = L1_DEFAULT_WAYS;
+        cpu->config.l1.line_words = L1_DEFAULT_LINE_WORDS;
+    }
+
+    /* Intervals follow one run of the pipeline from start to end */
+    if (cpu->config.interval && command != COMMAND_SIMULATE && command != COMMAND_DISPLAY
+        && command != COMMAND_SINGLE_STEP && command != COMMAND_SHOW_MEMORY
+        && command != COMMAND_REPLAY)
+    {
+        printf("Interval statistics need the simulate, display, single_step, show_mem or replay command\n");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    /* Variants fork from one prefix, each runs quietly in its own process */
+    if (cpu->config.num_variants && command != COMMAND_FORK)
+    {
+        printf("Variants need the fork command\n");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    if (command == COMMAND_FORK)
+    {
+        APEX_Config variant;
+
+        if (!cpu->config.num_variants || cpu->config.trace_path || cpu->config.profile
+            || cpu->config.check || cpu->config.reuse || cpu->config.interval)
+        {
+            printf("The fork command needs a --variant and runs without tracing, profiling, checking, reuse analysis or intervals\n");
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+        for (int i = 0; i < cpu->config.num_variants; i++)
+        {
+            if (!map_variant(&cpu->config, cpu->config.variants[i], &variant))
+            {
+                APEX_cpu_stop(cpu);
+                return NULL;
             }
-                       
         }
+    }
+
+    /* Only the compare command's quiet runs are cached */
+    if (cpu->config.result_dir && command != COMMAND_COMPARE)
+    {
+        printf("The result cache needs the compare command\n");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    if (cpu->config.result_dir && !APEX_results_open(cpu->config.result_dir))
+    {
+        fprintf(stderr, "APEX_Error: Unable to use result cache directory %s\n",
+                cpu->config.result_dir);
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    /* Warming fills the L1s before a pipeline starts part way through */
+    if (cpu->config.warm && !cpu->config.l1.sets)
+    {
+        printf("Warming needs L1 caches, --l1 or several cores\n");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    if (cpu->config.warm && !cpu->config.fast_forward && command != COMMAND_SIMPOINT)
+    {
+        printf("Warming needs --fast-forward or the simpoint command\n");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    /* Simulation points are single core pipelines of their own */
+    if (command == COMMAND_SIMPOINT
+        && (cpu->config.num_cores > 1 || cpu->config.fast_forward || cpu->config.trace_path
+            || cpu->config.profile || cpu->config.check || cpu->config.reuse))
+    {
+        printf("The simpoint command runs one core without fast-forward, tracing, profiling, checking or reuse analysis\n");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    /* A trace is recorded from, and replayed on, a single core */
+    if (command == COMMAND_RECORD
+        && (cpu->config.num_cores > 1 || cpu->config.warm || cpu->config.trace_path
+            || cpu->config.profile || cpu->config.check || cpu->config.reuse))
+    {
+        printf("The record command runs one core without warming, tracing, profiling, checking or reuse analysis\n");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    if (command == COMMAND_REPLAY
+        && (cpu->config.num_cores > 1 || cpu->config.fast_forward || cpu->config.check))
+    {
+        printf("The replay command runs one core without fast-forward or checking\n");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    if (!APEX_cpu_load(cpu, arguments[1]) || !APEX_trace_attach(cpu)
+        || !APEX_interval_attach(cpu))
+    {
+        APEX_cpu_stop(cpu);
+        return NULL;  
+    }
+
+    /* All cores share the debugger's breakpoints and watchpoints */
+    if (command == COMMAND_DEBUG)
+    {
+        cpu->debug = APEX_debug_create(cpu->code_memory_size);
+        if (!cpu->debug)
+        {
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+        cpu->debug->history = APEX_history_create(cpu->config.snapshot_interval,
+                                                  cpu->config.max_snapshots);
+        if (!cpu->debug->history)
+        {
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+        for (int id = 0; id < cpu->config.num_cores; id++)
+        {
+            cpu->cores[id]->debug = cpu->debug;
+            cpu->debug->rings[id] = cpu->cores[id]->retire;
+        }
+    }
+    return cpu;
+}
 
-      pipeline_logs[DECODE_STAGE] = cpu->decode;
+/*
+ * Creates a CPU with the pipeline configuration of another one, a given
+ * hazard policy and a freshly loaded program.
+ */
+static APEX_CPU *
+APEX_cpu_create(const APEX_CPU *config, const char *filename, int hazard_policy)
+{
+    APEX_CPU *cpu = calloc(1, sizeof(APEX_CPU));
 
-        if(!cpu->halt)
-        {
-            /* Copy data from decode latch to execute latch*/
-            cpu->execute = cpu->decode;
-            cpu->decode.has_insn = FALSE;
+    if (!cpu)
+    {
+        return NULL;
+    }
+    cpu->config = config->config;
+    cpu->config.hazard_policy = hazard_policy;
 
+    if (!APEX_cpu_load(cpu, filename))
+    {
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    return cpu;
+}
+
+/*
+ * Runs the pipeline without any output until HALT retires or the cycle limit
+ * is reached. Returns TRUE if the program halted.
+ */
+static int
+APEX_cpu_run_quiet(APEX_CPU *cpu, int max_cycles)
+{
+    if (cpu->config.quantum)
+    {
+        return APEX_parallel_run(cpu, max_cycles);
+    }
+
+    while (cpu->clock < max_cycles)
+    {
+        if (APEX_machine_cycle(cpu))
+        {
+            return TRUE;
         }
+        APEX_advance_clock(cpu);
     }
+    return FALSE;
 }
 
 /*
- * Execute Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Finds the outcome of one compare run in the --result-cache, or simulates
+ * it and stores it there. Returns TRUE if it was found.
+ */
+static int
+compare_run(APEX_CPU *cpu, APEX_Result *result)
+{
+    const char *dir = cpu->config.result_dir;
+
+    if (dir && APEX_results_lookup(dir, cpu->input_hash, cycle_count, result))
+    {
+        return TRUE;
+    }
+    result->halted = APEX_cpu_run_quiet(cpu, cycle_count);
+    result->clock = cpu->clock;
+    APEX_results_state(cpu, result->state);
+    if (dir && !APEX_results_store(dir, cpu->input_hash, cycle_count, result))
+    {
+        fprintf(stderr, "APEX_Error: Unable to store a result in %s\n", dir);
+    }
+    return FALSE;
+}
+
+/*
+ * Runs every program given to the compare command under each hazard policy
+ * with the same pipeline configuration and prints the cycle counts and the
+ * speedup over the stall policy. All policies must end in the same
+ * architectural state, any difference is reported. With --result-cache,
+ * runs whose program, data and configuration are unchanged are not
+ * simulated again.
  */
 static void
-APEX_execute(APEX_CPU *cpu)
+APEX_cpu_compare(const APEX_CPU *config)
 {
-    if (cpu->execute.has_insn)
+    int cached = 0;
+    int simulated = 0;
+
+    printf("APEX_CPU: Hazard policy comparison, pipeline depth = %d, cycle limit = %d\n",
+           config->num_stages, cycle_count);
+    printf("%-24s %12s %12s %12s %9s %9s\n", "Program", "Stall", "Forward",
+           "Perfect", "Fwd gain", "Max gain");
+
+    for (int p = 0; p < num_compare_programs; p++)
     {
-        /* Execute logic based on instruction type */
-        switch (cpu->execute.opcode)
+        APEX_CPU *cpu[NUM_HAZARD_POLICIES] = {NULL, NULL, NULL};
+        APEX_Result result[NUM_HAZARD_POLICIES];
+        int halted = TRUE;
+        int policy;
+
+        for (policy = 0; policy < NUM_HAZARD_POLICIES; policy++)
         {
-            case OPCODE_ADD:
+            cpu[policy] = APEX_cpu_create(config, compare_programs[p], policy);
+            if (!cpu[policy])
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value + cpu->execute.rs2_value;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;
-                /* Set the zero flag or positive flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                if (cpu->execute.result_buffer > 0)
-                {
-                    cpu->positive_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->positive_flag = FALSE;
-                }
                 break;
             }
-             case OPCODE_SUB:
+            if (compare_run(cpu[policy], &result[policy]))
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value - cpu->execute.rs2_value;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;
-                /* Set the zero flag or positive flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                if (cpu->execute.result_buffer > 0)
-                {
-                    cpu->positive_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->positive_flag = FALSE;
-                }
-                break;
+                cached++;
             }
-
-            case OPCODE_ADDL:
+            else
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;
-
-                /* Set the zero flag or positive flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                if (cpu->execute.result_buffer > 0)
-                {
-                    cpu->positive_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->positive_flag = FALSE;
-                }
-                break;
+                simulated++;
             }
-            case OPCODE_SUBL:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value - cpu->execute.imm;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;
+            halted &= result[policy].halted;
+        }
 
-                /* Set the zero flag or positive flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                if (cpu->execute.result_buffer > 0)
-                {
-                    cpu->positive_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->positive_flag = FALSE;
-                }
-                break;
+        if (policy < NUM_HAZARD_POLICIES)
+        {
+            printf("%-24s unable to load program\n", compare_programs[p]);
+        }
+        else
+        {
+            printf("%-24s %12d %12d %12d", compare_programs[p],
+                   result[HAZARD_STALL].clock, result[HAZARD_FORWARD].clock,
+                   result[HAZARD_PERFECT].clock);
+            if (halted)
+            {
+                printf(" %8.3fx %8.3fx\n",
+                       (double)result[HAZARD_STALL].clock / result[HAZARD_FORWARD].clock,
+                       (double)result[HAZARD_STALL].clock / result[HAZARD_PERFECT].clock);
             }
-            case OPCODE_MUL:
+            else
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value * cpu->execute.rs2_value;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;
-
-                /* Set the zero flag or positive flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                if (cpu->execute.result_buffer > 0)
-                {
-                    cpu->positive_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->positive_flag = FALSE;
-                }
-                break;
+                printf(" %9s %9s\n", "-", "-");
             }
-            case OPCODE_DIV:
+
+            for (policy = 1; policy < NUM_HAZARD_POLICIES; policy++)
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value / cpu->execute.rs2_value;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
+                if (halted
+                    && memcmp(result[policy].state, result[HAZARD_STALL].state,
+                              sizeof(result[policy].state)))
                 {
-                    cpu->zero_flag = FALSE;
+                    printf("APEX_CPU: WARNING: %s policy ends in a different state than stall\n",
+                           hazard_names[policy]);
                 }
-                if (cpu->execute.result_buffer > 0)
-                {
-                    cpu->positive_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->positive_flag = FALSE;
-                }
-                break;
-            }
-             case OPCODE_AND:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value & cpu->execute.rs2_value;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;
-                
-                break;
-            }
-            case OPCODE_OR:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value | cpu->execute.rs2_value;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;
-                
-                break;
             }
-            case OPCODE_XOR:
+        }
+
+        for (policy = 0; policy < NUM_HAZARD_POLICIES; policy++)
+        {
+            if (cpu[policy])
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;              
-                break;
+                APEX_cpu_stop(cpu[policy]);
             }
-            case OPCODE_LOAD:
+        }
+    }
+
+    if (config->config.result_dir)
+    {
+        printf("APEX_CPU: Result cache %s: %d runs found, %d simulated\n",
+               config->config.result_dir, cached, simulated);
+    }
+}
+
+/* Outcome of one fork variant, sent by its process through a pipe */
+typedef struct APEX_Variant_Result
+{
+    int ok;                        /* FALSE if the variant could not be set up */
+    int halted;
+    int clock;
+    long long instructions;        /* Retired by all cores */
+    int cycle_time;
+    long long l1_misses;
+    int warm_l1;                   /* The prefix's L1s were kept */
+    double seconds;
+} APEX_Variant_Result;
+
+/*
+ * Turns the machine left by the prefix into a variant and runs it to the end
+ * or the cycle limit. Runs in the variant's own process, so it reconfigures
+ * the pipeline in place. The warmed L1s are kept unless the variant changes
+ * their shape or protocol, which starts them cold.
+ */
+static void
+run_variant(APEX_CPU *cpu, const APEX_Config *variant, APEX_Variant_Result *result)
+{
+    const APEX_Cache_Config *l1 = &cpu->config.l1;
+    int reshaped = variant->l1.sets != l1->sets || variant->l1.ways != l1->ways
+                   || variant->l1.line_words != l1->line_words
+                   || variant->l1.protocol != l1->protocol;
+    struct timespec start, end;
+
+    memset(result, 0, sizeof(*result));
+    result->warm_l1 = cpu->bus && cpu->config.warm && !reshaped;
+    if (reshaped)
+    {
+        APEX_bus_free(cpu->bus);
+        cpu->bus = variant->l1.sets ? APEX_bus_create(&variant->l1, variant->num_cores) : NULL;
+        if (variant->l1.sets && !cpu->bus)
+        {
+            return;
+        }
+    }
+    else if (cpu->bus)
+    {
+        cpu->bus->config = variant->l1;
+    }
+    for (int id = 0; id < variant->num_cores; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+
+        core->config = *variant;
+        core->bus = cpu->bus;
+        if (!APEX_configure_pipeline(core))
+        {
+            return;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    result->halted = APEX_cpu_run_quiet(cpu, cycle_count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    result->ok = TRUE;
+    result->clock = cpu->clock;
+    result->cycle_time = cpu->cycle_time;
+    for (int id = 0; id < variant->num_cores; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+
+        result->instructions += core->insn_completed;
+        if (cpu->bus)
+        {
+            result->l1_misses += cpu->bus->caches[id].stats.read_misses
+                                 + cpu->bus->caches[id].stats.write_misses;
+        }
+    }
+    result->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * Starts the process of a variant, which runs it and writes the result to a
+ * pipe. Returns the read end, or -1.
+ */
+static int
+fork_variant(APEX_CPU *cpu, const APEX_Config *variant, pid_t *pid)
+{
+    APEX_Variant_Result result;
+    int fds[2];
+
+    if (pipe(fds))
+    {
+        return -1;
+    }
+    *pid = fork();
+    if (*pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (*pid == 0)
+    {
+        close(fds[0]);
+        run_variant(cpu, variant, &result);
+        _exit(write(fds[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+    }
+    close(fds[1]);
+    return fds[0];
+}
+
+/* Waits for a variant's process and reads its result */
+static int
+collect_variant(int fd, pid_t pid, APEX_Variant_Result *result)
+{
+    size_t got = 0;
+    ssize_t n = 0;
+    int status;
+
+    while (got < sizeof(*result)
+           && (n = read(fd, (char *)result + got, sizeof(*result) - got)) > 0)
+    {
+        got += n;
+    }
+    close(fd);
+    waitpid(pid, &status, 0);
+    return got == sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0
+           && result->ok;
+}
+
+/*
+ * Runs the fork command. The prefix, whatever --fast-forward (and --warm)
+ * executed when the program was loaded, is run once. Then one process per
+ * variant, and one for the base configuration, is forked from that state;
+ * fork() shares the data memory and everything else copy-on-write, so a
+ * variant only pays for the pages it writes. Each process reconfigures the
+ * timing model, runs the rest of the program quietly and sends its
+ * statistics back, and the table compares them.
+ */
+static void
+APEX_cpu_fork(APEX_CPU *cpu)
+{
+    APEX_Config variants[MAX_VARIANTS + 1];
+    pid_t pids[MAX_VARIANTS + 1];
+    int fds[MAX_VARIANTS + 1];
+    int count = cpu->config.num_variants + 1;
+    struct timespec start, end;
+
+    variants[0] = cpu->config;
+    for (int i = 1; i < count; i++)
+    {
+        map_variant(&cpu->config, cpu->config.variants[i - 1], &variants[i]);
+    }
+
+    printf("APEX_CPU: Fork fan-out after %lld instructions (prefix %.3f s), cycle limit = %d\n",
+           cpu->fast_forwarded, cpu->fast_forward_seconds, cycle_count);
+    printf("%-32s %10s %12s %7s %9s %14s %10s %4s\n", "Variant", "Cycles", "Instructions",
+           "CPI", "Cycle(ps)", "Time(ns)", "L1 misses", "L1");
+
+    /* Nothing buffered may be written again by every child */
+    fflush(stdout);
+    APEX_output_flush(cpu->output);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++)
+    {
+        fds[i] = fork_variant(cpu, &variants[i], &pids[i]);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        const char *name = i ? cpu->config.variants[i - 1] : "base";
+        APEX_Variant_Result result;
+
+        if (fds[i] < 0 || !collect_variant(fds[i], pids[i], &result))
+        {
+            printf("%-32.32s unable to run variant\n", name);
+            continue;
+        }
+        printf("%-32.32s %10d %12lld %7.3f %9d %14.3f %10lld %4s\n", name, result.clock,
+               result.instructions, result.instructions ? (double)result.clock / result.instructions : 0.0,
+               result.cycle_time, (double)result.clock * result.cycle_time / 1000.0,
+               result.l1_misses, !variants[i].l1.sets ? "-" : result.warm_l1 ? "warm" : "cold");
+        if (!result.halted)
+        {
+            printf("%-32s stopped at the cycle limit\n", "");
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("APEX_CPU: %d variants simulated in %.3f s\n", count,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+/*
+ * Simulates the next cycle under the debugger. A snapshot is taken at the
+ * start of the cycle when one is due, and instructions are published to the
+ * retire stream only the first time their cycle is simulated, so travelling
+ * back and replaying does not show them to the consumers twice. Returns
+ * TRUE once the program finished.
+ */
+static int
+debug_cycle(APEX_CPU *cpu)
+{
+    APEX_Debug *debug = cpu->debug;
+
+    if (cpu->clock < debug->cycle)
+    {
+        APEX_advance_clock(cpu);
+    }
+    if (!APEX_history_record(debug->history, cpu))
+    {
+        fprintf(stderr, "APEX_Error: Out of memory for snapshots\n");
+        exit(1);
+    }
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+
+        for (int stage = 0; stage < core->num_stages; stage++)
+        {
+            core->pipeline_logs[stage].has_insn = FALSE;
+        }
+        core->retire = debug->cycle >= debug->frontier ? debug->rings[id] : NULL;
+    }
+
+    debug->finished = APEX_machine_cycle(cpu);
+    debug->cycle++;
+    if (debug->cycle > debug->frontier)
+    {
+        debug->frontier = debug->cycle;
+    }
+    return debug->finished;
+}
+
+/*
+ * Puts the machine at the end of a cycle: the last snapshot before it is
+ * restored and the cycles after it are replayed. Only a stop in the target
+ * cycle itself is kept.
+ */
+static void
+debug_travel(APEX_CPU *cpu, int target)
+{
+    APEX_Debug *debug = cpu->debug;
+
+    debug->stop_retired = -1;
+
+    if (target <= debug->cycle)
+    {
+        debug->cycle = APEX_history_restore(debug->history, cpu, target - 1);
+        debug->finished = FALSE;
+    }
+    while (debug->cycle < target && !debug->finished)
+    {
+        debug->stop = FALSE;
+        debug->reason[0] = '\0';
+        debug_cycle(cpu);
+    }
+}
+
+/*
+ * Travels back to the last cycle before the current one in which a
+ * breakpoint or watchpoint fired, searching one snapshot interval at a time,
+ * or to cycle 1 if there is none. Returns TRUE if a stop was found.
+ */
+static int
+debug_reverse_continue(APEX_CPU *cpu)
+{
+    APEX_Debug *debug = cpu->debug;
+    int end = debug->cycle - 1;
+
+    debug->stop_retired = -1;
+    while (end >= 1)
+    {
+        int start = APEX_history_restore(debug->history, cpu, end - 1);
+        int last = 0;
+
+        debug->cycle = start;
+        debug->finished = FALSE;
+        while (debug->cycle < end && !debug->finished)
+        {
+            debug->stop = FALSE;
+            debug_cycle(cpu);
+            if (debug->stop)
             {
-                cpu->execute.memory_address
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                break;
+                last = debug->cycle;
             }
-            case OPCODE_STORE:
-            {
-                cpu->execute.memory_address
-                    = cpu->execute.rs2_value + cpu->execute.imm;
-                    break;
+        }
+        if (last)
+        {
+            debug_travel(cpu, last);
+            return TRUE;
+        }
+        end = start;
+    }
+    debug_travel(cpu, 1);
+    return FALSE;
+}
+
+/* Tells where a run or a travel left the machine */
+static void
+debug_report(const APEX_CPU *cpu)
+{
+    const APEX_Debug *debug = cpu->debug;
+
+    if (debug->stop)
+    {
+        printf("APEX_DEBUG: %s in cycle %d\n", debug->reason, debug->cycle);
+    }
+    if (debug->finished)
+    {
+        printf("APEX_DEBUG: The program has finished, cycles = %d instructions = %d\n",
+               cpu->clock, cpu->insn_completed);
+    }
+    else if (!debug->stop)
+    {
+        printf("APEX_DEBUG: Cycle %d\n", debug->cycle);
+    }
+}
+
+/*
+ * Carries out goto, reverse-step and reverse-continue. Replayed cycles do not
+ * count as breakpoint and watchpoint hits.
+ */
+static void
+debug_time_travel(APEX_CPU *cpu, int action)
+{
+    APEX_Debug *debug = cpu->debug;
+    APEX_Breakpoint breaks[MAX_BREAKPOINTS];
+    APEX_Watchpoint watches[MAX_WATCHPOINTS];
+    long long target = debug->target;
+
+    if (debug->cycle == 0 && action != DEBUG_GOTO)
+    {
+        printf("APEX_DEBUG: No cycle has been simulated yet\n");
+        return;
+    }
+    memcpy(breaks, debug->breaks, sizeof(breaks));
+    memcpy(watches, debug->watches, sizeof(watches));
+
+    if (action == DEBUG_REVERSE_CONTINUE)
+    {
+        if (!debug_reverse_continue(cpu))
+        {
+            printf("APEX_DEBUG: No earlier stop\n");
+        }
+    }
+    else
+    {
+        if (action == DEBUG_REVERSE_STEP)
+        {
+            target = debug->cycle - target < 1 ? 1 : debug->cycle - target;
+        }
+        debug_travel(cpu, target > INT_MAX ? INT_MAX : target);
+    }
 
-            }
-            case OPCODE_LDI:
-            {
-                cpu->execute.memory_address
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->execute.register_buffer
-                    = cpu->execute.rs1_value +4;
-                cpu->exe_dest_reg=cpu->execute.rs1;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.register_buffer;    
-                break;
-            }
-            case OPCODE_STI:
-            {
-                cpu->execute.memory_address
-                    = cpu->execute.rs2_value + cpu->execute.imm;
-                cpu->execute.register_buffer
-                    = cpu->execute.rs2_value +4;
-                cpu->exe_dest_reg=cpu->execute.rs2;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.register_buffer;
-                break;
+    memcpy(debug->breaks, breaks, sizeof(breaks));
+    memcpy(debug->watches, watches, sizeof(watches));
+    debug_report(cpu);
+}
 
-            }
-            case OPCODE_BZ:
-            {   
-                printf("cpu->zero_flag %d",cpu->zero_flag);
-                if (cpu->zero_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
+/*
+ * Debugger console. Between stops the machine runs without any output, only
+ * the debugger hooks in writeback and memory look at what it does. A stop
+ * ends the run after the cycle it happened in, which is the cycle the
+ * console reports and the one "stages" shows. Earlier cycles are reached
+ * through the snapshot history.
+ */
+static void
+APEX_cpu_debug(APEX_CPU *cpu)
+{
+    APEX_Debug *debug = cpu->debug;
+    char line[256];
+    int action = DEBUG_NONE;
+
+    printf("APEX_DEBUG: %s loaded, type help for commands\n", cpu->filename);
+    while (action != DEBUG_QUIT)
+    {
+        printf("(apex) ");
+        APEX_output_flush(cpu->output);
+        if (!fgets(line, sizeof(line), stdin))
+        {
+            break;
+        }
 
-            case OPCODE_BNZ:
+        action = APEX_debug_command(debug, cpu, line);
+        debug->stop = FALSE;
+        debug->reason[0] = '\0';
+        switch (action)
+        {
+            case DEBUG_RUN:
             {
-                if (cpu->zero_flag == FALSE)
+                if (debug->finished)
                 {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
+                    printf("APEX_DEBUG: The program has finished\n");
+                    break;
                 }
-                break;
-            }
-            case OPCODE_BP:
-            {
-                if (cpu->positive_flag == TRUE)
+                for (long long n = 0; debug->run_cycles < 0 || n < debug->run_cycles; n++)
                 {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
+                    if (debug_cycle(cpu) || debug->stop)
+                    {
+                        break;
+                    }
                 }
+                debug_report(cpu);
                 break;
             }
-             case OPCODE_BNP:
-            {
-                if (cpu->positive_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
+            case DEBUG_GOTO:
+            case DEBUG_REVERSE_STEP:
+            case DEBUG_REVERSE_CONTINUE:
+                debug_time_travel(cpu, action);
                 break;
-            }
 
-            case OPCODE_MOVC: 
-            {   
-                cpu->execute.result_buffer = cpu->execute.imm;
-                cpu->exe_dest_reg=cpu->execute.rd;
-                cpu->execute.dataforwarding_exe_buffer=cpu->execute.result_buffer;
+            case DEBUG_CHANGED:
+                /* Snapshots from here on were taken before the change */
+                APEX_history_discard(debug->history, cpu, debug->cycle);
                 break;
-            }
-            case OPCODE_CMP:
-            {
-                /* Set the zero flag or positive flag based on the comparison */
-                if (cpu->execute.rs1_value == cpu->execute.rs2_value)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                if (cpu->execute.rs1_value > cpu->execute.rs2_value)
-                {
-                    cpu->positive_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->positive_flag = FALSE;
-                }
+
+            case DEBUG_REGS:
+                show_core_register_files(cpu);
                 break;
-            } 
-            case OPCODE_JUMP:
-            {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                
+
+            case DEBUG_STAGES:
+                print_core_stage_content(cpu);
                 break;
-            }        
 
+            default:
+                break;
         }
+    }
 
-        pipeline_logs[EXECUTE_STAGE] = cpu->execute;
-        cpu->memory = cpu->execute;
-        cpu->execute.has_insn = FALSE;
-        
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        cpu->cores[id]->retire = debug->rings[id];
     }
+    show_pipeline_stats(cpu);
+    finish_run(cpu);
 }
 
 /*
- * Memory Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Replaces the first %d in a --load-data or --dump-memory path with an
+ * instance number. Returns FALSE if the path has none, so it is the same file
+ * for every instance.
  */
-static void
-APEX_memory(APEX_CPU *cpu)
+static int
+instance_path(const char *path, int lane, char *buffer, size_t size)
+{
+    const char *mark = strstr(path, "%d");
+
+    if (!mark)
+    {
+        snprintf(buffer, size, "%s", path);
+        return FALSE;
+    }
+    snprintf(buffer, size, "%.*s%d%s", (int)(mark - path), path, lane, mark + 2);
+    return TRUE;
+}
+
+/*
+ * Loads the --load-data images into every instance of a batch. Images shared
+ * by all instances are read once.
+ */
+static int
+load_batch_images(const APEX_CPU *cpu, APEX_Batch *batch)
 {
-    if (cpu->memory.has_insn)
+    APEX_Memory *shared = APEX_memory_create(cpu->config.memory_size);
+    char path[512];
+    int per_lane = FALSE;
+    int ok = shared != NULL;
+
+    for (int i = 0; ok && i < cpu->config.num_images; i++)
     {
-        switch (cpu->memory.opcode)
+        const APEX_Data_Image *image = &cpu->config.images[i];
+
+        if (instance_path(image->path, 0, path, sizeof(path)))
         {
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_MOVC:
-            {
-                cpu->mem_dest_reg=cpu->memory.rd;
-                cpu->execute.dataforwarding_mem_buffer=cpu->memory.result_buffer;
-                break;
-            }
-            case OPCODE_LOAD:
-            case OPCODE_LDI:
+            per_lane = TRUE;
+        }
+        else if (APEX_memory_load_image(shared, image->base, path) < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to load data image %s at %u\n", path, image->base);
+            ok = FALSE;
+        }
+    }
+    for (int lane = 0; ok && lane < batch->instances; lane++)
+    {
+        APEX_Memory *mem;
+
+        APEX_batch_load(batch, lane, shared);
+        if (!per_lane)
+        {
+            continue;
+        }
+        mem = APEX_memory_create(cpu->config.memory_size);
+        ok = mem != NULL;
+        for (int i = 0; ok && i < cpu->config.num_images; i++)
+        {
+            const APEX_Data_Image *image = &cpu->config.images[i];
+
+            if (instance_path(image->path, lane, path, sizeof(path))
+                && APEX_memory_load_image(mem, image->base, path) < 0)
             {
-                /* Read from data memory */
-                cpu->memory.result_buffer
-                    = cpu->data_memory[cpu->memory.memory_address];
-                cpu->mem_dest_reg=cpu->memory.rd;
-                cpu->execute.dataforwarding_mem_buffer=cpu->memory.result_buffer;
-                break;
-            }
-            case OPCODE_STORE:
-            case OPCODE_STI:
-            {  
-                /* Read from data memory */
-               cpu->data_memory[cpu->memory.memory_address]= cpu->memory.rs1_value;
-               cpu->mem_dest_reg=cpu->memory.rd;
-               cpu->execute.dataforwarding_mem_buffer=cpu->memory.result_buffer;
-               break;
+                fprintf(stderr, "APEX_Error: Unable to load data image %s at %u\n",
+                        path, image->base);
+                ok = FALSE;
             }
         }
-
-        pipeline_logs[MEMORY_STAGE] = cpu->memory;
-        cpu->writeback = cpu->memory;
-        cpu->memory.has_insn = FALSE;
+        if (ok)
+        {
+            APEX_batch_load(batch, lane, mem);
+        }
+        APEX_memory_free(mem);
     }
+    APEX_memory_free(shared);
+    return ok;
 }
 
 /*
- * Writeback Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Writes the --dump-memory dumps of a batch. A path with %d is written for
+ * every instance, one without for instance 0.
  */
-static int
-APEX_writeback(APEX_CPU *cpu)
+static void
+write_batch_dumps(const APEX_CPU *cpu, const APEX_Batch *batch)
 {
-    if (cpu->writeback.has_insn)
+    char path[512];
+
+    for (int i = 0; i < cpu->config.num_dumps; i++)
     {
-        /* Write result to register file based on instruction type */
-        switch (cpu->writeback.opcode)
+        const APEX_Memory_Dump *dump = &cpu->config.dumps[i];
+        int per_lane = instance_path(dump->path, 0, path, sizeof(path));
+
+        for (int lane = 0; lane < (per_lane ? batch->instances : 1); lane++)
         {
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
+            APEX_Memory *mem = APEX_batch_memory(batch, lane, dump->base, dump->words);
 
+            instance_path(dump->path, lane, path, sizeof(path));
+            if (!mem || !APEX_memory_dump(mem, dump->base, dump->words, path))
             {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->state[cpu->writeback.rd]=0;
-                break;
-            }
-            
-            case OPCODE_LOAD:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->state[cpu->writeback.rd] = 0;
-                break;
-            }
-            case OPCODE_LDI:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs[cpu->writeback.rs1] = cpu->writeback.register_buffer;
-                cpu->state[cpu->writeback.rd] = 0;
-                cpu->state[cpu->writeback.rs1] = 0;
-                break;
-            }
-            case OPCODE_STI:
-            {  
-                cpu->regs[cpu->writeback.rs2] = cpu->writeback.register_buffer;
-                cpu->state[cpu->writeback.rs2] = 0;
-                break;
-            }
-           case OPCODE_MOVC: 
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->state[cpu->writeback.rd] = 0;
-                break;
+                fprintf(stderr, "APEX_Error: Unable to write memory dump %s\n", path);
             }
+            APEX_memory_free(mem);
+        }
+    }
+}
+
+/* Reports how one instance of a batch ended and its registers */
+static void
+show_batch_instance(const APEX_CPU *cpu, const APEX_Batch *batch, int lane)
+{
+    static const char *status_names[] = {
+        "stopped at the limit", "halted", "PC fault", "memory fault"
+    };
+    static const char *reg_names[REG_FILE_SIZE] = {
+        "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
+        "R8", "R9", "R10", "R11", "R12", "R13", "R14", "R15"
+    };
+    APEX_Stat stats[3 + REG_FILE_SIZE] = {
+        {"status", 0, status_names[batch->status[lane]]},
+        {"instructions", (double)batch->executed[lane]},
+        {"pc", batch->stop_pc[lane]}
+    };
+    char text[512];
+    int used;
+
+    used = snprintf(text, sizeof(text), "APEX_BATCH: Instance %d %s after %llu instructions at PC %d,",
+                    lane, status_names[batch->status[lane]], batch->executed[lane],
+                    batch->stop_pc[lane]);
+    for (int reg = 0; reg < REG_FILE_SIZE; reg++)
+    {
+        stats[3 + reg].name = reg_names[reg];
+        stats[3 + reg].value = batch->regs[reg][lane];
+        used += snprintf(text + used, sizeof(text) - used, " R%d=%d", reg, batch->regs[reg][lane]);
+    }
+    snprintf(text + used, sizeof(text) - used, "\n");
+    APEX_output_stats(cpu->output, "instance", lane, text, stats, 3 + REG_FILE_SIZE);
+}
+
+/*
+ * Runs the batch command, cycle_count instances of the program on the
+ * batched functional engine, and reports each instance.
+ */
+static void
+APEX_cpu_batch(APEX_CPU *cpu)
+{
+    APEX_Batch *batch = APEX_batch_create(cpu, cycle_count, cpu->config.batch_limit);
+    unsigned long long instructions = 0;
+    struct timespec start, end;
+    double seconds, mips;
+    char text[160];
+
+    if (!batch)
+    {
+        fprintf(stderr, "APEX_Error: Unable to create a batch of %d instances\n", cycle_count);
+        return;
+    }
+    if (load_batch_images(cpu, batch))
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        APEX_batch_run(batch);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        for (int lane = 0; lane < batch->instances; lane++)
+        {
+            show_batch_instance(cpu, batch, lane);
+            instructions += batch->executed[lane];
         }
-        pipeline_logs[WRITE_BACK_STAGE] = cpu->writeback;
-        cpu->insn_completed++;
-        cpu->writeback.has_insn = FALSE;
-        if (cpu->writeback.opcode == OPCODE_HALT)
+        mips = seconds > 0 ? instructions / seconds / 1e6 : 0.0;
         {
-            /* Stop the APEX simulator */
-            return TRUE;
+            APEX_Stat stats[] = {
+                {"instances", batch->instances},
+                {"instructions", (double)instructions},
+                {"host_seconds", seconds},
+                {"mips", mips},
+                {"engine", 0, batch->vector ? "avx2" : "scalar"}
+            };
+
+            snprintf(text, sizeof(text),
+                     "APEX_BATCH: %d instances, %llu instructions, %.3f s (%.1f MIPS, %s)\n",
+                     batch->instances, instructions, seconds, mips,
+                     batch->vector ? "avx2" : "scalar");
+            APEX_output_stats(cpu->output, "batch", -1, text, stats, 5);
         }
+        write_batch_dumps(cpu, batch);
+    }
+    APEX_batch_free(batch);
+}
+
+/* Simulation points shared by the threads simulating them */
+typedef struct APEX_Point_Queue
+{
+    const APEX_CPU *cpu;           /* Configuration and program */
+    APEX_Simpoints *set;
+    _Atomic int next;              /* Next point to take */
+    _Atomic int failed;
+} APEX_Point_Queue;
+
+/*
+ * Simulates one point on a pipeline of its own, started empty from the
+ * point's checkpoint, until the interval's instructions have retired. The
+ * checkpoint's data memory becomes the pipeline's.
+ */
+static int
+simulate_point(const APEX_CPU *config, APEX_Simpoint *point)
+{
+    APEX_CPU *cpu = calloc(1, sizeof(APEX_CPU));
+    int done;
+
+    if (!cpu)
+    {
+        return FALSE;
+    }
+    cpu->config = config->config;
+    cpu->config.num_images = 0;
+    cpu->config.diff_path = NULL;
+    if (!APEX_cpu_load(cpu, config->filename))
+    {
+        APEX_cpu_stop(cpu);
+        return FALSE;
+    }
+    APEX_memory_free(cpu->data_memory);
+    cpu->data_memory = point->data_memory;
+    point->data_memory = NULL;
+    cpu->pc = point->pc;
+    memcpy(cpu->regs, point->regs, sizeof(cpu->regs));
+    cpu->zero_flag = point->zero_flag;
+    cpu->positive_flag = point->positive_flag;
+    if (point->bus)
+    {
+        APEX_bus_copy(cpu->bus, point->bus);
     }
 
-    /* Default */
-    return 0;
+    do
+    {
+        done = APEX_pipeline_cycle(cpu);
+        cpu->clock++;
+    } while (!done && cpu->insn_completed < point->length);
+
+    point->cycles = cpu->clock;
+    point->retired = cpu->insn_completed;
+    APEX_cpu_stop(cpu);
+    return TRUE;
 }
 
 /*
- * This function creates and initializes APEX cpu.
- *
- * Note: You are free to edit this function according to your implementation
+ * Thread body: takes points off the queue until none is left.
  */
-APEX_CPU *
-APEX_cpu_init(const char *arguments[])
+static void *
+point_worker(void *arg)
 {
-    APEX_CPU *cpu;
-    if (!arguments[1])
+    APEX_Point_Queue *queue = arg;
+    int i;
+
+    while ((i = atomic_fetch_add(&queue->next, 1)) < queue->set->num_points)
     {
-        return NULL;
+        if (!simulate_point(queue->cpu, &queue->set->points[i]))
+        {
+            atomic_store(&queue->failed, TRUE);
+        }
     }
-    cpu = calloc(1, sizeof(APEX_CPU));
-    if (!cpu)
+    return NULL;
+}
+
+/* Prints one simulation point and how its detailed simulation went */
+static void
+show_simpoint(const APEX_CPU *cpu, const APEX_Simpoints *set, int i)
+{
+    const APEX_Simpoint *point = &set->points[i];
+    double cpi = point->retired ? (double)point->cycles / point->retired : 0.0;
+    char text[256];
+    APEX_Stat stats[] = {
+        {"interval", (double)point->interval},
+        {"cluster", point->cluster},
+        {"start", (double)point->start},
+        {"instructions", (double)point->retired},
+        {"weight", point->weight},
+        {"cycles", (double)point->cycles},
+        {"cpi", cpi}
+    };
+
+    snprintf(text, sizeof(text),
+             "APEX_SIMPOINT: Point %d: interval %lld (instructions %lld to %lld), weight %.4f, cycles = %lld, CPI = %.3f\n",
+             i, point->interval, point->start, point->start + point->length - 1, point->weight,
+             point->cycles, cpi);
+    APEX_output_stats(cpu->output, "simpoint", i, text, stats, 7);
+}
+
+/*
+ * Runs the simpoint command: profiles the program in intervals of
+ * cycle_count instructions, simulates the chosen points in detail on up to
+ * --threads threads and estimates the whole program's CPI as the weighted
+ * sum of theirs.
+ */
+static void
+APEX_cpu_simpoint(APEX_CPU *cpu)
+{
+    static const char *outcome_names[] = {
+        "up to the limit", "to HALT", "to a PC fault", "to a memory fault"
+    };
+    APEX_Simpoints *set = APEX_simpoint_select(cpu, cycle_count);
+    APEX_Point_Queue queue;
+    pthread_t threads[MAX_CORES];
+    int num_threads = cpu->config.threads ? cpu->config.threads : 1;
+    long long detailed = 0;
+    double cpi = 0.0;
+    struct timespec start, end;
+    double seconds;
+    char text[1024];
+    int length;
+
+    if (!set || !APEX_simpoint_checkpoint(set, cpu))
     {
-        return NULL;
+        fprintf(stderr, "APEX_Error: Unable to choose simulation points\n");
+        APEX_simpoint_free(set);
+        return;
     }
-    /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
-    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->state, 0, sizeof(unsigned char) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    memset(pipeline_logs, 0, 5 * sizeof(CPU_Stage));
 
-    if(!map_commands(arguments))
+    queue.cpu = cpu;
+    queue.set = set;
+    atomic_init(&queue.next, 0);
+    atomic_init(&queue.failed, FALSE);
+    num_threads = num_threads < set->num_points ? num_threads : set->num_points;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 1; i < num_threads; i++)
     {
-        free(cpu);
-        return NULL;  
+        if (pthread_create(&threads[i], NULL, point_worker, &queue))
+        {
+            fprintf(stderr, "APEX_Error: Unable to start simulation thread\n");
+            exit(1);
+        }
     }
-    /* Parse input file and create code memory */
-    cpu->code_memory = create_code_memory(arguments[1], &cpu->code_memory_size);
-    if (!cpu->code_memory)
+    point_worker(&queue);
+    for (int i = 1; i < num_threads; i++)
     {
-        free(cpu);
-        return NULL;
+        pthread_join(threads[i], NULL);
     }
-    cpu->halt=0;
-    cpu->exe_dest_reg=16;
-    cpu->mem_dest_reg=16;
-    if (ENABLE_DEBUG_MESSAGES)
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (atomic_load(&queue.failed))
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
-               "imm");
+        fprintf(stderr, "APEX_Error: Unable to simulate every simulation point\n");
+        APEX_simpoint_free(set);
+        return;
+    }
 
-        for (int i = 0; i < cpu->code_memory_size; ++i)
-        {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
-        } 
+    for (int i = 0; i < set->num_points; i++)
+    {
+        const APEX_Simpoint *point = &set->points[i];
+
+        show_simpoint(cpu, set, i);
+        detailed += point->retired;
+        cpi += point->retired ? point->weight * point->cycles / point->retired : 0.0;
     }
+    {
+        double cycles = cpi * set->instructions;
+        APEX_Stat stats[] = {
+            {"instructions", (double)set->instructions},
+            {"outcome", 0, outcome_names[set->outcome]},
+            {"interval_length", (double)set->interval_length},
+            {"intervals", (double)set->num_intervals},
+            {"blocks", set->num_blocks},
+            {"points", set->num_points},
+            {"detailed_instructions", (double)detailed},
+            {"cpi", cpi},
+            {"cycles", cycles},
+            {"execution_time_ns", cycles * cpu->cycle_time / 1000.0},
+            {"functional_seconds", set->seconds},
+            {"detailed_seconds", seconds}
+        };
+
+        length = snprintf(text, sizeof(text),
+                          "APEX_SIMPOINT: %lld instructions %s in %lld intervals of %lld, %d basic blocks\n",
+                          set->instructions, outcome_names[set->outcome], set->num_intervals,
+                          set->interval_length, set->num_blocks);
+        length += snprintf(text + length, sizeof(text) - length,
+                           "APEX_SIMPOINT: %d simulation points, %lld instructions simulated in detail (%.2f%% of the program)\n",
+                           set->num_points, detailed,
+                           set->instructions ? 100.0 * detailed / set->instructions : 0.0);
+        length += snprintf(text + length, sizeof(text) - length,
+                           "APEX_SIMPOINT: Estimated CPI = %.3f, cycles = %.0f, execution time = %.3f ns\n",
+                           cpi, cycles, cycles * cpu->cycle_time / 1000.0);
+        snprintf(text + length, sizeof(text) - length,
+                 "APEX_SIMPOINT: Functional runs %.3f s, detailed simulation %.3f s\n",
+                 set->seconds, seconds);
+        APEX_output_stats(cpu->output, "simpoints", -1, text, stats,
+                          sizeof(stats) / sizeof(stats[0]));
+    }
+    APEX_simpoint_free(set);
+}
 
-    /* To start fetch stage */
-    cpu->fetch.has_insn = TRUE;
-    return cpu;
+/*
+ * Runs the functional model from the loaded program, or from where
+ * --fast-forward left it, and writes what it executes to the --record-file
+ * trace for the replay command.
+ */
+static void
+APEX_cpu_record(APEX_CPU *cpu)
+{
+    static const char *outcome_names[] = {
+        "up to the limit", "to HALT", "to a PC fault", "to a memory fault"
+    };
+    APEX_Recording recording;
+    char text[512];
+
+    if (!APEX_replay_record(cpu, cpu->config.record_path, cycle_count, &recording))
+    {
+        fprintf(stderr, "APEX_Error: Unable to write trace %s\n", cpu->config.record_path);
+        return;
+    }
+    {
+        double per_insn = recording.instructions
+                          ? (double)recording.bytes / recording.instructions : 0.0;
+        APEX_Stat stats[] = {
+            {"path", 0, cpu->config.record_path},
+            {"instructions", (double)recording.instructions},
+            {"outcome", 0, outcome_names[recording.outcome]},
+            {"bytes", (double)recording.bytes},
+            {"bytes_per_instruction", per_insn},
+            {"host_seconds", recording.seconds}
+        };
+
+        snprintf(text, sizeof(text),
+                 "APEX_CPU: Recorded %llu instructions %s to %s, %llu bytes (%.2f per instruction) in %.3f s\n",
+                 recording.instructions, outcome_names[recording.outcome],
+                 cpu->config.record_path, recording.bytes, per_insn, recording.seconds);
+        APEX_output_stats(cpu->output, "record", -1, text, stats,
+                          sizeof(stats) / sizeof(stats[0]));
+    }
+    show_fast_forward_stats(cpu);
+    finish_run(cpu);
+}
+
+/*
+ * Drives the pipeline from a recorded trace up to the cycle limit. Nothing
+ * is computed, so neither registers nor memory are shown, only the timing.
+ */
+static void
+APEX_cpu_replay(APEX_CPU *cpu)
+{
+    struct timespec start, end;
+    double seconds;
+    int halted;
+    char text[512];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    halted = APEX_cpu_run_quiet(cpu, cycle_count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    {
+        APEX_Stat stats[] = {
+            {"path", 0, cpu->replay->path},
+            {"halted", halted},
+            {"cycles", cpu->clock},
+            {"instructions", cpu->insn_completed},
+            {"records", (double)cpu->replay->records},
+            {"malformed", cpu->replay->malformed},
+            {"host_seconds", seconds}
+        };
+
+        snprintf(text, sizeof(text),
+                 "APEX_CPU: Replay of %s %s, cycles = %d instructions = %d, %llu trace records read in %.3f s\n",
+                 cpu->replay->path, halted ? "halted" : "reached the cycle limit", cpu->clock,
+                 cpu->insn_completed, cpu->replay->records, seconds);
+        APEX_output_stats(cpu->output, "replay", -1, text, stats,
+                          sizeof(stats) / sizeof(stats[0]));
+    }
+    show_pipeline_stats(cpu);
+    finish_run(cpu);
 }
 
 /*
@@ -1289,9 +3523,83 @@ void
 APEX_cpu_run(APEX_CPU *cpu)
 {
     char user_prompt_val;
+
+    if (command == COMMAND_COMPARE)
+    {
+        APEX_cpu_compare(cpu);
+        return;
+    }
+    if (command == COMMAND_DEBUG)
+    {
+        APEX_cpu_debug(cpu);
+        return;
+    }
+    if (command == COMMAND_BATCH)
+    {
+        APEX_cpu_batch(cpu);
+        return;
+    }
+    if (command == COMMAND_SIMPOINT)
+    {
+        APEX_cpu_simpoint(cpu);
+        return;
+    }
+    if (command == COMMAND_FORK)
+    {
+        APEX_cpu_fork(cpu);
+        return;
+    }
+    if (command == COMMAND_RECORD)
+    {
+        APEX_cpu_record(cpu);
+        return;
+    }
+    if (command == COMMAND_REPLAY)
+    {
+        APEX_cpu_replay(cpu);
+        return;
+    }
+
+    /* The quantum engine has no per-cycle view, display and single_step
+     * always run in lockstep */
+    if (cpu->config.quantum
+        && (command == COMMAND_SIMULATE || command == COMMAND_SHOW_MEMORY))
+    {
+        /* The argument of show_mem is an address, it runs to the end */
+        int halted = APEX_parallel_run(cpu, command == COMMAND_SHOW_MEMORY ? INT_MAX
+                                                                           : cycle_count);
+
+        if (command == COMMAND_SIMULATE)
+        {
+            show_core_register_files(cpu);
+            show_memory(cpu);
+            if (!halted)
+            {
+                show_end_of_run(cpu, "complete");
+            }
+        }
+        else
+        {
+            show_memory_word(cpu, cycle_count);
+        }
+        show_pipeline_stats(cpu);
+        finish_run(cpu);
+        return;
+    }
+
+    /* Nothing is shown before the end, run without per-cycle output */
+    if (command == COMMAND_SHOW_MEMORY)
+    {
+        APEX_cpu_run_quiet(cpu, INT_MAX);
+        show_memory_word(cpu, cycle_count);
+        show_pipeline_stats(cpu);
+        finish_run(cpu);
+        return;
+    }
+
     while (TRUE)
     {
-        if (APEX_writeback(cpu))
+        if (APEX_machine_cycle(cpu))
         {
             switch (command)
             {
@@ -1302,42 +3610,38 @@ APEX_cpu_run(APEX_CPU *cpu)
             case COMMAND_DISPLAY:
             case COMMAND_SINGLE_STEP:
                     print_pipeline_logs(cpu);
-                    show_register_files(cpu);
+                    show_core_register_files(cpu);
                     show_memory(cpu);
                 break;
 
-            case COMMAND_SHOW_MEMORY:
-                    printf("|         MEM[%04d]         |       Data Value = %d           \n", cycle_count, cpu->data_memory[cycle_count]);
-                break;
-
             default:
                 break;
             }
+            show_pipeline_stats(cpu);
+            finish_run(cpu);
             break;
         }
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
         print_pipeline_logs(cpu);
 
         if (command == COMMAND_SINGLE_STEP)
         {
             printf("Press any key to advance CPU Clock or <q> to quit:\n");
+            APEX_output_flush(cpu->output);
             scanf("%c", &user_prompt_val);
 
             if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
             {
-                show_register_files(cpu);
+                show_core_register_files(cpu);
                 show_memory(cpu);
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                show_end_of_run(cpu, "stopped");
+                show_pipeline_stats(cpu);
+                finish_run(cpu);
                 break;
             }
         }
 
-        cpu->clock++;
+        APEX_advance_clock(cpu);
     }
 }
 
@@ -1349,6 +3653,25 @@ APEX_cpu_run(APEX_CPU *cpu)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
+    /* Only core 0 is ever stopped, it owns everything the cores share */
+    APEX_trace_detach(cpu);
+    APEX_reuse_detach(cpu);
+    APEX_interval_detach(cpu);
+    for (int id = 1; id < MAX_CORES; id++)
+    {
+        if (cpu->cores[id])
+        {
+            APEX_store_log_free(&cpu->cores[id]->store_log);
+            free(cpu->cores[id]);
+        }
+    }
+    APEX_store_log_free(&cpu->store_log);
+    APEX_bus_free(cpu->bus);
+    APEX_memory_free(cpu->data_memory);
+    APEX_memory_free(cpu->initial_memory);
+    APEX_output_close(cpu->output);
+    APEX_debug_free(cpu->debug);
+    APEX_replay_close(cpu->replay);
     free(cpu->code_memory);
     free(cpu);
 }
\ No newline at end of file
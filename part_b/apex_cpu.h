@@ -9,11 +9,15 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 #include "apex_macros.h"
+#include "apex_memory.h"
+#include "apex_cache.h"
+#include "apex_retire.h"
+#include "apex_output.h"
 
 /* Format of an APEX instruction  */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
+    const char *opcode_str;        /* Mnemonic, from the ISA table */
     int opcode;
     int rd;
     int rs1;
@@ -25,7 +29,7 @@ typedef struct APEX_Instruction
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
+    const char *opcode_str;
     int opcode;
     int rs1;
     int rs2;
@@ -35,44 +39,154 @@ typedef struct CPU_Stage
     int rs2_value;
     int result_buffer;
     int register_buffer;
-    int dataforwarding_exe_buffer;
-    int dataforwarding_mem_buffer;
     int memory_address;
     int has_insn;
+    int done;                      /* Stage work finished, ready to advance */
+    int entered;                   /* Cycle the instruction entered this latch */
+    int mem_wait;                  /* Cycles left on an L1 miss or upgrade */
+    int ex_wait;                   /* Execute cycles left of a longer latency */
+    int redirect;                  /* Replayed branch or jump target, 0 when not taken */
 } CPU_Stage;
 
+/* Binary or hex file loaded into data memory at an address */
+typedef struct APEX_Data_Image
+{
+    const char *path;
+    unsigned int base;
+} APEX_Data_Image;
+
+/* Data memory range written to a binary file at exit */
+typedef struct APEX_Memory_Dump
+{
+    const char *path;
+    unsigned int base;
+    unsigned long long words;
+} APEX_Memory_Dump;
+
+/* Simulator configuration, set from the command line */
+typedef struct APEX_Config
+{
+    int hazard_policy;             /* HAZARD_STALL, HAZARD_FORWARD or HAZARD_PERFECT */
+    int log_stages;                /* Keep stage contents for display */
+    int stats_level;               /* STATS_CYCLES or STATS_FULL */
+    int depth[NUM_PHASES];         /* Sub-stages per phase */
+    int latch_overhead;            /* Setup and clock-to-q delay of a latch (ps) */
+    unsigned long long memory_size; /* Addressable data memory words */
+    unsigned int dense_base;       /* Huge page backed data region, if any */
+    unsigned long long dense_words;
+    APEX_Data_Image images[MAX_DATA_IMAGES];
+    int num_images;
+    APEX_Memory_Dump dumps[MAX_MEMORY_DUMPS];
+    int num_dumps;
+    const char *diff_path;         /* Changed words since load, "-" for stdout */
+    int num_cores;                 /* Cores running the program */
+    int quantum;                   /* Cycles between barriers, 0 for lockstep */
+    int threads;                   /* Host threads of the quantum engine */
+    const char *trace_path;        /* Retired instruction trace, per core */
+    int profile;                   /* Print instruction mix and hot spots */
+    int retire_slots;              /* Size of each core's retire ring */
+    int check;                     /* Check retirement against the functional model */
+    APEX_Cache_Config l1;          /* Private L1s, sets == 0 for none */
+    int output_format;             /* OUTPUT_TEXT, OUTPUT_JSON or OUTPUT_CSV */
+    const char *output_path;       /* Report file, NULL for stdout */
+    int snapshot_interval;         /* Cycles between debugger snapshots */
+    int max_snapshots;
+    unsigned long long fast_forward; /* Instructions each core executes functionally first */
+    int jit;                       /* Translate fast-forwarded code to host code */
+    unsigned long long warm;       /* Functional instructions that warm the L1s, 0 for none */
+    unsigned long long batch_limit; /* Instructions each batch instance may execute, 0 for none */
+    int simpoint_max;              /* Clusters, and so simulation points, at most */
+    unsigned long long simpoint_limit; /* Instructions profiled for simpoint, 0 for all */
+    const char *bbv_path;          /* Basic block vectors of the simpoint profile */
+    int interval;                  /* Cycles between interval samples, 0 for none */
+    const char *interval_path;     /* Interval statistics file */
+    int reuse;                     /* Analyse the locality of data accesses */
+    int reuse_window;              /* Accesses per working set window */
+    const char *reuse_path;        /* Locality tables file */
+    const char *result_dir;        /* Result cache of the compare command, NULL for none */
+    const char *variants[MAX_VARIANTS]; /* Options of each fork variant, space separated */
+    int num_variants;
+    const char *record_path;       /* Trace written by the record command */
+} APEX_Config;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
     int pc;                        /* Current program counter */
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
-    int halt;                      /* to stall the instruction in fetch stage*/
-    int halted;                    /* to check if already stalled*/
-    int halt_instruction_received;  /* To check if halt instruction is received */
+    int fetch_enabled;             /* Cleared once HALT is fetched */
     int regs[REG_FILE_SIZE];       /* Integer register file */
-    unsigned char state[REG_FILE_SIZE];    /* Register status */
+    unsigned char state[REG_FILE_SIZE];    /* In-flight writers of each register */
+    const char *filename;          /* Program loaded into code memory */
     int code_memory_size;          /* Number of instruction in the input file */
     APEX_Instruction *code_memory; /* Code Memory */
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
+    APEX_Memory *data_memory;      /* Data Memory */
+    APEX_Memory *initial_memory;   /* Data memory as loaded, kept for the diff */
+    unsigned long long input_hash[2]; /* Result cache key, taken when loaded */
+    int memory_fault;              /* Set when an access fell outside data memory */
+    int fault_pc;                  /* Of the access that set memory_fault */
+    unsigned int fault_address;
+    int ran_off_code;              /* Fetch ran past the end of code memory, no HALT */
     int single_step;               /* Wait for user input after every cycle */
     int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int positive_flag;             /* {TRUE, FALSE} Used by BP and BNP to branch */
     int fetch_from_next_cycle;
-    int exe_dest_reg;             /* to address of register which is in execution stage*/
-    int mem_dest_reg;              /* to address of register which is in memory stage*/
+    int wb_dest[2];                /* Registers written back in cycle wb_cycle */
+    int wb_count;
+    int wb_cycle;
+    APEX_Config config;
+
+    /* Multicore organisation, the other cores are owned by core 0 */
+    int core_id;                   /* Read by CID */
+    int halted;                    /* HALT retired on this core */
+    int halt_cycle;
+    struct APEX_CPU *cores[MAX_CORES]; /* All cores, kept by core 0 */
+    APEX_Bus *bus;                 /* Coherent L1s, NULL when not modelled */
+    int buffer_stores;             /* Stores go to store_log (quantum engine) */
+    APEX_Store_Log store_log;
+    APEX_Retire_Ring *retire;      /* Retired instructions, NULL without consumers */
+    _Atomic int diverged;          /* Set by the checker, stops the simulation */
+    APEX_Output *output;           /* Report output, kept by core 0 */
+    struct APEX_Debug *debug;      /* Debugger hooks, NULL unless debugging */
+    struct APEX_Interval *interval; /* Interval samples, NULL when not sampling */
+    int next_sample;               /* Cycle of the next interval sample */
+    struct APEX_Reuse *reuse;      /* Locality analysis, NULL when not analysing */
+    struct APEX_Replay *replay;    /* Trace fetch reads instead of code memory, or NULL */
+
+    /* Pipeline organisation */
+    int num_stages;                /* Total number of stage latches */
+    int phase_of[MAX_PIPELINE_STAGES]; /* Phase each stage belongs to */
+    int first_of[NUM_PHASES];      /* First sub-stage of each phase */
+    int last_of[NUM_PHASES];       /* Sub-stage doing the work of each phase */
+    int cycle_time;                /* Modelled clock period (ps) */
+    int (*cycle)(struct APEX_CPU *cpu); /* Pipeline cycle variant for the configuration */
+
+    /* Pipeline statistics */
+    int stall_cycles;              /* Cycles decode held an instruction back */
+    int branch_flushes;            /* Taken branches and jumps */
+    int flushed_insns;             /* Wrong-path instructions squashed */
+    int load_use_stalls;           /* Stall cycles waiting on a loaded value */
+    int bypass_count[NUM_PHASES];  /* Operands forwarded from each phase */
+    int memory_stall_cycles;       /* Cycles memory waited on the L1 */
+    int loads;                     /* Data memory reads */
+    int stores;                    /* Data memory writes */
 
+    /* Fast-forward statistics, kept by core 0 */
+    long long fast_forwarded;      /* Instructions executed before the pipeline started */
+    long long jit_blocks;          /* Blocks translated to host code */
+    double fast_forward_seconds;   /* Host time taken */
+    long long warmed;              /* Of those, instructions that warmed the L1s */
+    double warm_seconds;
 
-    /* Pipeline stages */
-    CPU_Stage fetch;
-    CPU_Stage decode;
-    CPU_Stage execute;
-    CPU_Stage memory;
-    CPU_Stage writeback;
+    /* Pipeline stages, stage[0] is the first fetch stage */
+    CPU_Stage stage[MAX_PIPELINE_STAGES];
+    CPU_Stage pipeline_logs[MAX_PIPELINE_STAGES]; /* Stage contents for display */
 } APEX_CPU;
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
 APEX_CPU *APEX_cpu_init(const char *commands[]);
+int APEX_pipeline_cycle(APEX_CPU *cpu);
 void APEX_cpu_run(APEX_CPU *cpu);
 void APEX_cpu_stop(APEX_CPU *cpu);
 #endif
@@ -0,0 +1,285 @@
+/*
+ * apex_cycle.h
+ * Contains the APEX pipeline cycle, instantiated once per variant
+ *
+ * apex_cpu.c includes this file once for every combination of stage
+ * logging, hazard policy and statistics level, after defining:
+ *
+ *   CYCLE_VARIANT  suffix of the functions of this instance
+ *   CYCLE_LOG      TRUE to copy each stage latch into pipeline_logs
+ *   CYCLE_HAZARD   HAZARD_STALL, HAZARD_FORWARD or HAZARD_PERFECT
+ *   CYCLE_STATS    STATS_CYCLES or STATS_FULL
+ *
+ * The choices are made by the preprocessor, so a variant carries no code and
+ * no tests for the others, whatever the optimisation level. There is no
+ * include guard on purpose; the parameters are undefined at the end.
+ */
+#define CYCLE_PASTE(name, variant) name##_##variant
+#define CYCLE_EXPAND(name, variant) CYCLE_PASTE(name, variant)
+#define CYCLE_FN(name) CYCLE_EXPAND(name, CYCLE_VARIANT)
+
+/*
+ * Reads a source register through the bypass network. The youngest in-flight
+ * writer of the register supplies the value if it has produced it already;
+ * otherwise decode has to wait. Under the stall policy any in-flight writer
+ * blocks the read, under the perfect policy none does. The path the value
+ * came from is returned in *path: the phase the producer was in when the
+ * value left it, or -1 for a plain register file read. Returns FALSE when
+ * the operand is not available.
+ */
+static int
+CYCLE_FN(read_operand)(APEX_CPU *cpu, int reg, int *value, int *path, int *load_use)
+{
+    int ready;
+
+    for (int i = cpu->last_of[PHASE_DECODE] + 1; i < cpu->num_stages; i++)
+    {
+        const CPU_Stage *producer = &cpu->stage[i];
+
+        if (!producer->has_insn || !lookup_producer(cpu, i, reg, value, &ready))
+        {
+            continue;
+        }
+#if CYCLE_HAZARD == HAZARD_STALL
+        /* No bypass network, wait for the value to reach the register file */
+        ready = FALSE;
+#elif CYCLE_HAZARD == HAZARD_PERFECT
+        if (!ready)
+        {
+            *value = predict_result(cpu, i, reg);
+            *path = -1;
+            return TRUE;
+        }
+#endif
+        if (!ready)
+        {
+            /* Only the bypass network has a load-use interlock */
+#if CYCLE_STATS == STATS_FULL && CYCLE_HAZARD == HAZARD_FORWARD
+            *load_use = apex_isa[producer->opcode].unit == UNIT_LOAD
+                        && producer->rd == reg;
+#endif
+            return FALSE;
+        }
+
+        /* A latch filled this cycle got its value from the stage before it */
+        *path = cpu->phase_of[producer->entered == cpu->clock ? i - 1 : i];
+        return TRUE;
+    }
+
+    /* Writeback runs before decode, so a result retired this cycle is read
+     * from the register file; with a bypass network count it as the
+     * writeback path, the stall policy has none */
+    *value = cpu->regs[reg];
+    *path = -1;
+#if CYCLE_STATS == STATS_FULL && CYCLE_HAZARD != HAZARD_STALL
+    for (int i = 0; i < cpu->wb_count; i++)
+    {
+        if (cpu->wb_cycle == cpu->clock && cpu->wb_dest[i] == reg)
+        {
+            *path = PHASE_WRITEBACK;
+        }
+    }
+#endif
+    return TRUE;
+}
+
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * With forwarding, all source operands are read through the bypass network
+ * and the only stalls left are for values that have not been produced yet:
+ * the one cycle load-use interlock, plus the extra execute sub-stages of a
+ * deeper pipeline. The stall policy waits for every pending source and
+ * destination register to be written back instead.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+CYCLE_FN(APEX_decode)(APEX_CPU *cpu)
+{
+    CPU_Stage *decode = &cpu->stage[cpu->last_of[PHASE_DECODE]];
+    int reads_rs1;
+    int reads_rs2;
+    int path[2] = {-1, -1};
+    int load_use = FALSE;
+    int stall = FALSE;
+    int dest[2];
+    int num_dest;
+
+    /* Read operands from register file based on the instruction's format */
+    reads_rs1 = APEX_ISA_USES(decode->opcode, OPND_RS1);
+    reads_rs2 = APEX_ISA_USES(decode->opcode, OPND_RS2);
+
+    if (reads_rs1
+        && !CYCLE_FN(read_operand)(cpu, decode->rs1, &decode->rs1_value, &path[0], &load_use))
+    {
+        stall = TRUE;
+    }
+    if (!stall && reads_rs2
+        && !CYCLE_FN(read_operand)(cpu, decode->rs2, &decode->rs2_value, &path[1], &load_use))
+    {
+        stall = TRUE;
+    }
+
+    num_dest = get_dest_regs(decode, dest);
+#if CYCLE_HAZARD == HAZARD_STALL
+    /* The scoreboard also holds back a second writer of a pending register */
+    for (int i = 0; i < num_dest; i++)
+    {
+        if (cpu->state[dest[i]])
+        {
+            stall = TRUE;
+        }
+    }
+#endif
+
+    if (stall)
+    {
+#if CYCLE_STATS == STATS_FULL
+        cpu->stall_cycles++;
+        if (load_use)
+        {
+            cpu->load_use_stalls++;
+        }
+#endif
+        return FALSE;
+    }
+
+#if CYCLE_STATS == STATS_FULL
+    for (int i = 0; i < 2; i++)
+    {
+        if (path[i] >= 0)
+        {
+            cpu->bypass_count[path[i]]++;
+        }
+    }
+#endif
+
+    /* Destinations stay pending in the scoreboard until writeback */
+    for (int i = 0; i < num_dest; i++)
+    {
+        cpu->state[dest[i]]++;
+    }
+
+    /* The instruction may only leave decode once its operands are available */
+    return TRUE;
+}
+
+/*
+ * Runs the work of one stage on the instruction in its latch. Only the last
+ * sub-stage of a phase does the work of that phase, the sub-stages before it
+ * model the extra latency of the split logic. Returns TRUE once the
+ * instruction may leave the stage.
+ */
+static int
+CYCLE_FN(APEX_stage_work)(APEX_CPU *cpu, int stage)
+{
+    int phase = cpu->phase_of[stage];
+
+    if (stage != cpu->last_of[phase])
+    {
+        return TRUE;
+    }
+
+    switch (phase)
+    {
+        case PHASE_DECODE:
+            return CYCLE_FN(APEX_decode)(cpu);
+
+        case PHASE_EXECUTE:
+            return APEX_execute(cpu);
+
+        case PHASE_MEMORY:
+            return APEX_memory(cpu);
+
+        case PHASE_WRITEBACK:
+            APEX_writeback(cpu);
+            break;
+
+        default:
+            break;
+    }
+    return TRUE;
+}
+
+/*
+ * Advances one stage latch. An instruction moves on only when its work is
+ * done and the next latch is free; otherwise it stays put, which in turn
+ * holds back every stage behind it. Returns TRUE when HALT retires or the
+ * instruction faulted.
+ */
+static int
+CYCLE_FN(APEX_stage_step)(APEX_CPU *cpu, int stage)
+{
+    CPU_Stage *latch = &cpu->stage[stage];
+
+    if (!latch->has_insn)
+    {
+        return FALSE;
+    }
+
+    if (!latch->done)
+    {
+        latch->done = CYCLE_FN(APEX_stage_work)(cpu, stage);
+    }
+#if CYCLE_LOG
+    cpu->pipeline_logs[stage] = *latch;
+#endif
+
+    if (cpu->memory_fault)
+    {
+        return TRUE;
+    }
+
+    if (!latch->done)
+    {
+        return FALSE;
+    }
+
+    if (stage == cpu->num_stages - 1)
+    {
+        /* Instruction retires */
+        cpu->insn_completed++;
+        latch->has_insn = FALSE;
+        return latch->opcode == OPCODE_HALT;
+    }
+
+    if (!cpu->stage[stage + 1].has_insn)
+    {
+        cpu->stage[stage + 1] = *latch;
+        cpu->stage[stage + 1].done = FALSE;
+        cpu->stage[stage + 1].entered = cpu->clock;
+        latch->has_insn = FALSE;
+    }
+    return FALSE;
+}
+
+/*
+ * Simulates one clock cycle. Stages are evaluated from writeback back to
+ * fetch so that a latch freed this cycle can be refilled in the same cycle.
+ * Returns TRUE when the simulation has to stop, which includes a program
+ * that ran past the end of code memory and drained the pipeline.
+ */
+static int
+CYCLE_FN(APEX_pipeline_cycle)(APEX_CPU *cpu)
+{
+    for (int i = cpu->num_stages - 1; i > 0; i--)
+    {
+        if (CYCLE_FN(APEX_stage_step)(cpu, i))
+        {
+            return TRUE;
+        }
+    }
+
+    APEX_fetch(cpu);
+    CYCLE_FN(APEX_stage_step)(cpu, 0);
+    return APEX_ran_off_code(cpu);
+}
+
+#undef CYCLE_FN
+#undef CYCLE_EXPAND
+#undef CYCLE_PASTE
+#undef CYCLE_VARIANT
+#undef CYCLE_LOG
+#undef CYCLE_HAZARD
+#undef CYCLE_STATS
@@ -0,0 +1,655 @@
+/*
+ * apex_debug.c
+ * Contains the APEX debugger: breakpoints, watchpoints and the console
+ * command parser
+ *
+ * The simulation runs quietly between stops. Writeback and the memory stage
+ * call the hooks below only when a debugger is attached, and the hooks look
+ * up per instruction and per page tables, so a breakpoint or watchpoint costs
+ * nothing until an instruction or store actually touches it. A stop ends the
+ * run at the end of the current cycle.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apex_debug.h"
+#include "apex_macros.h"
+
+/* Data memory pages, one bit each in page_watch */
+#define DEBUG_PAGES (MEM_ADDRESS_SPACE >> MEM_PAGE_BITS)
+
+static const char *cond_ops[] = {"==", "!=", "<", "<=", ">", ">="};
+
+APEX_Debug *
+APEX_debug_create(int code_memory_size)
+{
+    APEX_Debug *debug = calloc(1, sizeof(APEX_Debug));
+
+    if (!debug)
+    {
+        return NULL;
+    }
+    debug->break_at = calloc(code_memory_size + 1, 1);
+    if (!debug->break_at)
+    {
+        free(debug);
+        return NULL;
+    }
+    debug->code_memory_size = code_memory_size;
+    debug->stop_retired = -1;
+    debug->run_cycles = -1;
+    return debug;
+}
+
+void
+APEX_debug_free(APEX_Debug *debug)
+{
+    if (debug)
+    {
+        free(debug->break_at);
+        free(debug->page_watch);
+        APEX_history_free(debug->history);
+        free(debug);
+    }
+}
+
+static int
+cond_compare(int value, int op, int limit)
+{
+    switch (op)
+    {
+        case COND_EQ: return value == limit;
+        case COND_NE: return value != limit;
+        case COND_LT: return value < limit;
+        case COND_LE: return value <= limit;
+        case COND_GT: return value > limit;
+        default: return value >= limit;
+    }
+}
+
+static int
+cond_holds(const APEX_Condition *cond, const APEX_CPU *cpu)
+{
+    switch (cond->kind)
+    {
+        case COND_REG:
+            return cond_compare(cpu->regs[cond->index], cond->op, cond->value);
+        case COND_MEM:
+            return cond_compare(APEX_memory_read(cpu->data_memory, cond->index), cond->op,
+                                cond->value);
+    }
+    return TRUE;
+}
+
+static void
+format_cond(const APEX_Condition *cond, char *text, size_t size)
+{
+    if (cond->kind == COND_REG)
+    {
+        snprintf(text, size, " if R%u %s %d", cond->index, cond_ops[cond->op], cond->value);
+    }
+    else if (cond->kind == COND_MEM)
+    {
+        snprintf(text, size, " if MEM[%u] %s %d", cond->index, cond_ops[cond->op],
+                 cond->value);
+    }
+    else
+    {
+        text[0] = '\0';
+    }
+}
+
+/*
+ * Called by writeback for every retired instruction with the registers it
+ * wrote.
+ */
+void
+APEX_debug_retire(APEX_Debug *debug, const APEX_CPU *cpu, int pc, const int *dest,
+                  int count)
+{
+    int index = (pc - 4000) / 4;
+
+    if (index >= 0 && index < debug->code_memory_size && debug->break_at[index])
+    {
+        for (int i = 0; i < debug->num_breaks; i++)
+        {
+            APEX_Breakpoint *bp = &debug->breaks[i];
+
+            if (bp->pc == pc && cond_holds(&bp->cond, cpu))
+            {
+                bp->hits++;
+                debug->stop = TRUE;
+                snprintf(debug->reason, sizeof(debug->reason),
+                         "Breakpoint %d, core %d retired PC %d", i + 1, cpu->core_id, pc);
+                break;
+            }
+        }
+    }
+
+    for (int d = 0; d < count; d++)
+    {
+        if (!(debug->reg_watch & (1u << dest[d])))
+        {
+            continue;
+        }
+        for (int i = 0; i < debug->num_watches; i++)
+        {
+            APEX_Watchpoint *wp = &debug->watches[i];
+
+            if (!wp->is_memory && wp->index == dest[d] && cond_holds(&wp->cond, cpu))
+            {
+                wp->hits++;
+                debug->stop = TRUE;
+                snprintf(debug->reason, sizeof(debug->reason),
+                         "Watchpoint %d, core %d PC %d wrote R%d = %d", i + 1,
+                         cpu->core_id, pc, dest[d], cpu->regs[dest[d]]);
+            }
+        }
+    }
+
+    if (cpu->core_id == debug->core && ++debug->retired == debug->stop_retired)
+    {
+        debug->stop = TRUE;
+        if (!debug->reason[0])
+        {
+            snprintf(debug->reason, sizeof(debug->reason),
+                     "Stepped, core %d retired PC %d", cpu->core_id, pc);
+        }
+    }
+}
+
+/* Called by the memory stage after every store */
+void
+APEX_debug_store(APEX_Debug *debug, const APEX_CPU *cpu, unsigned int address,
+                 int old_value, int value)
+{
+    unsigned int page = address >> MEM_PAGE_BITS;
+
+    if (!debug->page_watch || !(debug->page_watch[page / 8] & (1u << (page % 8))))
+    {
+        return;
+    }
+    for (int i = 0; i < debug->num_watches; i++)
+    {
+        APEX_Watchpoint *wp = &debug->watches[i];
+
+        if (wp->is_memory && wp->index == address && cond_holds(&wp->cond, cpu))
+        {
+            wp->hits++;
+            debug->stop = TRUE;
+            snprintf(debug->reason, sizeof(debug->reason),
+                     "Watchpoint %d, core %d wrote MEM[%u] %d -> %d", i + 1,
+                     cpu->core_id, address, old_value, value);
+        }
+    }
+}
+
+/*
+ * Rebuilds the lookup tables the hooks use from the breakpoint and
+ * watchpoint lists.
+ */
+static void
+rebuild_tables(APEX_Debug *debug)
+{
+    memset(debug->break_at, 0, debug->code_memory_size + 1);
+    for (int i = 0; i < debug->num_breaks; i++)
+    {
+        debug->break_at[(debug->breaks[i].pc - 4000) / 4]++;
+    }
+
+    debug->reg_watch = 0;
+    if (debug->page_watch)
+    {
+        memset(debug->page_watch, 0, DEBUG_PAGES / 8);
+    }
+    for (int i = 0; i < debug->num_watches; i++)
+    {
+        const APEX_Watchpoint *wp = &debug->watches[i];
+
+        if (wp->is_memory)
+        {
+            unsigned int page = wp->index >> MEM_PAGE_BITS;
+
+            debug->page_watch[page / 8] |= 1u << (page % 8);
+        }
+        else
+        {
+            debug->reg_watch |= 1u << wp->index;
+        }
+    }
+}
+
+/* Parses a whole decimal or 0x prefixed hexadecimal integer */
+static int
+parse_int(const char *text, long long *value)
+{
+    char *end;
+
+    if (!text)
+    {
+        return FALSE;
+    }
+    *value = strtoll(text, &end, 0);
+    return end != text && *end == '\0';
+}
+
+/* Parses "R<n>" */
+static int
+parse_reg(const char *text, unsigned int *reg)
+{
+    long long value;
+
+    if (!text || (text[0] != 'R' && text[0] != 'r') || !parse_int(text + 1, &value)
+        || value < 0 || value >= REG_FILE_SIZE)
+    {
+        return FALSE;
+    }
+    *reg = value;
+    return TRUE;
+}
+
+/* Parses "MEM[<address>]" or a bare address */
+static int
+parse_address(const APEX_CPU *cpu, const char *text, unsigned int *address)
+{
+    char number[32];
+    long long value;
+
+    if (text && strncmp(text, "MEM[", 4) == 0 && strlen(text) < sizeof(number) + 5
+        && text[strlen(text) - 1] == ']')
+    {
+        snprintf(number, sizeof(number), "%.*s", (int)strlen(text) - 5, text + 4);
+        text = number;
+    }
+    if (!parse_int(text, &value) || value < 0 || value >= (long long)MEM_ADDRESS_SPACE
+        || !APEX_memory_in_range(cpu->data_memory, (unsigned int)value))
+    {
+        return FALSE;
+    }
+    *address = value;
+    return TRUE;
+}
+
+/* Parses the tokens after "if": "R<n> <op> <value>" or "MEM[<a>] <op> <value>" */
+static int
+parse_cond(const APEX_CPU *cpu, char **save, APEX_Condition *cond)
+{
+    char *operand = strtok_r(NULL, " \t", save);
+    char *op = strtok_r(NULL, " \t", save);
+    char *limit = strtok_r(NULL, " \t", save);
+    long long value;
+
+    if (parse_reg(operand, &cond->index))
+    {
+        cond->kind = COND_REG;
+    }
+    else if (parse_address(cpu, operand, &cond->index))
+    {
+        cond->kind = COND_MEM;
+    }
+    else
+    {
+        return FALSE;
+    }
+    for (cond->op = 0; op && cond->op <= COND_GE; cond->op++)
+    {
+        if (strcmp(op, cond_ops[cond->op]) == 0)
+        {
+            break;
+        }
+    }
+    if (!op || cond->op > COND_GE || !parse_int(limit, &value))
+    {
+        return FALSE;
+    }
+    cond->value = value;
+    return TRUE;
+}
+
+/* Parses an optional "if <condition>" ending a command */
+static int
+parse_optional_cond(const APEX_CPU *cpu, char **save, APEX_Condition *cond)
+{
+    char *word = strtok_r(NULL, " \t", save);
+
+    cond->kind = COND_NONE;
+    if (!word)
+    {
+        return TRUE;
+    }
+    if (strcmp(word, "if") != 0 || !parse_cond(cpu, save, cond))
+    {
+        printf("Condition must be: if R<n>|MEM[<address>] ==|!=|<|<=|>|>= <value>\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+show_help(void)
+{
+    printf("  break PC [if COND]      stop when the instruction at PC retires\n");
+    printf("  watch Rn|ADDR [if COND] stop when a register or memory word is written\n");
+    printf("  delete N, unwatch N     remove breakpoint or watchpoint N\n");
+    printf("  info                    list breakpoints and watchpoints\n");
+    printf("  continue                run until a stop or HALT\n");
+    printf("  step [N]                run N cycles (default 1)\n");
+    printf("  stepi [N]               run until the selected core retires N instructions\n");
+    printf("  goto N                  travel to the end of cycle N, back or forward\n");
+    printf("  reverse-step [N]        travel N cycles back (default 1)\n");
+    printf("  reverse-continue        travel back to the last breakpoint or watchpoint hit\n");
+    printf("  regs, stages            show the register files, the stages of the last cycle\n");
+    printf("  mem ADDR [COUNT]        show data memory words\n");
+    printf("  set Rn|ADDR VALUE       change a register or memory word\n");
+    printf("  core N                  select the core stepi, regs conditions and set use\n");
+    printf("  quit\n");
+    printf("  COND is R<n>|MEM[<address>] ==|!=|<|<=|>|>= <value>\n");
+}
+
+static void
+show_info(const APEX_Debug *debug)
+{
+    char text[64];
+
+    if (!debug->num_breaks && !debug->num_watches)
+    {
+        printf("No breakpoints or watchpoints\n");
+    }
+    for (int i = 0; i < debug->num_breaks; i++)
+    {
+        format_cond(&debug->breaks[i].cond, text, sizeof(text));
+        printf("Breakpoint %d: PC %d%s, %d hits\n", i + 1, debug->breaks[i].pc, text,
+               debug->breaks[i].hits);
+    }
+    for (int i = 0; i < debug->num_watches; i++)
+    {
+        const APEX_Watchpoint *wp = &debug->watches[i];
+
+        format_cond(&wp->cond, text, sizeof(text));
+        if (wp->is_memory)
+        {
+            printf("Watchpoint %d: MEM[%u]%s, %d hits\n", i + 1, wp->index, text, wp->hits);
+        }
+        else
+        {
+            printf("Watchpoint %d: R%u%s, %d hits\n", i + 1, wp->index, text, wp->hits);
+        }
+    }
+}
+
+static int
+add_breakpoint(APEX_Debug *debug, const APEX_CPU *cpu, char **save)
+{
+    long long pc;
+    APEX_Breakpoint *bp;
+
+    if (!parse_int(strtok_r(NULL, " \t", save), &pc) || pc < 4000 || (pc - 4000) % 4
+        || (pc - 4000) / 4 >= debug->code_memory_size)
+    {
+        printf("Breakpoint needs the PC of an instruction\n");
+        return FALSE;
+    }
+    if (debug->num_breaks == MAX_BREAKPOINTS)
+    {
+        printf("At most %d breakpoints can be set\n", MAX_BREAKPOINTS);
+        return FALSE;
+    }
+    bp = &debug->breaks[debug->num_breaks];
+    memset(bp, 0, sizeof(*bp));
+    bp->pc = pc;
+    if (!parse_optional_cond(cpu, save, &bp->cond))
+    {
+        return FALSE;
+    }
+    debug->num_breaks++;
+    rebuild_tables(debug);
+    printf("Breakpoint %d at PC %d\n", debug->num_breaks, bp->pc);
+    return TRUE;
+}
+
+static int
+add_watchpoint(APEX_Debug *debug, const APEX_CPU *cpu, char **save)
+{
+    char *target = strtok_r(NULL, " \t", save);
+    APEX_Watchpoint *wp;
+
+    if (debug->num_watches == MAX_WATCHPOINTS)
+    {
+        printf("At most %d watchpoints can be set\n", MAX_WATCHPOINTS);
+        return FALSE;
+    }
+    wp = &debug->watches[debug->num_watches];
+    memset(wp, 0, sizeof(*wp));
+    if (!parse_reg(target, &wp->index))
+    {
+        if (!parse_address(cpu, target, &wp->index))
+        {
+            printf("Watchpoint needs a register R<n> or a data memory address\n");
+            return FALSE;
+        }
+        wp->is_memory = TRUE;
+        if (!debug->page_watch)
+        {
+            debug->page_watch = calloc(DEBUG_PAGES / 8, 1);
+            if (!debug->page_watch)
+            {
+                fprintf(stderr, "APEX_Error: Out of memory for watchpoints\n");
+                return FALSE;
+            }
+        }
+    }
+    if (!parse_optional_cond(cpu, save, &wp->cond))
+    {
+        return FALSE;
+    }
+    debug->num_watches++;
+    rebuild_tables(debug);
+    printf("Watchpoint %d on %s%u\n", debug->num_watches, wp->is_memory ? "MEM " : "R",
+           wp->index);
+    return TRUE;
+}
+
+/* Removes entry N (1 based) of a breakpoint or watchpoint list */
+static int
+remove_entry(void *list, int *count, size_t size, char **save)
+{
+    long long n;
+
+    if (!parse_int(strtok_r(NULL, " \t", save), &n) || n < 1 || n > *count)
+    {
+        printf("No such entry\n");
+        return FALSE;
+    }
+    memmove((char *)list + (n - 1) * size, (char *)list + n * size, (*count - n) * size);
+    (*count)--;
+    return TRUE;
+}
+
+static void
+show_words(const APEX_CPU *cpu, char **save)
+{
+    unsigned int address;
+    long long count = 1;
+    char *text = strtok_r(NULL, " \t", save);
+    char *words = strtok_r(NULL, " \t", save);
+
+    if (!parse_address(cpu, text, &address) || (words && !parse_int(words, &count))
+        || count < 1 || count > 4096)
+    {
+        printf("Usage: mem ADDR [COUNT], COUNT up to 4096\n");
+        return;
+    }
+    for (long long i = 0; i < count && APEX_memory_in_range(cpu->data_memory, address + i); i++)
+    {
+        printf("MEM[%llu] = %d\n", address + i,
+               APEX_memory_read(cpu->data_memory, (unsigned int)(address + i)));
+    }
+}
+
+static int
+set_value(APEX_CPU *cpu, char **save)
+{
+    char *target = strtok_r(NULL, " \t", save);
+    unsigned int index;
+    long long value;
+
+    if (!parse_int(strtok_r(NULL, " \t", save), &value))
+    {
+        printf("Usage: set Rn|ADDR VALUE\n");
+    }
+    else if (parse_reg(target, &index))
+    {
+        cpu->regs[index] = value;
+        return TRUE;
+    }
+    else if (parse_address(cpu, target, &index))
+    {
+        APEX_memory_write(cpu->data_memory, index, value);
+        return TRUE;
+    }
+    else
+    {
+        printf("Usage: set Rn|ADDR VALUE\n");
+    }
+    return FALSE;
+}
+
+/*
+ * Carries out one console command. Commands that inspect or change the
+ * machine are handled here, the others are returned as DEBUG_* actions for
+ * the simulation loop.
+ */
+int
+APEX_debug_command(APEX_Debug *debug, APEX_CPU *cpu, char *line)
+{
+    APEX_CPU *core = cpu->cores[debug->core];
+    char *save;
+    char *command;
+    long long n = 1;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    command = strtok_r(line, " \t", &save);
+
+    if (!command)
+    {
+        return DEBUG_NONE;
+    }
+    if (strcmp(command, "continue") == 0 || strcmp(command, "c") == 0)
+    {
+        debug->run_cycles = -1;
+        debug->stop_retired = -1;
+        return DEBUG_RUN;
+    }
+    if (strcmp(command, "step") == 0 || strcmp(command, "s") == 0
+        || strcmp(command, "stepi") == 0 || strcmp(command, "si") == 0)
+    {
+        char *count = strtok_r(NULL, " \t", &save);
+
+        if (count && (!parse_int(count, &n) || n < 1))
+        {
+            printf("Step count must be positive\n");
+            return DEBUG_NONE;
+        }
+        debug->run_cycles = -1;
+        debug->stop_retired = -1;
+        if (command[strlen(command) - 1] == 'i')
+        {
+            debug->stop_retired = debug->retired + n;
+        }
+        else
+        {
+            debug->run_cycles = n;
+        }
+        return DEBUG_RUN;
+    }
+    if (strcmp(command, "goto") == 0 || strcmp(command, "reverse-step") == 0
+        || strcmp(command, "rs") == 0)
+    {
+        char *count = strtok_r(NULL, " \t", &save);
+
+        debug->target = 1;
+        if ((command[0] == 'g' || count) && (!parse_int(count, &debug->target)
+                                             || debug->target < 1))
+        {
+            printf("%s needs a positive cycle count\n", command);
+            return DEBUG_NONE;
+        }
+        return command[0] == 'g' ? DEBUG_GOTO : DEBUG_REVERSE_STEP;
+    }
+    if (strcmp(command, "reverse-continue") == 0 || strcmp(command, "rc") == 0)
+    {
+        return DEBUG_REVERSE_CONTINUE;
+    }
+    if (strcmp(command, "regs") == 0 || strcmp(command, "r") == 0)
+    {
+        return DEBUG_REGS;
+    }
+    if (strcmp(command, "stages") == 0)
+    {
+        return DEBUG_STAGES;
+    }
+    if (strcmp(command, "quit") == 0 || strcmp(command, "q") == 0)
+    {
+        return DEBUG_QUIT;
+    }
+
+    if (strcmp(command, "break") == 0 || strcmp(command, "b") == 0)
+    {
+        add_breakpoint(debug, core, &save);
+    }
+    else if (strcmp(command, "watch") == 0 || strcmp(command, "w") == 0)
+    {
+        add_watchpoint(debug, core, &save);
+    }
+    else if (strcmp(command, "delete") == 0 || strcmp(command, "d") == 0)
+    {
+        if (remove_entry(debug->breaks, &debug->num_breaks, sizeof(APEX_Breakpoint), &save))
+        {
+            rebuild_tables(debug);
+        }
+    }
+    else if (strcmp(command, "unwatch") == 0)
+    {
+        if (remove_entry(debug->watches, &debug->num_watches, sizeof(APEX_Watchpoint), &save))
+        {
+            rebuild_tables(debug);
+        }
+    }
+    else if (strcmp(command, "info") == 0 || strcmp(command, "i") == 0)
+    {
+        show_info(debug);
+    }
+    else if (strcmp(command, "mem") == 0 || strcmp(command, "x") == 0)
+    {
+        show_words(core, &save);
+    }
+    else if (strcmp(command, "set") == 0)
+    {
+        if (set_value(core, &save))
+        {
+            return DEBUG_CHANGED;
+        }
+    }
+    else if (strcmp(command, "core") == 0)
+    {
+        if (!parse_int(strtok_r(NULL, " \t", &save), &n) || n < 0
+            || n >= cpu->config.num_cores)
+        {
+            printf("Core must be between 0 and %d\n", cpu->config.num_cores - 1);
+        }
+        else
+        {
+            debug->core = n;
+            debug->retired = 0;
+        }
+    }
+    else if (strcmp(command, "help") == 0 || strcmp(command, "h") == 0)
+    {
+        show_help();
+    }
+    else
+    {
+        printf("Unknown command %s, type help\n", command);
+    }
+    return DEBUG_NONE;
+}
@@ -0,0 +1,97 @@
+/*
+ * apex_debug.h
+ * Contains the APEX debugger declarations: breakpoints, watchpoints and the
+ * console command parser
+ */
+#ifndef _APEX_DEBUG_H_
+#define _APEX_DEBUG_H_
+#include "apex_cpu.h"
+#include "apex_snapshot.h"
+
+#define MAX_BREAKPOINTS 32
+#define MAX_WATCHPOINTS 16
+
+/* Operand of a condition */
+#define COND_NONE 0
+#define COND_REG 1
+#define COND_MEM 2
+
+/* Comparisons of a condition */
+#define COND_EQ 0
+#define COND_NE 1
+#define COND_LT 2
+#define COND_LE 3
+#define COND_GT 4
+#define COND_GE 5
+
+/* What the console asks the simulation loop to do after a command */
+#define DEBUG_NONE 0                   /* Command handled, read the next one */
+#define DEBUG_RUN 1                    /* Run until a stop, see run_cycles */
+#define DEBUG_REGS 2                   /* Show the register files */
+#define DEBUG_STAGES 3                 /* Show the stages of the last cycle */
+#define DEBUG_QUIT 4
+#define DEBUG_CHANGED 5                /* A register or memory word was set */
+#define DEBUG_GOTO 6                   /* Travel to cycle target */
+#define DEBUG_REVERSE_STEP 7           /* Travel target cycles back */
+#define DEBUG_REVERSE_CONTINUE 8       /* Travel back to the last stop */
+
+/* Register or memory word compared with a constant, e.g. "R1 >= 10" */
+typedef struct APEX_Condition
+{
+    int kind;                      /* COND_NONE, COND_REG or COND_MEM */
+    unsigned int index;            /* Register number or word address */
+    int op;
+    int value;
+} APEX_Condition;
+
+typedef struct APEX_Breakpoint
+{
+    int pc;
+    APEX_Condition cond;
+    int hits;
+} APEX_Breakpoint;
+
+typedef struct APEX_Watchpoint
+{
+    int is_memory;
+    unsigned int index;            /* Register number or word address */
+    APEX_Condition cond;
+    int hits;
+} APEX_Watchpoint;
+
+typedef struct APEX_Debug
+{
+    APEX_Breakpoint breaks[MAX_BREAKPOINTS];
+    int num_breaks;
+    unsigned char *break_at;       /* Breakpoints per code memory index */
+    int code_memory_size;
+
+    APEX_Watchpoint watches[MAX_WATCHPOINTS];
+    int num_watches;
+    unsigned int reg_watch;        /* Bit per watched register */
+    unsigned char *page_watch;     /* Bit per data page holding a watched word */
+
+    int core;                      /* Core inspected and stepped by the console */
+    int stop;                      /* Set by a hook, ends the current run */
+    char reason[160];
+    long long retired;             /* Instructions the selected core retired */
+    long long stop_retired;        /* Stop once retired reaches it, -1 for never */
+    long long run_cycles;          /* Cycles the next run may take, -1 for no limit */
+    long long target;              /* Cycle or cycle count of a DEBUG_GOTO or DEBUG_REVERSE_STEP */
+
+    /* Position in the run, kept by the simulation loop */
+    int cycle;                     /* Cycles simulated */
+    int finished;                  /* All cores halted or one faulted */
+    APEX_History *history;         /* Snapshots for travelling back */
+    int frontier;                  /* Cycles the retire stream has seen */
+    APEX_Retire_Ring *rings[MAX_CORES]; /* Retire stream of each core */
+} APEX_Debug;
+
+APEX_Debug *APEX_debug_create(int code_memory_size);
+void APEX_debug_free(APEX_Debug *debug);
+void APEX_debug_retire(APEX_Debug *debug, const APEX_CPU *cpu, int pc,
+                       const int *dest, int count);
+void APEX_debug_store(APEX_Debug *debug, const APEX_CPU *cpu, unsigned int address,
+                      int old_value, int value);
+int APEX_debug_command(APEX_Debug *debug, APEX_CPU *cpu, char *line);
+#endif
@@ -0,0 +1,410 @@
+/*
+ * apex_func.c
+ * Contains the APEX functional model
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "apex_func.h"
+
+/*
+ * Starts a model in the architectural state of a CPU with an empty pipeline,
+ * the reset state unless it was fast-forwarded, executing the CPU's program
+ * on the given data memory.
+ */
+void
+APEX_func_init(APEX_Func *func, const APEX_CPU *cpu, APEX_Memory *data_memory)
+{
+    memset(func, 0, sizeof(APEX_Func));
+    func->pc = cpu->pc;
+    memcpy(func->regs, cpu->regs, sizeof(func->regs));
+    func->zero_flag = cpu->zero_flag;
+    func->positive_flag = cpu->positive_flag;
+    func->core_id = cpu->core_id;
+    func->code_memory = cpu->code_memory;
+    func->code_memory_size = cpu->code_memory_size;
+    func->data_memory = data_memory;
+}
+
+/*
+ * Releases the blocks decoded by APEX_func_run.
+ */
+void
+APEX_func_free(APEX_Func *func)
+{
+    if (!func->blocks)
+    {
+        return;
+    }
+    for (int index = 0; index < func->code_memory_size; index++)
+    {
+        free(func->blocks[index]);
+    }
+    free(func->blocks);
+    func->blocks = NULL;
+}
+
+static void
+set_flags(APEX_Func *func, int result)
+{
+    func->zero_flag = result == 0;
+    func->positive_flag = result > 0;
+}
+
+/*
+ * Functional warming: the access updates the L1 tags and coherence states
+ * as the pipeline's would. Its latency is of no interest here.
+ */
+static void
+warm_line(APEX_Func *func, unsigned int address, int is_write)
+{
+    if (func->warm)
+    {
+        APEX_cache_access(func->warm, func->core_id, address, is_write, 0);
+    }
+}
+
+static void
+write_reg(APEX_Retired *effects, APEX_Func *func, int reg, int value)
+{
+    func->regs[reg] = value;
+    effects->dest[effects->num_dest] = reg;
+    effects->dest_value[effects->num_dest] = value;
+    effects->num_dest++;
+}
+
+/*
+ * Executes the instruction at the model's PC and describes its architectural
+ * effects the way the pipeline publishes a retired instruction. Loads take
+ * their value from *load_value when it is given, so a core of a multicore
+ * machine can follow the interleaving the pipeline saw; otherwise from the
+ * model's own data memory. Returns one of the FUNC_* outcomes.
+ */
+int
+APEX_func_step(APEX_Func *func, const int *load_value, APEX_Retired *effects)
+{
+    const APEX_Instruction *insn;
+    const APEX_Isa_Op *op;
+    int index = (func->pc - 4000) / 4;
+    int next_pc = func->pc + 4;
+    int rs1, rs2, value;
+    unsigned int address;
+
+    if (func->pc < 4000 || (func->pc - 4000) % 4 || index >= func->code_memory_size)
+    {
+        return FUNC_PC_FAULT;
+    }
+    insn = &func->code_memory[index];
+    rs1 = func->regs[insn->rs1];
+    rs2 = func->regs[insn->rs2];
+
+    memset(effects, 0, sizeof(APEX_Retired));
+    effects->core = func->core_id;
+    effects->pc = func->pc;
+    effects->opcode = insn->opcode;
+    effects->opcode_str = insn->opcode_str;
+    effects->mem_access = RETIRE_NO_ACCESS;
+
+    if (insn->opcode == OPCODE_HALT)
+    {
+        func->executed++;
+        return FUNC_HALT;
+    }
+
+    op = &apex_isa[insn->opcode];
+    value = op->eval(rs1, rs2, insn->imm, func->core_id, func->zero_flag, func->positive_flag);
+    switch (op->unit)
+    {
+        case UNIT_LOAD:
+        case UNIT_STORE:
+        {
+            address = (unsigned int)value;
+            if (!APEX_memory_in_range(func->data_memory, address))
+            {
+                return FUNC_MEMORY_FAULT;
+            }
+            effects->mem_address = address;
+            if (op->unit == UNIT_LOAD)
+            {
+                value = load_value ? *load_value : APEX_memory_read(func->data_memory, address);
+                warm_line(func, address, FALSE);
+                effects->mem_access = RETIRE_LOAD;
+                effects->mem_value = value;
+            }
+            else
+            {
+                APEX_memory_write(func->data_memory, address, rs1);
+                warm_line(func, address, TRUE);
+                effects->mem_access = RETIRE_STORE;
+                effects->mem_value = rs1;
+            }
+            break;
+        }
+        case UNIT_BRANCH:
+            next_pc = value ? func->pc + insn->imm : next_pc;
+            break;
+        case UNIT_JUMP:
+            next_pc = value;
+            break;
+        default:
+            break;
+    }
+
+    if (op->effects & EFFECT_FLAGS)
+    {
+        set_flags(func, value);
+    }
+    if (op->effects & EFFECT_COMPARE)
+    {
+        func->zero_flag = rs1 == rs2;
+        func->positive_flag = rs1 > rs2;
+    }
+    if (APEX_ISA_USES(insn->opcode, OPND_RD))
+    {
+        write_reg(effects, func, insn->rd, value);
+    }
+    if (op->effects & EFFECT_INCREMENT)
+    {
+        write_reg(effects, func, APEX_ISA_BASE(insn->opcode, insn->rs1, insn->rs2),
+                  APEX_ISA_BASE(insn->opcode, rs1, rs2) + 4);
+    }
+
+    func->pc = next_pc;
+    func->executed++;
+    return FUNC_OK;
+}
+
+/*
+ * Decodes the block starting at a code memory index, which must not hold a
+ * HALT. Returns NULL if out of host memory.
+ */
+static APEX_Func_Block *
+decode_block(APEX_Func *func, int index)
+{
+    APEX_Func_Block *block;
+    int count = 0;
+
+    if (!func->blocks)
+    {
+        func->blocks = calloc(func->code_memory_size, sizeof(APEX_Func_Block *));
+        if (!func->blocks)
+        {
+            return NULL;
+        }
+    }
+    while (index + count < func->code_memory_size && count < FUNC_BLOCK_MAX)
+    {
+        int opcode = func->code_memory[index + count].opcode;
+
+        if (opcode == OPCODE_HALT)
+        {
+            break;
+        }
+        count++;
+        if (opcode == OPCODE_JUMP)
+        {
+            break;
+        }
+    }
+
+    block = calloc(1, sizeof(APEX_Func_Block) + count * sizeof(APEX_Func_Op));
+    if (!block)
+    {
+        return NULL;
+    }
+    block->count = count;
+    block->next_pc = 4000 + (index + count) * 4;
+    for (int k = 0; k < count; k++)
+    {
+        const APEX_Instruction *insn = &func->code_memory[index + k];
+        APEX_Func_Op *op = &block->ops[k];
+
+        op->opcode = insn->opcode == OPCODE_CID ? OPCODE_MOVC : insn->opcode;
+        op->pc = 4000 + (index + k) * 4;
+        op->rd = &func->regs[insn->rd];
+        op->rs1 = &func->regs[insn->rs1];
+        op->rs2 = &func->regs[insn->rs2];
+        op->imm = insn->opcode == OPCODE_CID ? func->core_id : insn->imm;
+    }
+    func->blocks[index] = block;
+    return block;
+}
+
+/*
+ * Executes a whole block unless it leaves early. Sets *exit to the link to
+ * the block it continues at, NULL after a JUMP. Returns one of the FUNC_*
+ * outcomes, leaving the PC at the instruction that faulted.
+ */
+static int
+run_block(APEX_Func *func, APEX_Func_Block *block, APEX_Func_Block ***exit)
+{
+    for (int k = 0; k < block->count; k++)
+    {
+        APEX_Func_Op *op = &block->ops[k];
+        unsigned int address;
+        int base;
+        int taken;
+
+        switch (op->opcode)
+        {
+            case OPCODE_ADD:
+                set_flags(func, *op->rd = *op->rs1 + *op->rs2);
+                break;
+            case OPCODE_SUB:
+                set_flags(func, *op->rd = *op->rs1 - *op->rs2);
+                break;
+            case OPCODE_MUL:
+                set_flags(func, *op->rd = *op->rs1 * *op->rs2);
+                break;
+            case OPCODE_DIV:
+                set_flags(func, *op->rd = APEX_isa_divide(*op->rs1, *op->rs2));
+                break;
+            case OPCODE_ADDL:
+                set_flags(func, *op->rd = *op->rs1 + op->imm);
+                break;
+            case OPCODE_SUBL:
+                set_flags(func, *op->rd = *op->rs1 - op->imm);
+                break;
+            case OPCODE_AND:
+                *op->rd = *op->rs1 & *op->rs2;
+                break;
+            case OPCODE_OR:
+                *op->rd = *op->rs1 | *op->rs2;
+                break;
+            case OPCODE_XOR:
+                *op->rd = *op->rs1 ^ *op->rs2;
+                break;
+            case OPCODE_MOVC:
+                *op->rd = op->imm;
+                break;
+            case OPCODE_CMP:
+                func->zero_flag = *op->rs1 == *op->rs2;
+                func->positive_flag = *op->rs1 > *op->rs2;
+                break;
+
+            case OPCODE_LOAD:
+            case OPCODE_LDI:
+                base = *op->rs1;
+                address = (unsigned int)(base + op->imm);
+                if (!APEX_memory_in_range(func->data_memory, address))
+                {
+                    func->pc = op->pc;
+                    func->executed += k;
+                    return FUNC_MEMORY_FAULT;
+                }
+                *op->rd = APEX_memory_read(func->data_memory, address);
+                warm_line(func, address, FALSE);
+                if (op->opcode == OPCODE_LDI)
+                {
+                    *op->rs1 = base + 4;
+                }
+                break;
+            case OPCODE_STORE:
+            case OPCODE_STI:
+                base = *op->rs2;
+                address = (unsigned int)(base + op->imm);
+                if (!APEX_memory_in_range(func->data_memory, address))
+                {
+                    func->pc = op->pc;
+                    func->executed += k;
+                    return FUNC_MEMORY_FAULT;
+                }
+                APEX_memory_write(func->data_memory, address, *op->rs1);
+                warm_line(func, address, TRUE);
+                if (op->opcode == OPCODE_STI)
+                {
+                    *op->rs2 = base + 4;
+                }
+                break;
+
+            case OPCODE_BZ:
+            case OPCODE_BNZ:
+            case OPCODE_BP:
+            case OPCODE_BNP:
+                taken = op->opcode == OPCODE_BZ ? func->zero_flag
+                        : op->opcode == OPCODE_BNZ ? !func->zero_flag
+                        : op->opcode == OPCODE_BP ? func->positive_flag
+                        : !func->positive_flag;
+                if (taken)
+                {
+                    func->pc = op->pc + op->imm;
+                    func->executed += k + 1;
+                    *exit = &op->taken;
+                    return FUNC_OK;
+                }
+                break;
+            case OPCODE_JUMP:
+                func->pc = *op->rs1 + op->imm;
+                func->executed += k + 1;
+                *exit = NULL;
+                return FUNC_OK;
+
+            default:
+                break;
+        }
+    }
+    func->pc = block->next_pc;
+    func->executed += block->count;
+    *exit = &block->fall_through;
+    return FUNC_OK;
+}
+
+/*
+ * Executes up to count instructions with no effects reported, for running
+ * ahead fast. Instructions are decoded once into blocks keyed by their entry
+ * PC and the blocks are linked to their successors as they are taken, so a
+ * loop runs with no PC mapping or decoding. Stops early at HALT, at a PC
+ * outside code memory or at an access outside data memory, leaving the PC
+ * at that instruction without executing it, and returns the FUNC_* outcome;
+ * FUNC_OK when all count were executed.
+ */
+int
+APEX_func_run(APEX_Func *func, long long count)
+{
+    APEX_Func_Block *block = NULL;
+    APEX_Func_Block **link = NULL;
+    APEX_Retired effects;
+
+    while (count > 0)
+    {
+        unsigned long long executed = func->executed;
+        int index = (func->pc - 4000) / 4;
+        int status;
+
+        if (!block)
+        {
+            if (func->pc < 4000 || (func->pc - 4000) % 4 || index >= func->code_memory_size)
+            {
+                return FUNC_PC_FAULT;
+            }
+            if (func->code_memory[index].opcode == OPCODE_HALT)
+            {
+                return FUNC_HALT;
+            }
+            block = func->blocks ? func->blocks[index] : NULL;
+            block = block ? block : decode_block(func, index);
+            if (link)
+            {
+                *link = block;
+            }
+        }
+
+        /* One at a time when out of host memory or near the end of count */
+        if (!block || block->count > count)
+        {
+            status = APEX_func_step(func, NULL, &effects);
+            block = NULL;
+            link = NULL;
+        }
+        else
+        {
+            status = run_block(func, block, &link);
+            block = link ? *link : NULL;
+        }
+        count -= func->executed - executed;
+        if (status != FUNC_OK)
+        {
+            return status;
+        }
+    }
+    return FUNC_OK;
+}
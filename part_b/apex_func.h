@@ -0,0 +1,66 @@
+/*
+ * apex_func.h
+ * Contains the APEX functional model declarations
+ *
+ * The functional model executes one instruction at a time with no pipeline,
+ * straight from the ISA semantics, and serves as the golden reference the
+ * pipeline is checked against.
+ */
+#ifndef _APEX_FUNC_H_
+#define _APEX_FUNC_H_
+#include "apex_cpu.h"
+
+/* Outcome of one functional step */
+#define FUNC_OK 0
+#define FUNC_HALT 1                /* HALT executed */
+#define FUNC_PC_FAULT 2            /* PC outside code memory */
+#define FUNC_MEMORY_FAULT 3        /* Access outside data memory */
+
+#define FUNC_BLOCK_MAX 32          /* Instructions decoded into one superblock */
+
+/* Instruction decoded for APEX_func_run, its operands bound to registers */
+typedef struct APEX_Func_Op
+{
+    int opcode;                    /* CID is decoded as MOVC of the core id */
+    int pc;
+    int *rd;
+    int *rs1;
+    int *rs2;
+    int imm;
+    struct APEX_Func_Block *taken; /* Branch target, linked when first taken */
+} APEX_Func_Op;
+
+/*
+ * Straight-line run of decoded instructions from one entry PC. Conditional
+ * branches leave it when taken; it ends at a JUMP, before a HALT or after
+ * FUNC_BLOCK_MAX instructions.
+ */
+typedef struct APEX_Func_Block
+{
+    int count;
+    int next_pc;                   /* PC after the last instruction */
+    struct APEX_Func_Block *fall_through; /* Block at next_pc, linked on first use */
+    APEX_Func_Op ops[];
+} APEX_Func_Block;
+
+/* Architectural state of one core */
+typedef struct APEX_Func
+{
+    int pc;
+    int regs[REG_FILE_SIZE];
+    int zero_flag;
+    int positive_flag;
+    int core_id;
+    const APEX_Instruction *code_memory;
+    int code_memory_size;
+    APEX_Memory *data_memory;      /* Owned by whoever set up the model */
+    unsigned long long executed;
+    APEX_Func_Block **blocks;      /* Decoded block at each code index, or NULL */
+    APEX_Bus *warm;                /* L1s every load and store warms, or NULL */
+} APEX_Func;
+
+void APEX_func_init(APEX_Func *func, const APEX_CPU *cpu, APEX_Memory *data_memory);
+void APEX_func_free(APEX_Func *func);
+int APEX_func_step(APEX_Func *func, const int *load_value, APEX_Retired *effects);
+int APEX_func_run(APEX_Func *func, long long count);
+#endif
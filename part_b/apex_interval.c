@@ -0,0 +1,231 @@
+/*
+ * apex_interval.c
+ * Contains the APEX interval statistics
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "apex_interval.h"
+#include "apex_macros.h"
+
+#define INTERVAL_INITIAL_SAMPLES 256
+
+/*
+ * Appends the counters of a core as they are at the start of a cycle. Returns
+ * FALSE once the samples no longer fit in host memory.
+ */
+static int
+append_sample(APEX_CPU *cpu, int cycle)
+{
+    APEX_Interval *interval = cpu->interval;
+    APEX_Interval_Sample *sample;
+
+    if (interval->failed)
+    {
+        return FALSE;
+    }
+    if (interval->count == interval->capacity)
+    {
+        int capacity = interval->capacity ? 2 * interval->capacity : INTERVAL_INITIAL_SAMPLES;
+
+        sample = realloc(interval->samples, capacity * sizeof(APEX_Interval_Sample));
+        if (!sample)
+        {
+            interval->failed = TRUE;
+            return FALSE;
+        }
+        interval->samples = sample;
+        interval->capacity = capacity;
+    }
+
+    sample = &interval->samples[interval->count++];
+    sample->cycle = cycle;
+    sample->instructions = cpu->insn_completed;
+    sample->stall_cycles = cpu->stall_cycles;
+    sample->load_use_stalls = cpu->load_use_stalls;
+    sample->branch_flushes = cpu->branch_flushes;
+    sample->flushed_insns = cpu->flushed_insns;
+    sample->memory_stall_cycles = cpu->memory_stall_cycles;
+    sample->loads = cpu->loads;
+    sample->stores = cpu->stores;
+    sample->l1_misses = 0;
+    if (cpu->bus)
+    {
+        const APEX_Cache_Stats *stats = &cpu->bus->caches[cpu->core_id].stats;
+
+        sample->l1_misses = stats->read_misses + stats->write_misses;
+    }
+    return TRUE;
+}
+
+/*
+ * Starts sampling every core if --interval was given, called once the
+ * cores exist and any fast-forwarding is done.
+ */
+int
+APEX_interval_attach(APEX_CPU *cpu)
+{
+    if (!cpu->config.interval)
+    {
+        return TRUE;
+    }
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+
+        core->interval = calloc(1, sizeof(APEX_Interval));
+        if (!core->interval)
+        {
+            return FALSE;
+        }
+        core->interval->period = cpu->config.interval;
+        if (!append_sample(core, core->clock))
+        {
+            return FALSE;
+        }
+        core->next_sample = core->clock + cpu->config.interval;
+    }
+    return TRUE;
+}
+
+/*
+ * Called by the pipeline at the start of cycle next_sample. Out of host
+ * memory, the core stops sampling and the file ends early.
+ */
+void
+APEX_interval_sample(APEX_CPU *cpu)
+{
+    if (append_sample(cpu, cpu->clock))
+    {
+        cpu->next_sample += cpu->interval->period;
+    }
+    else
+    {
+        cpu->next_sample = -1;
+    }
+}
+
+/* Writes one row, what the counters gained from one sample to the next */
+static void
+write_row(FILE *fp, int core, const APEX_Interval_Sample *from, const APEX_Interval_Sample *to)
+{
+    int cycles = to->cycle - from->cycle;
+    int instructions = to->instructions - from->instructions;
+
+    fprintf(fp, "%d,%d,%d,%d,%.3f,%d,%d,%d,%d,%d,%d,%d,%lld\n",
+            from->cycle, core, cycles, instructions,
+            cycles ? (double)instructions / cycles : 0.0,
+            to->stall_cycles - from->stall_cycles,
+            to->load_use_stalls - from->load_use_stalls,
+            to->branch_flushes - from->branch_flushes,
+            to->flushed_insns - from->flushed_insns,
+            to->memory_stall_cycles - from->memory_stall_cycles,
+            to->loads - from->loads, to->stores - from->stores,
+            to->l1_misses - from->l1_misses);
+}
+
+/* Reports where the rows went */
+static void
+report_rows(const APEX_CPU *cpu, int rows)
+{
+    char text[512];
+    APEX_Stat stats[] = {
+        {"rows", rows}, {"interval", cpu->config.interval},
+        {"path", 0, cpu->config.interval_path}
+    };
+
+    snprintf(text, sizeof(text), "APEX_CPU: %d intervals of %d cycles written to %s\n",
+             rows, cpu->config.interval, cpu->config.interval_path);
+    APEX_output_stats(cpu->output, "intervals", -1, text, stats, 3);
+}
+
+/*
+ * Closes the last, partial interval of every core and writes the samples of
+ * all cores to the --interval-file, oldest interval first and lower core
+ * first on a tie. Called once when the simulation ends.
+ */
+void
+APEX_interval_write(APEX_CPU *cpu)
+{
+    int next[MAX_CORES];
+    int rows = 0;
+    FILE *fp;
+
+    if (!cpu->interval)
+    {
+        return;
+    }
+
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+        const APEX_Interval_Sample *last = &core->interval->samples[core->interval->count - 1];
+        int end = core->halted ? core->halt_cycle + 1 : core->clock;
+
+        /* A sample taken at the start of the final cycle still misses it */
+        if (end <= last->cycle)
+        {
+            end = last->cycle + 1;
+        }
+        if (!append_sample(core, end))
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for the interval samples of core %d, they stop at cycle %d\n",
+                    id, core->interval->samples[core->interval->count - 1].cycle);
+        }
+        next[id] = 1;
+    }
+
+    fp = fopen(cpu->config.interval_path, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write interval statistics %s\n",
+                cpu->config.interval_path);
+        return;
+    }
+    fprintf(fp, "cycle,core,cycles,instructions,ipc,stall_cycles,load_use_stalls,"
+            "branch_flushes,flushed_insns,memory_stall_cycles,loads,stores,l1_misses\n");
+    while (TRUE)
+    {
+        const APEX_Interval *interval;
+        int core = -1;
+
+        for (int id = 0; id < cpu->config.num_cores; id++)
+        {
+            interval = cpu->cores[id]->interval;
+            if (next[id] < interval->count
+                && (core < 0 || interval->samples[next[id] - 1].cycle
+                                < cpu->cores[core]->interval->samples[next[core] - 1].cycle))
+            {
+                core = id;
+            }
+        }
+        if (core < 0)
+        {
+            break;
+        }
+        interval = cpu->cores[core]->interval;
+        write_row(fp, core, &interval->samples[next[core] - 1], &interval->samples[next[core]]);
+        next[core]++;
+        rows++;
+    }
+    fclose(fp);
+    report_rows(cpu, rows);
+}
+
+/*
+ * Frees the samples of every core.
+ */
+void
+APEX_interval_detach(APEX_CPU *cpu)
+{
+    for (int id = 0; id < MAX_CORES; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+
+        if (core && core->interval)
+        {
+            free(core->interval->samples);
+            free(core->interval);
+            core->interval = NULL;
+        }
+    }
+}
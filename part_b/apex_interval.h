@@ -0,0 +1,44 @@
+/*
+ * apex_interval.h
+ * Contains the APEX interval statistics declarations
+ *
+ * Every --interval cycles each core copies its pipeline counters into a
+ * sample of its own, so the quantum engine's threads never share one. At the
+ * end of the run the samples of all cores are merged in cycle order and
+ * written as one CSV row per core and interval, holding what the counters
+ * gained during that interval.
+ */
+#ifndef _APEX_INTERVAL_H_
+#define _APEX_INTERVAL_H_
+#include "apex_cpu.h"
+
+/* Counters of one core at the start of a cycle */
+typedef struct APEX_Interval_Sample
+{
+    int cycle;
+    int instructions;
+    int stall_cycles;
+    int load_use_stalls;
+    int branch_flushes;            /* Taken branches and jumps, fetch predicts not taken */
+    int flushed_insns;
+    int memory_stall_cycles;
+    int loads;
+    int stores;
+    long long l1_misses;
+} APEX_Interval_Sample;
+
+/* Samples of one core, samples[0] is the start of the run */
+typedef struct APEX_Interval
+{
+    int period;                    /* Cycles between samples */
+    int failed;                    /* Out of host memory, sampling stopped */
+    APEX_Interval_Sample *samples;
+    int count;
+    int capacity;
+} APEX_Interval;
+
+int APEX_interval_attach(APEX_CPU *cpu);
+void APEX_interval_sample(APEX_CPU *cpu);
+void APEX_interval_write(APEX_CPU *cpu);
+void APEX_interval_detach(APEX_CPU *cpu);
+#endif
@@ -0,0 +1,105 @@
+/*
+ * apex_isa.c
+ * Contains the APEX instruction set tables generated from APEX_ISA
+ */
+#include <stdio.h>
+#include <string.h>
+#include "apex_isa.h"
+
+/* Semantics of each instruction, eval_ADD and so on; most use only some of
+ * the operands */
+#define ISA_EVAL(name, mnemonic, format, unit, latency, effects, semantics) \
+    static int                                                              \
+    eval_##name(int a, int b, int imm, int core, int z, int p)             \
+    {                                                                       \
+        (void)a, (void)b, (void)imm, (void)core, (void)z, (void)p;          \
+        return semantics;                                                   \
+    }
+APEX_ISA(ISA_EVAL)
+#undef ISA_EVAL
+
+#define ISA_ENTRY(name, mnemonic, format, unit, latency, effects, semantics) \
+    {mnemonic, format, unit, latency, effects, eval_##name},
+const APEX_Isa_Op apex_isa[NUM_OPCODES] = {
+    APEX_ISA(ISA_ENTRY)
+};
+#undef ISA_ENTRY
+
+#define OPERANDS(count, first, second, third) \
+    {count, {first, second, third}, (first) | (second) | (third)}
+const APEX_Isa_Format apex_formats[NUM_FORMATS] = {
+    [FORMAT_RRR] = OPERANDS(3, OPND_RD, OPND_RS1, OPND_RS2),
+    [FORMAT_RRI] = OPERANDS(3, OPND_RD, OPND_RS1, OPND_IMM),
+    [FORMAT_RI] = OPERANDS(2, OPND_RD, OPND_IMM, 0),
+    [FORMAT_R] = OPERANDS(1, OPND_RD, 0, 0),
+    [FORMAT_SSI] = OPERANDS(3, OPND_RS1, OPND_RS2, OPND_IMM),
+    [FORMAT_SS] = OPERANDS(2, OPND_RS1, OPND_RS2, 0),
+    [FORMAT_SI] = OPERANDS(2, OPND_RS1, OPND_IMM, 0),
+    [FORMAT_I] = OPERANDS(1, OPND_IMM, 0, 0),
+    [FORMAT_NONE] = OPERANDS(0, 0, 0, 0)
+};
+#undef OPERANDS
+
+/*
+ * Returns the opcode of a mnemonic, or -1 if there is no such instruction.
+ */
+int
+APEX_isa_opcode(const char *mnemonic)
+{
+    for (int opcode = 0; opcode < NUM_OPCODES; opcode++)
+    {
+        if (strcmp(mnemonic, apex_isa[opcode].mnemonic) == 0)
+        {
+            return opcode;
+        }
+    }
+    return -1;
+}
+
+/*
+ * DIV, 0 for a zero divisor. The most negative number over -1 wraps instead
+ * of trapping on the host.
+ */
+int
+APEX_isa_divide(int a, int b)
+{
+    if (b == 0)
+    {
+        return 0;
+    }
+    if (b == -1)
+    {
+        return (int)(0u - (unsigned int)a);
+    }
+    return a / b;
+}
+
+/*
+ * Writes an instruction as listed in the pipeline display, the mnemonic and
+ * its operands separated by commas, e.g. "ADDL,R1,R2,#4".
+ */
+void
+APEX_isa_format(int opcode, int rd, int rs1, int rs2, int imm, char *text, size_t size)
+{
+    const APEX_Isa_Format *format = &apex_formats[apex_isa[opcode].format];
+    int used = snprintf(text, size, "%s", apex_isa[opcode].mnemonic);
+
+    for (int i = 0; i < format->count && used >= 0 && (size_t)used < size; i++)
+    {
+        switch (format->operands[i])
+        {
+            case OPND_RD:
+                used += snprintf(text + used, size - used, ",R%d", rd);
+                break;
+            case OPND_RS1:
+                used += snprintf(text + used, size - used, ",R%d", rs1);
+                break;
+            case OPND_RS2:
+                used += snprintf(text + used, size - used, ",R%d", rs2);
+                break;
+            default:
+                used += snprintf(text + used, size - used, ",#%d", imm);
+                break;
+        }
+    }
+}
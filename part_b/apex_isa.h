@@ -0,0 +1,126 @@
+/*
+ * apex_isa.h
+ * Contains the APEX instruction set definition
+ *
+ * Every instruction is one line of APEX_ISA. The opcode numbers, the
+ * assembler, the disassembler and the way each pipeline stage handles an
+ * instruction all come from it, so an ISA experiment is an edit of this table.
+ *
+ *   X(NAME, mnemonic, format, unit, latency, effects, semantics)
+ *
+ * format     FORMAT_*, the operands in assembly order; this also says which
+ *            registers are read and whether rd is written
+ * unit       UNIT_*, the functional unit class, which says what the stages do
+ * latency    cycles the instruction spends in the last execute sub-stage
+ * effects    EFFECT_* bits for flags and the LDI/STI address increment
+ * semantics  expression of a and b (the rs1 and rs2 values), imm, core (the
+ *            core id) and z and p (the flags), giving the result of ALU,
+ *            MUL and DIV instructions, the address of loads and stores, the
+ *            taken condition of branches or the target of jumps
+ *
+ * New entries go at the end so that the opcode numbers of the others, which
+ * appear in traces, stay the same.
+ */
+#ifndef _APEX_ISA_H_
+#define _APEX_ISA_H_
+#include <stddef.h>
+
+#define APEX_ISA(X) \
+    X(ADD,   "ADD",   FORMAT_RRR,  UNIT_ALU,    1, EFFECT_FLAGS,     a + b) \
+    X(SUB,   "SUB",   FORMAT_RRR,  UNIT_ALU,    1, EFFECT_FLAGS,     a - b) \
+    X(MUL,   "MUL",   FORMAT_RRR,  UNIT_MUL,    1, EFFECT_FLAGS,     a * b) \
+    X(DIV,   "DIV",   FORMAT_RRR,  UNIT_DIV,    1, EFFECT_FLAGS,     APEX_isa_divide(a, b)) \
+    X(AND,   "AND",   FORMAT_RRR,  UNIT_ALU,    1, EFFECT_NONE,      a & b) \
+    X(OR,    "OR",    FORMAT_RRR,  UNIT_ALU,    1, EFFECT_NONE,      a | b) \
+    X(XOR,   "EXOR",  FORMAT_RRR,  UNIT_ALU,    1, EFFECT_NONE,      a ^ b) \
+    X(MOVC,  "MOVC",  FORMAT_RI,   UNIT_ALU,    1, EFFECT_NONE,      imm) \
+    X(LOAD,  "LOAD",  FORMAT_RRI,  UNIT_LOAD,   1, EFFECT_NONE,      a + imm) \
+    X(STORE, "STORE", FORMAT_SSI,  UNIT_STORE,  1, EFFECT_NONE,      b + imm) \
+    X(BZ,    "BZ",    FORMAT_I,    UNIT_BRANCH, 1, EFFECT_NONE,      z) \
+    X(BNZ,   "BNZ",   FORMAT_I,    UNIT_BRANCH, 1, EFFECT_NONE,      !z) \
+    X(HALT,  "HALT",  FORMAT_NONE, UNIT_NONE,   1, EFFECT_NONE,      0) \
+    X(ADDL,  "ADDL",  FORMAT_RRI,  UNIT_ALU,    1, EFFECT_FLAGS,     a + imm) \
+    X(SUBL,  "SUBL",  FORMAT_RRI,  UNIT_ALU,    1, EFFECT_FLAGS,     a - imm) \
+    X(LDI,   "LDI",   FORMAT_RRI,  UNIT_LOAD,   1, EFFECT_INCREMENT, a + imm) \
+    X(STI,   "STI",   FORMAT_SSI,  UNIT_STORE,  1, EFFECT_INCREMENT, b + imm) \
+    X(BP,    "BP",    FORMAT_I,    UNIT_BRANCH, 1, EFFECT_NONE,      p) \
+    X(BNP,   "BNP",   FORMAT_I,    UNIT_BRANCH, 1, EFFECT_NONE,      !p) \
+    X(CMP,   "CMP",   FORMAT_SS,   UNIT_ALU,    1, EFFECT_COMPARE,   0) \
+    X(NOP,   "NOP",   FORMAT_NONE, UNIT_NONE,   1, EFFECT_NONE,      0) \
+    X(JUMP,  "JUMP",  FORMAT_SI,   UNIT_JUMP,   1, EFFECT_NONE,      a + imm) \
+    X(CID,   "CID",   FORMAT_R,    UNIT_ALU,    1, EFFECT_NONE,      core)
+
+/* Opcodes, OPCODE_ADD and so on in table order */
+#define ISA_OPCODE(name, mnemonic, format, unit, latency, effects, semantics) OPCODE_##name,
+enum
+{
+    APEX_ISA(ISA_OPCODE)
+    NUM_OPCODES
+};
+#undef ISA_OPCODE
+
+/* Operands, as bits of APEX_Isa_Format.uses */
+#define OPND_RD 0x1
+#define OPND_RS1 0x2
+#define OPND_RS2 0x4
+#define OPND_IMM 0x8
+
+/* Operand formats, see apex_formats */
+#define FORMAT_RRR 0                   /* rd,rs1,rs2 */
+#define FORMAT_RRI 1                   /* rd,rs1,#imm */
+#define FORMAT_RI 2                    /* rd,#imm */
+#define FORMAT_R 3                     /* rd */
+#define FORMAT_SSI 4                   /* rs1,rs2,#imm */
+#define FORMAT_SS 5                    /* rs1,rs2 */
+#define FORMAT_SI 6                    /* rs1,#imm */
+#define FORMAT_I 7                     /* #imm */
+#define FORMAT_NONE 8
+#define NUM_FORMATS 9
+
+/* Functional unit classes. Those up to UNIT_DIV write a result to rd */
+#define UNIT_ALU 0
+#define UNIT_MUL 1
+#define UNIT_DIV 2
+#define UNIT_LOAD 3                    /* Loads rd from the address */
+#define UNIT_STORE 4                   /* Stores rs1 at the address */
+#define UNIT_BRANCH 5                  /* Goes to pc + imm if taken */
+#define UNIT_JUMP 6                    /* Goes to the target */
+#define UNIT_NONE 7
+#define NUM_UNITS 8
+
+/* Side effects */
+#define EFFECT_NONE 0x0
+#define EFFECT_FLAGS 0x1               /* Zero and positive flags of the result */
+#define EFFECT_COMPARE 0x2             /* Zero flag if a == b, positive if a > b */
+#define EFFECT_INCREMENT 0x4           /* Address register += 4 */
+
+typedef struct APEX_Isa_Format
+{
+    int count;
+    int operands[3];               /* OPND_* in assembly order */
+    int uses;                      /* OPND_* bits of all of them */
+} APEX_Isa_Format;
+
+typedef struct APEX_Isa_Op
+{
+    const char *mnemonic;
+    int format;
+    int unit;
+    int latency;
+    int effects;
+    int (*eval)(int a, int b, int imm, int core, int z, int p);
+} APEX_Isa_Op;
+
+extern const APEX_Isa_Op apex_isa[NUM_OPCODES];
+extern const APEX_Isa_Format apex_formats[NUM_FORMATS];
+
+/* Whether an opcode has an operand, e.g. APEX_ISA_USES(op, OPND_RD) */
+#define APEX_ISA_USES(opcode, operand) (apex_formats[apex_isa[opcode].format].uses & (operand))
+
+/* The register LDI and STI increment, rs2 for stores and rs1 otherwise */
+#define APEX_ISA_BASE(opcode, rs1, rs2) (apex_isa[opcode].unit == UNIT_STORE ? (rs2) : (rs1))
+
+int APEX_isa_opcode(const char *mnemonic);
+int APEX_isa_divide(int a, int b);
+void APEX_isa_format(int opcode, int rd, int rs1, int rs2, int imm, char *text, size_t size);
+#endif
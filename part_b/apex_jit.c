@@ -0,0 +1,640 @@
+/*
+ * apex_jit.c
+ * Contains the APEX dynamic binary translator
+ *
+ * The translation cache starts with an entry routine, called by APEX_jit_run
+ * with the block to run, that loads rbx with the APEX_Func, rbp with the
+ * APEX_Jit, r12d and r13d with the zero and positive flags and r14 with data
+ * memory. Blocks run with them in place, jump to each other and leave through
+ * the exit code after the entry routine, with the reason in eax.
+ *
+ * A block first takes its instruction count from the budget, or leaves for
+ * the interpreter if the budget is short. Loads and stores call the memory
+ * module. Exits to blocks not translated yet are linked in place, turning
+ * them into a direct jump, the first time they are taken.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "apex_jit.h"
+#include "apex_macros.h"
+
+/* Host registers */
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RSP 4
+#define RBP 5
+#define RSI 6
+#define RDI 7
+#define R12 12
+#define R13 13
+#define R14 14
+#define R15 15
+
+/* Why a block returned to APEX_jit_run, the PC is stored in every case */
+#define EXIT_LOOKUP 0                  /* Jump, or a PC that is not code */
+#define EXIT_HALT 1                    /* At HALT, not executed */
+#define EXIT_FAULT 2                   /* At a load or store out of range */
+#define EXIT_BUDGET 3                  /* Budget shorter than the block */
+#define EXIT_LINK 4                    /* Plus the number of an exit to link */
+
+/* Room kept for one block, well above JIT_MAX_BLOCK of the longest instruction */
+#define JIT_BLOCK_BYTES 16384
+
+#define REG_OFFSET(reg) ((int)(offsetof(APEX_Func, regs) + (reg) * sizeof(int)))
+
+typedef int (*Jit_Entry)(APEX_Jit *jit, APEX_Func *func, unsigned char *block);
+
+static void
+emit_byte(APEX_Jit *jit, int byte)
+{
+    jit->code[jit->used++] = (unsigned char)byte;
+}
+
+static void
+emit_u32(APEX_Jit *jit, unsigned int value)
+{
+    memcpy(&jit->code[jit->used], &value, 4);
+    jit->used += 4;
+}
+
+static void
+emit_rex(APEX_Jit *jit, int wide, int reg, int rm)
+{
+    int rex = 0x40 | (wide ? 8 : 0) | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0);
+
+    if (rex != 0x40)
+    {
+        emit_byte(jit, rex);
+    }
+}
+
+static void
+emit_opcode(APEX_Jit *jit, int opcode)
+{
+    if (opcode > 0xff)
+    {
+        emit_byte(jit, opcode >> 8);
+    }
+    emit_byte(jit, opcode & 0xff);
+}
+
+/* Instruction with a register, or opcode extension, and [base + disp32] */
+static void
+emit_mem(APEX_Jit *jit, int wide, int opcode, int reg, int base, int disp)
+{
+    emit_rex(jit, wide, reg, base);
+    emit_opcode(jit, opcode);
+    emit_byte(jit, 0x80 | ((reg & 7) << 3) | (base & 7));
+    emit_u32(jit, (unsigned int)disp);
+}
+
+/* Instruction with a register, or opcode extension, and a register */
+static void
+emit_reg(APEX_Jit *jit, int wide, int opcode, int reg, int rm)
+{
+    emit_rex(jit, wide, reg, rm);
+    emit_opcode(jit, opcode);
+    emit_byte(jit, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* Jump or conditional jump with a rel32 to fill in, returns where it is */
+static size_t
+emit_jump(APEX_Jit *jit, int opcode)
+{
+    emit_opcode(jit, opcode);
+    emit_u32(jit, 0);
+    return jit->used - 4;
+}
+
+static void
+patch_jump(APEX_Jit *jit, size_t at, size_t target)
+{
+    unsigned int rel = (unsigned int)(target - (at + 4));
+
+    memcpy(&jit->code[at], &rel, 4);
+}
+
+static void
+emit_exit(APEX_Jit *jit, int pc, int reason)
+{
+    emit_mem(jit, FALSE, 0xc7, 0, RBX, offsetof(APEX_Func, pc));
+    emit_u32(jit, (unsigned int)pc);
+    emit_byte(jit, 0xb8 + RAX);
+    emit_u32(jit, (unsigned int)reason);
+    patch_jump(jit, emit_jump(jit, 0xe9), jit->epilogue);
+}
+
+/* Sets the flags from the result in eax */
+static void
+emit_flags(APEX_Jit *jit)
+{
+    emit_reg(jit, FALSE, 0x85, RAX, RAX);              /* test eax, eax */
+    emit_reg(jit, FALSE, 0x0f94, 0, R12);              /* setz r12b */
+    emit_reg(jit, FALSE, 0x0f9f, 0, R13);              /* setg r13b */
+}
+
+static int
+code_index(const APEX_Func *func, int pc)
+{
+    int index = (pc - 4000) / 4;
+
+    if (pc < 4000 || (pc - 4000) % 4 || index >= func->code_memory_size)
+    {
+        return -1;
+    }
+    return index;
+}
+
+/*
+ * Continues at a PC, directly if its block is translated, otherwise through
+ * an exit that is linked once it is. Returns FALSE if out of host memory.
+ */
+static int
+emit_continue(APEX_Jit *jit, int pc)
+{
+    int index = code_index(jit->func, pc);
+
+    if (index < 0)
+    {
+        emit_exit(jit, pc, EXIT_LOOKUP);
+        return TRUE;
+    }
+    if (jit->entry[index])
+    {
+        patch_jump(jit, emit_jump(jit, 0xe9), jit->entry[index] - jit->code);
+        return TRUE;
+    }
+    if (jit->num_exits == jit->max_exits)
+    {
+        int max = jit->max_exits ? jit->max_exits * 2 : 256;
+        APEX_Jit_Exit *exits = realloc(jit->exits, max * sizeof(APEX_Jit_Exit));
+
+        if (!exits)
+        {
+            return FALSE;
+        }
+        jit->exits = exits;
+        jit->max_exits = max;
+    }
+    jit->exits[jit->num_exits].offset = jit->used;
+    jit->exits[jit->num_exits].target = index;
+    emit_exit(jit, pc, EXIT_LINK + jit->num_exits++);
+    return TRUE;
+}
+
+/*
+ * Emits the routine APEX_jit_run calls to run a block, and the exit code
+ * blocks return through.
+ */
+static void
+emit_entry(APEX_Jit *jit)
+{
+    static const int saved[] = {RBX, RBP, R12, R13, R14, R15};
+
+    for (int i = 0; i < 6; i++)
+    {
+        emit_rex(jit, FALSE, 0, saved[i]);
+        emit_byte(jit, 0x50 + (saved[i] & 7));        /* push */
+    }
+    emit_reg(jit, TRUE, 0x83, 5, RSP);                 /* sub rsp, 8 */
+    emit_byte(jit, 8);
+    emit_reg(jit, TRUE, 0x89, RDI, RBP);               /* mov rbp, rdi */
+    emit_reg(jit, TRUE, 0x89, RSI, RBX);               /* mov rbx, rsi */
+    emit_mem(jit, FALSE, 0x8b, R12, RBX, offsetof(APEX_Func, zero_flag));
+    emit_mem(jit, FALSE, 0x8b, R13, RBX, offsetof(APEX_Func, positive_flag));
+    emit_mem(jit, TRUE, 0x8b, R14, RBX, offsetof(APEX_Func, data_memory));
+    emit_reg(jit, FALSE, 0xff, 4, RDX);                /* jmp rdx */
+
+    jit->epilogue = jit->used;
+    emit_mem(jit, FALSE, 0x89, R12, RBX, offsetof(APEX_Func, zero_flag));
+    emit_mem(jit, FALSE, 0x89, R13, RBX, offsetof(APEX_Func, positive_flag));
+    emit_reg(jit, TRUE, 0x83, 0, RSP);                 /* add rsp, 8 */
+    emit_byte(jit, 8);
+    for (int i = 5; i >= 0; i--)
+    {
+        emit_rex(jit, FALSE, 0, saved[i]);
+        emit_byte(jit, 0x58 + (saved[i] & 7));        /* pop */
+    }
+    emit_byte(jit, 0xc3);                              /* ret */
+    jit->first_block = jit->used;
+}
+
+/* Calls a memory function with data memory, esi and edx as arguments */
+static void
+emit_memory_call(APEX_Jit *jit, void *function)
+{
+    uint64_t address = (uint64_t)(uintptr_t)function;
+
+    emit_reg(jit, TRUE, 0x89, R14, RDI);               /* mov rdi, r14 */
+    emit_byte(jit, 0x48);                              /* mov rax, imm64 */
+    emit_byte(jit, 0xb8);
+    memcpy(&jit->code[jit->used], &address, 8);
+    jit->used += 8;
+    emit_reg(jit, FALSE, 0xff, 2, RAX);                /* call rax */
+}
+
+/*
+ * Computes the address of a load or store into esi, keeping the base
+ * register's value in r15d for LDI and STI. Returns the jump to take if it
+ * is out of range, or 0 when every address is in range.
+ */
+static size_t
+emit_address(APEX_Jit *jit, int base, int imm)
+{
+    emit_mem(jit, FALSE, 0x8b, R15, RBX, REG_OFFSET(base));
+    emit_reg(jit, FALSE, 0x89, R15, RSI);              /* mov esi, r15d */
+    emit_reg(jit, FALSE, 0x81, 0, RSI);                /* add esi, imm */
+    emit_u32(jit, (unsigned int)imm);
+    if (jit->func->data_memory->size >= MEM_ADDRESS_SPACE)
+    {
+        return 0;
+    }
+    emit_reg(jit, FALSE, 0x81, 7, RSI);                /* cmp esi, size */
+    emit_u32(jit, (unsigned int)jit->func->data_memory->size);
+    return emit_jump(jit, 0x0f83);                     /* jae */
+}
+
+/* Writes r15d plus 4 back to a register, for LDI and STI */
+static void
+emit_post_increment(APEX_Jit *jit, int reg)
+{
+    emit_reg(jit, FALSE, 0x83, 0, R15);                /* add r15d, 4 */
+    emit_byte(jit, 4);
+    emit_mem(jit, FALSE, 0x89, R15, RBX, REG_OFFSET(reg));
+}
+
+/* DIV as the functional model does it, 0 for a zero divisor */
+static void
+emit_divide(APEX_Jit *jit, const APEX_Instruction *insn)
+{
+    size_t by_zero, by_minus_one, done, done_negated;
+
+    emit_mem(jit, FALSE, 0x8b, RCX, RBX, REG_OFFSET(insn->rs2));
+    emit_mem(jit, FALSE, 0x8b, RAX, RBX, REG_OFFSET(insn->rs1));
+    emit_reg(jit, FALSE, 0x85, RCX, RCX);              /* test ecx, ecx */
+    by_zero = emit_jump(jit, 0x0f84);
+    emit_reg(jit, FALSE, 0x83, 7, RCX);                /* cmp ecx, -1 */
+    emit_byte(jit, 0xff);
+    by_minus_one = emit_jump(jit, 0x0f84);
+    emit_byte(jit, 0x99);                              /* cdq */
+    emit_reg(jit, FALSE, 0xf7, 7, RCX);                /* idiv ecx */
+    done = emit_jump(jit, 0xe9);
+
+    /* idiv faults on the most negative number over -1, which wraps */
+    patch_jump(jit, by_minus_one, jit->used);
+    emit_reg(jit, FALSE, 0xf7, 3, RAX);                /* neg eax */
+    done_negated = emit_jump(jit, 0xe9);
+
+    patch_jump(jit, by_zero, jit->used);
+    emit_reg(jit, FALSE, 0x31, RAX, RAX);              /* xor eax, eax */
+    patch_jump(jit, done, jit->used);
+    patch_jump(jit, done_negated, jit->used);
+}
+
+static void
+flush(APEX_Jit *jit)
+{
+    jit->used = jit->first_block;
+    memset(jit->entry, 0, jit->func->code_memory_size * sizeof(unsigned char *));
+    jit->num_exits = 0;
+    jit->flushes++;
+}
+
+/*
+ * Translates the basic block starting at a code memory index. It runs to the
+ * first branch, jump or HALT, or JIT_MAX_BLOCK instructions. Returns the
+ * block, or NULL if out of host memory.
+ */
+static unsigned char *
+translate(APEX_Jit *jit, int index)
+{
+    const APEX_Instruction *code = jit->func->code_memory;
+    size_t faults[JIT_MAX_BLOCK];
+    int fault_at[JIT_MAX_BLOCK];
+    int num_faults = 0;
+    size_t short_budget = 0;
+    size_t start;
+    int length = 0;
+    int counted;
+    int ends_block = FALSE;
+
+    if (jit->used + JIT_BLOCK_BYTES > JIT_CODE_BYTES)
+    {
+        flush(jit);
+    }
+    while (index + length < jit->func->code_memory_size && length < JIT_MAX_BLOCK)
+    {
+        int opcode = code[index + length++].opcode;
+
+        if (opcode == OPCODE_HALT || opcode == OPCODE_JUMP || opcode == OPCODE_BZ
+            || opcode == OPCODE_BNZ || opcode == OPCODE_BP || opcode == OPCODE_BNP)
+        {
+            ends_block = TRUE;
+            break;
+        }
+    }
+    /* HALT is left for the caller to execute */
+    counted = length - (code[index + length - 1].opcode == OPCODE_HALT);
+
+    start = jit->used;
+    jit->entry[index] = jit->code + start;
+    if (counted)
+    {
+        emit_mem(jit, TRUE, 0x81, 7, RBP, offsetof(APEX_Jit, budget));
+        emit_u32(jit, counted);                        /* cmp budget, counted */
+        short_budget = emit_jump(jit, 0x0f8c);         /* jl */
+        emit_mem(jit, TRUE, 0x81, 5, RBP, offsetof(APEX_Jit, budget));
+        emit_u32(jit, counted);                        /* sub budget, counted */
+    }
+
+    for (int k = 0; k < length; k++)
+    {
+        const APEX_Instruction *insn = &code[index + k];
+        int pc = 4000 + (index + k) * 4;
+        int result = TRUE;
+        size_t fault;
+
+        switch (insn->opcode)
+        {
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_MUL:
+            case OPCODE_AND:
+            case OPCODE_OR:
+            case OPCODE_XOR:
+            {
+                static const int alu[] = {
+                    [OPCODE_ADD] = 0x03, [OPCODE_SUB] = 0x2b, [OPCODE_MUL] = 0x0faf,
+                    [OPCODE_AND] = 0x23, [OPCODE_OR] = 0x0b, [OPCODE_XOR] = 0x33
+                };
+
+                emit_mem(jit, FALSE, 0x8b, RAX, RBX, REG_OFFSET(insn->rs1));
+                emit_mem(jit, FALSE, alu[insn->opcode], RAX, RBX, REG_OFFSET(insn->rs2));
+                emit_mem(jit, FALSE, 0x89, RAX, RBX, REG_OFFSET(insn->rd));
+                if (insn->opcode == OPCODE_ADD || insn->opcode == OPCODE_SUB
+                    || insn->opcode == OPCODE_MUL)
+                {
+                    emit_flags(jit);
+                }
+                break;
+            }
+            case OPCODE_ADDL:
+            case OPCODE_SUBL:
+                emit_mem(jit, FALSE, 0x8b, RAX, RBX, REG_OFFSET(insn->rs1));
+                emit_reg(jit, FALSE, 0x81, insn->opcode == OPCODE_ADDL ? 0 : 5, RAX);
+                emit_u32(jit, (unsigned int)insn->imm);
+                emit_mem(jit, FALSE, 0x89, RAX, RBX, REG_OFFSET(insn->rd));
+                emit_flags(jit);
+                break;
+            case OPCODE_DIV:
+                emit_divide(jit, insn);
+                emit_mem(jit, FALSE, 0x89, RAX, RBX, REG_OFFSET(insn->rd));
+                emit_flags(jit);
+                break;
+            case OPCODE_MOVC:
+            case OPCODE_CID:
+                emit_mem(jit, FALSE, 0xc7, 0, RBX, REG_OFFSET(insn->rd));
+                emit_u32(jit, (unsigned int)(insn->opcode == OPCODE_MOVC
+                                             ? insn->imm : jit->func->core_id));
+                break;
+            case OPCODE_CMP:
+                emit_mem(jit, FALSE, 0x8b, RAX, RBX, REG_OFFSET(insn->rs1));
+                emit_mem(jit, FALSE, 0x3b, RAX, RBX, REG_OFFSET(insn->rs2));
+                emit_reg(jit, FALSE, 0x0f94, 0, R12);  /* setz r12b */
+                emit_reg(jit, FALSE, 0x0f9f, 0, R13);  /* setg r13b */
+                break;
+
+            case OPCODE_LOAD:
+            case OPCODE_LDI:
+                fault = emit_address(jit, insn->rs1, insn->imm);
+                emit_memory_call(jit, (void *)APEX_memory_read);
+                emit_mem(jit, FALSE, 0x89, RAX, RBX, REG_OFFSET(insn->rd));
+                if (insn->opcode == OPCODE_LDI)
+                {
+                    emit_post_increment(jit, insn->rs1);
+                }
+                if (fault)
+                {
+                    faults[num_faults] = fault;
+                    fault_at[num_faults++] = k;
+                }
+                break;
+            case OPCODE_STORE:
+            case OPCODE_STI:
+                fault = emit_address(jit, insn->rs2, insn->imm);
+                emit_mem(jit, FALSE, 0x8b, RDX, RBX, REG_OFFSET(insn->rs1));
+                emit_memory_call(jit, (void *)APEX_memory_write);
+                if (insn->opcode == OPCODE_STI)
+                {
+                    emit_post_increment(jit, insn->rs2);
+                }
+                if (fault)
+                {
+                    faults[num_faults] = fault;
+                    fault_at[num_faults++] = k;
+                }
+                break;
+
+            case OPCODE_BZ:
+            case OPCODE_BNZ:
+            case OPCODE_BP:
+            case OPCODE_BNP:
+            {
+                int flag = insn->opcode == OPCODE_BZ || insn->opcode == OPCODE_BNZ ? R12 : R13;
+                int on_set = insn->opcode == OPCODE_BZ || insn->opcode == OPCODE_BP;
+                size_t taken;
+
+                emit_reg(jit, FALSE, 0x85, flag, flag);
+                taken = emit_jump(jit, on_set ? 0x0f85 : 0x0f84);
+                result = emit_continue(jit, pc + 4);
+                patch_jump(jit, taken, jit->used);
+                result = result && emit_continue(jit, pc + insn->imm);
+                break;
+            }
+            case OPCODE_JUMP:
+                emit_mem(jit, FALSE, 0x8b, RAX, RBX, REG_OFFSET(insn->rs1));
+                emit_reg(jit, FALSE, 0x81, 0, RAX);    /* add eax, imm */
+                emit_u32(jit, (unsigned int)insn->imm);
+                emit_mem(jit, FALSE, 0x89, RAX, RBX, offsetof(APEX_Func, pc));
+                emit_byte(jit, 0xb8 + RAX);
+                emit_u32(jit, EXIT_LOOKUP);
+                patch_jump(jit, emit_jump(jit, 0xe9), jit->epilogue);
+                break;
+            case OPCODE_HALT:
+                emit_exit(jit, pc, EXIT_HALT);
+                break;
+
+            default:
+                break;
+        }
+        if (!result)
+        {
+            jit->entry[index] = NULL;
+            jit->used = start;
+            return NULL;
+        }
+    }
+    if (!ends_block && !emit_continue(jit, 4000 + (index + length) * 4))
+    {
+        jit->entry[index] = NULL;
+        jit->used = start;
+        return NULL;
+    }
+
+    /* Out of line exits, giving back the instructions not executed */
+    if (counted)
+    {
+        patch_jump(jit, short_budget, jit->used);
+        emit_exit(jit, 4000 + index * 4, EXIT_BUDGET);
+    }
+    for (int i = 0; i < num_faults; i++)
+    {
+        patch_jump(jit, faults[i], jit->used);
+        emit_mem(jit, TRUE, 0x81, 0, RBP, offsetof(APEX_Jit, budget));
+        emit_u32(jit, counted - fault_at[i]);          /* add budget, left */
+        emit_exit(jit, 4000 + (index + fault_at[i]) * 4, EXIT_FAULT);
+    }
+    jit->blocks++;
+    return jit->entry[index];
+}
+
+/*
+ * Turns an exit taken to a block not translated at the time into a direct
+ * jump, translating the block if needed.
+ */
+static void
+link_exit(APEX_Jit *jit, int exit)
+{
+    APEX_Jit_Exit taken = jit->exits[exit];
+    unsigned char *block = jit->entry[taken.target];
+    int flushes = jit->flushes;
+
+    if (!block)
+    {
+        block = translate(jit, taken.target);
+    }
+    /* A flush while translating took the exit away */
+    if (block && flushes == jit->flushes)
+    {
+        jit->code[taken.offset] = 0xe9;
+        patch_jump(jit, taken.offset + 1, block - jit->code);
+    }
+}
+
+/*
+ * Creates a translator for a functional model. Without translate, on hosts
+ * other than x86-64 or when the host refuses executable memory, every
+ * instruction is interpreted.
+ */
+APEX_Jit *
+APEX_jit_create(APEX_Func *func, int translate)
+{
+    APEX_Jit *jit = calloc(1, sizeof(APEX_Jit));
+
+    if (!jit)
+    {
+        return NULL;
+    }
+    jit->func = func;
+#if defined(__x86_64__)
+    if (translate && func->code_memory_size)
+    {
+        void *code = mmap(NULL, JIT_CODE_BYTES, PROT_READ | PROT_WRITE | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        jit->entry = calloc(func->code_memory_size, sizeof(unsigned char *));
+        if (code != MAP_FAILED && jit->entry)
+        {
+            jit->code = code;
+            emit_entry(jit);
+        }
+        else if (code != MAP_FAILED)
+        {
+            munmap(code, JIT_CODE_BYTES);
+        }
+    }
+#endif
+    return jit;
+}
+
+void
+APEX_jit_free(APEX_Jit *jit)
+{
+    if (!jit)
+    {
+        return;
+    }
+    if (jit->code)
+    {
+        munmap(jit->code, JIT_CODE_BYTES);
+    }
+    free(jit->entry);
+    free(jit->exits);
+    free(jit);
+}
+
+/* Runs the rest of the budget on the functional model's block interpreter */
+static int
+interpret(APEX_Jit *jit)
+{
+    unsigned long long executed = jit->func->executed;
+    int status = APEX_func_run(jit->func, jit->budget);
+
+    jit->budget -= jit->func->executed - executed;
+    return status;
+}
+
+/*
+ * Executes up to count instructions on the functional model. Stops early at
+ * HALT, at a PC outside code memory or at an access outside data memory,
+ * leaving the PC at that instruction without executing it, and returns the
+ * FUNC_* outcome; FUNC_OK when all count were executed.
+ */
+int
+APEX_jit_run(APEX_Jit *jit, long long count)
+{
+    APEX_Func *func = jit->func;
+
+    jit->budget = count;
+    while (jit->budget > 0)
+    {
+        int index = code_index(func, func->pc);
+        unsigned char *block = NULL;
+        long long before = jit->budget;
+        Jit_Entry run;
+        int exit;
+
+        if (jit->code && index >= 0 && func->code_memory[index].opcode != OPCODE_HALT)
+        {
+            block = jit->entry[index] ? jit->entry[index] : translate(jit, index);
+        }
+        if (!block)
+        {
+            return interpret(jit);
+        }
+
+        run = (Jit_Entry)(void *)jit->code;
+        exit = run(jit, func, block);
+        func->executed += before - jit->budget;
+        switch (exit)
+        {
+            case EXIT_LOOKUP:
+                break;
+            case EXIT_HALT:
+                return FUNC_HALT;
+            case EXIT_FAULT:
+                return FUNC_MEMORY_FAULT;
+            case EXIT_BUDGET:
+                return interpret(jit);
+            default:
+                link_exit(jit, exit - EXIT_LINK);
+                break;
+        }
+    }
+    return FUNC_OK;
+}
@@ -0,0 +1,47 @@
+/*
+ * apex_jit.h
+ * Contains the APEX dynamic binary translator declarations
+ *
+ * The translator runs the functional model fast by turning each basic block
+ * of code memory into x86-64 code the first time it is entered. The block
+ * keeps the flags in host registers, reads and writes the register file of
+ * the APEX_Func in place and jumps straight to the next block once that one
+ * is translated too. Anything it does not translate falls back to the
+ * functional model's block interpreter, APEX_func_run, as does everything on
+ * other hosts.
+ */
+#ifndef _APEX_JIT_H_
+#define _APEX_JIT_H_
+#include "apex_func.h"
+
+#define JIT_CODE_BYTES (4u << 20)  /* Translation cache, flushed whole when full */
+#define JIT_MAX_BLOCK 64           /* Instructions translated into one block */
+#define FAST_FORWARD_TURN 10000    /* Instructions a core fast-forwards per turn */
+
+/* Exit of a block to a block not translated when it was */
+typedef struct APEX_Jit_Exit
+{
+    unsigned int offset;           /* Of the exit in the translation cache */
+    int target;                    /* Code memory index it leaves for */
+} APEX_Jit_Exit;
+
+typedef struct APEX_Jit
+{
+    APEX_Func *func;
+    long long budget;              /* Instructions the blocks may still execute */
+    unsigned char *code;           /* Translation cache, NULL when not translating */
+    size_t used;
+    size_t first_block;            /* Blocks start after the entry and exit code */
+    size_t epilogue;               /* Returns from the blocks to APEX_jit_run */
+    unsigned char **entry;         /* Block at each code memory index, or NULL */
+    APEX_Jit_Exit *exits;
+    int num_exits;
+    int max_exits;
+    long long blocks;              /* Blocks translated */
+    int flushes;                   /* Times the translation cache filled up */
+} APEX_Jit;
+
+APEX_Jit *APEX_jit_create(APEX_Func *func, int translate);
+void APEX_jit_free(APEX_Jit *jit);
+int APEX_jit_run(APEX_Jit *jit, long long count);
+#endif
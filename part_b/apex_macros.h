@@ -18,40 +18,77 @@
 /* Size of integer register file */
 #define REG_FILE_SIZE 16
 
-/* Numeric OPCODE identifiers for instructions */
-#define OPCODE_ADD 0x0
-#define OPCODE_SUB 0x1
-#define OPCODE_MUL 0x2
-#define OPCODE_DIV 0x3
-#define OPCODE_AND 0x4
-#define OPCODE_OR 0x5
-#define OPCODE_XOR 0x6
-#define OPCODE_MOVC 0x7
-#define OPCODE_LOAD 0x8
-#define OPCODE_STORE 0x9
-#define OPCODE_BZ 0xa
-#define OPCODE_BNZ 0xb
-#define OPCODE_HALT 0xc
-#define OPCODE_ADDL 0xd
-#define OPCODE_SUBL 0xe
-#define OPCODE_LDI 0xf
-#define OPCODE_STI 0x10
-#define OPCODE_BP 0x11
-#define OPCODE_BNP 0x12
-#define OPCODE_CMP 0x13
-#define OPCODE_NOP 0x14
-#define OPCODE_JUMP 0x15
-
-#define FETCH_STAGE 0x00
-#define DECODE_STAGE 0x01
-#define EXECUTE_STAGE 0x02
-#define MEMORY_STAGE 0x03
-#define WRITE_BACK_STAGE 0x04
+/* Numeric OPCODE identifiers, generated from the ISA table */
+#include "apex_isa.h"
+
+/* Pipeline phases, each one split into one or more sub-stages */
+#define PHASE_FETCH 0x00
+#define PHASE_DECODE 0x01
+#define PHASE_EXECUTE 0x02
+#define PHASE_MEMORY 0x03
+#define PHASE_WRITEBACK 0x04
+#define NUM_PHASES 5
+
+/* Limits on the number of sub-stages per phase and in the whole pipeline */
+#define MAX_PHASE_DEPTH 4
+#define MAX_PIPELINE_STAGES (NUM_PHASES * MAX_PHASE_DEPTH)
+
+/* Cycle-time model: logic delay of each unsplit phase and of a latch (ps) */
+#define FETCH_LOGIC_DELAY 600
+#define DECODE_LOGIC_DELAY 400
+#define EXECUTE_LOGIC_DELAY 800
+#define MEMORY_LOGIC_DELAY 700
+#define WRITEBACK_LOGIC_DELAY 300
+#define LATCH_OVERHEAD 50
 
 #define COMMAND_DISPLAY 0
 #define COMMAND_SIMULATE 1
 #define COMMAND_SINGLE_STEP 2
 #define COMMAND_SHOW_MEMORY 3
+#define COMMAND_COMPARE 4
+#define COMMAND_DEBUG 5
+#define COMMAND_BATCH 6
+#define COMMAND_SIMPOINT 7
+#define COMMAND_FORK 8
+#define COMMAND_RECORD 9
+#define COMMAND_REPLAY 10
+
+/* Data hazard handling in decode, selected with --hazard */
+#define HAZARD_STALL 0                 /* Scoreboard, operands only from the register file */
+#define HAZARD_FORWARD 1               /* Bypass network with load-use interlock */
+#define HAZARD_PERFECT 2               /* No data hazard stalls at all (limit study) */
+#define NUM_HAZARD_POLICIES 3
+
+/* Statistics a pipeline variant keeps */
+#define STATS_CYCLES 0                 /* Cycles and retired instructions only */
+#define STATS_FULL 1                   /* Also stalls and bypass paths */
+#define NUM_STATS_LEVELS 2
+
+/* Programs accepted by the compare command */
+#define MAX_COMPARE_PROGRAMS 32
+
+/* Data images loaded before, and memory ranges dumped after, simulation */
+#define MAX_DATA_IMAGES 8
+#define MAX_MEMORY_DUMPS 8
+
+/* Timing variants the fork command runs besides the base configuration */
+#define MAX_VARIANTS 16
+
+/* Cores sharing data memory in multicore mode */
+#define MAX_CORES 16
+
+/* Default slots of a core's retire ring */
+#define RETIRE_RING_SLOTS 4096
+
+/* Interval statistics file unless --interval-file is given */
+#define INTERVAL_FILE "intervals.csv"
+
+/* Locality analysis defaults */
+#define REUSE_WINDOW 10000             /* Accesses per working set window */
+#define REUSE_FILE "reuse.csv"
+
+/* Trace of the record command unless --record-file is given */
+#define RECORD_FILE "trace.apt"
 
 #define ENABLE_DEBUG_MESSAGES 0
 #define ENABLE_SINGLE_STEP 1
@@ -0,0 +1,930 @@
+/*
+ * apex_memory.c
+ * Contains APEX paged data memory implementation
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "apex_memory.h"
+#include "apex_macros.h"
+
+#define DIR_INDEX(address) ((address) >> (MEM_TABLE_BITS + MEM_PAGE_BITS))
+#define TABLE_INDEX(address) (((address) >> MEM_PAGE_BITS) & (MEM_TABLE_SIZE - 1))
+#define PAGE_OFFSET(address) ((address) & (MEM_PAGE_WORDS - 1))
+
+/* Host huge page size the dense region is rounded to */
+#define MEM_HUGE_PAGE_BYTES (2u << 20)
+
+/*
+ * Creates an empty data memory of the given number of words. No host memory
+ * is used for the data itself until a page is written.
+ */
+APEX_Memory *
+APEX_memory_create(unsigned long long size)
+{
+    APEX_Memory *mem = calloc(1, sizeof(APEX_Memory));
+
+    if (!mem)
+    {
+        return NULL;
+    }
+    if (size == 0 || size > MEM_ADDRESS_SPACE)
+    {
+        size = MEM_ADDRESS_SPACE;
+    }
+    mem->size = size;
+    return mem;
+}
+
+static int
+in_dense_region(const APEX_Memory *mem, unsigned int address)
+{
+    return mem->dense && (unsigned int)(address - mem->dense_base) < mem->dense_words;
+}
+
+/*
+ * Records that a page was written since the last image.
+ */
+static void
+mark_dirty(APEX_Memory *mem, unsigned int page)
+{
+    if (mem->dirty[page >> 3] & (1u << (page & 7)))
+    {
+        return;
+    }
+    if (mem->num_dirty == mem->dirty_capacity)
+    {
+        int capacity = mem->dirty_capacity ? mem->dirty_capacity * 2 : 256;
+        unsigned int *pages = realloc(mem->dirty_pages, capacity * sizeof(unsigned int));
+
+        if (!pages)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for dirty page list\n");
+            exit(1);
+        }
+        mem->dirty_pages = pages;
+        mem->dirty_capacity = capacity;
+    }
+    mem->dirty[page >> 3] |= 1u << (page & 7);
+    mem->dirty_pages[mem->num_dirty++] = page;
+}
+
+/*
+ * Backs a dense region with one host mapping, using huge pages where the
+ * host allows, so that large arrays do not pay a page table walk and a
+ * separate allocation per page. The region is rounded out to whole pages and
+ * must be set up before any page inside it is written.
+ */
+int
+APEX_memory_map_dense(APEX_Memory *mem, unsigned int base, unsigned long long words)
+{
+    unsigned long long first = base & ~(MEM_PAGE_WORDS - 1);
+    unsigned long long last = ((unsigned long long)base + words + MEM_PAGE_WORDS - 1)
+                              & ~(unsigned long long)(MEM_PAGE_WORDS - 1);
+    size_t bytes;
+    void *region;
+
+    if (mem->dense || words == 0 || last > MEM_ADDRESS_SPACE || mem->pages_allocated)
+    {
+        return FALSE;
+    }
+
+    /* Whole huge pages, explicit huge page mappings can not be partial */
+    bytes = ((size_t)(last - first) * sizeof(int) + MEM_HUGE_PAGE_BYTES - 1)
+            & ~(size_t)(MEM_HUGE_PAGE_BYTES - 1);
+    region = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    /* Reserved up front, so it either fails here or is fully backed */
+    region = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (region == MAP_FAILED)
+    {
+        /* No reserved huge pages, ask for transparent ones instead */
+        region = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+        {
+            return FALSE;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(region, bytes, MADV_HUGEPAGE);
+#endif
+    }
+
+    mem->dense = region;
+    mem->dense_base = (unsigned int)first;
+    mem->dense_words = last - first;
+    mem->dense_bytes = bytes;
+    return TRUE;
+}
+
+/*
+ * Releases all pages, tables and the dense mapping.
+ */
+void
+APEX_memory_free(APEX_Memory *mem)
+{
+    if (!mem)
+    {
+        return;
+    }
+    for (unsigned int dir = 0; dir < MEM_DIR_SIZE; dir++)
+    {
+        if (!mem->tables[dir])
+        {
+            continue;
+        }
+        for (unsigned int table = 0; table < MEM_TABLE_SIZE; table++)
+        {
+            unsigned int address = (dir << (MEM_TABLE_BITS + MEM_PAGE_BITS))
+                                   | (table << MEM_PAGE_BITS);
+
+            if (!in_dense_region(mem, address))
+            {
+                free(mem->tables[dir][table]);
+            }
+        }
+        free(mem->tables[dir]);
+    }
+    if (mem->dense)
+    {
+        munmap(mem->dense, mem->dense_bytes);
+    }
+    free(mem->dirty);
+    free(mem->dirty_pages);
+    free(mem);
+}
+
+/*
+ * Checks an address against the configured memory size.
+ */
+int
+APEX_memory_in_range(const APEX_Memory *mem, unsigned int address)
+{
+    return address < mem->size;
+}
+
+/*
+ * Returns the page holding an address, or NULL if it was never written.
+ */
+const int *
+APEX_memory_page(const APEX_Memory *mem, unsigned int address)
+{
+    int **table = mem->tables[DIR_INDEX(address)];
+
+    if (in_dense_region(mem, address))
+    {
+        return mem->dense + ((address - mem->dense_base) & ~(MEM_PAGE_WORDS - 1));
+    }
+    return table ? table[TABLE_INDEX(address)] : NULL;
+}
+
+/*
+ * Reads a word. Words that were never written read as zero.
+ */
+int
+APEX_memory_read(const APEX_Memory *mem, unsigned int address)
+{
+    const int *page;
+
+    if (in_dense_region(mem, address))
+    {
+        return mem->dense[address - mem->dense_base];
+    }
+    page = APEX_memory_page(mem, address);
+    return page ? page[PAGE_OFFSET(address)] : 0;
+}
+
+/*
+ * Writes a word, allocating its page table and page on first use.
+ */
+void
+APEX_memory_write(APEX_Memory *mem, unsigned int address, int value)
+{
+    int ***table = &mem->tables[DIR_INDEX(address)];
+    int **page;
+
+    if (mem->dirty)
+    {
+        mark_dirty(mem, address >> MEM_PAGE_BITS);
+    }
+    if (in_dense_region(mem, address))
+    {
+        mem->dense[address - mem->dense_base] = value;
+        return;
+    }
+
+    if (!*table)
+    {
+        *table = calloc(MEM_TABLE_SIZE, sizeof(int *));
+        if (!*table)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for page table\n");
+            exit(1);
+        }
+    }
+    page = &(*table)[TABLE_INDEX(address)];
+    if (!*page)
+    {
+        if (value == 0)
+        {
+            /* Unwritten words already read as zero */
+            return;
+        }
+        *page = calloc(MEM_PAGE_WORDS, sizeof(int));
+        if (!*page)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for data page\n");
+            exit(1);
+        }
+        mem->pages_allocated++;
+    }
+    (*page)[PAGE_OFFSET(address)] = value;
+}
+
+/*
+ * Compares the contents of two memories. A page missing on one side equals
+ * a page of zeros on the other.
+ */
+int
+APEX_memory_equal(const APEX_Memory *a, const APEX_Memory *b)
+{
+    static const int zero_page[MEM_PAGE_WORDS];
+
+    for (unsigned int dir = 0; dir < MEM_DIR_SIZE; dir++)
+    {
+        if (!a->tables[dir] && !b->tables[dir] && !a->dense && !b->dense)
+        {
+            continue;
+        }
+        for (unsigned int table = 0; table < MEM_TABLE_SIZE; table++)
+        {
+            unsigned int address = (dir << (MEM_TABLE_BITS + MEM_PAGE_BITS))
+                                   | (table << MEM_PAGE_BITS);
+            const int *page_a = APEX_memory_page(a, address);
+            const int *page_b = APEX_memory_page(b, address);
+
+            if (page_a == page_b)
+            {
+                continue;
+            }
+            if (memcmp(page_a ? page_a : zero_page, page_b ? page_b : zero_page,
+                       sizeof(zero_page)))
+            {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Makes an independent copy of a memory, including its dense region. Used to
+ * keep the initial data image for the diff written at exit.
+ */
+APEX_Memory *
+APEX_memory_clone(const APEX_Memory *mem)
+{
+    APEX_Memory *copy = APEX_memory_create(mem->size);
+
+    if (!copy)
+    {
+        return NULL;
+    }
+    if (mem->dense)
+    {
+        if (!APEX_memory_map_dense(copy, mem->dense_base, mem->dense_words))
+        {
+            APEX_memory_free(copy);
+            return NULL;
+        }
+        memcpy(copy->dense, mem->dense, mem->dense_words * sizeof(int));
+    }
+    for (unsigned int dir = 0; dir < MEM_DIR_SIZE; dir++)
+    {
+        if (!mem->tables[dir])
+        {
+            continue;
+        }
+        for (unsigned int table = 0; table < MEM_TABLE_SIZE; table++)
+        {
+            const int *page = mem->tables[dir][table];
+            unsigned int address = (dir << (MEM_TABLE_BITS + MEM_PAGE_BITS))
+                                   | (table << MEM_PAGE_BITS);
+
+            if (!page || in_dense_region(mem, address))
+            {
+                continue;
+            }
+            for (unsigned int cnt = 0; cnt < MEM_PAGE_WORDS; cnt++)
+            {
+                APEX_memory_write(copy, address + cnt, page[cnt]);
+            }
+        }
+    }
+    return copy;
+}
+
+/*
+ * Starts tracking the pages written, for APEX_memory_image. Every page that
+ * holds data counts as written, so the next image is built whole. Returns
+ * FALSE if out of host memory.
+ */
+int
+APEX_memory_track(APEX_Memory *mem)
+{
+    if (!mem->dirty)
+    {
+        mem->dirty = calloc(MEM_ADDRESS_SPACE >> MEM_PAGE_BITS >> 3, 1);
+        if (!mem->dirty)
+        {
+            return FALSE;
+        }
+    }
+    for (unsigned long long word = 0; word < mem->dense_words; word += MEM_PAGE_WORDS)
+    {
+        mark_dirty(mem, (mem->dense_base + (unsigned int)word) >> MEM_PAGE_BITS);
+    }
+    for (unsigned int dir = 0; dir < MEM_DIR_SIZE; dir++)
+    {
+        if (!mem->tables[dir])
+        {
+            continue;
+        }
+        for (unsigned int table = 0; table < MEM_TABLE_SIZE; table++)
+        {
+            unsigned int address = (dir << (MEM_TABLE_BITS + MEM_PAGE_BITS))
+                                   | (table << MEM_PAGE_BITS);
+
+            if (mem->tables[dir][table] && !in_dense_region(mem, address))
+            {
+                mark_dirty(mem, address >> MEM_PAGE_BITS);
+            }
+        }
+    }
+    return TRUE;
+}
+
+static int
+compare_pages(const void *a, const void *b)
+{
+    unsigned int page_a = *(const unsigned int *)a;
+    unsigned int page_b = *(const unsigned int *)b;
+
+    return (page_a > page_b) - (page_a < page_b);
+}
+
+/*
+ * Returns the page copy an image holds for a page number, or NULL for a
+ * page of zeros.
+ */
+static APEX_Page_Copy *
+find_page(const APEX_Memory_Image *image, unsigned int page)
+{
+    int low = 0;
+    int high = image ? image->count : 0;
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+
+        if (image->pages[mid].page < page)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    if (image && low < image->count && image->pages[low].page == page)
+    {
+        return image->pages[low].copy;
+    }
+    return NULL;
+}
+
+/*
+ * Takes an image of memory as it is now, given the image taken last, or
+ * NULL for the first. Only the pages written since are copied, the rest are
+ * shared with the previous image. Returns NULL if out of host memory.
+ */
+APEX_Memory_Image *
+APEX_memory_image(APEX_Memory *mem, const APEX_Memory_Image *previous)
+{
+    static const int zero_page[MEM_PAGE_WORDS];
+    APEX_Memory_Image *image = calloc(1, sizeof(APEX_Memory_Image));
+    int max = (previous ? previous->count : 0) + mem->num_dirty;
+    int old = 0;
+
+    if (!image || !(image->pages = malloc((max ? max : 1) * sizeof(APEX_Page_Entry))))
+    {
+        free(image);
+        return NULL;
+    }
+    if (mem->num_dirty)
+    {
+        qsort(mem->dirty_pages, mem->num_dirty, sizeof(unsigned int), compare_pages);
+    }
+
+    /* Merges the previous pages with the written ones, which replace them */
+    for (int cnt = 0; cnt <= mem->num_dirty; cnt++)
+    {
+        unsigned int page = cnt < mem->num_dirty ? mem->dirty_pages[cnt] : 0;
+        const int *words;
+
+        while (previous && old < previous->count
+               && (cnt == mem->num_dirty || previous->pages[old].page < page))
+        {
+            image->pages[image->count] = previous->pages[old++];
+            image->pages[image->count++].copy->refs++;
+        }
+        if (cnt == mem->num_dirty)
+        {
+            break;
+        }
+        if (previous && old < previous->count && previous->pages[old].page == page)
+        {
+            old++;
+        }
+
+        words = APEX_memory_page(mem, page << MEM_PAGE_BITS);
+        if (!words || !memcmp(words, zero_page, sizeof(zero_page)))
+        {
+            /* Pages of zeros, such as most of a dense region, are left out */
+            continue;
+        }
+        image->pages[image->count].page = page;
+        image->pages[image->count].copy = malloc(sizeof(APEX_Page_Copy));
+        if (!image->pages[image->count].copy)
+        {
+            /* The pages stay marked for the next attempt */
+            APEX_memory_image_free(image);
+            return NULL;
+        }
+        image->pages[image->count].copy->refs = 1;
+        memcpy(image->pages[image->count++].copy->words, words,
+               MEM_PAGE_WORDS * sizeof(int));
+    }
+    for (int cnt = 0; cnt < mem->num_dirty; cnt++)
+    {
+        mem->dirty[mem->dirty_pages[cnt] >> 3] &= ~(1u << (mem->dirty_pages[cnt] & 7));
+    }
+    mem->num_dirty = 0;
+    return image;
+}
+
+void
+APEX_memory_image_free(APEX_Memory_Image *image)
+{
+    if (!image)
+    {
+        return;
+    }
+    for (int cnt = 0; cnt < image->count; cnt++)
+    {
+        if (--image->pages[cnt].copy->refs == 0)
+        {
+            free(image->pages[cnt].copy);
+        }
+    }
+    free(image->pages);
+    free(image);
+}
+
+/*
+ * Marks as written every page whose contents differ between two images, as
+ * told by them not sharing its copy.
+ */
+void
+APEX_memory_mark_changed(APEX_Memory *mem, const APEX_Memory_Image *a,
+                         const APEX_Memory_Image *b)
+{
+    int i = 0;
+    int j = 0;
+
+    while (i < a->count || j < b->count)
+    {
+        if (j == b->count || (i < a->count && a->pages[i].page < b->pages[j].page))
+        {
+            mark_dirty(mem, a->pages[i++].page);
+        }
+        else if (i == a->count || b->pages[j].page < a->pages[i].page)
+        {
+            mark_dirty(mem, b->pages[j++].page);
+        }
+        else
+        {
+            if (a->pages[i].copy != b->pages[j].copy)
+            {
+                mark_dirty(mem, a->pages[i].page);
+            }
+            i++;
+            j++;
+        }
+    }
+}
+
+/*
+ * Makes memory equal to an image, given the image taken last. Memory only
+ * differs from the last image in the pages written since, and that from the
+ * image restored in the pages the two do not share, so only those are
+ * copied. They stay marked as written, relative to the last image.
+ */
+void
+APEX_memory_restore(APEX_Memory *mem, const APEX_Memory_Image *image,
+                    const APEX_Memory_Image *latest)
+{
+    APEX_memory_mark_changed(mem, image, latest);
+    for (int cnt = 0; cnt < mem->num_dirty; cnt++)
+    {
+        unsigned int address = mem->dirty_pages[cnt] << MEM_PAGE_BITS;
+        const APEX_Page_Copy *copy = find_page(image, mem->dirty_pages[cnt]);
+        int *page = (int *)APEX_memory_page(mem, address);
+
+        if (copy && !page)
+        {
+            /* Allocates the page */
+            APEX_memory_write(mem, address, 1);
+            page = (int *)APEX_memory_page(mem, address);
+        }
+        if (copy)
+        {
+            memcpy(page, copy->words, MEM_PAGE_WORDS * sizeof(int));
+        }
+        else if (page)
+        {
+            /* Cleared, not freed, as the simulation is likely to write it again */
+            memset(page, 0, MEM_PAGE_WORDS * sizeof(int));
+        }
+    }
+}
+
+/* Raw images hold little endian words, on such hosts they are copied as is */
+#define MEM_IMAGE_HOST_ORDER (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+
+/* Converts a word between raw image and host order, both ways */
+static int
+image_word(int word)
+{
+#if MEM_IMAGE_HOST_ORDER
+    return word;
+#else
+    return (int)__builtin_bswap32((unsigned int)word);
+#endif
+}
+
+/*
+ * Copies words into memory starting at base. Runs of zeros do not allocate
+ * pages.
+ */
+static void
+store_words(APEX_Memory *mem, unsigned int base, const int *words, size_t count)
+{
+    for (size_t cnt = 0; cnt < count; cnt++)
+    {
+        APEX_memory_write(mem, base + (unsigned int)cnt, words[cnt]);
+    }
+}
+
+/*
+ * Loads a text image, one hexadecimal word per token. '#' starts a comment
+ * that runs to the end of the line. The whole image is parsed before memory
+ * is written, so an image that is rejected leaves memory as it was. Returns
+ * the number of words, or -1.
+ */
+static long long
+load_hex_image(APEX_Memory *mem, unsigned int base, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char token[64];
+    int *words = NULL;
+    size_t capacity = 0;
+    size_t count = 0;
+
+    if (!fp)
+    {
+        return -1;
+    }
+    while (fscanf(fp, "%63s", token) == 1)
+    {
+        char *end;
+        unsigned long word;
+
+        if (token[0] == '#')
+        {
+            fscanf(fp, "%*[^\n]");
+            continue;
+        }
+        word = strtoul(token, &end, 16);
+        if (*end != '\0' || base + (unsigned long long)count >= mem->size)
+        {
+            break;
+        }
+        if (count == capacity)
+        {
+            int *grown;
+
+            capacity = capacity ? 2 * capacity : MEM_PAGE_WORDS;
+            grown = realloc(words, capacity * sizeof(int));
+            if (!grown)
+            {
+                break;
+            }
+            words = grown;
+        }
+        words[count++] = (int)word;
+    }
+    if (!feof(fp))
+    {
+        fclose(fp);
+        free(words);
+        return -1;
+    }
+    fclose(fp);
+    store_words(mem, base, words, count);
+    free(words);
+    return (long long)count;
+}
+
+/*
+ * Loads a data image at base before simulation. Files ending in ".hex" are
+ * read as text, anything else as raw 32-bit little endian words, which are
+ * mapped rather than read so multi-megabyte inputs are copied only once.
+ * Returns the number of words loaded, or -1 if the file can not be read or
+ * does not fit in memory.
+ */
+long long
+APEX_memory_load_image(APEX_Memory *mem, unsigned int base, const char *path)
+{
+    size_t length = strlen(path);
+    struct stat info;
+    const int *image;
+    size_t words;
+    int fd;
+
+    if (length > 4 && strcmp(path + length - 4, ".hex") == 0)
+    {
+        return load_hex_image(mem, base, path);
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (fstat(fd, &info) < 0 || info.st_size % sizeof(int)
+        || base + (unsigned long long)info.st_size / sizeof(int) > mem->size)
+    {
+        close(fd);
+        return -1;
+    }
+    words = info.st_size / sizeof(int);
+    if (words == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    image = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+    {
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise((void *)image, info.st_size, MADV_SEQUENTIAL);
+#endif
+    if (MEM_IMAGE_HOST_ORDER && in_dense_region(mem, base)
+        && in_dense_region(mem, base + (unsigned int)(words - 1)))
+    {
+        memcpy(mem->dense + (base - mem->dense_base), image, info.st_size);
+    }
+    else
+    {
+        for (size_t cnt = 0; cnt < words; cnt++)
+        {
+            APEX_memory_write(mem, base + (unsigned int)cnt, image_word(image[cnt]));
+        }
+    }
+    munmap((void *)image, info.st_size);
+    return (long long)words;
+}
+
+/*
+ * Writes words [base, base + words) to a file as raw 32-bit little endian
+ * words, the same format APEX_memory_load_image reads. Returns FALSE if the
+ * file can not be written.
+ */
+int
+APEX_memory_dump(const APEX_Memory *mem, unsigned int base, unsigned long long words,
+                 const char *path)
+{
+    static const int zero_page[MEM_PAGE_WORDS];
+    FILE *fp = fopen(path, "wb");
+    unsigned long long address = base;
+    unsigned long long end = (unsigned long long)base + words;
+
+    if (!fp)
+    {
+        return FALSE;
+    }
+    /* Whole runs within a page at a time, unwritten pages come out as zeros */
+    while (address < end)
+    {
+        const int *page = APEX_memory_page(mem, (unsigned int)address);
+        unsigned int offset = PAGE_OFFSET((unsigned int)address);
+        unsigned long long run = MEM_PAGE_WORDS - offset;
+        const int *from;
+
+        if (run > end - address)
+        {
+            run = end - address;
+        }
+        from = (page ? page : zero_page) + offset;
+#if !MEM_IMAGE_HOST_ORDER
+        int swapped[MEM_PAGE_WORDS];
+
+        for (unsigned long long cnt = 0; cnt < run; cnt++)
+        {
+            swapped[cnt] = image_word(from[cnt]);
+        }
+        from = swapped;
+#endif
+        if (fwrite(from, sizeof(int), run, fp) != run)
+        {
+            fclose(fp);
+            return FALSE;
+        }
+        address += run;
+    }
+    return fclose(fp) == 0;
+}
+
+/*
+ * Calls change for every word that differs between two memories, in address
+ * order, or only counts them when change is NULL. Pages that are identical
+ * or unwritten on both sides are skipped. Returns the number of words that
+ * differ.
+ */
+long long
+APEX_memory_diff(const APEX_Memory *initial, const APEX_Memory *final,
+                 APEX_Memory_Change change, void *arg)
+{
+    static const int zero_page[MEM_PAGE_WORDS];
+    long long changed = 0;
+
+    for (unsigned int dir = 0; dir < MEM_DIR_SIZE; dir++)
+    {
+        if (!initial->tables[dir] && !final->tables[dir] && !initial->dense && !final->dense)
+        {
+            continue;
+        }
+        for (unsigned int table = 0; table < MEM_TABLE_SIZE; table++)
+        {
+            unsigned int address = (dir << (MEM_TABLE_BITS + MEM_PAGE_BITS))
+                                   | (table << MEM_PAGE_BITS);
+            const int *before = APEX_memory_page(initial, address);
+            const int *after = APEX_memory_page(final, address);
+
+            before = before ? before : zero_page;
+            after = after ? after : zero_page;
+            if (before == after || !memcmp(before, after, sizeof(zero_page)))
+            {
+                continue;
+            }
+            for (unsigned int cnt = 0; cnt < MEM_PAGE_WORDS; cnt++)
+            {
+                if (before[cnt] != after[cnt])
+                {
+                    if (change)
+                    {
+                        change(address + cnt, before[cnt], after[cnt], arg);
+                    }
+                    changed++;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+#define STORE_LOG_MIN_CAPACITY 256
+
+/* Multiplicative hash of a word address into the store log index */
+#define STORE_LOG_HASH(address, size) (((address) * 2654435761u) & ((size) - 1))
+
+void
+APEX_store_log_free(APEX_Store_Log *log)
+{
+    free(log->stores);
+    free(log->index);
+    memset(log, 0, sizeof(APEX_Store_Log));
+}
+
+/*
+ * Finds the index slot of an address: either the slot naming its latest
+ * store or the empty slot where it would go.
+ */
+static int
+store_log_slot(const APEX_Store_Log *log, unsigned int address)
+{
+    int slot = STORE_LOG_HASH(address, (unsigned int)log->index_size);
+
+    while (log->index[slot] && log->stores[log->index[slot] - 1].address != address)
+    {
+        slot = (slot + 1) & (log->index_size - 1);
+    }
+    return slot;
+}
+
+/*
+ * Doubles the log and rebuilds its index.
+ */
+static int
+store_log_grow(APEX_Store_Log *log)
+{
+    int capacity = log->capacity ? 2 * log->capacity : STORE_LOG_MIN_CAPACITY;
+    APEX_Store *stores = realloc(log->stores, capacity * sizeof(APEX_Store));
+    int *index;
+
+    if (!stores)
+    {
+        return FALSE;
+    }
+    log->stores = stores;
+    index = calloc(2 * capacity, sizeof(int));
+    if (!index)
+    {
+        return FALSE;
+    }
+    free(log->index);
+    log->index = index;
+    log->index_size = 2 * capacity;
+    log->capacity = capacity;
+    for (int i = 0; i < log->count; i++)
+    {
+        log->index[store_log_slot(log, log->stores[i].address)] = i + 1;
+    }
+    return TRUE;
+}
+
+/*
+ * Buffers a store. Returns FALSE if the log could not grow.
+ */
+int
+APEX_store_log_append(APEX_Store_Log *log, long long cycle, unsigned int address, int value)
+{
+    APEX_Store *store;
+
+    if (log->count == log->capacity && !store_log_grow(log))
+    {
+        return FALSE;
+    }
+    store = &log->stores[log->count++];
+    store->cycle = cycle;
+    store->address = address;
+    store->value = value;
+    log->index[store_log_slot(log, address)] = log->count;
+    return TRUE;
+}
+
+/*
+ * Returns TRUE and the value of the latest buffered store to an address, if
+ * there is one.
+ */
+int
+APEX_store_log_lookup(const APEX_Store_Log *log, unsigned int address, int *value)
+{
+    int slot;
+
+    if (!log->count)
+    {
+        return FALSE;
+    }
+    slot = store_log_slot(log, address);
+    if (!log->index[slot])
+    {
+        return FALSE;
+    }
+    *value = log->stores[log->index[slot] - 1].value;
+    return TRUE;
+}
+
+/*
+ * Empties the log once its stores were applied, keeping its buffers.
+ */
+void
+APEX_store_log_clear(APEX_Store_Log *log)
+{
+    if (log->count)
+    {
+        memset(log->index, 0, log->index_size * sizeof(int));
+    }
+    log->count = 0;
+}
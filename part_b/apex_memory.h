@@ -0,0 +1,112 @@
+/*
+ * apex_memory.h
+ * Contains APEX data memory declarations
+ *
+ * Data memory is word addressed and covers the full 32-bit address space. It
+ * is kept as a two level table of fixed size pages which are only allocated
+ * when first written, so untouched address space costs nothing.
+ */
+#ifndef _APEX_MEMORY_H_
+#define _APEX_MEMORY_H_
+#include <stddef.h>
+
+/* Address split: directory index | table index | word in page */
+#define MEM_PAGE_BITS 12
+#define MEM_TABLE_BITS 10
+#define MEM_DIR_BITS (32 - MEM_TABLE_BITS - MEM_PAGE_BITS)
+#define MEM_PAGE_WORDS (1u << MEM_PAGE_BITS)
+#define MEM_TABLE_SIZE (1u << MEM_TABLE_BITS)
+#define MEM_DIR_SIZE (1u << MEM_DIR_BITS)
+
+/* Number of words in the full address space */
+#define MEM_ADDRESS_SPACE (1ull << 32)
+
+/* Model of APEX data memory */
+typedef struct APEX_Memory
+{
+    int **tables[MEM_DIR_SIZE];    /* Page tables, allocated on first use */
+    unsigned long long size;       /* Addressable words, accesses beyond fault */
+    int pages_allocated;           /* Pages backed by host memory */
+    int *dense;                    /* Optional huge page backed region */
+    unsigned int dense_base;       /* First word of the dense region */
+    unsigned long long dense_words; /* Words in the dense region */
+    size_t dense_bytes;            /* Size of the host mapping */
+
+    /* Pages written since the last image, only tracked for snapshots */
+    unsigned char *dirty;          /* Bit per page of the address space */
+    unsigned int *dirty_pages;     /* Page numbers with their bit set */
+    int num_dirty;
+    int dirty_capacity;
+} APEX_Memory;
+
+/* Copy of a page, shared by every image it did not change between */
+typedef struct APEX_Page_Copy
+{
+    int refs;
+    int words[MEM_PAGE_WORDS];
+} APEX_Page_Copy;
+
+typedef struct APEX_Page_Entry
+{
+    unsigned int page;             /* Page number, address >> MEM_PAGE_BITS */
+    APEX_Page_Copy *copy;
+} APEX_Page_Entry;
+
+/* Contents of data memory at one point, pages missing from it are zero */
+typedef struct APEX_Memory_Image
+{
+    APEX_Page_Entry *pages;        /* Sorted by page number */
+    int count;
+} APEX_Memory_Image;
+
+/* One buffered store of a core */
+typedef struct APEX_Store
+{
+    long long cycle;
+    unsigned int address;
+    int value;
+} APEX_Store;
+
+/*
+ * Stores a core made since the last quantum barrier of the parallel engine.
+ * They stay private to the core, which reads its own stores back through
+ * the index, until the barrier applies every core's log to data memory.
+ */
+typedef struct APEX_Store_Log
+{
+    APEX_Store *stores;            /* In program order */
+    int count;
+    int capacity;
+    int *index;                    /* Hash of address to latest store + 1 */
+    int index_size;                /* Power of two, at least twice capacity */
+} APEX_Store_Log;
+
+/* Called by APEX_memory_diff for every word that differs */
+typedef void (*APEX_Memory_Change)(unsigned int address, int initial, int final, void *arg);
+
+APEX_Memory *APEX_memory_create(unsigned long long size);
+int APEX_memory_map_dense(APEX_Memory *mem, unsigned int base, unsigned long long words);
+void APEX_memory_free(APEX_Memory *mem);
+int APEX_memory_in_range(const APEX_Memory *mem, unsigned int address);
+int APEX_memory_read(const APEX_Memory *mem, unsigned int address);
+void APEX_memory_write(APEX_Memory *mem, unsigned int address, int value);
+const int *APEX_memory_page(const APEX_Memory *mem, unsigned int address);
+int APEX_memory_equal(const APEX_Memory *a, const APEX_Memory *b);
+APEX_Memory *APEX_memory_clone(const APEX_Memory *mem);
+int APEX_memory_track(APEX_Memory *mem);
+APEX_Memory_Image *APEX_memory_image(APEX_Memory *mem, const APEX_Memory_Image *previous);
+void APEX_memory_image_free(APEX_Memory_Image *image);
+void APEX_memory_mark_changed(APEX_Memory *mem, const APEX_Memory_Image *a,
+                              const APEX_Memory_Image *b);
+void APEX_memory_restore(APEX_Memory *mem, const APEX_Memory_Image *image,
+                         const APEX_Memory_Image *latest);
+long long APEX_memory_load_image(APEX_Memory *mem, unsigned int base, const char *path);
+int APEX_memory_dump(const APEX_Memory *mem, unsigned int base, unsigned long long words,
+                     const char *path);
+void APEX_store_log_free(APEX_Store_Log *log);
+int APEX_store_log_append(APEX_Store_Log *log, long long cycle, unsigned int address, int value);
+int APEX_store_log_lookup(const APEX_Store_Log *log, unsigned int address, int *value);
+void APEX_store_log_clear(APEX_Store_Log *log);
+long long APEX_memory_diff(const APEX_Memory *initial, const APEX_Memory *final,
+                           APEX_Memory_Change change, void *arg);
+#endif
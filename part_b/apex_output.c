@@ -0,0 +1,490 @@
+/*
+ * apex_output.c
+ * Contains the APEX report output layer: text, JSON and CSV formatters
+ *
+ * The text formatter keeps the classic report layout. JSON writes one object
+ * per line and CSV one row per value with the columns
+ * record,core,cycle,name,value,detail so either can be read by scripts
+ * without scraping the text report.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apex_output.h"
+#include "apex_macros.h"
+
+/* Names accepted by --output, indexed by format */
+static const char *format_names[NUM_OUTPUT_FORMATS] = {
+    "text", "json", "csv"
+};
+
+/* stdout can only be given a buffer once, before anything is written */
+static char stdout_buffer[OUTPUT_BUFFER_BYTES];
+static int stdout_buffered;
+
+/*
+ * Text formatter
+ */
+static void
+text_core_header(APEX_Output *out, int core, const char *lead)
+{
+    if (out->num_cores > 1)
+    {
+        fprintf(out->fp, "%s------------------------------------- CORE %d -------------------------------------\n",
+                lead, core);
+    }
+}
+
+static void
+text_pipeline(APEX_Output *out, int core, int cycle, const APEX_Stage_View *stages,
+              int count)
+{
+    if (core == 0)
+    {
+        if (out->single_step)
+        {
+            fprintf(out->fp, "\n.......................... CLOCK CYCLE %d ...........................\n\n", cycle);
+        }
+        else
+        {
+            fprintf(out->fp, "\n............................. CLOCK CYCLE %d ..............................\n\n", cycle);
+        }
+    }
+    text_core_header(out, core, "");
+
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        char stage_name[32];
+        int len;
+
+        /* Stage names are padded to "EX________STAGE" */
+        snprintf(stage_name, sizeof(stage_name) - 5, "%s", stages[cnt].name);
+        for (len = strlen(stage_name); len < 10; len++)
+        {
+            stage_name[len] = '_';
+        }
+        strcpy(stage_name + len, "STAGE");
+
+        if (stages[cnt].insn)
+        {
+            /* Operand lists are followed by a space in the classic listing */
+            fprintf(out->fp, "%d. Instruction at %s ---->        (I%d: %d) %s%s\n",
+                    cnt + 1, stage_name, (stages[cnt].pc - 4000) / 4, stages[cnt].pc,
+                    stages[cnt].insn, strchr(stages[cnt].insn, ',') ? " " : "");
+        }
+        else
+        {
+            fprintf(out->fp, "%d. Instruction at %s --->         EMPTY\n", cnt + 1,
+                    stage_name);
+        }
+    }
+}
+
+static void
+text_registers(APEX_Output *out, int core, const int *regs, const unsigned char *pending,
+               int count)
+{
+    text_core_header(out, core, "\n");
+    fprintf(out->fp, "\n=============================== STATE OF ARCHITECTURAL REGISTER FILE =============================\n\n");
+
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        fprintf(out->fp, "|           REG[%04d]           |           Value = %4d|            Status = %s|\n",
+                cnt, regs[cnt], pending[cnt] ? "INVALID      " : "VALID        ");
+    }
+}
+
+static void
+text_memory_begin(APEX_Output *out)
+{
+    fprintf(out->fp, "\n============================== STATE OF DATA MEMORY ===============================\n\n");
+}
+
+static void
+text_memory(APEX_Output *out, unsigned long long address, int value)
+{
+    fprintf(out->fp, "|           MEM[%04llu]           |               Data Value = %d             \n",
+            address, value);
+}
+
+static void
+text_memory_end(APEX_Output *out)
+{
+}
+
+static void
+text_stats(APEX_Output *out, const char *record, int core, const char *text,
+           const APEX_Stat *stats, int count)
+{
+    fputs(text, out->fp);
+}
+
+/*
+ * JSON formatter
+ */
+static void
+json_string(FILE *fp, const char *text)
+{
+    fputc('"', fp);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\')
+        {
+            fprintf(fp, "\\%c", *text);
+        }
+        else if ((unsigned char)*text < 0x20)
+        {
+            fprintf(fp, "\\u%04x", *text);
+        }
+        else
+        {
+            fputc(*text, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void
+json_record(APEX_Output *out, const char *record, int core)
+{
+    fprintf(out->fp, "{\"record\":");
+    json_string(out->fp, record);
+    if (core >= 0)
+    {
+        fprintf(out->fp, ",\"core\":%d", core);
+    }
+}
+
+static void
+json_pipeline(APEX_Output *out, int core, int cycle, const APEX_Stage_View *stages,
+              int count)
+{
+    json_record(out, "stages", core);
+    fprintf(out->fp, ",\"cycle\":%d,\"stages\":[", cycle);
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        fprintf(out->fp, "%s{\"stage\":", cnt ? "," : "");
+        json_string(out->fp, stages[cnt].name);
+        if (stages[cnt].insn)
+        {
+            fprintf(out->fp, ",\"pc\":%d,\"insn\":", stages[cnt].pc);
+            json_string(out->fp, stages[cnt].insn);
+        }
+        else
+        {
+            fprintf(out->fp, ",\"pc\":null,\"insn\":null");
+        }
+        fputc('}', out->fp);
+    }
+    fprintf(out->fp, "]}\n");
+}
+
+static void
+json_registers(APEX_Output *out, int core, const int *regs, const unsigned char *pending,
+               int count)
+{
+    json_record(out, "registers", core);
+    fprintf(out->fp, ",\"values\":[");
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        fprintf(out->fp, "%s%d", cnt ? "," : "", regs[cnt]);
+    }
+    fprintf(out->fp, "],\"valid\":[");
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        fprintf(out->fp, "%s%s", cnt ? "," : "", pending[cnt] ? "false" : "true");
+    }
+    fprintf(out->fp, "]}\n");
+}
+
+static void
+json_memory_begin(APEX_Output *out)
+{
+    json_record(out, "memory", -1);
+    fprintf(out->fp, ",\"words\":[");
+    out->items = 0;
+}
+
+static void
+json_memory(APEX_Output *out, unsigned long long address, int value)
+{
+    fprintf(out->fp, "%s[%llu,%d]", out->items++ ? "," : "", address, value);
+}
+
+static void
+json_memory_end(APEX_Output *out)
+{
+    fprintf(out->fp, "]}\n");
+}
+
+static void
+json_stats(APEX_Output *out, const char *record, int core, const char *text,
+           const APEX_Stat *stats, int count)
+{
+    json_record(out, record, core);
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        fputc(',', out->fp);
+        json_string(out->fp, stats[cnt].name);
+        fputc(':', out->fp);
+        if (stats[cnt].text)
+        {
+            json_string(out->fp, stats[cnt].text);
+        }
+        else
+        {
+            fprintf(out->fp, "%.15g", stats[cnt].value);
+        }
+    }
+    fprintf(out->fp, "}\n");
+}
+
+/*
+ * CSV formatter
+ */
+static void
+csv_field(FILE *fp, const char *text)
+{
+    if (!strpbrk(text, ",\"\n"))
+    {
+        fputs(text, fp);
+        return;
+    }
+    fputc('"', fp);
+    for (; *text; text++)
+    {
+        if (*text == '"')
+        {
+            fputc('"', fp);
+        }
+        fputc(*text, fp);
+    }
+    fputc('"', fp);
+}
+
+static void
+csv_begin(APEX_Output *out)
+{
+    fprintf(out->fp, "record,core,cycle,name,value,detail\n");
+}
+
+static void
+csv_pipeline(APEX_Output *out, int core, int cycle, const APEX_Stage_View *stages,
+             int count)
+{
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        fprintf(out->fp, "stage,%d,%d,%s,", core, cycle, stages[cnt].name);
+        if (stages[cnt].insn)
+        {
+            fprintf(out->fp, "%d,", stages[cnt].pc);
+            csv_field(out->fp, stages[cnt].insn);
+        }
+        else
+        {
+            fputc(',', out->fp);
+        }
+        fputc('\n', out->fp);
+    }
+}
+
+static void
+csv_registers(APEX_Output *out, int core, const int *regs, const unsigned char *pending,
+              int count)
+{
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        fprintf(out->fp, "register,%d,,R%d,%d,%s\n", core, cnt, regs[cnt],
+                pending[cnt] ? "INVALID" : "VALID");
+    }
+}
+
+static void
+csv_memory_begin(APEX_Output *out)
+{
+}
+
+static void
+csv_memory(APEX_Output *out, unsigned long long address, int value)
+{
+    fprintf(out->fp, "memory,,,%llu,%d,\n", address, value);
+}
+
+static void
+csv_memory_end(APEX_Output *out)
+{
+}
+
+static void
+csv_stats(APEX_Output *out, const char *record, int core, const char *text,
+          const APEX_Stat *stats, int count)
+{
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        csv_field(out->fp, record);
+        if (core >= 0)
+        {
+            fprintf(out->fp, ",%d,,%s,", core, stats[cnt].name);
+        }
+        else
+        {
+            fprintf(out->fp, ",,,%s,", stats[cnt].name);
+        }
+        if (stats[cnt].text)
+        {
+            csv_field(out->fp, stats[cnt].text);
+        }
+        else
+        {
+            fprintf(out->fp, "%.15g", stats[cnt].value);
+        }
+        fprintf(out->fp, ",\n");
+    }
+}
+
+/* Formatters, indexed by format */
+static const APEX_Formatter formatters[NUM_OUTPUT_FORMATS] = {
+    {NULL, text_pipeline, text_registers, text_memory_begin, text_memory,
+     text_memory_end, text_stats},
+    {NULL, json_pipeline, json_registers, json_memory_begin, json_memory,
+     json_memory_end, json_stats},
+    {csv_begin, csv_pipeline, csv_registers, csv_memory_begin, csv_memory,
+     csv_memory_end, csv_stats},
+};
+
+/* Returns the format with the given name, or -1 */
+int
+APEX_output_format(const char *name)
+{
+    for (int format = 0; format < NUM_OUTPUT_FORMATS; format++)
+    {
+        if (strcmp(name, format_names[format]) == 0)
+        {
+            return format;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Opens the report output on a file, or on stdout when path is NULL or "-".
+ * Either way the stream is fully buffered with a large buffer, so it must be
+ * flushed before waiting for user input.
+ */
+APEX_Output *
+APEX_output_open(const char *path, int format)
+{
+    APEX_Output *out = calloc(1, sizeof(APEX_Output));
+
+    if (!out)
+    {
+        return NULL;
+    }
+    out->format = format;
+    out->formatter = &formatters[format];
+    out->num_cores = 1;
+
+    if (!path || strcmp(path, "-") == 0)
+    {
+        out->fp = stdout;
+        if (!stdout_buffered)
+        {
+            setvbuf(stdout, stdout_buffer, _IOFBF, sizeof(stdout_buffer));
+            stdout_buffered = TRUE;
+        }
+    }
+    else
+    {
+        out->fp = fopen(path, "w");
+        out->buffer = malloc(OUTPUT_BUFFER_BYTES);
+        if (!out->fp || !out->buffer)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write output file %s\n", path);
+            if (out->fp)
+            {
+                fclose(out->fp);
+            }
+            free(out->buffer);
+            free(out);
+            return NULL;
+        }
+        setvbuf(out->fp, out->buffer, _IOFBF, OUTPUT_BUFFER_BYTES);
+    }
+
+    if (out->formatter->begin)
+    {
+        out->formatter->begin(out);
+    }
+    return out;
+}
+
+void
+APEX_output_close(APEX_Output *out)
+{
+    if (!out)
+    {
+        return;
+    }
+    if (out->fp == stdout)
+    {
+        fflush(stdout);
+    }
+    else
+    {
+        fclose(out->fp);
+        free(out->buffer);
+    }
+    free(out);
+}
+
+void
+APEX_output_flush(APEX_Output *out)
+{
+    fflush(out->fp);
+}
+
+/* Contents of every stage of one core in a cycle */
+void
+APEX_output_pipeline(APEX_Output *out, int core, int cycle,
+                     const APEX_Stage_View *stages, int count)
+{
+    out->formatter->pipeline(out, core, cycle, stages, count);
+}
+
+/* Register file of one core, pending is non-zero for registers in flight */
+void
+APEX_output_registers(APEX_Output *out, int core, const int *regs,
+                      const unsigned char *pending, int count)
+{
+    out->formatter->registers(out, core, regs, pending, count);
+}
+
+/* Data memory words, given in address order between begin and end */
+void
+APEX_output_memory_begin(APEX_Output *out)
+{
+    out->formatter->memory_begin(out);
+}
+
+void
+APEX_output_memory(APEX_Output *out, unsigned long long address, int value)
+{
+    out->formatter->memory(out, address, value);
+}
+
+void
+APEX_output_memory_end(APEX_Output *out)
+{
+    out->formatter->memory_end(out);
+}
+
+/*
+ * Named values of a statistics record of one core, or of the whole machine
+ * when core is negative. The text format prints the given report lines.
+ */
+void
+APEX_output_stats(APEX_Output *out, const char *record, int core, const char *text,
+                  const APEX_Stat *stats, int count)
+{
+    out->formatter->stats(out, record, core, text, stats, count);
+}
@@ -0,0 +1,78 @@
+/*
+ * apex_output.h
+ * Contains the APEX report output layer declarations
+ *
+ * Pipeline views, final state and statistics are handed to the output layer
+ * as records, and a formatter turns them into the human readable text report,
+ * JSON lines or CSV rows. Output goes through one large stdio buffer.
+ */
+#ifndef _APEX_OUTPUT_H_
+#define _APEX_OUTPUT_H_
+#include <stdio.h>
+
+/* Output formats */
+#define OUTPUT_TEXT 0
+#define OUTPUT_JSON 1
+#define OUTPUT_CSV 2
+#define NUM_OUTPUT_FORMATS 3
+
+#define OUTPUT_BUFFER_BYTES (1 << 20)
+
+/* Content of one pipeline stage, pc is 0 and insn NULL when it is empty */
+typedef struct APEX_Stage_View
+{
+    const char *name;              /* Stage name, e.g. "EX" or "EX_2" */
+    int pc;
+    const char *insn;              /* Instruction as printed in listings */
+} APEX_Stage_View;
+
+/* One value of a statistics record, text is set for non numeric values */
+typedef struct APEX_Stat
+{
+    const char *name;
+    double value;
+    const char *text;
+} APEX_Stat;
+
+struct APEX_Output;
+
+/* A formatter has one function per kind of record */
+typedef struct APEX_Formatter
+{
+    void (*begin)(struct APEX_Output *out);
+    void (*pipeline)(struct APEX_Output *out, int core, int cycle,
+                     const APEX_Stage_View *stages, int count);
+    void (*registers)(struct APEX_Output *out, int core, const int *regs,
+                      const unsigned char *pending, int count);
+    void (*memory_begin)(struct APEX_Output *out);
+    void (*memory)(struct APEX_Output *out, unsigned long long address, int value);
+    void (*memory_end)(struct APEX_Output *out);
+    void (*stats)(struct APEX_Output *out, const char *record, int core,
+                  const char *text, const APEX_Stat *stats, int count);
+} APEX_Formatter;
+
+typedef struct APEX_Output
+{
+    FILE *fp;
+    char *buffer;                  /* stdio buffer of fp when it is a file */
+    int format;
+    const APEX_Formatter *formatter;
+    int num_cores;                 /* Text format heads each core's part */
+    int single_step;               /* Text format uses the single step layout */
+    int items;                     /* Values written in the open JSON array */
+} APEX_Output;
+
+int APEX_output_format(const char *name);
+APEX_Output *APEX_output_open(const char *path, int format);
+void APEX_output_close(APEX_Output *out);
+void APEX_output_flush(APEX_Output *out);
+void APEX_output_pipeline(APEX_Output *out, int core, int cycle,
+                          const APEX_Stage_View *stages, int count);
+void APEX_output_registers(APEX_Output *out, int core, const int *regs,
+                           const unsigned char *pending, int count);
+void APEX_output_memory_begin(APEX_Output *out);
+void APEX_output_memory(APEX_Output *out, unsigned long long address, int value);
+void APEX_output_memory_end(APEX_Output *out);
+void APEX_output_stats(APEX_Output *out, const char *record, int core,
+                       const char *text, const APEX_Stat *stats, int count);
+#endif
@@ -0,0 +1,220 @@
+/*
+ * apex_parallel.c
+ * Contains the APEX parallel multicore engine
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "apex_parallel.h"
+
+/* State shared by the threads of one parallel run */
+typedef struct APEX_Parallel
+{
+    APEX_CPU *cpu;                 /* Core 0 of the machine */
+    int num_threads;
+    int max_cycles;
+    int quantum_end;               /* Cycle the current quantum stops at */
+    int finished;                  /* Set at a barrier to stop every thread */
+    pthread_barrier_t barrier;
+} APEX_Parallel;
+
+typedef struct APEX_Worker
+{
+    APEX_Parallel *run;
+    int id;
+    pthread_t thread;
+} APEX_Worker;
+
+/*
+ * Simulates one core up to, not including, cycle end or until it halts or
+ * faults.
+ */
+static void
+run_core(APEX_CPU *core, int end)
+{
+    while (!core->halted && !core->memory_fault && core->clock < end
+           && !atomic_load_explicit(&core->diverged, memory_order_relaxed))
+    {
+        if (APEX_pipeline_cycle(core))
+        {
+            if (!core->memory_fault)
+            {
+                core->halted = TRUE;
+                core->halt_cycle = core->clock;
+            }
+            return;
+        }
+        core->clock++;
+    }
+}
+
+/*
+ * Applies the stores every core buffered during the quantum to data memory,
+ * oldest cycle first and lower core first on a tie, then empties the logs.
+ */
+static void
+apply_store_logs(APEX_CPU *cpu)
+{
+    int next[MAX_CORES] = {0};
+
+    while (TRUE)
+    {
+        const APEX_Store *store;
+        int core = -1;
+
+        for (int i = 0; i < cpu->config.num_cores; i++)
+        {
+            const APEX_Store_Log *log = &cpu->cores[i]->store_log;
+
+            if (next[i] < log->count
+                && (core < 0 || log->stores[next[i]].cycle
+                                < cpu->cores[core]->store_log.stores[next[core]].cycle))
+            {
+                core = i;
+            }
+        }
+        if (core < 0)
+        {
+            break;
+        }
+        store = &cpu->cores[core]->store_log.stores[next[core]++];
+        APEX_memory_write(cpu->data_memory, store->address, store->value);
+    }
+
+    for (int i = 0; i < cpu->config.num_cores; i++)
+    {
+        APEX_store_log_clear(&cpu->cores[i]->store_log);
+    }
+}
+
+/*
+ * Runs on one thread while all others wait at the barrier: makes the
+ * quantum's stores and bus requests visible and decides whether to go on.
+ */
+static void
+synchronize(APEX_Parallel *run)
+{
+    APEX_CPU *cpu = run->cpu;
+    int running = FALSE;
+
+    apply_store_logs(cpu);
+    if (cpu->bus)
+    {
+        APEX_bus_deliver(cpu->bus);
+    }
+
+    for (int i = 0; i < cpu->config.num_cores; i++)
+    {
+        if (cpu->cores[i]->memory_fault
+            || atomic_load_explicit(&cpu->cores[i]->diverged, memory_order_relaxed))
+        {
+            run->finished = TRUE;
+            return;
+        }
+        running |= !cpu->cores[i]->halted;
+    }
+    run->finished = !running || run->quantum_end >= run->max_cycles;
+    run->quantum_end += cpu->config.quantum;
+}
+
+/*
+ * Thread body: simulates every num_threads-th core a quantum at a time.
+ */
+static void *
+worker(void *arg)
+{
+    APEX_Worker *self = arg;
+    APEX_Parallel *run = self->run;
+    APEX_CPU *cpu = run->cpu;
+
+    while (TRUE)
+    {
+        int end = run->quantum_end < run->max_cycles ? run->quantum_end : run->max_cycles;
+
+        for (int i = self->id; i < cpu->config.num_cores; i += run->num_threads)
+        {
+            run_core(cpu->cores[i], end);
+        }
+
+        pthread_barrier_wait(&run->barrier);
+        if (self->id == 0)
+        {
+            synchronize(run);
+        }
+        pthread_barrier_wait(&run->barrier);
+
+        if (run->finished)
+        {
+            return NULL;
+        }
+    }
+}
+
+/*
+ * Runs the machine with the quantum engine until every core halted, one of
+ * them faulted or max_cycles is reached. Afterwards every core's clock is
+ * the machine's final cycle, as with the lockstep engine. Returns TRUE if
+ * all cores halted.
+ */
+int
+APEX_parallel_run(APEX_CPU *cpu, int max_cycles)
+{
+    APEX_Worker workers[MAX_CORES];
+    APEX_Parallel run;
+    int halted = TRUE;
+    int clock = 0;
+
+    run.cpu = cpu;
+    run.max_cycles = max_cycles;
+    run.quantum_end = cpu->clock + cpu->config.quantum;
+    run.finished = FALSE;
+    run.num_threads = cpu->config.threads;
+    if (run.num_threads < 1 || run.num_threads > cpu->config.num_cores)
+    {
+        run.num_threads = cpu->config.num_cores;
+    }
+
+    for (int i = 0; i < cpu->config.num_cores; i++)
+    {
+        cpu->cores[i]->buffer_stores = TRUE;
+    }
+    if (cpu->bus)
+    {
+        cpu->bus->deferred = TRUE;
+    }
+
+    pthread_barrier_init(&run.barrier, NULL, run.num_threads);
+    for (int i = 0; i < run.num_threads; i++)
+    {
+        workers[i].run = &run;
+        workers[i].id = i;
+        if (i > 0 && pthread_create(&workers[i].thread, NULL, worker, &workers[i]))
+        {
+            fprintf(stderr, "APEX_Error: Unable to start simulation thread\n");
+            exit(1);
+        }
+    }
+    worker(&workers[0]);
+    for (int i = 1; i < run.num_threads; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+    pthread_barrier_destroy(&run.barrier);
+
+    for (int i = 0; i < cpu->config.num_cores; i++)
+    {
+        const APEX_CPU *core = cpu->cores[i];
+        int end = core->halted ? core->halt_cycle : core->clock;
+
+        halted &= core->halted;
+        if (end > clock)
+        {
+            clock = end;
+        }
+    }
+    for (int i = 0; i < cpu->config.num_cores; i++)
+    {
+        cpu->cores[i]->clock = clock;
+    }
+    return halted;
+}
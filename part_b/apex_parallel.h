@@ -0,0 +1,18 @@
+/*
+ * apex_parallel.h
+ * Contains the APEX parallel multicore engine declarations
+ *
+ * The cores of a multicore machine are spread over host threads that each
+ * simulate their cores independently for a quantum of cycles and then meet
+ * at a barrier. During a quantum a core only sees data memory as it was at
+ * the last barrier plus its own stores, and its L1 only sees its own
+ * accesses; at the barrier all buffered stores and bus requests are applied
+ * in cycle order. The result therefore depends on the quantum but not on the
+ * number of threads or how they were scheduled.
+ */
+#ifndef _APEX_PARALLEL_H_
+#define _APEX_PARALLEL_H_
+#include "apex_cpu.h"
+
+int APEX_parallel_run(APEX_CPU *cpu, int max_cycles);
+#endif
@@ -0,0 +1,260 @@
+/*
+ * apex_replay.c
+ * Contains the APEX trace recording and replay
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "apex_replay.h"
+#include "apex_func.h"
+#include "apex_macros.h"
+
+_Static_assert(NUM_OPCODES <= REPLAY_OPCODE_MASK + 1, "opcode numbers must fit a trace record");
+_Static_assert(REG_FILE_SIZE <= 16, "register numbers must fit a trace record");
+
+/* Appends one record, with a word when the instruction has one */
+static int
+put_record(FILE *fp, const APEX_Instruction *insn, int has_word, unsigned int word)
+{
+    unsigned char record[REPLAY_RECORD_MAX];
+    int length = REPLAY_RECORD_MAX - 4;
+
+    record[0] = insn->opcode | (has_word ? REPLAY_WORD : 0);
+    record[1] = (insn->rd & 0xF) | (insn->rs1 & 0xF) << 4;
+    record[2] = insn->rs2 & 0xF;
+    if (has_word)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            record[3 + i] = word >> (8 * i);
+        }
+        length = REPLAY_RECORD_MAX;
+    }
+    fwrite(record, 1, length, fp);
+    return length;
+}
+
+/*
+ * Runs the functional model from the CPU's state, after any fast-forward,
+ * until HALT, a fault or limit instructions (0 for no limit), writing each
+ * instruction it executes to the trace at path. A faulting instruction is
+ * left out, HALT is the last record. Returns FALSE if the trace could not be
+ * written.
+ */
+int
+APEX_replay_record(const APEX_CPU *cpu, const char *path, unsigned long long limit,
+                   APEX_Recording *recording)
+{
+    APEX_Func func;
+    APEX_Retired effects;
+    struct timespec start, end;
+    FILE *fp = fopen(path, "wb");
+    int ok;
+
+    if (!fp)
+    {
+        return FALSE;
+    }
+    memset(recording, 0, sizeof(APEX_Recording));
+    APEX_func_init(&func, cpu, cpu->data_memory);
+    recording->bytes = fprintf(fp, "APEX_TRACE %d %d\n", REPLAY_VERSION, func.pc);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!limit || recording->instructions < limit)
+    {
+        /* The branch condition reads the flags as they were before the step */
+        int zero_flag = func.zero_flag;
+        int positive_flag = func.positive_flag;
+        const APEX_Instruction *insn;
+        const APEX_Isa_Op *op;
+
+        recording->outcome = APEX_func_step(&func, NULL, &effects);
+        if (recording->outcome == FUNC_PC_FAULT || recording->outcome == FUNC_MEMORY_FAULT)
+        {
+            break;
+        }
+        insn = &cpu->code_memory[(effects.pc - 4000) / 4];
+        op = &apex_isa[insn->opcode];
+        switch (op->unit)
+        {
+            case UNIT_LOAD:
+            case UNIT_STORE:
+                recording->bytes += put_record(fp, insn, TRUE, effects.mem_address);
+                break;
+
+            case UNIT_BRANCH:
+                if (op->eval(0, 0, insn->imm, func.core_id, zero_flag, positive_flag))
+                {
+                    recording->bytes += put_record(fp, insn, TRUE, func.pc);
+                }
+                else
+                {
+                    recording->bytes += put_record(fp, insn, FALSE, 0);
+                }
+                break;
+
+            case UNIT_JUMP:
+                recording->bytes += put_record(fp, insn, TRUE, func.pc);
+                break;
+
+            default:
+                recording->bytes += put_record(fp, insn, FALSE, 0);
+                break;
+        }
+        recording->instructions++;
+        if (recording->outcome == FUNC_HALT)
+        {
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    recording->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    APEX_func_free(&func);
+
+    ok = !ferror(fp);
+    ok &= fclose(fp) == 0;
+    return ok;
+}
+
+/*
+ * Opens a trace for replay. Returns NULL if it cannot be read or does not
+ * start with a trace header.
+ */
+APEX_Replay *
+APEX_replay_open(const char *path)
+{
+    APEX_Replay *replay = calloc(1, sizeof(APEX_Replay));
+    int version;
+
+    if (!replay)
+    {
+        return NULL;
+    }
+    replay->path = path;
+    replay->fp = fopen(path, "rb");
+    if (!replay->fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open trace %s\n", path);
+        free(replay);
+        return NULL;
+    }
+    if (fscanf(replay->fp, "APEX_TRACE %d %d", &version, &replay->pc) != 2
+        || fgetc(replay->fp) != '\n' || version != REPLAY_VERSION)
+    {
+        fprintf(stderr, "APEX_Error: %s is not a version %d APEX trace\n", path,
+                REPLAY_VERSION);
+        APEX_replay_close(replay);
+        return NULL;
+    }
+    return replay;
+}
+
+/*
+ * Moves the bytes not read yet to the front of the buffer and fills the rest
+ * from the trace. Returns the bytes now available.
+ */
+static size_t
+refill(APEX_Replay *replay)
+{
+    size_t left = replay->length - replay->next;
+
+    memmove(replay->buffer, replay->buffer + replay->next, left);
+    replay->next = 0;
+    replay->length = left + fread(replay->buffer + left, 1, sizeof(replay->buffer) - left,
+                                  replay->fp);
+    return replay->length;
+}
+
+/*
+ * Reads the next instruction of the trace. Returns FALSE at the end of the
+ * trace, or at the first record that is cut short or does not describe an
+ * instruction, which is reported once.
+ */
+int
+APEX_replay_next(APEX_Replay *replay, APEX_Replay_Insn *insn)
+{
+    const unsigned char *record;
+    size_t available = replay->length - replay->next;
+    size_t size;
+    int has_word;
+    int unit = UNIT_NONE;
+
+    /* Records are decoded in place, the buffer is refilled when one might
+     * cross its end */
+    if (available < REPLAY_RECORD_MAX)
+    {
+        available = refill(replay);
+    }
+    if (replay->malformed || !available)
+    {
+        return FALSE;
+    }
+
+    record = replay->buffer + replay->next;
+    has_word = (record[0] & REPLAY_WORD) != 0;
+    size = has_word ? REPLAY_RECORD_MAX : REPLAY_RECORD_MAX - 4;
+    insn->opcode = record[0] & REPLAY_OPCODE_MASK;
+    if (available < size || (record[0] & 0x80) || (record[2] & 0xF0)
+        || insn->opcode >= NUM_OPCODES)
+    {
+        replay->malformed = TRUE;
+    }
+    else
+    {
+        /* Loads, stores and jumps always carry a word, branches only when taken */
+        unit = apex_isa[insn->opcode].unit;
+        if (unit == UNIT_LOAD || unit == UNIT_STORE || unit == UNIT_JUMP)
+        {
+            replay->malformed = !has_word;
+        }
+        else if (unit != UNIT_BRANCH)
+        {
+            replay->malformed = has_word;
+        }
+    }
+    if (replay->malformed)
+    {
+        fprintf(stderr, "APEX_Error: Malformed record %llu in trace %s\n", replay->records,
+                replay->path);
+        return FALSE;
+    }
+
+    insn->pc = replay->pc;
+    insn->rd = record[1] & 0xF;
+    insn->rs1 = record[1] >> 4;
+    insn->rs2 = record[2];
+    insn->address = 0;
+    insn->target = 0;
+    if (has_word)
+    {
+        unsigned int word = record[3] | record[4] << 8 | record[5] << 16
+                            | (unsigned int)record[6] << 24;
+
+        if (unit == UNIT_LOAD || unit == UNIT_STORE)
+        {
+            insn->address = word;
+        }
+        else
+        {
+            insn->target = (int)word;
+        }
+    }
+    replay->pc = insn->target ? insn->target : insn->pc + 4;
+    replay->next += size;
+    replay->records++;
+    return TRUE;
+}
+
+void
+APEX_replay_close(APEX_Replay *replay)
+{
+    if (!replay)
+    {
+        return;
+    }
+    if (replay->fp)
+    {
+        fclose(replay->fp);
+    }
+    free(replay);
+}
@@ -0,0 +1,77 @@
+/*
+ * apex_replay.h
+ * Contains the APEX trace recording and replay declarations
+ *
+ * The record command runs the functional model once and writes every
+ * instruction it executes to a compact binary trace. The replay command then
+ * feeds the pipeline from the trace instead of code memory: decode still
+ * finds the hazards from the register numbers, execute takes each branch
+ * outcome from the trace and memory sends the recorded addresses through
+ * the L1s, but no value is computed and data memory is never touched.
+ *
+ * A trace is one text line "APEX_TRACE <version> <first pc>\n" followed by
+ * one record per instruction, in the order they retire:
+ *
+ *   byte 0     opcode number from the ISA table in bits 0-5, bit 6 set when
+ *              a word follows, bit 7 clear
+ *   byte 1     rd in bits 0-3, rs1 in bits 4-7
+ *   byte 2     rs2 in bits 0-3, bits 4-7 clear
+ *   bytes 3-6  only with bit 6: the address of a load or store, or the
+ *              target of a taken branch or a jump, little endian
+ *
+ * The PC of a record is the target of the one before if that was taken,
+ * otherwise its PC plus 4, so a simulator that executes APEX code can write
+ * traces the pipeline replays without the program.
+ */
+#ifndef _APEX_REPLAY_H_
+#define _APEX_REPLAY_H_
+#include <stdio.h>
+#include "apex_cpu.h"
+
+#define REPLAY_VERSION 1
+#define REPLAY_OPCODE_MASK 0x3F
+#define REPLAY_WORD 0x40               /* A word follows the registers */
+#define REPLAY_RECORD_MAX 7            /* Bytes of a record with a word */
+#define REPLAY_BUFFER 65536            /* Bytes read from the trace at a time */
+
+/* One instruction read from a trace */
+typedef struct APEX_Replay_Insn
+{
+    int pc;
+    int opcode;
+    int rd;
+    int rs1;
+    int rs2;
+    unsigned int address;          /* Of a load or store */
+    int target;                    /* Of a taken branch or a jump, 0 when not taken */
+} APEX_Replay_Insn;
+
+/* Trace being replayed */
+typedef struct APEX_Replay
+{
+    FILE *fp;
+    const char *path;
+    int pc;                        /* PC of the next record */
+    unsigned long long records;    /* Records read so far */
+    int wrong_path;                /* Fetching behind a taken branch not resolved yet */
+    int malformed;                 /* Stopped at a record that could not be read */
+    size_t length;                 /* Bytes in buffer */
+    size_t next;                   /* Next byte to read from it */
+    unsigned char buffer[REPLAY_BUFFER];
+} APEX_Replay;
+
+/* Outcome of the record command */
+typedef struct APEX_Recording
+{
+    unsigned long long instructions;
+    unsigned long long bytes;      /* Size of the trace */
+    int outcome;                   /* FUNC_* outcome that ended it, FUNC_OK at the limit */
+    double seconds;
+} APEX_Recording;
+
+int APEX_replay_record(const APEX_CPU *cpu, const char *path, unsigned long long limit,
+                       APEX_Recording *recording);
+APEX_Replay *APEX_replay_open(const char *path);
+int APEX_replay_next(APEX_Replay *replay, APEX_Replay_Insn *insn);
+void APEX_replay_close(APEX_Replay *replay);
+#endif
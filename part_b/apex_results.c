@@ -0,0 +1,239 @@
+/*
+ * apex_results.c
+ * Contains the APEX result cache
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "apex_results.h"
+#include "apex_macros.h"
+
+/* Adds a value to both lanes of a hash */
+static void
+mix(unsigned long long hash[2], unsigned long long value)
+{
+    unsigned long long a = hash[0] ^ (value * 0x87C37B91114253D5ull);
+    unsigned long long b = hash[1] ^ (value * 0x9E3779B97F4A7C15ull);
+
+    hash[0] = ((a << 31) | (a >> 33)) * 0x4CF5AD432745937Full;
+    hash[1] = ((b << 27) | (b >> 37)) * 0xC2B2AE3D27D4EB4Full;
+}
+
+/* Spreads every bit of a lane over all of them */
+static unsigned long long
+finish_lane(unsigned long long lane)
+{
+    lane ^= lane >> 33;
+    lane *= 0xFF51AFD7ED558CCDull;
+    lane ^= lane >> 33;
+    lane *= 0xC4CEB9FE1A85EC53ull;
+    return lane ^ (lane >> 33);
+}
+
+static void
+start_hash(unsigned long long hash[2], unsigned long long kind)
+{
+    hash[0] = 0x243F6A8885A308D3ull;
+    hash[1] = 0x13198A2E03707344ull;
+    mix(hash, RESULTS_VERSION);
+    mix(hash, kind);
+}
+
+static void
+finish_hash(unsigned long long hash[2])
+{
+    hash[0] = finish_lane(hash[0]);
+    hash[1] = finish_lane(hash[1] ^ hash[0]);
+}
+
+/*
+ * Adds the data memory, page by page in address order. Pages that are all
+ * zero are skipped, so a page that was only ever written with zeros hashes
+ * like one never touched, as APEX_memory_equal sees them.
+ */
+static void
+mix_memory(unsigned long long hash[2], const APEX_Memory *mem)
+{
+    for (unsigned int dir = 0; dir < MEM_DIR_SIZE; dir++)
+    {
+        if (!mem->tables[dir] && !mem->dense)
+        {
+            continue;
+        }
+        for (unsigned int table = 0; table < MEM_TABLE_SIZE; table++)
+        {
+            unsigned int address = (dir << (MEM_TABLE_BITS + MEM_PAGE_BITS))
+                                   | (table << MEM_PAGE_BITS);
+            const int *page = APEX_memory_page(mem, address);
+            unsigned int first = 0;
+
+            while (page && first < MEM_PAGE_WORDS && !page[first])
+            {
+                first++;
+            }
+            if (!page || first == MEM_PAGE_WORDS)
+            {
+                continue;
+            }
+            mix(hash, address);
+            for (unsigned int i = 0; i < MEM_PAGE_WORDS; i += 2)
+            {
+                mix(hash, (unsigned int)page[i] | (unsigned long long)(unsigned int)page[i + 1] << 32);
+            }
+        }
+    }
+}
+
+/*
+ * Creates the cache directory if it does not exist yet. Returns FALSE if it
+ * cannot be used.
+ */
+int
+APEX_results_open(const char *dir)
+{
+    struct stat info;
+
+    if (mkdir(dir, 0777) && errno != EEXIST)
+    {
+        return FALSE;
+    }
+    return stat(dir, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+/*
+ * Hashes what a run starts from, called once the program and data images are
+ * loaded and before any fast-forward. Reports, traces and host threads are
+ * left out; the hazard policy, pipeline shape, caches, cores, quantum,
+ * fast-forward and warming are all in.
+ */
+void
+APEX_results_input(const APEX_CPU *cpu, unsigned long long hash[2])
+{
+    const APEX_Config *config = &cpu->config;
+
+    start_hash(hash, 'I');
+    mix(hash, config->hazard_policy);
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+    {
+        mix(hash, config->depth[phase]);
+    }
+    mix(hash, config->latch_overhead);
+    mix(hash, config->memory_size);
+    mix(hash, config->num_cores);
+    mix(hash, config->quantum);
+    mix(hash, config->l1.sets);
+    mix(hash, config->l1.ways);
+    mix(hash, config->l1.line_words);
+    mix(hash, config->l1.protocol);
+    mix(hash, config->l1.memory_latency);
+    mix(hash, config->l1.bus_latency);
+    mix(hash, config->fast_forward);
+    mix(hash, config->warm);
+
+    mix(hash, cpu->pc);
+    for (int reg = 0; reg < REG_FILE_SIZE; reg++)
+    {
+        mix(hash, (unsigned int)cpu->regs[reg]);
+    }
+    mix(hash, cpu->code_memory_size);
+    for (int i = 0; i < cpu->code_memory_size; i++)
+    {
+        const APEX_Instruction *insn = &cpu->code_memory[i];
+
+        mix(hash, insn->opcode);
+        mix(hash, (unsigned int)insn->rd | (unsigned long long)(unsigned int)insn->rs1 << 32);
+        mix(hash, (unsigned int)insn->rs2 | (unsigned long long)(unsigned int)insn->imm << 32);
+    }
+    mix_memory(hash, cpu->data_memory);
+    finish_hash(hash);
+}
+
+/*
+ * Hashes the architectural state a run ended in, so runs can be compared
+ * without keeping their memories.
+ */
+void
+APEX_results_state(const APEX_CPU *cpu, unsigned long long hash[2])
+{
+    start_hash(hash, 'S');
+    for (int reg = 0; reg < REG_FILE_SIZE; reg++)
+    {
+        mix(hash, (unsigned int)cpu->regs[reg]);
+    }
+    mix_memory(hash, cpu->data_memory);
+    finish_hash(hash);
+}
+
+/* File of a run: its input hash with the cycle limit mixed in */
+static void
+result_path(char *path, size_t size, const char *dir, const unsigned long long input[2],
+            int max_cycles)
+{
+    unsigned long long hash[2] = {input[0], input[1]};
+
+    mix(hash, (unsigned int)max_cycles);
+    finish_hash(hash);
+    snprintf(path, size, "%s/%016llx%016llx.result", dir, hash[0], hash[1]);
+}
+
+/*
+ * Reads the result of a run. Returns FALSE if it was never stored or the
+ * file does not hold one.
+ */
+int
+APEX_results_lookup(const char *dir, const unsigned long long input[2], int max_cycles,
+                    APEX_Result *result)
+{
+    char path[1024];
+    int version;
+    FILE *fp;
+    int fields;
+
+    result_path(path, sizeof(path), dir, input, max_cycles);
+    fp = fopen(path, "r");
+    if (!fp)
+    {
+        return FALSE;
+    }
+    fields = fscanf(fp, "APEX_RESULT %d clock %d halted %d state %16llx%16llx",
+                    &version, &result->clock, &result->halted, &result->state[0],
+                    &result->state[1]);
+    fclose(fp);
+    return fields == 5 && version == RESULTS_VERSION;
+}
+
+/*
+ * Stores the result of a run. The file is written under a temporary name
+ * and renamed, so concurrent runs sharing the directory never read half of
+ * one.
+ */
+int
+APEX_results_store(const char *dir, const unsigned long long input[2], int max_cycles,
+                   const APEX_Result *result)
+{
+    char path[1024];
+    char temp[1100];
+    FILE *fp;
+    int ok;
+
+    result_path(path, sizeof(path), dir, input, max_cycles);
+    snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+    fp = fopen(temp, "w");
+    if (!fp)
+    {
+        return FALSE;
+    }
+    fprintf(fp, "APEX_RESULT %d\nclock %d\nhalted %d\nstate %016llx%016llx\n", RESULTS_VERSION,
+            result->clock, result->halted, result->state[0], result->state[1]);
+    ok = !ferror(fp);
+    ok &= fclose(fp) == 0;
+    if (!ok || rename(temp, path))
+    {
+        remove(temp);
+        return FALSE;
+    }
+    return TRUE;
+}
@@ -0,0 +1,33 @@
+/*
+ * apex_results.h
+ * Contains the APEX result cache declarations
+ *
+ * A run is named by a 128-bit hash of everything its outcome depends on:
+ * the parsed code memory, the data memory as loaded, the starting registers
+ * and every simulator parameter that can change the cycle count or the
+ * final state, but not those that only change what is reported. With
+ * --result-cache each finished run leaves one small file named by its hash,
+ * so an unchanged run is later answered from the file instead of simulated.
+ */
+#ifndef _APEX_RESULTS_H_
+#define _APEX_RESULTS_H_
+#include "apex_cpu.h"
+
+#define RESULTS_VERSION 1              /* Bump when the simulated timing changes */
+
+/* Outcome of one run */
+typedef struct APEX_Result
+{
+    int clock;                     /* Cycles simulated */
+    int halted;                    /* HALT retired before the cycle limit */
+    unsigned long long state[2];   /* Hash of the final registers and data memory */
+} APEX_Result;
+
+int APEX_results_open(const char *dir);
+void APEX_results_input(const APEX_CPU *cpu, unsigned long long hash[2]);
+void APEX_results_state(const APEX_CPU *cpu, unsigned long long hash[2]);
+int APEX_results_lookup(const char *dir, const unsigned long long input[2], int max_cycles,
+                        APEX_Result *result);
+int APEX_results_store(const char *dir, const unsigned long long input[2], int max_cycles,
+                       const APEX_Result *result);
+#endif
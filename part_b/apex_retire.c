@@ -0,0 +1,195 @@
+/*
+ * apex_retire.c
+ * Contains the APEX lock-free retire stream
+ */
+#include <sched.h>
+#include <stdlib.h>
+#include "apex_retire.h"
+#include "apex_macros.h"
+
+/* Records a consumer reads before it tells the producer about them */
+#define RETIRE_BATCH 256
+
+/*
+ * Creates a ring of the given number of slots, rounded up to a power of two.
+ */
+APEX_Retire_Ring *
+APEX_retire_create(int slots)
+{
+    APEX_Retire_Ring *ring = calloc(1, sizeof(APEX_Retire_Ring));
+    unsigned long long size = 1;
+
+    if (!ring)
+    {
+        return NULL;
+    }
+    while (size < (unsigned long long)slots)
+    {
+        size <<= 1;
+    }
+    ring->slots = calloc(size, sizeof(APEX_Retired));
+    if (!ring->slots)
+    {
+        free(ring);
+        return NULL;
+    }
+    ring->mask = size - 1;
+    ring->limit = size;
+    return ring;
+}
+
+/*
+ * Adds a consumer. All consumers must subscribe before the ring is started.
+ */
+int
+APEX_retire_subscribe(APEX_Retire_Ring *ring, APEX_Retire_Consume consume,
+                      APEX_Retire_Finish finish, void *arg)
+{
+    APEX_Retire_Consumer *consumer;
+
+    if (ring->started || ring->num_consumers == MAX_RETIRE_CONSUMERS)
+    {
+        return FALSE;
+    }
+    consumer = &ring->consumers[ring->num_consumers++];
+    atomic_init(&consumer->head, 0);
+    consumer->consume = consume;
+    consumer->finish = finish;
+    consumer->arg = arg;
+    consumer->ring = ring;
+    return TRUE;
+}
+
+/*
+ * Consumer thread: reads every record up to the producer's tail, publishing
+ * its own position every batch so the producer can reuse the slots, until
+ * the ring is closed and drained.
+ */
+static void *
+consumer_main(void *arg)
+{
+    APEX_Retire_Consumer *consumer = arg;
+    APEX_Retire_Ring *ring = consumer->ring;
+    unsigned long long head = 0;
+
+    while (TRUE)
+    {
+        unsigned long long tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (head == tail)
+        {
+            if (atomic_load_explicit(&ring->closed, memory_order_acquire)
+                && head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+            {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        while (head != tail)
+        {
+            consumer->consume(&ring->slots[head & ring->mask], consumer->arg);
+            head++;
+            if ((head & (RETIRE_BATCH - 1)) == 0)
+            {
+                atomic_store_explicit(&consumer->head, head, memory_order_release);
+            }
+        }
+        atomic_store_explicit(&consumer->head, head, memory_order_release);
+    }
+
+    if (consumer->finish)
+    {
+        consumer->finish(consumer->arg);
+    }
+    return NULL;
+}
+
+/*
+ * Starts one thread per consumer.
+ */
+int
+APEX_retire_start(APEX_Retire_Ring *ring)
+{
+    for (int i = 0; i < ring->num_consumers; i++)
+    {
+        if (pthread_create(&ring->consumers[i].thread, NULL, consumer_main,
+                           &ring->consumers[i]))
+        {
+            /* Let the ones already running finish */
+            ring->num_consumers = i;
+            ring->started = TRUE;
+            APEX_retire_close(ring);
+            return FALSE;
+        }
+    }
+    ring->started = TRUE;
+    return TRUE;
+}
+
+/*
+ * Publishes a record. Only the producer calls this. When every slot still
+ * holds a record some consumer has not read, waits for the slowest one.
+ */
+void
+APEX_retire_publish(APEX_Retire_Ring *ring, const APEX_Retired *insn)
+{
+    unsigned long long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    APEX_Retired *slot;
+
+    while (tail == ring->limit)
+    {
+        unsigned long long oldest = tail;
+
+        for (int i = 0; i < ring->num_consumers; i++)
+        {
+            unsigned long long head
+                = atomic_load_explicit(&ring->consumers[i].head, memory_order_acquire);
+
+            if (head < oldest)
+            {
+                oldest = head;
+            }
+        }
+        ring->limit = oldest + ring->mask + 1;
+        if (tail == ring->limit)
+        {
+            sched_yield();
+        }
+    }
+
+    slot = &ring->slots[tail & ring->mask];
+    *slot = *insn;
+    slot->seq = tail;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+/*
+ * Tells the consumers no more records follow and waits for them to drain
+ * the ring and finish.
+ */
+void
+APEX_retire_close(APEX_Retire_Ring *ring)
+{
+    atomic_store_explicit(&ring->closed, TRUE, memory_order_release);
+    for (int i = 0; ring->started && i < ring->num_consumers; i++)
+    {
+        pthread_join(ring->consumers[i].thread, NULL);
+    }
+    ring->num_consumers = 0;
+}
+
+void
+APEX_retire_free(APEX_Retire_Ring *ring)
+{
+    if (!ring)
+    {
+        return;
+    }
+    if (!atomic_load(&ring->closed))
+    {
+        APEX_retire_close(ring);
+    }
+    free(ring->slots);
+    free(ring);
+}
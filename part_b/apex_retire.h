@@ -0,0 +1,74 @@
+/*
+ * apex_retire.h
+ * Contains the APEX retire stream declarations
+ *
+ * Each core publishes every instruction it retires into its own ring. The
+ * ring has a single producer, the thread simulating the core, and any number
+ * of consumers that each see every record and drain it on their own thread,
+ * so tracing and profiling do not run inside the simulation loop. The ring
+ * is lock-free; when it is full the core waits for the slowest consumer.
+ */
+#ifndef _APEX_RETIRE_H_
+#define _APEX_RETIRE_H_
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Consumers of one ring */
+#define MAX_RETIRE_CONSUMERS 4
+
+/* Memory access of a retired instruction */
+#define RETIRE_NO_ACCESS 0
+#define RETIRE_LOAD 1
+#define RETIRE_STORE 2
+
+/* One retired instruction */
+typedef struct APEX_Retired
+{
+    unsigned long long seq;        /* Retirement number on its core */
+    int cycle;
+    int core;
+    int pc;
+    int opcode;
+    const char *opcode_str;
+    int num_dest;
+    int dest[2];                   /* Registers written */
+    int dest_value[2];
+    int mem_access;                /* RETIRE_LOAD, RETIRE_STORE or RETIRE_NO_ACCESS */
+    unsigned int mem_address;
+    int mem_value;                 /* Value loaded or stored */
+} APEX_Retired;
+
+/* Called on the consumer thread for every record, then once at the end */
+typedef void (*APEX_Retire_Consume)(const APEX_Retired *insn, void *arg);
+typedef void (*APEX_Retire_Finish)(void *arg);
+
+typedef struct APEX_Retire_Consumer
+{
+    _Alignas(64) _Atomic unsigned long long head; /* Next record to read */
+    APEX_Retire_Consume consume;
+    APEX_Retire_Finish finish;
+    void *arg;
+    struct APEX_Retire_Ring *ring;
+    pthread_t thread;
+} APEX_Retire_Consumer;
+
+typedef struct APEX_Retire_Ring
+{
+    APEX_Retired *slots;
+    unsigned long long mask;       /* Number of slots - 1 */
+    _Alignas(64) _Atomic unsigned long long tail; /* Records published */
+    _Alignas(64) unsigned long long limit;        /* Producer only, free up to here */
+    _Atomic int closed;
+    int num_consumers;
+    int started;
+    APEX_Retire_Consumer consumers[MAX_RETIRE_CONSUMERS];
+} APEX_Retire_Ring;
+
+APEX_Retire_Ring *APEX_retire_create(int slots);
+int APEX_retire_subscribe(APEX_Retire_Ring *ring, APEX_Retire_Consume consume,
+                          APEX_Retire_Finish finish, void *arg);
+int APEX_retire_start(APEX_Retire_Ring *ring);
+void APEX_retire_publish(APEX_Retire_Ring *ring, const APEX_Retired *insn);
+void APEX_retire_close(APEX_Retire_Ring *ring);
+void APEX_retire_free(APEX_Retire_Ring *ring);
+#endif
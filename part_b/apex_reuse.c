@@ -0,0 +1,571 @@
+/*
+ * apex_reuse.c
+ * Contains the APEX memory locality analysis
+ *
+ * The consumers run on the retire stream threads; the reports are written
+ * from the simulation thread once the rings are drained.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apex_reuse.h"
+#include "apex_cache.h"
+#include "apex_macros.h"
+
+#define REUSE_INITIAL_TIMES 4096
+#define REUSE_INITIAL_ENTRIES 1024
+#define REUSE_INITIAL_WINDOWS 256
+
+/* Bucket of a reuse distance: 0, then b for [2^(b-1), 2^b) */
+static int
+distance_bucket(unsigned long long distance)
+{
+    int bucket = 0;
+
+    while (distance)
+    {
+        distance >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/* Adds delta to the mark at a time */
+static void
+tree_add(APEX_Reuse *reuse, long long time, int delta)
+{
+    for (long long i = time + 1; i <= reuse->capacity; i += i & -i)
+    {
+        reuse->tree[i] += delta;
+    }
+}
+
+/* Marks at times up to and including a time */
+static long long
+tree_prefix(const APEX_Reuse *reuse, long long time)
+{
+    long long sum = 0;
+
+    for (long long i = time + 1; i > 0; i -= i & -i)
+    {
+        sum += reuse->tree[i];
+    }
+    return sum;
+}
+
+/* Slot of a line, or the free slot it would take */
+static APEX_Reuse_Entry *
+find_entry(const APEX_Reuse *reuse, unsigned int line)
+{
+    unsigned long long mask = reuse->num_entries - 1;
+    unsigned long long hash = line * 0x9E3779B97F4A7C15ull;
+    unsigned long long i = (hash ^ (hash >> 29)) & mask;
+
+    while (reuse->entries[i].time >= 0 && reuse->entries[i].line != line)
+    {
+        i = (i + 1) & mask;
+    }
+    return &reuse->entries[i];
+}
+
+/* Doubles the line table, keeping it at most half full */
+static int
+grow_entries(APEX_Reuse *reuse)
+{
+    APEX_Reuse_Entry *old = reuse->entries;
+    unsigned long long num_old = reuse->num_entries;
+
+    reuse->entries = malloc(2 * num_old * sizeof(APEX_Reuse_Entry));
+    if (!reuse->entries)
+    {
+        reuse->entries = old;
+        return FALSE;
+    }
+    reuse->num_entries = 2 * num_old;
+    for (unsigned long long i = 0; i < reuse->num_entries; i++)
+    {
+        reuse->entries[i].time = -1;
+    }
+    for (unsigned long long i = 0; i < num_old; i++)
+    {
+        if (old[i].time >= 0)
+        {
+            *find_entry(reuse, old[i].line) = old[i];
+        }
+    }
+    free(old);
+    return TRUE;
+}
+
+/*
+ * Renumbers the marked times 0, 1, ... in their order, which keeps every
+ * distance, and rebuilds the tree. It doubles when the lines fill more than
+ * half of it, so compactions stay rare.
+ */
+static int
+compact_times(APEX_Reuse *reuse)
+{
+    long long marks = 0;
+    long long capacity = reuse->capacity;
+
+    for (long long time = 0; time < reuse->capacity; time++)
+    {
+        if (reuse->marked[time])
+        {
+            reuse->owner[marks] = reuse->owner[time];
+            find_entry(reuse, reuse->owner[marks])->time = marks;
+            marks++;
+        }
+    }
+
+    if (2 * marks > capacity)
+    {
+        unsigned int *owner = realloc(reuse->owner, 2 * capacity * sizeof(unsigned int));
+        unsigned char *marked;
+        int *tree;
+
+        if (!owner)
+        {
+            return FALSE;
+        }
+        reuse->owner = owner;
+        marked = realloc(reuse->marked, 2 * capacity);
+        if (!marked)
+        {
+            return FALSE;
+        }
+        reuse->marked = marked;
+        tree = realloc(reuse->tree, (2 * capacity + 1) * sizeof(int));
+        if (!tree)
+        {
+            return FALSE;
+        }
+        reuse->tree = tree;
+        capacity *= 2;
+    }
+
+    memset(reuse->marked, 0, capacity);
+    memset(reuse->marked, 1, marks);
+    memset(reuse->tree, 0, (capacity + 1) * sizeof(int));
+    for (long long i = 1; i <= capacity; i++)
+    {
+        long long parent = i + (i & -i);
+
+        reuse->tree[i] += reuse->marked[i - 1];
+        if (parent <= capacity)
+        {
+            reuse->tree[parent] += reuse->tree[i];
+        }
+    }
+    reuse->capacity = capacity;
+    reuse->now = marks;
+    return TRUE;
+}
+
+/* Closes the working set window that just ended */
+static int
+close_window(APEX_Reuse *reuse)
+{
+    if (reuse->num_windows == reuse->window_capacity)
+    {
+        long long capacity = reuse->window_capacity ? 2 * reuse->window_capacity
+                                                    : REUSE_INITIAL_WINDOWS;
+        unsigned long long *working_set = realloc(reuse->working_set,
+                                                  capacity * sizeof(unsigned long long));
+
+        if (!working_set)
+        {
+            return FALSE;
+        }
+        reuse->working_set = working_set;
+        reuse->window_capacity = capacity;
+    }
+    reuse->working_set[reuse->num_windows++] = reuse->window_lines;
+    reuse->window_lines = 0;
+    return TRUE;
+}
+
+/*
+ * Records an access to a line: its reuse distance, or a cold miss, and its
+ * window. Returns FALSE out of host memory.
+ */
+static int
+touch_line(APEX_Reuse *reuse, unsigned int line)
+{
+    unsigned long long window = reuse->accesses / reuse->window + 1;
+    APEX_Reuse_Entry *entry;
+
+    if (reuse->accesses && reuse->accesses % reuse->window == 0 && !close_window(reuse))
+    {
+        return FALSE;
+    }
+    if (reuse->now == reuse->capacity && !compact_times(reuse))
+    {
+        return FALSE;
+    }
+
+    entry = find_entry(reuse, line);
+    if (entry->time < 0)
+    {
+        if (2 * (reuse->num_lines + 1) > reuse->num_entries)
+        {
+            if (!grow_entries(reuse))
+            {
+                return FALSE;
+            }
+            entry = find_entry(reuse, line);
+        }
+        entry->line = line;
+        entry->window = 0;
+        reuse->num_lines++;
+        reuse->cold++;
+    }
+    else
+    {
+        /* Lines touched since: the marks after its last access */
+        unsigned long long distance = reuse->num_lines - tree_prefix(reuse, entry->time);
+
+        reuse->histogram[distance_bucket(distance)]++;
+        reuse->distance_sum += distance;
+        reuse->marked[entry->time] = FALSE;
+        tree_add(reuse, entry->time, -1);
+    }
+
+    entry->time = reuse->now++;
+    reuse->owner[entry->time] = line;
+    reuse->marked[entry->time] = TRUE;
+    tree_add(reuse, entry->time, 1);
+    if (entry->window != window)
+    {
+        entry->window = window;
+        reuse->window_lines++;
+    }
+    return TRUE;
+}
+
+/* Follows the stride between successive accesses of one instruction */
+static void
+record_stride(APEX_Reuse *reuse, int pc, unsigned int address)
+{
+    int index = (pc - 4000) / 4;
+    APEX_Reuse_Stride *stride;
+
+    if (index < 0 || index >= reuse->code_memory_size)
+    {
+        return;
+    }
+    stride = &reuse->strides[index];
+    if (stride->accesses)
+    {
+        int words = (int)(address - stride->last_address);
+
+        if (stride->accesses > 1 && words == stride->stride)
+        {
+            stride->strided++;
+        }
+        stride->stride = words;
+    }
+    stride->last_address = address;
+    stride->accesses++;
+}
+
+static void
+reuse_consume(const APEX_Retired *insn, void *arg)
+{
+    APEX_Reuse *reuse = arg;
+
+    if (insn->mem_access == RETIRE_NO_ACCESS || reuse->failed)
+    {
+        return;
+    }
+    record_stride(reuse, insn->pc, insn->mem_address);
+    if (!touch_line(reuse, insn->mem_address >> reuse->line_shift))
+    {
+        reuse->failed = TRUE;
+        return;
+    }
+    reuse->accesses++;
+    reuse->loads += insn->mem_access == RETIRE_LOAD;
+}
+
+static void
+free_reuse(APEX_Reuse *reuse)
+{
+    if (!reuse)
+    {
+        return;
+    }
+    free(reuse->entries);
+    free(reuse->tree);
+    free(reuse->marked);
+    free(reuse->owner);
+    free(reuse->working_set);
+    free(reuse->strides);
+    free(reuse);
+}
+
+/*
+ * Subscribes the analysis of one core to its ring. Lines are those of the
+ * L1 when there is one.
+ */
+int
+APEX_reuse_subscribe(APEX_CPU *core, APEX_Retire_Ring *ring)
+{
+    APEX_Reuse *reuse = calloc(1, sizeof(APEX_Reuse));
+    int line_words = core->config.l1.sets ? core->config.l1.line_words : L1_DEFAULT_LINE_WORDS;
+
+    if (!reuse)
+    {
+        return FALSE;
+    }
+    core->reuse = reuse;
+    reuse->core = core->core_id;
+    while ((1 << reuse->line_shift) < line_words)
+    {
+        reuse->line_shift++;
+    }
+    reuse->window = core->config.reuse_window;
+    reuse->num_entries = REUSE_INITIAL_ENTRIES;
+    reuse->capacity = REUSE_INITIAL_TIMES;
+    reuse->code_memory_size = core->code_memory_size;
+    reuse->entries = malloc(REUSE_INITIAL_ENTRIES * sizeof(APEX_Reuse_Entry));
+    reuse->tree = calloc(REUSE_INITIAL_TIMES + 1, sizeof(int));
+    reuse->marked = calloc(REUSE_INITIAL_TIMES, 1);
+    reuse->owner = malloc(REUSE_INITIAL_TIMES * sizeof(unsigned int));
+    reuse->strides = calloc(core->code_memory_size, sizeof(APEX_Reuse_Stride));
+    if (!reuse->entries || !reuse->tree || !reuse->marked || !reuse->owner || !reuse->strides)
+    {
+        return FALSE;
+    }
+    for (int i = 0; i < REUSE_INITIAL_ENTRIES; i++)
+    {
+        reuse->entries[i].time = -1;
+    }
+    return APEX_retire_subscribe(ring, reuse_consume, NULL, reuse);
+}
+
+/* Misses of a fully associative LRU cache of 2^size lines */
+static unsigned long long
+lru_misses(const APEX_Reuse *reuse, int size)
+{
+    unsigned long long misses = reuse->cold;
+
+    for (int bucket = size + 1; bucket < REUSE_BUCKETS; bucket++)
+    {
+        misses += reuse->histogram[bucket];
+    }
+    return misses;
+}
+
+/* Cache sizes on the curve, powers of two up to the first holding every line */
+static int
+curve_sizes(const APEX_Reuse *reuse)
+{
+    int sizes = 1;
+
+    while (sizes < REUSE_BUCKETS - 1 && (1ull << (sizes - 1)) < reuse->num_lines)
+    {
+        sizes++;
+    }
+    return sizes;
+}
+
+/* Most lines touched in one window */
+static unsigned long long
+peak_working_set(const APEX_Reuse *reuse)
+{
+    unsigned long long peak = 0;
+
+    for (long long i = 0; i < reuse->num_windows; i++)
+    {
+        peak = reuse->working_set[i] > peak ? reuse->working_set[i] : peak;
+    }
+    return peak;
+}
+
+/* Reports the accesses, footprint, reuse and miss ratio curve of a core */
+static void
+show_reuse(const APEX_CPU *cpu, const APEX_Reuse *reuse)
+{
+    unsigned long long reuses = reuse->accesses - reuse->cold;
+    unsigned long long peak = peak_working_set(reuse);
+    double mean = reuses ? reuse->distance_sum / reuses : 0.0;
+    APEX_Stat stats[] = {
+        {"accesses", reuse->accesses},
+        {"loads", reuse->loads},
+        {"lines", reuse->num_lines},
+        {"line_words", 1 << reuse->line_shift},
+        {"cold", reuse->cold},
+        {"mean_distance", mean},
+        {"peak_working_set", peak}
+    };
+    APEX_Stat curve[REUSE_BUCKETS];
+    char names[REUSE_BUCKETS][24];
+    char text[2048];
+    int sizes = curve_sizes(reuse);
+    int length;
+
+    snprintf(text, sizeof(text),
+             "APEX_REUSE: Core %d: %llu accesses (%llu loads) to %llu lines of %d words, cold = %llu, mean reuse distance = %.1f lines, peak working set = %llu lines per %d accesses\n",
+             reuse->core, reuse->accesses, reuse->loads, reuse->num_lines,
+             1 << reuse->line_shift, reuse->cold, mean, peak, reuse->window);
+    APEX_output_stats(cpu->output, "reuse", reuse->core, text, stats, 7);
+
+    length = snprintf(text, sizeof(text), "APEX_REUSE: Core %d LRU miss ratio by lines:",
+                      reuse->core);
+    for (int size = 0; size < sizes; size++)
+    {
+        double ratio = reuse->accesses ? (double)lru_misses(reuse, size) / reuse->accesses : 0.0;
+
+        snprintf(names[size], sizeof(names[size]), "lines_%llu", 1ull << size);
+        curve[size].name = names[size];
+        curve[size].value = ratio;
+        curve[size].text = NULL;
+        length += snprintf(text + length, sizeof(text) - length, " %llu:%.3f",
+                           1ull << size, ratio);
+    }
+    snprintf(text + length, sizeof(text) - length, "\n");
+    APEX_output_stats(cpu->output, "miss_ratio", reuse->core, text, curve, sizes);
+}
+
+/* Writes the four tables of every core to the --reuse-file */
+static int
+write_tables(const APEX_CPU *cpu, FILE *fp)
+{
+    int num_cores = cpu->config.num_cores;
+
+    fprintf(fp, "# Reuse distance histogram, in lines\ncore,min_distance,max_distance,accesses\n");
+    for (int id = 0; id < num_cores; id++)
+    {
+        const APEX_Reuse *reuse = cpu->cores[id]->reuse;
+
+        fprintf(fp, "%d,cold,cold,%llu\n", id, reuse->cold);
+        for (int bucket = 0; bucket < REUSE_BUCKETS; bucket++)
+        {
+            if (reuse->histogram[bucket])
+            {
+                fprintf(fp, "%d,%llu,%llu,%llu\n", id,
+                        bucket ? 1ull << (bucket - 1) : 0, bucket ? (1ull << bucket) - 1 : 0,
+                        reuse->histogram[bucket]);
+            }
+        }
+    }
+
+    fprintf(fp, "\n# Miss ratio curve, fully associative LRU\ncore,lines,words,misses,miss_ratio\n");
+    for (int id = 0; id < num_cores; id++)
+    {
+        const APEX_Reuse *reuse = cpu->cores[id]->reuse;
+        int sizes = curve_sizes(reuse);
+
+        for (int size = 0; size < sizes; size++)
+        {
+            unsigned long long misses = lru_misses(reuse, size);
+
+            fprintf(fp, "%d,%llu,%llu,%llu,%.6f\n", id, 1ull << size,
+                    (1ull << size) << reuse->line_shift, misses,
+                    reuse->accesses ? (double)misses / reuse->accesses : 0.0);
+        }
+    }
+
+    fprintf(fp, "\n# Working set, distinct lines per window\ncore,first_access,accesses,lines\n");
+    for (int id = 0; id < num_cores; id++)
+    {
+        const APEX_Reuse *reuse = cpu->cores[id]->reuse;
+
+        for (long long i = 0; i < reuse->num_windows; i++)
+        {
+            unsigned long long first = (unsigned long long)i * reuse->window;
+            unsigned long long accesses = reuse->accesses - first < (unsigned long long)reuse->window
+                                          ? reuse->accesses - first : reuse->window;
+
+            fprintf(fp, "%d,%llu,%llu,%llu\n", id, first, accesses, reuse->working_set[i]);
+        }
+    }
+
+    fprintf(fp, "\n# Strides in words, per instruction\ncore,pc,accesses,last_stride,strided\n");
+    for (int id = 0; id < num_cores; id++)
+    {
+        const APEX_Reuse *reuse = cpu->cores[id]->reuse;
+
+        for (int i = 0; i < reuse->code_memory_size; i++)
+        {
+            const APEX_Reuse_Stride *stride = &reuse->strides[i];
+
+            if (stride->accesses)
+            {
+                fprintf(fp, "%d,%d,%llu,%d,%llu\n", id, 4000 + 4 * i, stride->accesses,
+                        stride->accesses > 1 ? stride->stride : 0, stride->strided);
+            }
+        }
+    }
+    return !ferror(fp);
+}
+
+/*
+ * Reports the analysis of every core and writes its tables, called once the
+ * retire rings are drained.
+ */
+void
+APEX_reuse_write(APEX_CPU *cpu)
+{
+    APEX_Stat stats[] = {{"path", 0, cpu->config.reuse_path}};
+    char text[640];
+    FILE *fp;
+    int ok;
+
+    if (!cpu->reuse)
+    {
+        return;
+    }
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        APEX_Reuse *reuse = cpu->cores[id]->reuse;
+
+        if (reuse->failed)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for the reuse analysis of core %d, it stops after %llu accesses\n",
+                    id, reuse->accesses);
+        }
+        else if (reuse->window_lines && !close_window(reuse))
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for the working set of core %d\n", id);
+        }
+        show_reuse(cpu, reuse);
+    }
+
+    fp = fopen(cpu->config.reuse_path, "w");
+    ok = fp && write_tables(cpu, fp);
+    if (fp && fclose(fp))
+    {
+        ok = FALSE;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write the reuse analysis %s\n",
+                cpu->config.reuse_path);
+        return;
+    }
+
+    snprintf(text, sizeof(text),
+             "APEX_REUSE: Reuse distances, miss ratio curves, working sets and strides written to %s\n",
+             cpu->config.reuse_path);
+    APEX_output_stats(cpu->output, "reuse_file", -1, text, stats, 1);
+}
+
+/*
+ * Frees the analysis of every core.
+ */
+void
+APEX_reuse_detach(APEX_CPU *cpu)
+{
+    for (int id = 0; id < MAX_CORES; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+
+        if (core && core->reuse)
+        {
+            free_reuse(core->reuse);
+            core->reuse = NULL;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * apex_reuse.h
+ * Contains the APEX memory locality analysis declarations
+ *
+ * A retire stream consumer per core follows the data addresses of every
+ * LOAD, LDI, STORE and STI the core retires, at the granularity of L1 lines.
+ * The reuse distance of an access is the number of distinct lines touched
+ * since the last access to its line. It is found with a Fenwick tree over
+ * the access times that marks the time of every line's last access, so the
+ * lines touched since time p are the marks after p; the tree is compacted
+ * whenever it fills up, so it never holds more than twice the lines seen.
+ * A fully associative LRU cache of C lines misses exactly the first
+ * accesses and those with a distance of C or more, so the histogram of
+ * distances gives the miss ratio of every cache size at once.
+ */
+#ifndef _APEX_REUSE_H_
+#define _APEX_REUSE_H_
+#include "apex_cpu.h"
+#include "apex_retire.h"
+
+#define REUSE_BUCKETS 33               /* Distance 0, then [2^(b-1), 2^b) */
+
+/* Stride of the accesses of one instruction */
+typedef struct APEX_Reuse_Stride
+{
+    unsigned long long accesses;
+    unsigned long long strided;    /* Accesses at the same stride as the one before */
+    unsigned int last_address;
+    int stride;                    /* Words from the access before, the last one seen */
+} APEX_Reuse_Stride;
+
+/* Line known to the analysis, found by hashing its address */
+typedef struct APEX_Reuse_Entry
+{
+    unsigned int line;
+    unsigned long long window;     /* Last window it was touched in, plus one */
+    long long time;                /* Its last access on the tree, -1 for a free slot */
+} APEX_Reuse_Entry;
+
+typedef struct APEX_Reuse
+{
+    int core;
+    int line_shift;                /* log2 of the words per line */
+    int failed;                    /* Out of host memory, analysis stopped */
+
+    /* Lines, open addressing */
+    APEX_Reuse_Entry *entries;
+    unsigned long long num_entries; /* Power of two */
+    unsigned long long num_lines;  /* Distinct lines, the footprint */
+
+    /* Fenwick tree over access times, one mark per line */
+    int *tree;
+    unsigned char *marked;
+    unsigned int *owner;           /* Line whose last access is at a marked time */
+    long long capacity;
+    long long now;                 /* Next time on the tree */
+
+    /* Reuse distances */
+    unsigned long long accesses;
+    unsigned long long loads;
+    unsigned long long cold;       /* First accesses to a line */
+    unsigned long long histogram[REUSE_BUCKETS];
+    double distance_sum;
+
+    /* Working set, distinct lines per window of accesses */
+    int window;
+    unsigned long long window_lines;
+    unsigned long long *working_set;
+    long long num_windows;
+    long long window_capacity;
+
+    /* Strides, per instruction in code memory */
+    int code_memory_size;
+    APEX_Reuse_Stride *strides;
+} APEX_Reuse;
+
+int APEX_reuse_subscribe(APEX_CPU *core, APEX_Retire_Ring *ring);
+void APEX_reuse_write(APEX_CPU *cpu);
+void APEX_reuse_detach(APEX_CPU *cpu);
+#endif
@@ -0,0 +1,639 @@
+/*
+ * apex_simpoint.c
+ * Contains the APEX representative sampling: basic block vectors, their
+ * clustering and the checkpoints of the chosen intervals
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "apex_simpoint.h"
+#include "apex_func.h"
+#include "apex_jit.h"
+#include "apex_macros.h"
+
+#define SIMPOINT_SEED 0x5eed5eedULL
+
+/* Basic block vectors while the profile runs */
+typedef struct APEX_Bbv
+{
+    int num_blocks;                /* Code memory size, a block is named by its first index */
+    long long *counts;             /* Instructions per block in the open interval */
+    int *touched;                  /* Blocks counted in the open interval */
+    int num_touched;
+    char *seen;                    /* Blocks counted in any interval */
+    double *projection;            /* num_blocks x SIMPOINT_DIMENSIONS */
+    double *vectors;               /* Projected vector of every closed interval */
+    long long *lengths;            /* Instructions of every closed interval */
+    long long count;
+    long long capacity;
+    FILE *fp;                      /* --bbv-file, or NULL */
+} APEX_Bbv;
+
+/* Uniform in [0, 1), the same sequence on every host */
+static double
+next_random(unsigned long long *seed)
+{
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (*seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double
+squared_distance(const double *a, const double *b)
+{
+    double sum = 0.0;
+
+    for (int d = 0; d < SIMPOINT_DIMENSIONS; d++)
+    {
+        sum += (a[d] - b[d]) * (a[d] - b[d]);
+    }
+    return sum;
+}
+
+static void
+free_bbv(APEX_Bbv *bbv)
+{
+    free(bbv->counts);
+    free(bbv->touched);
+    free(bbv->seen);
+    free(bbv->projection);
+    free(bbv->vectors);
+    free(bbv->lengths);
+    if (bbv->fp)
+    {
+        fclose(bbv->fp);
+    }
+}
+
+/*
+ * Sets up the block counters and the random projection, a fixed matrix of
+ * values in [-1, 1) so that a run is reproducible.
+ */
+static int
+create_bbv(APEX_Bbv *bbv, const APEX_CPU *cpu)
+{
+    unsigned long long seed = SIMPOINT_SEED;
+
+    memset(bbv, 0, sizeof(APEX_Bbv));
+    bbv->num_blocks = cpu->code_memory_size;
+    bbv->counts = calloc(bbv->num_blocks, sizeof(long long));
+    bbv->touched = calloc(bbv->num_blocks, sizeof(int));
+    bbv->seen = calloc(bbv->num_blocks, 1);
+    bbv->projection = malloc(bbv->num_blocks * SIMPOINT_DIMENSIONS * sizeof(double));
+    if (!bbv->counts || !bbv->touched || !bbv->seen || !bbv->projection)
+    {
+        return FALSE;
+    }
+    for (int i = 0; i < bbv->num_blocks * SIMPOINT_DIMENSIONS; i++)
+    {
+        bbv->projection[i] = 2.0 * next_random(&seed) - 1.0;
+    }
+    if (cpu->config.bbv_path)
+    {
+        bbv->fp = fopen(cpu->config.bbv_path, "w");
+        if (!bbv->fp)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write basic block vectors %s\n",
+                    cpu->config.bbv_path);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Ends the open interval: normalises its vector to the share of the
+ * interval's instructions each block executed, projects it and clears the
+ * counters. With --bbv-file the raw vector is also written as a line of
+ * "T:block:count" pairs, blocks numbered from 1, which SimPoint reads.
+ */
+static int
+close_interval(APEX_Bbv *bbv, long long length)
+{
+    double *vector;
+
+    if (bbv->count == bbv->capacity)
+    {
+        long long capacity = bbv->capacity ? 2 * bbv->capacity : 1024;
+        double *vectors = realloc(bbv->vectors,
+                                  capacity * SIMPOINT_DIMENSIONS * sizeof(double));
+        long long *lengths;
+
+        if (!vectors)
+        {
+            return FALSE;
+        }
+        bbv->vectors = vectors;
+        lengths = realloc(bbv->lengths, capacity * sizeof(long long));
+        if (!lengths)
+        {
+            return FALSE;
+        }
+        bbv->lengths = lengths;
+        bbv->capacity = capacity;
+    }
+
+    vector = &bbv->vectors[bbv->count * SIMPOINT_DIMENSIONS];
+    memset(vector, 0, SIMPOINT_DIMENSIONS * sizeof(double));
+    if (bbv->fp)
+    {
+        fputc('T', bbv->fp);
+    }
+    for (int i = 0; i < bbv->num_touched; i++)
+    {
+        int block = bbv->touched[i];
+        double share = (double)bbv->counts[block] / length;
+
+        for (int d = 0; d < SIMPOINT_DIMENSIONS; d++)
+        {
+            vector[d] += share * bbv->projection[block * SIMPOINT_DIMENSIONS + d];
+        }
+        if (bbv->fp)
+        {
+            fprintf(bbv->fp, ":%d:%lld ", block + 1, bbv->counts[block]);
+        }
+        bbv->counts[block] = 0;
+    }
+    if (bbv->fp)
+    {
+        fputc('\n', bbv->fp);
+    }
+    bbv->lengths[bbv->count++] = length;
+    bbv->num_touched = 0;
+    return TRUE;
+}
+
+/*
+ * Runs the whole program on the functional model, one instruction at a
+ * time, and records the basic block vector of every interval. A block
+ * starts at the first instruction and after every branch or jump, taken or
+ * not. Stops at HALT, at a fault or after --simpoint-limit instructions.
+ */
+static int
+profile(APEX_Simpoints *set, APEX_Bbv *bbv, const APEX_CPU *cpu)
+{
+    APEX_Memory *memory = APEX_memory_clone(cpu->data_memory);
+    APEX_Func func;
+    APEX_Retired effects;
+    long long in_interval = 0;
+    int block_start = TRUE;
+    int block = 0;
+    int status = FUNC_OK;
+
+    if (!memory)
+    {
+        return FALSE;
+    }
+    APEX_func_init(&func, cpu, memory);
+    while (!cpu->config.simpoint_limit || func.executed < cpu->config.simpoint_limit)
+    {
+        int index = (func.pc - 4000) / 4;
+
+        if (block_start)
+        {
+            block = index;
+        }
+        status = APEX_func_step(&func, NULL, &effects);
+        if (status == FUNC_PC_FAULT || status == FUNC_MEMORY_FAULT)
+        {
+            break;
+        }
+        if (!bbv->counts[block]++)
+        {
+            bbv->touched[bbv->num_touched++] = block;
+            set->num_blocks += !bbv->seen[block];
+            bbv->seen[block] = TRUE;
+        }
+        block_start = apex_isa[effects.opcode].unit == UNIT_BRANCH
+                      || apex_isa[effects.opcode].unit == UNIT_JUMP;
+
+        if (++in_interval == set->interval_length || status == FUNC_HALT)
+        {
+            if (!close_interval(bbv, in_interval))
+            {
+                APEX_memory_free(memory);
+                return FALSE;
+            }
+            in_interval = 0;
+        }
+        if (status == FUNC_HALT)
+        {
+            break;
+        }
+    }
+    APEX_memory_free(memory);
+
+    set->instructions = func.executed;
+    set->outcome = status;
+    if (in_interval && !close_interval(bbv, in_interval))
+    {
+        return FALSE;
+    }
+    set->num_intervals = bbv->count;
+    return bbv->count > 0;
+}
+
+/*
+ * One k-means run seeded the k-means++ way. Leaves the cluster of every
+ * interval in assign and the centres in centres, and returns the sum of the
+ * squared distances of the intervals to their centres. A cluster that
+ * loses all its intervals keeps its centre.
+ */
+static double
+kmeans(const APEX_Bbv *bbv, int k, unsigned long long seed, int *assign, double *centres,
+       double *scratch)
+{
+    const double *vectors = bbv->vectors;
+    long long n = bbv->count;
+    double sse = 0.0;
+
+    /* First centre uniformly, the next ones in proportion to the squared
+     * distance to the nearest centre chosen so far */
+    memcpy(centres, &vectors[(long long)(next_random(&seed) * n) * SIMPOINT_DIMENSIONS],
+           SIMPOINT_DIMENSIONS * sizeof(double));
+    for (long long i = 0; i < n; i++)
+    {
+        scratch[i] = squared_distance(&vectors[i * SIMPOINT_DIMENSIONS], centres);
+    }
+    for (int c = 1; c < k; c++)
+    {
+        double total = 0.0;
+        double target;
+        long long pick = n - 1;
+
+        for (long long i = 0; i < n; i++)
+        {
+            total += scratch[i];
+        }
+        target = next_random(&seed) * total;
+        for (long long i = 0; i < n; i++)
+        {
+            target -= scratch[i];
+            if (target < 0.0)
+            {
+                pick = i;
+                break;
+            }
+        }
+        memcpy(&centres[c * SIMPOINT_DIMENSIONS], &vectors[pick * SIMPOINT_DIMENSIONS],
+               SIMPOINT_DIMENSIONS * sizeof(double));
+        for (long long i = 0; i < n; i++)
+        {
+            double distance = squared_distance(&vectors[i * SIMPOINT_DIMENSIONS],
+                                               &centres[c * SIMPOINT_DIMENSIONS]);
+
+            scratch[i] = distance < scratch[i] ? distance : scratch[i];
+        }
+    }
+
+    for (long long i = 0; i < n; i++)
+    {
+        assign[i] = -1;
+    }
+    for (int iteration = 0; iteration < SIMPOINT_ITERATIONS; iteration++)
+    {
+        double sums[SIMPOINT_MAX_CLUSTERS][SIMPOINT_DIMENSIONS] = {{0.0}};
+        long long members[SIMPOINT_MAX_CLUSTERS] = {0};
+        int changed = FALSE;
+
+        sse = 0.0;
+        for (long long i = 0; i < n; i++)
+        {
+            const double *vector = &vectors[i * SIMPOINT_DIMENSIONS];
+            double best = squared_distance(vector, centres);
+            int nearest = 0;
+
+            for (int c = 1; c < k; c++)
+            {
+                double distance = squared_distance(vector, &centres[c * SIMPOINT_DIMENSIONS]);
+
+                if (distance < best)
+                {
+                    best = distance;
+                    nearest = c;
+                }
+            }
+            changed |= assign[i] != nearest;
+            assign[i] = nearest;
+            sse += best;
+            members[nearest]++;
+            for (int d = 0; d < SIMPOINT_DIMENSIONS; d++)
+            {
+                sums[nearest][d] += vector[d];
+            }
+        }
+        if (!changed)
+        {
+            break;
+        }
+        for (int c = 0; c < k; c++)
+        {
+            for (int d = 0; members[c] && d < SIMPOINT_DIMENSIONS; d++)
+            {
+                centres[c * SIMPOINT_DIMENSIONS + d] = sums[c][d] / members[c];
+            }
+        }
+    }
+    return sse;
+}
+
+/*
+ * Bayesian information criterion of a clustering, under the identical
+ * spherical Gaussian model of X-means that SimPoint uses.
+ */
+static double
+clustering_bic(const int *assign, long long n, int k, double sse)
+{
+    long long members[SIMPOINT_MAX_CLUSTERS] = {0};
+    double variance = sse / ((double)SIMPOINT_DIMENSIONS * (n - k));
+    double likelihood = 0.0;
+    double parameters = (k - 1) + (double)SIMPOINT_DIMENSIONS * k + 1;
+
+    /* Identical vectors would make the likelihood infinite */
+    variance = variance > 1e-12 ? variance : 1e-12;
+    for (long long i = 0; i < n; i++)
+    {
+        members[assign[i]]++;
+    }
+    for (int c = 0; c < k; c++)
+    {
+        double r = (double)members[c];
+
+        if (!members[c])
+        {
+            continue;
+        }
+        likelihood += -r / 2.0 * log(2.0 * M_PI) - r * SIMPOINT_DIMENSIONS / 2.0 * log(variance)
+                      - (r - k) / 2.0 + r * log(r) - r * log((double)n);
+    }
+    return likelihood - parameters / 2.0 * log((double)n);
+}
+
+/* Best of SIMPOINT_SEEDS k-means runs, the same ones for the same k */
+static double
+best_kmeans(const APEX_Bbv *bbv, int k, int *assign, double *centres, int *trial_assign,
+            double *trial_centres, double *scratch)
+{
+    double best = -1.0;
+
+    for (int s = 0; s < SIMPOINT_SEEDS; s++)
+    {
+        double sse = kmeans(bbv, k, SIMPOINT_SEED + k * SIMPOINT_SEEDS + s, trial_assign,
+                            trial_centres, scratch);
+
+        if (best < 0.0 || sse < best)
+        {
+            best = sse;
+            memcpy(assign, trial_assign, bbv->count * sizeof(int));
+            memcpy(centres, trial_centres, k * SIMPOINT_DIMENSIONS * sizeof(double));
+        }
+    }
+    return best;
+}
+
+/*
+ * Clusters the intervals for every cluster count up to --simpoint-max and
+ * keeps the fewest clusters whose BIC reaches SIMPOINT_BIC_THRESHOLD of the
+ * range between the worst and the best. Each non-empty cluster then gets
+ * its point, the interval nearest its centre, in interval order.
+ */
+static int
+choose_points(APEX_Simpoints *set, const APEX_Bbv *bbv, int max_clusters)
+{
+    long long n = bbv->count;
+    double bic[SIMPOINT_MAX_CLUSTERS + 1];
+    double centres[SIMPOINT_MAX_CLUSTERS * SIMPOINT_DIMENSIONS];
+    double trial_centres[SIMPOINT_MAX_CLUSTERS * SIMPOINT_DIMENSIONS];
+    int *assign = malloc(n * sizeof(int));
+    int *trial_assign = malloc(n * sizeof(int));
+    double *scratch = malloc(n * sizeof(double));
+    double lowest = 0.0;
+    double highest = 0.0;
+    int k = 1;
+
+    if (!assign || !trial_assign || !scratch)
+    {
+        free(assign);
+        free(trial_assign);
+        free(scratch);
+        return FALSE;
+    }
+
+    /* The criterion needs more intervals than clusters */
+    max_clusters = n - 1 < max_clusters ? (int)(n - 1) : max_clusters;
+    for (int clusters = 1; clusters <= max_clusters; clusters++)
+    {
+        double sse = best_kmeans(bbv, clusters, assign, centres, trial_assign,
+                                 trial_centres, scratch);
+
+        bic[clusters] = clustering_bic(assign, n, clusters, sse);
+        lowest = clusters == 1 || bic[clusters] < lowest ? bic[clusters] : lowest;
+        highest = clusters == 1 || bic[clusters] > highest ? bic[clusters] : highest;
+    }
+    for (int clusters = max_clusters; clusters >= 1; clusters--)
+    {
+        if (bic[clusters] >= lowest + SIMPOINT_BIC_THRESHOLD * (highest - lowest))
+        {
+            k = clusters;
+        }
+    }
+    best_kmeans(bbv, k, assign, centres, trial_assign, trial_centres, scratch);
+
+    set->num_points = 0;
+    for (int c = 0; c < k; c++)
+    {
+        long long nearest = -1;
+        long long instructions = 0;
+        double best = 0.0;
+
+        for (long long i = 0; i < n; i++)
+        {
+            double distance;
+
+            if (assign[i] != c)
+            {
+                continue;
+            }
+            distance = squared_distance(&bbv->vectors[i * SIMPOINT_DIMENSIONS],
+                                        &centres[c * SIMPOINT_DIMENSIONS]);
+            if (nearest < 0 || distance < best)
+            {
+                nearest = i;
+                best = distance;
+            }
+            instructions += bbv->lengths[i];
+        }
+        if (nearest >= 0)
+        {
+            APEX_Simpoint *point = &set->points[set->num_points++];
+
+            point->interval = nearest;
+            point->cluster = c;
+            point->start = nearest * set->interval_length;
+            point->length = bbv->lengths[nearest];
+            point->weight = (double)instructions / set->instructions;
+        }
+    }
+
+    /* In interval order, so that one functional run reaches them all */
+    for (int i = 1; i < set->num_points; i++)
+    {
+        for (int j = i; j > 0 && set->points[j].interval < set->points[j - 1].interval; j--)
+        {
+            APEX_Simpoint point = set->points[j];
+
+            set->points[j] = set->points[j - 1];
+            set->points[j - 1] = point;
+        }
+    }
+
+    free(assign);
+    free(trial_assign);
+    free(scratch);
+    return TRUE;
+}
+
+/*
+ * Profiles the CPU's program from its loaded state and chooses the
+ * simulation points, --simpoint-max clusters at most. Returns NULL if the
+ * program executed nothing or host memory ran out.
+ */
+APEX_Simpoints *
+APEX_simpoint_select(const APEX_CPU *cpu, long long interval_length)
+{
+    APEX_Simpoints *set = calloc(1, sizeof(APEX_Simpoints));
+    struct timespec start, end;
+    APEX_Bbv bbv;
+    int ok;
+
+    if (!set)
+    {
+        return NULL;
+    }
+    set->interval_length = interval_length;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ok = create_bbv(&bbv, cpu) && profile(set, &bbv, cpu)
+         && choose_points(set, &bbv, cpu->config.simpoint_max);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free_bbv(&bbv);
+
+    if (!ok)
+    {
+        free(set);
+        return NULL;
+    }
+    set->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return set;
+}
+
+/*
+ * Runs the program again, translated to host code unless --jit=off, and
+ * checkpoints the state at the start of every point. Returns FALSE if host
+ * memory ran out.
+ */
+int
+APEX_simpoint_checkpoint(APEX_Simpoints *set, const APEX_CPU *cpu)
+{
+    APEX_Memory *memory = APEX_memory_clone(cpu->data_memory);
+    APEX_Bus *bus = NULL;
+    struct timespec start, end;
+    APEX_Func func;
+    APEX_Jit *jit;
+    int ok = TRUE;
+
+    if (!memory)
+    {
+        return FALSE;
+    }
+    if (cpu->config.warm)
+    {
+        bus = APEX_bus_create(&cpu->config.l1, 1);
+        if (!bus)
+        {
+            APEX_memory_free(memory);
+            return FALSE;
+        }
+    }
+    APEX_func_init(&func, cpu, memory);
+    jit = APEX_jit_create(&func, cpu->config.jit);
+    if (!jit)
+    {
+        APEX_bus_free(bus);
+        APEX_memory_free(memory);
+        return FALSE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; ok && i < set->num_points; i++)
+    {
+        APEX_Simpoint *point = &set->points[i];
+        long long cold = point->start;
+
+        /* Only the last --warm instructions before the point warm the L1 */
+        if (bus)
+        {
+            cold = (unsigned long long)point->start > cpu->config.warm
+                   ? point->start - (long long)cpu->config.warm : 0;
+        }
+
+        /* The profile got past the start, so no HALT or fault comes first */
+        if (cold > (long long)func.executed && APEX_jit_run(jit, cold - func.executed) != FUNC_OK)
+        {
+            ok = FALSE;
+            break;
+        }
+        func.warm = bus;
+        if (point->start > (long long)func.executed
+            && APEX_func_run(&func, point->start - func.executed) != FUNC_OK)
+        {
+            ok = FALSE;
+            break;
+        }
+        func.warm = NULL;
+        if (bus)
+        {
+            point->bus = APEX_bus_create(&cpu->config.l1, 1);
+            if (!point->bus)
+            {
+                ok = FALSE;
+                break;
+            }
+            APEX_bus_copy(point->bus, bus);
+            APEX_bus_reset_stats(point->bus);
+        }
+        point->pc = func.pc;
+        memcpy(point->regs, func.regs, sizeof(point->regs));
+        point->zero_flag = func.zero_flag;
+        point->positive_flag = func.positive_flag;
+        point->data_memory = APEX_memory_clone(memory);
+        ok = point->data_memory != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    set->seconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    APEX_jit_free(jit);
+    APEX_func_free(&func);
+    APEX_bus_free(bus);
+    APEX_memory_free(memory);
+    return ok;
+}
+
+/*
+ * Frees the points and any checkpoint no pipeline took.
+ */
+void
+APEX_simpoint_free(APEX_Simpoints *set)
+{
+    if (!set)
+    {
+        return;
+    }
+    for (int i = 0; i < set->num_points; i++)
+    {
+        APEX_memory_free(set->points[i].data_memory);
+        APEX_bus_free(set->points[i].bus);
+    }
+    free(set);
+}
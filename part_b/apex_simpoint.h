@@ -0,0 +1,67 @@
+/*
+ * apex_simpoint.h
+ * Contains the APEX representative sampling declarations
+ *
+ * The functional model runs the whole program once and records a basic
+ * block vector for every interval of a fixed number of instructions: how
+ * many instructions executed in each dynamic basic block, named by the code
+ * memory index of its first instruction. The vectors are normalised,
+ * randomly projected to SIMPOINT_DIMENSIONS and clustered with k-means, the
+ * number of clusters chosen by the Bayesian information criterion as
+ * SimPoint does. The interval closest to the centre of each cluster is its
+ * simulation point, weighted by the share of the program's instructions
+ * the cluster executed. A second functional run stops at the start of each
+ * point and checkpoints the architectural state and data memory there, so
+ * only the points need the pipeline. With --warm the last instructions before
+ * each point also pass their loads and stores through an L1, whose contents
+ * the checkpoint keeps too.
+ */
+#ifndef _APEX_SIMPOINT_H_
+#define _APEX_SIMPOINT_H_
+#include "apex_cpu.h"
+
+#define SIMPOINT_DIMENSIONS 15         /* Size of the projected vectors */
+#define SIMPOINT_MAX_CLUSTERS 30
+#define SIMPOINT_DEFAULT_CLUSTERS 10
+#define SIMPOINT_SEEDS 5               /* k-means runs per cluster count, best is kept */
+#define SIMPOINT_ITERATIONS 100        /* k-means iterations at most */
+#define SIMPOINT_BIC_THRESHOLD 0.9     /* Fewest clusters within this share of the best BIC */
+
+/* Representative interval of one cluster and its checkpoint */
+typedef struct APEX_Simpoint
+{
+    long long interval;            /* Index of the interval */
+    int cluster;
+    long long start;               /* Instructions executed before the interval */
+    long long length;              /* Instructions in the interval */
+    double weight;                 /* Share of all instructions in its cluster */
+
+    /* Architectural state at the start of the interval */
+    int pc;
+    int regs[REG_FILE_SIZE];
+    int zero_flag;
+    int positive_flag;
+    APEX_Memory *data_memory;      /* Owned until taken by a pipeline */
+    APEX_Bus *bus;                 /* Warmed L1, NULL without --warm */
+
+    /* Detailed simulation of the interval from the checkpoint */
+    long long cycles;
+    long long retired;
+} APEX_Simpoint;
+
+typedef struct APEX_Simpoints
+{
+    long long interval_length;     /* Instructions per interval */
+    long long num_intervals;
+    long long instructions;        /* Executed by the whole program */
+    int outcome;                   /* FUNC_* outcome that ended it, FUNC_OK at --simpoint-limit */
+    int num_blocks;                /* Distinct basic blocks seen */
+    int num_points;                /* One per cluster */
+    APEX_Simpoint points[SIMPOINT_MAX_CLUSTERS];
+    double seconds;                /* Host time of both functional runs */
+} APEX_Simpoints;
+
+APEX_Simpoints *APEX_simpoint_select(const APEX_CPU *cpu, long long interval_length);
+int APEX_simpoint_checkpoint(APEX_Simpoints *set, const APEX_CPU *cpu);
+void APEX_simpoint_free(APEX_Simpoints *set);
+#endif
@@ -0,0 +1,207 @@
+/*
+ * apex_snapshot.c
+ * Contains the APEX run history used by the debugger to travel back in time
+ *
+ * A snapshot copies each core's APEX_CPU whole and the L1 state, which are
+ * small. Data memory is kept as an image holding only the pages written since
+ * the previous snapshot, sharing the others with it copy-on-write, so that a
+ * long run can keep thousands of snapshots. Restoring one copies them back
+ * into the running machine, keeping everything the cores share or own outside
+ * their struct.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apex_snapshot.h"
+#include "apex_macros.h"
+
+APEX_History *
+APEX_history_create(int interval, int max)
+{
+    APEX_History *history = calloc(1, sizeof(APEX_History));
+
+    if (!history)
+    {
+        return NULL;
+    }
+    history->snapshots = calloc(max, sizeof(APEX_Snapshot));
+    if (!history->snapshots)
+    {
+        free(history);
+        return NULL;
+    }
+    history->interval = interval;
+    history->max = max;
+    return history;
+}
+
+static void
+free_snapshot(APEX_Snapshot *snapshot)
+{
+    free(snapshot->cores);
+    APEX_memory_image_free(snapshot->memory);
+    APEX_bus_free(snapshot->bus);
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+void
+APEX_history_free(APEX_History *history)
+{
+    if (!history)
+    {
+        return;
+    }
+    for (int i = 0; i < history->count; i++)
+    {
+        free_snapshot(&history->snapshots[i]);
+    }
+    free(history->snapshots);
+    free(history);
+}
+
+/*
+ * Drops every other snapshot, keeping the first and the last, and doubles
+ * the interval so that a long run keeps snapshots spread over all of it. The
+ * last stays as the pages written since are tracked relative to it.
+ */
+static void
+thin_history(APEX_History *history)
+{
+    int kept = 0;
+
+    for (int i = 0; i < history->count; i++)
+    {
+        if (i % 2 && i != history->count - 1)
+        {
+            free_snapshot(&history->snapshots[i]);
+        }
+        else
+        {
+            history->snapshots[kept++] = history->snapshots[i];
+        }
+    }
+    history->count = kept;
+    history->interval *= 2;
+}
+
+/*
+ * Takes a snapshot of the machine if one is due at its current clock, which
+ * must be at the start of a cycle. Returns FALSE if out of host memory.
+ */
+int
+APEX_history_record(APEX_History *history, const APEX_CPU *cpu)
+{
+    APEX_Snapshot *snapshot;
+    const APEX_Memory_Image *previous = NULL;
+    int num_cores = cpu->config.num_cores;
+
+    if (history->count
+        && cpu->clock < history->snapshots[history->count - 1].clock + history->interval)
+    {
+        return TRUE;
+    }
+    if (history->count == history->max)
+    {
+        thin_history(history);
+    }
+
+    if (history->count)
+    {
+        previous = history->snapshots[history->count - 1].memory;
+    }
+    else if (!APEX_memory_track(cpu->data_memory))
+    {
+        return FALSE;
+    }
+
+    snapshot = &history->snapshots[history->count];
+    snapshot->clock = cpu->clock;
+    snapshot->cores = malloc(num_cores * sizeof(APEX_CPU));
+    snapshot->memory = APEX_memory_image(cpu->data_memory, previous);
+    if (cpu->bus)
+    {
+        snapshot->bus = APEX_bus_create(&cpu->bus->config, cpu->bus->num_caches);
+    }
+    if (!snapshot->cores || !snapshot->memory || (cpu->bus && !snapshot->bus))
+    {
+        free_snapshot(snapshot);
+        return FALSE;
+    }
+    for (int id = 0; id < num_cores; id++)
+    {
+        memcpy(&snapshot->cores[id], cpu->cores[id], sizeof(APEX_CPU));
+    }
+    if (cpu->bus)
+    {
+        APEX_bus_copy(snapshot->bus, cpu->bus);
+    }
+    history->count++;
+    return TRUE;
+}
+
+/*
+ * Copies a saved core back, except for what lives outside the struct and is
+ * shared with, or owned on behalf of, the other cores.
+ */
+static void
+restore_core(APEX_CPU *core, const APEX_CPU *saved)
+{
+    APEX_CPU keep;
+
+    memcpy(&keep, core, sizeof(APEX_CPU));
+    memcpy(core, saved, sizeof(APEX_CPU));
+    core->data_memory = keep.data_memory;
+    core->initial_memory = keep.initial_memory;
+    core->bus = keep.bus;
+    core->store_log = keep.store_log;
+    core->retire = keep.retire;
+    core->output = keep.output;
+    core->debug = keep.debug;
+}
+
+/*
+ * Restores the last snapshot taken at or before the given clock and returns
+ * its clock. There is always one at clock 0.
+ */
+int
+APEX_history_restore(const APEX_History *history, APEX_CPU *cpu, int clock)
+{
+    const APEX_Snapshot *snapshot = &history->snapshots[0];
+
+    for (int i = 1; i < history->count && history->snapshots[i].clock <= clock; i++)
+    {
+        snapshot = &history->snapshots[i];
+    }
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        restore_core(cpu->cores[id], &snapshot->cores[id]);
+    }
+    APEX_memory_restore(cpu->data_memory, snapshot->memory,
+                        history->snapshots[history->count - 1].memory);
+    if (cpu->bus)
+    {
+        APEX_bus_copy(cpu->bus, snapshot->bus);
+    }
+    return snapshot->clock;
+}
+
+/*
+ * Drops the snapshots at or after a clock, used when the user changes the
+ * machine and the history from there on no longer holds.
+ */
+void
+APEX_history_discard(APEX_History *history, APEX_CPU *cpu, int clock)
+{
+    while (history->count && history->snapshots[history->count - 1].clock >= clock)
+    {
+        APEX_Snapshot *last = &history->snapshots[--history->count];
+
+        /* Pages written are now tracked relative to the one before */
+        if (history->count)
+        {
+            APEX_memory_mark_changed(cpu->data_memory, last->memory,
+                                     history->snapshots[history->count - 1].memory);
+        }
+        free_snapshot(last);
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * apex_snapshot.h
+ * Contains the APEX run history used by the debugger to travel back in time
+ *
+ * Every few cycles the debugger takes a snapshot of all cores, data memory
+ * and the L1s. Any earlier cycle is reached by restoring the last snapshot
+ * before it and replaying forward, which the simulator does deterministically.
+ */
+#ifndef _APEX_SNAPSHOT_H_
+#define _APEX_SNAPSHOT_H_
+#include "apex_cpu.h"
+
+/* Defaults of --snapshot-interval and --max-snapshots */
+#define SNAPSHOT_INTERVAL 1000
+#define MAX_SNAPSHOTS 4096
+
+/* The machine at the start of a cycle, clock cycles after reset */
+typedef struct APEX_Snapshot
+{
+    int clock;
+    APEX_CPU *cores;               /* Copy of every core */
+    APEX_Memory_Image *memory;     /* Shares unchanged pages with the snapshot before */
+    APEX_Bus *bus;                 /* NULL without L1s */
+} APEX_Snapshot;
+
+typedef struct APEX_History
+{
+    APEX_Snapshot *snapshots;      /* Oldest first, the first at clock 0 */
+    int count;
+    int max;                       /* Every other snapshot is dropped at max */
+    int interval;                  /* Cycles between snapshots, doubles when thinned */
+} APEX_History;
+
+APEX_History *APEX_history_create(int interval, int max);
+void APEX_history_free(APEX_History *history);
+int APEX_history_record(APEX_History *history, const APEX_CPU *cpu);
+int APEX_history_restore(const APEX_History *history, APEX_CPU *cpu, int clock);
+void APEX_history_discard(APEX_History *history, APEX_CPU *cpu, int clock);
+#endif
@@ -0,0 +1,294 @@
+/*
+ * apex_trace.c
+ * Contains the APEX retire stream consumers: instruction tracer and profiler
+ *
+ * Consumers run on their own thread per core, fed by the core's retire ring, and
+ * never touch the simulator's state.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apex_trace.h"
+#include "apex_check.h"
+#include "apex_reuse.h"
+#include "apex_macros.h"
+
+#define PROFILE_HOTTEST 5
+
+typedef struct APEX_Tracer
+{
+    FILE *fp;
+} APEX_Tracer;
+
+typedef struct APEX_Profile
+{
+    int core;
+    unsigned long long retired;
+    unsigned long long opcode_count[NUM_OPCODES];
+    int code_memory_size;
+    unsigned long long *pc_count;  /* Per instruction in code memory */
+} APEX_Profile;
+
+/*
+ * Formats a retired instruction as one trace line without the newline:
+ * core, cycle, PC, opcode, the registers written and the memory access.
+ */
+void
+APEX_trace_format(const APEX_Retired *insn, char *text, size_t size)
+{
+    int length = snprintf(text, size, "C%d %6d %5d %-5s", insn->core, insn->cycle,
+                          insn->pc, insn->opcode_str);
+
+    for (int i = 0; i < insn->num_dest && length < (int)size; i++)
+    {
+        length += snprintf(text + length, size - length, " R%d=%d", insn->dest[i],
+                           insn->dest_value[i]);
+    }
+    if (length < (int)size && insn->mem_access == RETIRE_LOAD)
+    {
+        snprintf(text + length, size - length, " MEM[%u]->%d", insn->mem_address,
+                 insn->mem_value);
+    }
+    else if (length < (int)size && insn->mem_access == RETIRE_STORE)
+    {
+        snprintf(text + length, size - length, " MEM[%u]<-%d", insn->mem_address,
+                 insn->mem_value);
+    }
+}
+
+static void
+trace_consume(const APEX_Retired *insn, void *arg)
+{
+    APEX_Tracer *tracer = arg;
+    char text[128];
+
+    APEX_trace_format(insn, text, sizeof(text));
+    fprintf(tracer->fp, "%s\n", text);
+}
+
+static void
+trace_finish(void *arg)
+{
+    APEX_Tracer *tracer = arg;
+
+    fclose(tracer->fp);
+    free(tracer);
+}
+
+static void
+profile_consume(const APEX_Retired *insn, void *arg)
+{
+    APEX_Profile *profile = arg;
+    int index = (insn->pc - 4000) / 4;
+
+    profile->retired++;
+    if (insn->opcode >= 0 && insn->opcode < NUM_OPCODES)
+    {
+        profile->opcode_count[insn->opcode]++;
+    }
+    if (index >= 0 && index < profile->code_memory_size)
+    {
+        profile->pc_count[index]++;
+    }
+}
+
+/*
+ * Prints the instruction mix and the most executed instructions of a core
+ * once its ring has been drained.
+ */
+static void
+profile_finish(void *arg)
+{
+    APEX_Profile *profile = arg;
+    int shown[PROFILE_HOTTEST];
+    int num_shown = 0;
+
+    printf("APEX_CPU: Core %d profile, %llu instructions retired\n", profile->core,
+           profile->retired);
+    printf("APEX_CPU:   Mix:");
+    for (int op = 0; op < NUM_OPCODES; op++)
+    {
+        if (profile->opcode_count[op])
+        {
+            printf(" %s %llu (%.1f%%)", apex_isa[op].mnemonic, profile->opcode_count[op],
+                   100.0 * profile->opcode_count[op] / profile->retired);
+        }
+    }
+    printf("\n");
+
+    /* Hottest instructions, by repeated selection */
+    for (num_shown = 0; num_shown < PROFILE_HOTTEST; num_shown++)
+    {
+        int best = -1;
+
+        for (int i = 0; i < profile->code_memory_size; i++)
+        {
+            int taken = FALSE;
+
+            for (int j = 0; j < num_shown; j++)
+            {
+                taken |= shown[j] == i;
+            }
+            if (!taken && profile->pc_count[i]
+                && (best < 0 || profile->pc_count[i] > profile->pc_count[best]))
+            {
+                best = i;
+            }
+        }
+        if (best < 0)
+        {
+            break;
+        }
+        shown[num_shown] = best;
+    }
+    printf("APEX_CPU:   Hottest:");
+    for (int j = 0; j < num_shown; j++)
+    {
+        printf(" %d x%llu", 4000 + 4 * shown[j], profile->pc_count[shown[j]]);
+    }
+    printf("\n");
+
+    free(profile->pc_count);
+    free(profile);
+}
+
+/*
+ * Subscribes the consumers asked for on the command line to one core's
+ * ring.
+ */
+static int
+subscribe_consumers(APEX_CPU *core, APEX_Retire_Ring *ring)
+{
+    if (core->config.trace_path)
+    {
+        APEX_Tracer *tracer = calloc(1, sizeof(APEX_Tracer));
+        char path[512];
+
+        if (core->config.num_cores > 1)
+        {
+            snprintf(path, sizeof(path), "%s.%d", core->config.trace_path, core->core_id);
+        }
+        else
+        {
+            snprintf(path, sizeof(path), "%s", core->config.trace_path);
+        }
+        if (!tracer || !(tracer->fp = fopen(path, "w")))
+        {
+            fprintf(stderr, "APEX_Error: Unable to open trace file %s\n", path);
+            free(tracer);
+            return FALSE;
+        }
+        APEX_retire_subscribe(ring, trace_consume, trace_finish, tracer);
+    }
+    if (core->config.profile)
+    {
+        APEX_Profile *profile = calloc(1, sizeof(APEX_Profile));
+
+        if (!profile
+            || !(profile->pc_count = calloc(core->code_memory_size, sizeof(unsigned long long))))
+        {
+            free(profile);
+            return FALSE;
+        }
+        profile->core = core->core_id;
+        profile->code_memory_size = core->code_memory_size;
+        APEX_retire_subscribe(ring, profile_consume, profile_finish, profile);
+    }
+    if (core->config.check && !APEX_check_subscribe(core, ring))
+    {
+        return FALSE;
+    }
+    if (core->config.reuse && !APEX_reuse_subscribe(core, ring))
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Gives every core a retire ring with the consumers asked for and starts
+ * them. Without any consumer no ring is created and retirement costs
+ * nothing extra.
+ */
+int
+APEX_trace_attach(APEX_CPU *cpu)
+{
+    if (!cpu->config.trace_path && !cpu->config.profile && !cpu->config.check
+        && !cpu->config.reuse)
+    {
+        return TRUE;
+    }
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+
+        core->retire = APEX_retire_create(cpu->config.retire_slots);
+        if (!core->retire)
+        {
+            return FALSE;
+        }
+        if (!subscribe_consumers(core, core->retire) || !APEX_retire_start(core->retire))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Publishes the instruction in the writeback latch after it wrote the
+ * register file.
+ */
+void
+APEX_trace_publish(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    APEX_Retired insn;
+
+    insn.cycle = cpu->clock;
+    insn.core = cpu->core_id;
+    insn.pc = stage->pc;
+    insn.opcode = stage->opcode;
+    insn.opcode_str = stage->opcode_str;
+    insn.num_dest = cpu->wb_count;
+    for (int i = 0; i < cpu->wb_count; i++)
+    {
+        insn.dest[i] = cpu->wb_dest[i];
+        insn.dest_value[i] = cpu->regs[cpu->wb_dest[i]];
+    }
+
+    insn.mem_access = RETIRE_NO_ACCESS;
+    insn.mem_address = (unsigned int)stage->memory_address;
+    insn.mem_value = 0;
+    switch (apex_isa[stage->opcode].unit)
+    {
+        case UNIT_LOAD:
+            insn.mem_access = RETIRE_LOAD;
+            insn.mem_value = stage->result_buffer;
+            break;
+
+        case UNIT_STORE:
+            insn.mem_access = RETIRE_STORE;
+            insn.mem_value = stage->rs1_value;
+            break;
+    }
+    APEX_retire_publish(cpu->retire, &insn);
+}
+
+/*
+ * Closes every core's ring, waiting for the consumers to drain it and write
+ * their reports.
+ */
+void
+APEX_trace_detach(APEX_CPU *cpu)
+{
+    for (int id = 0; id < cpu->config.num_cores; id++)
+    {
+        APEX_CPU *core = cpu->cores[id];
+
+        if (core && core->retire)
+        {
+            APEX_retire_free(core->retire);
+            core->retire = NULL;
+        }
+    }
+}
@@ -0,0 +1,14 @@
+/*
+ * apex_trace.h
+ * Contains the APEX retire stream consumers: instruction tracer and profiler
+ */
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+#include <stddef.h>
+#include "apex_cpu.h"
+
+int APEX_trace_attach(APEX_CPU *cpu);
+void APEX_trace_publish(APEX_CPU *cpu, const CPU_Stage *stage);
+void APEX_trace_detach(APEX_CPU *cpu);
+void APEX_trace_format(const APEX_Retired *insn, char *text, size_t size);
+#endif
@@ -1,7 +1,7 @@
 /*
  * file_parser.c
- * Contains functions to parse input file and create code memory, you can edit
- * this file to add new instructions
+ * Contains functions to parse input file and create code memory, driven by
+ * the ISA table in apex_isa.h
  *
  * Author:
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
@@ -35,116 +35,6 @@ get_num_from_string(const char *buffer)
     return atoi(str);
 }
 
-/*
- * This function sets the numeric opcode to an instruction based on string value
- *
- * Note : you can edit this function to add new instructions
- */
-static int
-set_opcode_str(const char *opcode_str)
-{
-    if (strcmp(opcode_str, "ADD") == 0)
-    {
-        return OPCODE_ADD;
-    }
-    if (strcmp(opcode_str, "ADDL") == 0)
-    {
-        return OPCODE_ADDL;
-    }
-    if (strcmp(opcode_str, "SUB") == 0)
-    {
-        return OPCODE_SUB;
-    }
-    if (strcmp(opcode_str, "SUBL") == 0)
-    {
-        return OPCODE_SUBL;
-    }
-    if (strcmp(opcode_str, "MUL") == 0)
-    {
-        return OPCODE_MUL;
-    }
-
-    if (strcmp(opcode_str, "DIV") == 0)
-    {
-        return OPCODE_DIV;
-    }
-
-    if (strcmp(opcode_str, "AND") == 0)
-    {
-        return OPCODE_AND;
-    }
-
-    if (strcmp(opcode_str, "OR") == 0)
-    {
-        return OPCODE_OR;
-    }
-
-    if (strcmp(opcode_str, "EXOR") == 0)
-    {
-        return OPCODE_XOR;
-    }
-
-    if (strcmp(opcode_str, "MOVC") == 0)
-    {
-        return OPCODE_MOVC;
-    }
-
-    if (strcmp(opcode_str, "LOAD") == 0)
-    {
-        return OPCODE_LOAD;
-    }
-
-    if (strcmp(opcode_str, "STORE") == 0)
-    {
-        return OPCODE_STORE;
-    }
-
-    if (strcmp(opcode_str, "BZ") == 0)
-    {
-        return OPCODE_BZ;
-    }
-
-    if (strcmp(opcode_str, "BNZ") == 0)
-    {
-        return OPCODE_BNZ;
-    }
-    if (strcmp(opcode_str, "BP") == 0)
-    {
-        return OPCODE_BP;
-    }
-    if (strcmp(opcode_str, "BNP") == 0)
-    {
-        return OPCODE_BNP;
-    }
-    if (strcmp(opcode_str, "HALT") == 0)
-    {
-        return OPCODE_HALT;
-    }
-    if (strcmp(opcode_str, "CMP") == 0)
-    {
-        return OPCODE_CMP;
-    }
-    if (strcmp(opcode_str, "STI") == 0)
-    {
-        return OPCODE_STI;
-    }
-    if (strcmp(opcode_str, "LDI") == 0)
-    {
-        return OPCODE_LDI;
-    }
-    if (strcmp(opcode_str, "NOP") == 0)
-    {
-        return OPCODE_NOP;
-    }
-    if (strcmp(opcode_str, "JUMP") == 0)
-    {
-        return OPCODE_JUMP;
-    }
-
-    assert(0 && "Invalid opcode");
-    return 0;
-}
-
 static void
 split_opcode_from_insn_string(char *buffer, char tokens[2][128])
 {
@@ -163,7 +53,7 @@ split_opcode_from_insn_string(char *buffer, char tokens[2][128])
 /*
  * This function is related to parsing input file
  *
- * Note : you can edit this function to add new instructions
+ * Note : instructions are added to the ISA table in apex_isa.h
  */
 static void
 create_APEX_instruction(APEX_Instruction *ins, char *buffer)
@@ -171,6 +61,7 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
     int i, token_num = 0;
     char tokens[6][128];
     char top_level_tokens[2][128];
+    const APEX_Isa_Format *format;
 
     for (i = 0; i < 2; ++i)
     {
@@ -188,85 +79,32 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         token = strtok(NULL, ",");
     }
 
-    strcpy(ins->opcode_str, top_level_tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
+    ins->opcode = APEX_isa_opcode(top_level_tokens[0]);
+    assert(ins->opcode >= 0 && "Invalid opcode");
+    ins->opcode_str = apex_isa[ins->opcode].mnemonic;
 
-    switch (ins->opcode)
+    /* Operands in the order of the instruction's format */
+    format = &apex_formats[apex_isa[ins->opcode].format];
+    for (i = 0; i < format->count && i < token_num; i++)
     {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
-            break;
-        }
-
-        case OPCODE_MOVC:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
-            break;
-        }
-
-        case OPCODE_LOAD:
-        case OPCODE_LDI:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
-        }
-
-        case OPCODE_STORE:
-        case OPCODE_STI:
-        {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
-        }
+        int value = get_num_from_string(tokens[i]);
 
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        {
-            ins->imm = get_num_from_string(tokens[0]);
-            break;
-        }
-
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
-        }
-        case OPCODE_CMP:
-        {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            break;
-        }
-        case OPCODE_JUMP:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
-        }
-        case OPCODE_NOP:
+        switch (format->operands[i])
         {
-        	/* Does nothing */
-            break;
+            case OPND_RD:
+                ins->rd = value;
+                break;
+            case OPND_RS1:
+                ins->rs1 = value;
+                break;
+            case OPND_RS2:
+                ins->rs2 = value;
+                break;
+            default:
+                ins->imm = value;
+                break;
         }
     }
-    /* Fill in rest of the instructions accordingly */
 }
 
 /*
@@ -18,7 +18,7 @@ main(int argc, char const *argv[])
 
     if (argc < 3)
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> <command> [cycles] [--options]\n", argv[0]);
         exit(1);
     }
 